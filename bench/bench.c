@@ -0,0 +1,320 @@
+#ifdef BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include "../include/hash_map.h"
+#include "../include/row_map.h"
+#include "../include/matrix.h"
+#include "../include/export.h"
+#include "../include/repository.h"
+#include "bench_util.h"
+#include "bench.h"
+
+#define BENCH_CSV_NAME "bench_csv"
+#define BENCH_REPO_NAME "bench_repo"
+
+// Sizes of generated inputs, set from the command line
+typedef struct {
+    int size;           // Rows and columns of generated matrices
+    int nnz_per_row;    // Average non-zeros per row
+    int det_size;       // Rows and columns for determinant, which is cubic in size
+    int reps;           // Times each operation is timed
+    uint64_t seed;
+    const char* filter; // Only run benchmarks whose name contains this, NULL for all
+} BenchConfig;
+
+
+bool selected(BenchConfig* cfg, const char* name) {
+    return !cfg->filter || strstr(name, cfg->filter);
+}
+
+
+void report(FILE* out, const char* name, Pattern* pattern, Matrix* input, long nnz, int reps, double seconds) {
+    BenchResult result = {
+        name, pattern ? pattern_name(*pattern) : NULL,
+        input->rows, input->cols, nnz, reps, seconds
+    };
+
+    json_result(out, &result);
+}
+
+
+// Time map_set of uniformly random cells into an empty map, then map_get of the same cells
+void bench_map(BenchConfig* cfg, FILE* out) {
+    rng_seed(cfg->seed);
+    long count = (long)cfg->size * cfg->nnz_per_row;
+    int* rows = malloc(count * sizeof(int));
+    int* cols = malloc(count * sizeof(int));
+
+    for(long i = 0; i < count; i++) {
+        rows[i] = rng_next() % cfg->size;
+        cols[i] = rng_next() % cfg->size;
+    }
+
+    double set_time = 0, get_time = 0;
+    volatile double sink = 0; // Keeps lookups from being optimized out
+
+    for(int r = 0; r < cfg->reps; r++) {
+        HashMap* map = map_create();
+
+        double start = now_seconds();
+        for(long i = 0; i < count; i++)
+            map_set(map, rows[i], cols[i], i + 1);
+        set_time += now_seconds() - start;
+
+        start = now_seconds();
+        for(long i = 0; i < count; i++)
+            sink += map_get(map, rows[i], cols[i]);
+        get_time += now_seconds() - start;
+
+        free_hash_map(map);
+    }
+    (void)sink;
+
+    BenchResult set = {"map_set", "uniform", cfg->size, cfg->size, 1, (int)(count * cfg->reps), set_time};
+    BenchResult get = {"map_get", "uniform", cfg->size, cfg->size, 1, (int)(count * cfg->reps), get_time};
+
+    if(selected(cfg, "map_set"))
+        json_result(out, &set);
+    if(selected(cfg, "map_get"))
+        json_result(out, &get);
+
+    free(rows);
+    free(cols);
+}
+
+
+// Time add, multiply and transpose of generated matrices with pattern
+void bench_kernels(BenchConfig* cfg, FILE* out, Pattern pattern) {
+    if(!selected(cfg, "matrix_add") && !selected(cfg, "matrix_mult") && !selected(cfg, "matrix_transpose"))
+        return;
+
+    rng_seed(cfg->seed);
+    Matrix* a = gen_matrix(pattern, cfg->size, cfg->size, cfg->nnz_per_row);
+    Matrix* b = gen_matrix(pattern, cfg->size, cfg->size, cfg->nnz_per_row);
+    long nnz_a = matrix_size(a);
+    long nnz_b = matrix_size(b);
+    double seconds;
+
+    if(selected(cfg, "matrix_add")) {
+        seconds = 0;
+        for(int r = 0; r < cfg->reps; r++) {
+            double start = now_seconds();
+            Matrix* sum = matrix_add(a, b);
+            seconds += now_seconds() - start;
+            matrix_free(sum);
+        }
+        report(out, "matrix_add", &pattern, a, nnz_a + nnz_b, cfg->reps, seconds);
+    }
+
+    if(selected(cfg, "matrix_mult")) {
+        seconds = 0;
+        for(int r = 0; r < cfg->reps; r++) {
+            // Drop row cache built by the previous product so every rep builds it
+            if(b->mult_vals) {
+                free_row_map(b->mult_vals);
+                b->mult_vals = NULL;
+            }
+
+            double start = now_seconds();
+            Matrix* product = matrix_mult(a, b);
+            seconds += now_seconds() - start;
+            matrix_free(product);
+        }
+        report(out, "matrix_mult", &pattern, a, nnz_a + nnz_b, cfg->reps, seconds);
+    }
+
+    if(selected(cfg, "matrix_transpose")) {
+        seconds = 0;
+        for(int r = 0; r < cfg->reps; r++) {
+            double start = now_seconds();
+            Matrix* transpose = matrix_transpose(a);
+            seconds += now_seconds() - start;
+            matrix_free(transpose);
+        }
+        report(out, "matrix_transpose", &pattern, a, nnz_a, cfg->reps, seconds);
+    }
+
+    matrix_free(a);
+    matrix_free(b);
+}
+
+
+void bench_determinant(BenchConfig* cfg, FILE* out, Pattern pattern) {
+    int per_row = cfg->nnz_per_row < cfg->det_size ? cfg->nnz_per_row : cfg->det_size;
+    rng_seed(cfg->seed);
+    Matrix* a = gen_matrix(pattern, cfg->det_size, cfg->det_size, per_row);
+    volatile double sink = 0;
+    double seconds = 0;
+
+    for(int r = 0; r < cfg->reps; r++) {
+        // Drop factor kept by the previous determinant so every rep factors
+        cholesky_free(a->chol);
+        a->chol = NULL;
+        lu_free(a->lu);
+        a->lu = NULL;
+
+        double start = now_seconds();
+        sink += matrix_determinant(a);
+        seconds += now_seconds() - start;
+    }
+    (void)sink;
+
+    report(out, "matrix_determinant", &pattern, a, matrix_size(a), cfg->reps, seconds);
+    matrix_free(a);
+}
+
+
+// Time dense CSV export of a generated matrix and import of the written file
+void bench_csv(BenchConfig* cfg, FILE* out, Pattern pattern) {
+    rng_seed(cfg->seed);
+    Matrix* a = gen_matrix(pattern, cfg->size, cfg->size, cfg->nnz_per_row);
+    long nnz = matrix_size(a);
+    double export_time = 0, import_time = 0;
+    int reps = 0;
+
+    for(int r = 0; r < cfg->reps; r++) {
+        double start = now_seconds();
+        bool exported = export_csv(a, BENCH_CSV_NAME, EXPORT_DENSE);
+        double elapsed = now_seconds() - start;
+
+        // Exported file name carries a timestamp
+        glob_t files;
+        if(!exported || glob(BENCH_CSV_NAME "_*.csv", 0, NULL, &files) != 0)
+            break;
+
+        start = now_seconds();
+        Matrix* imported = import_csv(files.gl_pathv[0]);
+        import_time += now_seconds() - start;
+        export_time += elapsed;
+        reps++;
+
+        for(size_t i = 0; i < files.gl_pathc; i++)
+            remove(files.gl_pathv[i]);
+        globfree(&files);
+        matrix_free(imported);
+    }
+
+    if(reps > 0) {
+        if(selected(cfg, "csv_export"))
+            report(out, "csv_export", &pattern, a, nnz, reps, export_time);
+        if(selected(cfg, "csv_import"))
+            report(out, "csv_import", &pattern, a, nnz, reps, import_time);
+    }
+
+    matrix_free(a);
+}
+
+
+// Time full repository save of a generated matrix and complete load of it
+void bench_repo(BenchConfig* cfg, FILE* out, Pattern pattern) {
+    rng_seed(cfg->seed);
+    Matrix* a = gen_matrix(pattern, cfg->size, cfg->size, cfg->nnz_per_row);
+    long nnz = matrix_size(a);
+    double save_time = 0, load_time = 0;
+    int reps = 0;
+
+    for(int r = 0; r < cfg->reps; r++) {
+        matrix_untrack(a); // Forget previous save so every rep writes all values
+
+        double start = now_seconds();
+        bool saved = repo_matrix_save(BENCH_REPO_NAME, a);
+        double elapsed = now_seconds() - start;
+
+        if(!saved)
+            break;
+
+        start = now_seconds();
+        Matrix* loaded = repo_matrix_load(BENCH_REPO_NAME);
+        bool complete = loaded && matrix_materialize(loaded);
+        load_time += now_seconds() - start;
+        save_time += elapsed;
+        matrix_free(loaded);
+
+        if(!complete)
+            break;
+        reps++;
+    }
+
+    repo_matrix_delete(BENCH_REPO_NAME);
+
+    if(reps > 0) {
+        if(selected(cfg, "repo_save"))
+            report(out, "repo_save", &pattern, a, nnz, reps, save_time);
+        if(selected(cfg, "repo_load"))
+            report(out, "repo_load", &pattern, a, nnz, reps, load_time);
+    }
+
+    matrix_free(a);
+}
+
+
+void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-n size] [-k nnz_per_row] [-d det_size] [-r reps] [-s seed] [-f filter] [-o file]\n", program);
+}
+
+
+// Run benchmarks and write results as JSON to stdout or the -o file
+int run_benchmarks(int argc, char** argv) {
+    BenchConfig cfg = {2000, 8, 60, 5, 42, NULL};
+    const char* out_path = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:k:d:r:s:f:o:")) != -1) {
+        switch(opt) {
+            case 'n': cfg.size = atoi(optarg); break;
+            case 'k': cfg.nnz_per_row = atoi(optarg); break;
+            case 'd': cfg.det_size = atoi(optarg); break;
+            case 'r': cfg.reps = atoi(optarg); break;
+            case 's': cfg.seed = strtoull(optarg, NULL, 10); break;
+            case 'f': cfg.filter = optarg; break;
+            case 'o': out_path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(cfg.size < 1 || cfg.nnz_per_row < 1 || cfg.det_size < 1 || cfg.reps < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Keep JSON on stdout, messages printed by the calculator go to stderr
+    FILE* out = out_path ? fopen(out_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if(!out) {
+        perror("Failed to open benchmark output");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    // Every benchmark reseeds, so its inputs do not depend on which others run
+    json_begin(out, cfg.seed);
+
+    if(selected(&cfg, "map_set") || selected(&cfg, "map_get"))
+        bench_map(&cfg, out);
+
+    for(int p = 0; p < NUM_PATTERNS; p++) {
+        Pattern pattern = p;
+
+        bench_kernels(&cfg, out, pattern);
+
+        if(selected(&cfg, "matrix_determinant"))
+            bench_determinant(&cfg, out, pattern);
+        if(selected(&cfg, "csv_export") || selected(&cfg, "csv_import"))
+            bench_csv(&cfg, out, pattern);
+        if(selected(&cfg, "repo_save") || selected(&cfg, "repo_load"))
+            bench_repo(&cfg, out, pattern);
+    }
+
+    json_end(out);
+    fclose(out);
+
+    return 0;
+}
+
+#endif
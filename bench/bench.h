@@ -0,0 +1,9 @@
+#ifdef BENCH
+
+#ifndef BENCH_H
+#define BENCH_H
+
+int run_benchmarks(int argc, char** argv);
+
+#endif
+#endif
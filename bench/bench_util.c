@@ -0,0 +1,124 @@
+#ifdef BENCH
+
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bench_util.h"
+
+// xorshift64* state, fixed seed makes generated matrices reproducible
+uint64_t rng_state = 1;
+int num_results = 0;
+
+
+void rng_seed(uint64_t seed) {
+    rng_state = seed ? seed : 1;
+}
+
+
+uint64_t rng_next() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+
+// Uniform double in [0, 1)
+double rng_uniform() {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+const char* pattern_name(Pattern pattern) {
+    switch(pattern) {
+        case PATTERN_UNIFORM: return "uniform";
+        case PATTERN_BANDED: return "banded";
+        default: return "power_law";
+    }
+}
+
+
+// Non-zero value in [1, 10)
+double gen_val() {
+    return 1 + 9 * rng_uniform();
+}
+
+
+// Generate rows x cols matrix with about nnz_per_row non-zeros per row on average
+Matrix* gen_matrix(Pattern pattern, int rows, int cols, int nnz_per_row) {
+    Matrix* matrix = matrix_create(rows, cols);
+    long total = (long)rows * nnz_per_row;
+
+    for(long k = 0; k < total; k++) {
+        int row, col;
+
+        if(pattern == PATTERN_UNIFORM) {
+            row = rng_next() % rows;
+            col = rng_next() % cols;
+        } else if(pattern == PATTERN_BANDED) { // Column within nnz_per_row of the diagonal
+            row = k / nnz_per_row;
+            col = row - nnz_per_row + (int)(rng_next() % (2 * nnz_per_row + 1));
+            if(col < 0 || col >= cols)
+                continue;
+        } else { // Row density falls off as a power of the row number
+            row = (int)(rows * pow(rng_uniform(), 3));
+            col = rng_next() % cols;
+        }
+
+        matrix_set(matrix, row, col, gen_val());
+    }
+
+    return matrix;
+}
+
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Highest resident set size of the process so far
+long peak_rss_kb() {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+    return usage.ru_maxrss; // Kilobytes on Linux
+}
+
+
+void json_begin(FILE* out, uint64_t seed) {
+    fprintf(out, "{\n  \"seed\": %llu,\n  \"benchmarks\": [", (unsigned long long)seed);
+    num_results = 0;
+}
+
+
+// Write result with derived ns/op and nnz/s, peak RSS is measured when written
+void json_result(FILE* out, BenchResult* result) {
+    double ns_per_op = result->seconds * 1e9 / result->reps;
+    double nnz_per_s = result->seconds > 0 ? result->nnz * (double)result->reps / result->seconds : 0;
+
+    fprintf(out, "%s\n    {\"name\": \"%s\", ", num_results++ ? "," : "", result->name);
+
+    if(result->pattern)
+        fprintf(out, "\"pattern\": \"%s\", ", result->pattern);
+    else
+        fprintf(out, "\"pattern\": null, ");
+
+    fprintf(out, "\"rows\": %d, \"cols\": %d, \"nnz\": %ld, \"reps\": %d, ",
+        result->rows, result->cols, result->nnz, result->reps);
+    fprintf(out, "\"ns_per_op\": %.1f, \"nnz_per_s\": %.1f, \"peak_rss_kb\": %ld}",
+        ns_per_op, nnz_per_s, peak_rss_kb());
+    fflush(out);
+}
+
+
+void json_end(FILE* out) {
+    fprintf(out, "\n  ]\n}\n");
+    fflush(out);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifdef BENCH
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../include/matrix.h"
+
+// Sparsity pattern of generated matrices
+typedef enum {
+    PATTERN_UNIFORM,    // Non-zeros spread evenly over the matrix
+    PATTERN_BANDED,     // Non-zeros within a band around the diagonal
+    PATTERN_POWER_LAW   // Few rows hold most non-zeros
+} Pattern;
+
+#define NUM_PATTERNS 3
+
+// Timing of one benchmark, written as one JSON object
+typedef struct {
+    const char* name;
+    const char* pattern;    // Pattern of input matrices, NULL if not applicable
+    int rows;
+    int cols;
+    long nnz;               // Non-zeros processed by one operation
+    int reps;               // Operations timed
+    double seconds;         // Total time of all operations
+} BenchResult;
+
+void rng_seed(uint64_t seed);
+uint64_t rng_next();
+double rng_uniform();
+
+const char* pattern_name(Pattern pattern);
+Matrix* gen_matrix(Pattern pattern, int rows, int cols, int nnz_per_row);
+
+double now_seconds();
+long peak_rss_kb();
+
+void json_begin(FILE* out, uint64_t seed);
+void json_result(FILE* out, BenchResult* result);
+void json_end(FILE* out);
+
+#endif
+#endif
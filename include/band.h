@@ -0,0 +1,34 @@
+#ifndef BAND_H
+#define BAND_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BAND_MAX_DIAGS 64   // Sparse results with more diagonals than this are never banded
+
+// Diagonal storage of a banded matrix, cells off the stored diagonals are zero
+typedef struct {
+    int rows;
+    int cols;
+    int num_diags;
+    int* offsets;       // Column minus row of each stored diagonal, ascending
+    double* vals;       // Cell (i, i + offsets[d]) is at vals[d * rows + i], NULL if every stored cell is 1
+} Band;
+
+Band* band_create(int rows, int cols, int num_diags, const int* offsets);
+Band* band_identity(int n);
+Band* band_copy(Band* band);
+void band_free(Band* band);
+int band_find(Band* band, int offset);
+double band_diag_val(Band* band, int d, int row);
+bool band_has_cell(Band* band, int row, int offset);
+double band_get(Band* band, int row, int col);
+long band_nnz(Band* band);
+size_t band_bytes(Band* band);
+Band* band_add(Band* a, Band* b, double sign);
+Band* band_scale(Band* band, double scalar);
+Band* band_mult(Band* a, Band* b);
+Band* band_transpose(Band* band);
+double band_determinant(Band* band);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "csr.h"
+
+// Factor L L^T = P A P^T of a symmetric positive definite matrix
+typedef struct {
+    int n;
+    int* perm;          // perm[k]: row and column of A eliminated k-th
+    int* parent;        // Elimination tree of P A P^T, -1 at roots
+    Csr* l;             // Columns of L stored as rows, row j holds L(j..n-1, j) with the diagonal first
+    double log_det;     // Natural log of the determinant of A
+} Cholesky;
+
+Cholesky* cholesky_factor(Csr* a);
+void cholesky_solve(Cholesky* chol, const double* b, double* x);
+size_t cholesky_bytes(Cholesky* chol);
+void cholesky_free(Cholesky* chol);
+
+#endif
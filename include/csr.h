@@ -0,0 +1,28 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdbool.h>
+#include "hash_map.h"
+
+// Row-ordered compressed copy of a matrix's stored values
+typedef struct {
+    int rows;
+    int cols;
+    long nnz;
+    long* row_ptr;      // Entries of row i are at [row_ptr[i], row_ptr[i + 1])
+    int* col_idx;       // Column of each entry, ascending within a row
+    double* vals;       // Stored value of each entry
+} Csr;
+
+Csr* csr_create(int rows, int cols, long nnz);
+Csr* csr_from_map(HashMap* map, int rows, int cols);
+HashMap* csr_to_map(Csr* csr);
+Csr* csr_transpose(Csr* csr);
+Csr* csr_add(Csr* a, Csr* b, double sign);
+void csr_mult_vec(Csr* csr, const double* x, double* y);
+void csr_mult_block(Csr* csr, const double* x, int width, double* y);
+Csr* csr_kron(Csr* a, Csr* b);
+bool csr_is_symmetric(Csr* csr);
+void csr_free(Csr* csr);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef DENSE_H
+#define DENSE_H
+
+#include <stdbool.h>
+#include "csr.h"
+
+#define DENSE_BLOCK 64  // Rows and columns of the tiles blocked kernels work on
+
+// Kernels on row-major arrays, products accumulate into c which the caller zeroes
+void dense_mult(const double* a, const double* b, double* c, int rows, int inner, int cols);
+void csr_dense_mult(Csr* a, const double* b, double* c, int cols);
+void dense_csr_mult(const double* a, Csr* b, double* c, int rows);
+void dense_transpose(const double* a, double* t, int rows, int cols);
+double dense_determinant(double* a, int n);
+bool dense_inverse(double* a, double* inv, int n);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef EIGEN_H
+#define EIGEN_H
+
+#include <stdbool.h>
+#include "matrix.h"
+
+#define EIGEN_TOL 1e-10         // Ritz residual, relative to the eigenvalue, at which an eigenpair is accepted
+#define EIGEN_MAX_RESTARTS 300
+
+typedef enum {
+    EIGEN_LARGEST,      // Largest real part
+    EIGEN_SMALLEST      // Smallest real part
+} EigenWhich;
+
+// Outcome of a restarted Krylov eigensolve
+typedef struct {
+    int restarts;
+    int converged;      // Wanted eigenpairs that met the tolerance
+    bool symmetric;     // Lanczos was used, Arnoldi otherwise
+} EigenStats;
+
+double start_entry(long i);
+void jacobi_eigen(double* s, int m, double* vals, double* vecs);
+bool eigen_which(const char* name, EigenWhich* which);
+bool eigen_solve(Matrix* a, int k, EigenWhich which, Matrix** values, Matrix** vectors, EigenStats* stats);
+
+#endif
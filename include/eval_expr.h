@@ -1,10 +1,14 @@
 #ifndef EVAL_EXPR_H
 #define EVAL_EXPR_H
 
+#include <stdio.h>
+#include <stdbool.h>
 #include "token.h"
 #include "matrix.h"
 
 Matrix* eval_expr(Token* expr, int len);
+void expr_set_quiet(bool quiet);
+void expr_error(FILE* stream, const char* format, ...);
 
 #ifdef TEST
 Token* convert_rpn(Token* tokens, int num_tokens, int* out_rpn_len);
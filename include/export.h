@@ -4,7 +4,14 @@
 #include <stdbool.h>
 #include "matrix.h"
 
-bool export_csv(Matrix* matrix, const char* filename);
+typedef enum {
+    EXPORT_DENSE,       // Every cell, one line per row
+    EXPORT_TRIPLET      // One row,col,val line per non-zero cell
+} ExportFormat;
+
+int format_double(double val, char* out);
+bool export_csv_file(Matrix* matrix, const char* name, ExportFormat format);
+bool export_csv(Matrix* matrix, const char* filename, ExportFormat format);
 Matrix* import_csv(const char* filename);
 
 #endif
\ No newline at end of file
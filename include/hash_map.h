@@ -12,10 +12,14 @@ typedef struct {
 } HashMap;
 
 HashMap* map_create();
+HashMap* map_share(HashMap* map);
+unsigned int hash(int row, int col);
 void map_insert(HashMap* map, int row, int col, double val);
+void map_append(HashMap* map, int row, int col, double val);
 void map_set(HashMap* map, int row, int col, double val);
 double map_get(HashMap* map, int row, int col);
 void free_hash_map(HashMap* map);
+size_t map_bytes(HashMap* map);
 bool map_save(HashMap* map, const char* filename);
 HashMap* map_load(const char* filename);
 
@@ -0,0 +1,39 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "export.h"
+
+typedef enum {
+    JOB_SAVE,
+    JOB_EXPORT
+} JobType;
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED
+} JobStatus;
+
+typedef struct Job {
+    int id;
+    JobType type;
+    char* name;         // Saved name or export file prefix
+    void* data;         // RepoWrite for saves, Matrix snapshot for exports
+    ExportFormat format;
+    JobStatus status;
+    long progress;      // Units of work done so far
+    long total;         // Units of work in job, 0 until known
+    struct Job* next;
+} Job;
+
+int jobs_submit_save(char* name, Matrix* matrix);
+int jobs_submit_export(char* name, Matrix* matrix, ExportFormat format);
+void jobs_report_progress(long progress, long total);
+void jobs_wait_name(const char* name);
+bool jobs_wait();
+void jobs_print();
+
+#endif
@@ -2,6 +2,7 @@
 #define LIST_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 //typedef struct Node Node;
 
@@ -15,9 +16,11 @@ typedef struct Node {
 typedef struct {
     Node* head;
     long size;
+    int refs;       // Hash maps sharing this list as a bucket
 } List;
 
 List* list_create();
+List* list_copy(List* list);
 void list_append(List* list, int row, int col, double val);
 void list_prepend(List* list, int row, int col, double val);
 double list_get_val(List* list, int row, int col);
@@ -25,6 +28,7 @@ double list_increment_val(List* list, int row, int col, double val);
 void list_update_val(List* list, int row, int col, double val);
 double list_remove_val(List* list, int row, int col);
 void list_free(List* list);
+size_t list_bytes(List* list);
 void list_print(List* list);
 bool list_save(List* list, const char* filename);
 List* list_load(const char* filename);
@@ -0,0 +1,25 @@
+#ifndef LU_H
+#define LU_H
+
+#include <stddef.h>
+#include "csr.h"
+
+#define LU_PIVOT_THRESHOLD 0.1  // Pivots may be this fraction of the largest candidate if their row is shorter
+
+// Factor L U = P A Q of a square non-singular matrix, step k pivots on A(row_perm[k], col_perm[k])
+typedef struct {
+    int n;
+    int* row_perm;      // row_perm[k]: row of A pivoted at step k
+    int* col_perm;      // col_perm[k]: column of A eliminated at step k
+    Csr* l;             // Row k holds the multipliers L(k, j), j < k, the unit diagonal is not stored
+    Csr* u;             // Row k holds U(k, j), j >= k, with the diagonal first
+    double det;         // Determinant of A
+} SparseLu;
+
+SparseLu* lu_factor(Csr* a);
+void lu_solve(SparseLu* lu, const double* b, double* x);
+void lu_solve_transpose(SparseLu* lu, const double* b, double* x);
+size_t lu_bytes(SparseLu* lu);
+void lu_free(SparseLu* lu);
+
+#endif
@@ -3,6 +3,15 @@
 
 #include "hash_map.h"
 #include "row_map.h"
+#include "matrix_pager.h"
+#include "band.h"
+#include "csr.h"
+#include "precond.h"
+#include "cholesky.h"
+#include "lu.h"
+
+#define DENSE_THRESHOLD 0.25    // Default stored density from which results switch to dense storage
+#define DENSE_MIN_CELLS 1024    // Matrices with fewer cells always stay sparse
 
 typedef struct {
     int rows;
@@ -10,8 +19,30 @@ typedef struct {
     HashMap* vals;
     RowMap* mult_vals;
     double scalar_val;
+    HashMap* dirty;     // Cells changed since last load/save, NULL when untracked
+    long repo_token;    // Repository version this matrix mirrors, 0 if none
+    MatrixPager* pager; // Fetches persisted rows on demand, NULL once fully loaded
+    int refs;           // Owners of this matrix, freed when the last one releases it
+    double* dense;      // Row-major values of every cell, NULL unless stored dense.
+                        // vals is then empty and scalar_val 0
+    int* dense_refs;    // Matrices sharing dense, each copy clones it before its first write
+    Band* band;         // Stored diagonals, NULL unless banded. vals is then empty and scalar_val 0
+    Precond* precond;   // Applied by iterative solves, NULL if none. Dropped when a cell changes
+    Cholesky* chol;     // Factor built by the first determinant, inverse or direct solve that needs it,
+                        // NULL until then. Dropped when a cell changes
+    bool chol_failed;   // Matrix was found not symmetric positive definite, cleared when a cell changes
+    SparseLu* lu;       // Factor built by the first determinant, inverse, solve or condition estimate
+                        // that needs one and finds no Cholesky factor, NULL until then. Dropped when a cell changes
 } Matrix;
 
+// Memory held by a matrix
+typedef struct {
+    long nnz;           // Values resident in memory
+    size_t vals;        // Stored values
+    size_t index;       // Row index cached for products, preconditioner and factor kept for solves
+    size_t other;       // Matrix struct, changed cell set and cached row blocks
+} MatrixMem;
+
 Matrix* matrix_create(int rows, int cols);
 int matrix_size(Matrix* matrix);
 Matrix* matrix_add(Matrix* a, Matrix* b);
@@ -20,15 +51,42 @@ Matrix* matrix_scalar_mult(Matrix* matrix, double scalar);
 Matrix* matrix_scalar_add(Matrix* matrix, double scalar);
 Matrix* matrix_scalar_subr(Matrix* matrix, double scalar);
 Matrix* matrix_transpose(Matrix* matrix);
+Matrix* matrix_kron(Matrix* a, Matrix* b);
 Matrix* matrix_mult(Matrix* a, Matrix* b);
-void matrix_set(Matrix* matrix, int row, int col, double val);
+bool matrix_set(Matrix* matrix, int row, int col, double val);
 double matrix_get(Matrix* matrix, int row, int col);
 void matrix_print(Matrix* matrix);
 Matrix* matrix_copy(Matrix* matrix);
 void matrix_free(Matrix* matrix);
+Matrix* matrix_retain(Matrix* matrix);
+void matrix_release(Matrix* matrix);
 Matrix* scalar_subr(Matrix* matrix, double val);
 double matrix_determinant(Matrix* a);
 Matrix* matrix_identity(int rows, int cols);
 Matrix* matrix_inverse(Matrix* a);
+void matrix_mark_clean(Matrix* matrix, long repo_token);
+void matrix_untrack(Matrix* matrix);
+Matrix* matrix_take_changes(Matrix* matrix);
+bool matrix_materialize(Matrix* matrix);
+double matrix_get_stored(Matrix* matrix, int row, int col);
+void matrix_mem(Matrix* matrix, MatrixMem* mem);
+long matrix_stored(Matrix* matrix);
+void matrix_make_dense(Matrix* matrix);
+void matrix_make_sparse(Matrix* matrix);
+void matrix_fit_storage(Matrix* matrix);
+void matrix_set_dense_threshold(double threshold);
+double matrix_dense_threshold();
+RowMap* matrix_row_index(Matrix* matrix);
+Csr* matrix_csr(Matrix* matrix);
+double* matrix_cells_copy(Matrix* matrix);
+Csr* matrix_cells_csr(Matrix* matrix);
+Matrix* matrix_from_cells(double* cells, int rows, int cols);
+Matrix* matrix_slice(Matrix* matrix, int r0, int r1, int c0, int c1);
+bool matrix_assign_slice(Matrix* matrix, int row, int col, Matrix* block);
+Matrix* matrix_permute(Matrix* matrix, const int* row_perm, const int* col_perm);
+bool matrix_precondition(Matrix* matrix, PrecondType type);
+void matrix_drop_precond(Matrix* matrix);
+Cholesky* matrix_cholesky(Matrix* matrix);
+SparseLu* matrix_lu(Matrix* matrix);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef MATRIX_PAGER_H
+#define MATRIX_PAGER_H
+
+#include <stdbool.h>
+#include "hash_map.h"
+
+#define PAGER_BLOCK_ROWS 256   // Rows fetched together on first access
+#define PAGER_MAX_BLOCKS 64    // Unpinned blocks kept before evicting
+
+// Loads stored values of rows [first_row, last_row] of matrix name into dest
+typedef bool (*PagerFetchFn)(const char* name, int first_row, int last_row, HashMap* dest);
+// Called once the pager no longer reads from matrix name
+typedef void (*PagerReleaseFn)(const char* name);
+
+typedef struct PagerBlock {
+    int index;                  // Block covers rows [index * PAGER_BLOCK_ROWS, (index + 1) * PAGER_BLOCK_ROWS)
+    HashMap* vals;              // Stored values of the block's rows
+    bool pinned;                // Block holds edits and cannot be evicted
+    struct PagerBlock* prev;    // Next more recently used block
+    struct PagerBlock* next;    // Next less recently used block
+} PagerBlock;
+
+typedef struct {
+    char* name;                 // Persisted matrix rows are fetched from
+    int num_blocks;
+    PagerBlock** blocks;        // Cached block for each block index, NULL if not loaded
+    PagerBlock* lru_head;       // Most recently used block
+    PagerBlock* lru_tail;       // Least recently used block
+    int cached;                 // Number of unpinned blocks in cache
+    PagerFetchFn fetch;
+    PagerReleaseFn release;
+} MatrixPager;
+
+MatrixPager* pager_create(const char* name, int rows, PagerFetchFn fetch, PagerReleaseFn release);
+double pager_get(MatrixPager* pager, int row, int col);
+bool pager_set(MatrixPager* pager, int row, int col, double val);
+bool pager_materialize(MatrixPager* pager, HashMap* dest);
+void pager_free(MatrixPager* pager);
+long pager_resident(MatrixPager* pager);
+size_t pager_bytes(MatrixPager* pager);
+
+#endif
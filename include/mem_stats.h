@@ -0,0 +1,32 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stddef.h>
+
+// Structures whose live allocations are tracked, in the order mem prints them
+typedef enum {
+    MEM_MATRIX,     // Matrix structs
+    MEM_HASH_MAP,   // HashMap structs
+    MEM_ROW_MAP,    // RowMap structs and their row nodes
+    MEM_LIST,       // List structs and their nodes
+    MEM_DENSE,      // Value arrays of dense matrices
+    MEM_BAND,       // Diagonal storage of banded matrices
+    NUM_MEM_KINDS
+} MemKind;
+
+// Compiling with -DNO_PROFILE removes tracking along with the rest of the instrumentation
+#ifdef NO_PROFILE
+
+#define MEM_TRACK(kind, objects, bytes) ((void)sizeof((objects) + (bytes)))
+
+#else
+
+#define MEM_TRACK(kind, objects, bytes) mem_track((kind), (objects), (long)(bytes))
+
+void mem_track(MemKind kind, long objects, long bytes);
+
+#endif
+
+void mem_print_structures();
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef NORM_H
+#define NORM_H
+
+#include <stdbool.h>
+#include "matrix.h"
+
+#define COND_MAX_ITER 5         // Sign vectors tried by the condition estimator, LAPACK uses the same limit
+#define COND_WARN 1e8           // Estimated condition number from which a computed inverse is reported unreliable
+
+typedef enum {
+    NORM_ONE,           // Largest absolute column sum
+    NORM_INF,           // Largest absolute row sum
+    NORM_FRO            // Square root of the sum of squares of every cell
+} NormType;
+
+double matrix_norm(Matrix* a, NormType type);
+double matrix_cond(Matrix* a);
+
+#endif
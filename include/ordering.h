@@ -0,0 +1,19 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include "csr.h"
+
+#define ORDER_DENSE_ROWS 10     // Rows longer than this times sqrt(columns) are left out of column orderings
+
+// Spread of the non-zeros of a + a^T about the diagonal
+typedef struct {
+    int bandwidth;      // Largest distance of a non-zero from the diagonal
+    long profile;       // Cells from the first non-zero of each row to the diagonal, summed over rows
+} Envelope;
+
+int* order_min_degree(Csr* a);
+int* order_column_min_degree(Csr* a);
+int* order_rcm(Csr* a);
+void envelope_measure(Csr* a, const int* perm, Envelope* env);
+
+#endif
@@ -3,9 +3,17 @@
 
 #include "matrix.h"
 
+// Indices [start, end) of a slice, end is -1 when the range runs to the last index
+typedef struct {
+    int start;
+    int end;
+} SliceRange;
+
 Matrix* solve_expr(char* expr);
 int parse_pattern(const char* str, int start, int* end);
 void get_matrix_index(const char* input, char** name, int* row, int* col);
+int parse_slice(const char* str, int start, int* end, char** name, SliceRange* rows, SliceRange* cols);
+Matrix* get_slice(const char* input);
 
 #ifdef TEST
 Token* parse_expr(char* expr, int* token_count);
@@ -3,8 +3,11 @@
 
 #include "hash_map.h"
 #include "token.h"
+#include "matrix.h"
 
 bool handle_input(char* input);
+bool parse_assignment(char* input, char** target, char** expr);
+bool save_result(Matrix* result, char* target);
 
 // Allows test.c to access methods for unit testing
 #ifdef TEST 
@@ -0,0 +1,29 @@
+#ifndef PRECOND_H
+#define PRECOND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "csr.h"
+
+typedef enum {
+    PRECOND_JACOBI,     // Reciprocal of the diagonal
+    PRECOND_ILU0        // Incomplete LU keeping the pattern of the matrix
+} PrecondType;
+
+// Approximate inverse applied to residuals by iterative solvers
+typedef struct {
+    PrecondType type;
+    int n;
+    double* inv_diag;   // Jacobi: 1 / a_ii, ILU(0): 1 / u_ii
+    Csr* lu;            // ILU(0): strictly lower part holds L, whose diagonal is 1, the rest holds U
+    long* diag;         // ILU(0): position of each row's diagonal entry in lu
+} Precond;
+
+bool precond_type(const char* name, PrecondType* type);
+const char* precond_name(Precond* precond);
+Precond* precond_create(Csr* a, double scalar_val, PrecondType type);
+void precond_apply(Precond* precond, const double* r, double* z);
+size_t precond_bytes(Precond* precond);
+void precond_free(Precond* precond);
+
+#endif
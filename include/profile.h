@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+// Instrumented operations, in the order stats prints them
+typedef enum {
+    PROF_EVAL_EXPR,
+    PROF_MATRIX_ADD,
+    PROF_MATRIX_MULT,
+    PROF_MATRIX_DETERMINANT,
+    PROF_SOLVE,
+    PROF_EIGEN,
+    PROF_SVD,
+    PROF_COND,
+    PROF_LSTSQ,
+    PROF_REORDER,
+    PROF_KRON,
+    PROF_IMPORT_CSV,
+    PROF_REPO_SAVE,
+    PROF_REPO_LOAD,
+    PROF_REPO_FETCH_ROWS,
+    PROF_REPO_DELETE,
+    PROF_REPO_LIST,
+    NUM_PROFILE_OPS
+} ProfileOp;
+
+// Start of one timed call
+typedef struct {
+    long start_ns;
+    long start_allocs;
+} ProfileSpan;
+
+// Compiling with -DNO_PROFILE removes all instrumentation, nnz arguments are never evaluated
+#ifdef NO_PROFILE
+
+#define PROFILE_BEGIN(span) ((void)0)
+#define PROFILE_END(op, span, nnz_in, nnz_out) ((void)sizeof((nnz_in) + (nnz_out)))
+#define PROFILE_ALLOC() ((void)0)
+
+#else
+
+// Allocations of matrix storage made by the calling thread
+extern _Thread_local long profile_allocs;
+
+#define PROFILE_BEGIN(span) ProfileSpan span = profile_begin()
+#define PROFILE_END(op, span, nnz_in, nnz_out) profile_end((op), &(span), (nnz_in), (nnz_out))
+#define PROFILE_ALLOC() (profile_allocs++)
+
+ProfileSpan profile_begin();
+void profile_end(ProfileOp op, ProfileSpan* span, long nnz_in, long nnz_out);
+
+#endif
+
+bool profile_enabled();
+void profile_print();
+void profile_reset();
+
+#endif
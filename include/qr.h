@@ -0,0 +1,18 @@
+#ifndef QR_H
+#define QR_H
+
+#include "matrix.h"
+
+#define QR_RANK_TOL 1e-12       // Diagonal of R, relative to the largest column norm, below which a column is dependent
+
+// Outcome of a least-squares solve
+typedef struct {
+    int rank;           // Independent columns found, the solution is 0 in the others
+    double residual;    // ||b - Ax|| of the returned x
+    double relative;    // Residual divided by ||b||
+} LstsqStats;
+
+int qr_solve(Csr* a, const double* b, double* x);
+Matrix* qr_lstsq(Matrix* a, Matrix* b, LstsqStats* stats);
+
+#endif
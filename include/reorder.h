@@ -0,0 +1,17 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "ordering.h"
+
+typedef enum {
+    REORDER_RCM,        // Reverse Cuthill-McKee, narrows the band
+    REORDER_AMD         // Minimum degree, reduces fill of a factorization
+} ReorderMethod;
+
+bool reorder_method(const char* name, ReorderMethod* method);
+Matrix* matrix_reorder(Matrix* a, ReorderMethod method, Matrix** perm, Envelope* before, Envelope* after);
+Matrix* reorder_apply(Matrix* x, Matrix* perm, bool undo);
+
+#endif
@@ -4,9 +4,22 @@
 #include <stdbool.h>
 #include "matrix.h"
 
+// Save of a matrix snapshot, planned on the caller's thread and committed later
+typedef struct {
+    char* name;
+    Matrix* snapshot;   // Values to write, unaffected by later edits
+    bool delta;         // Snapshot holds only the cells changed since base_token
+    long base_token;    // Persisted version a delta applies to
+    long token;         // Persisted version the write produces
+} RepoWrite;
+
 bool repo_is_unique(char* name);
 bool repo_matrix_save(char* name, Matrix* matrix);
+RepoWrite* repo_prepare_save(char* name, Matrix* matrix);
+bool repo_commit_save(RepoWrite* write);
+void repo_write_free(RepoWrite* write);
 Matrix* repo_matrix_load(char* name);
+bool repo_matrix_load_many(char** names, int count, Matrix** matrices);
 bool repo_matrix_delete(char* name);
 bool repo_list();
 
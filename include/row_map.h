@@ -27,5 +27,6 @@ List* row_map_get_row(RowMap* map, int row);
 double row_map_increment(RowMap* map, int row, int col, double val);
 void row_map_remove(RowMap* map, int row, int col);
 void free_row_map(RowMap* map);
+size_t row_map_bytes(RowMap* map);
 
 #endif
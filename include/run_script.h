@@ -1,6 +1,26 @@
 #ifndef RUN_SCRIPT_H
 #define RUN_SCRIPT_H
 
-void execute_file(const char* filepath);
+#include <stdbool.h>
+#include "matrix.h"
 
-#endif
\ No newline at end of file
+// Script statement scheduled for parallel execution
+typedef struct {
+    char* text;         // Statement as written
+    char* target;       // Matrix assigned, NULL if statement must run alone
+    char* expr;         // Expression assigned to target
+    char** reads;       // Matrix names the expression reads
+    int num_reads;
+    int wave;           // Statements of one wave run concurrently, waves run in order
+    Matrix* result;     // Value computed for target, NULL if evaluation failed
+} Statement;
+
+bool execute_file(const char* filepath, bool parallel);
+
+// Allows test.c to check how scripts are scheduled
+#ifdef TEST
+char** expr_reads(const char* expr, int* count);
+int plan_waves(Statement* stmts, int count);
+#endif
+
+#endif
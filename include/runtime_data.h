@@ -9,5 +9,6 @@ bool rd_overwrite_matrix(char* name, Matrix* matrix);
 bool rd_delete_matrix(char* name);
 Matrix* rd_get_matrix(char* name);
 void rd_print_all();
+void rd_print_mem();
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdbool.h>
+#include "matrix.h"
+
+#define SOLVER_TOL 1e-8         // Default relative residual at which a solve stops
+#define SOLVER_MAX_ITER 1000    // Default iteration limit
+
+typedef enum {
+    SOLVER_CG,          // Conjugate gradient, A must be symmetric positive definite
+    SOLVER_BICGSTAB,    // Biconjugate gradient stabilized, any non-singular A
+    SOLVER_CHOLESKY,    // Direct solve with the sparse Cholesky factor of a symmetric positive definite A
+    SOLVER_LU           // Direct solve with the sparse LU factor of any non-singular A
+} SolverMethod;
+
+// Outcome of an iterative solve
+typedef struct {
+    int iterations;
+    double residual;    // ||b - Ax|| / ||b|| of the returned x
+    bool converged;
+    bool breakdown;     // Iteration stopped on a zero or non-finite denominator, A may be singular or indefinite
+} SolveStats;
+
+// Square system matrix, every cell is its stored value plus scalar_val
+typedef struct {
+    Csr* csr;
+    double scalar_val;
+    int n;
+    Precond* precond;   // Applied to residuals, NULL to iterate unpreconditioned
+} System;
+
+double* vec_create(int n);
+double vec_dot(const double* x, const double* y, int n);
+void vec_axpy(double* y, double alpha, const double* x, int n);
+void system_apply(System* sys, const double* x, double* y);
+
+bool solver_method(const char* name, SolverMethod* method);
+Matrix* solver_solve(Matrix* a, Matrix* b, SolverMethod method, double tol, int max_iter, SolveStats* stats);
+
+#endif
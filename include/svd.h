@@ -0,0 +1,12 @@
+#ifndef SVD_H
+#define SVD_H
+
+#include <stdbool.h>
+#include "matrix.h"
+
+#define SVD_OVERSAMPLE 10       // Sampled directions beyond the k wanted
+#define SVD_POWER_ITERS 2       // Default passes of A A^T sharpening the decay of the sampled spectrum
+
+bool svd_truncated(Matrix* a, int k, int power_iters, Matrix** u, Matrix** s, Matrix** v);
+
+#endif
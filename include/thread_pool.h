@@ -0,0 +1,12 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#define POOL_MAX_THREADS 64
+
+// Runs task number task of a parallel loop, ctx is shared by all tasks
+typedef void (*PoolTaskFn)(int task, void* ctx);
+
+int pool_size();
+void pool_parallel_for(int num_tasks, PoolTaskFn fn, void* ctx);
+
+#endif
@@ -10,7 +10,9 @@ typedef enum {
     TOKEN_DET_R,
     TOKEN_MATRIX,
     TOKEN_INVALID,
-    TOKEN_NUMERIC
+    TOKEN_NUMERIC,
+    TOKEN_FUNC,
+    TOKEN_COMMA
 } TokenType;
 
 typedef struct {
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include "../include/band.h"
+#include "../include/mem_stats.h"
+
+
+// Band with zeroed diagonals at offsets, which must be ascending
+Band* band_create(int rows, int cols, int num_diags, const int* offsets) {
+    Band* band = malloc(sizeof(Band));
+    if(!band) {
+        fprintf(stderr, "Memory allocation failed for Band\n");
+        exit(1);
+    }
+
+    band->rows = rows;
+    band->cols = cols;
+    band->num_diags = num_diags;
+    band->offsets = malloc((num_diags > 0 ? num_diags : 1) * sizeof(int));
+    band->vals = calloc((long)(num_diags > 0 ? num_diags : 1) * rows, sizeof(double));
+
+    if(!band->offsets || !band->vals) {
+        fprintf(stderr, "Memory allocation failed for Band\n");
+        exit(1);
+    }
+
+    memcpy(band->offsets, offsets, num_diags * sizeof(int));
+    MEM_TRACK(MEM_BAND, 1, band_bytes(band));
+
+    return band;
+}
+
+
+// n x n identity, held without storing its diagonal
+Band* band_identity(int n) {
+    Band* band = malloc(sizeof(Band));
+    if(!band) {
+        fprintf(stderr, "Memory allocation failed for Band\n");
+        exit(1);
+    }
+
+    band->rows = n;
+    band->cols = n;
+    band->num_diags = 1;
+    band->offsets = calloc(1, sizeof(int));
+    band->vals = NULL;
+
+    if(!band->offsets) {
+        fprintf(stderr, "Memory allocation failed for Band\n");
+        exit(1);
+    }
+
+    MEM_TRACK(MEM_BAND, 1, band_bytes(band));
+
+    return band;
+}
+
+
+Band* band_copy(Band* band) {
+    if(!band->vals)
+        return band_identity(band->rows);
+
+    Band* copy = band_create(band->rows, band->cols, band->num_diags, band->offsets);
+    memcpy(copy->vals, band->vals, (long)band->num_diags * band->rows * sizeof(double));
+
+    return copy;
+}
+
+
+void band_free(Band* band) {
+    if(!band)
+        return;
+
+    MEM_TRACK(MEM_BAND, -1, -(long)band_bytes(band));
+    free(band->offsets);
+    free(band->vals);
+    free(band);
+}
+
+
+// Value of cell (row, row + offsets[d])
+double band_diag_val(Band* band, int d, int row) {
+    return band->vals ? band->vals[(long)d * band->rows + row] : 1;
+}
+
+
+// Check if diagonal at offset has a cell in row
+bool band_has_cell(Band* band, int row, int offset) {
+    return row + offset >= 0 && row + offset < band->cols;
+}
+
+
+// Index of diagonal at offset, -1 if not stored
+int band_find(Band* band, int offset) {
+    int low = 0, high = band->num_diags - 1;
+
+    while(low <= high) {
+        int mid = (low + high) / 2;
+
+        if(band->offsets[mid] == offset)
+            return mid;
+        if(band->offsets[mid] < offset)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return -1;
+}
+
+
+double band_get(Band* band, int row, int col) {
+    int d = band_find(band, col - row);
+
+    if(d < 0 || row < 0 || row >= band->rows || !band_has_cell(band, row, band->offsets[d]))
+        return 0;
+
+    return band_diag_val(band, d, row);
+}
+
+
+// Number of non-zero cells
+long band_nnz(Band* band) {
+    long nnz = 0;
+
+    for(int d = 0; d < band->num_diags; d++) {
+        for(int i = 0; i < band->rows; i++)
+            nnz += band_has_cell(band, i, band->offsets[d]) && band_diag_val(band, d, i) != 0;
+    }
+
+    return nnz;
+}
+
+
+// Bytes allocated for band and its diagonals
+size_t band_bytes(Band* band) {
+    size_t bytes = sizeof(Band) + (band->num_diags > 0 ? band->num_diags : 1) * sizeof(int);
+
+    if(band->vals)
+        bytes += (long)(band->num_diags > 0 ? band->num_diags : 1) * band->rows * sizeof(double);
+
+    return bytes;
+}
+
+
+int compare_offsets(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+
+// Sort offsets and drop duplicates, returns number kept
+int unique_offsets(int* offsets, int count) {
+    qsort(offsets, count, sizeof(int), compare_offsets);
+
+    int kept = 0;
+    for(int i = 0; i < count; i++) {
+        if(kept == 0 || offsets[kept - 1] != offsets[i])
+            offsets[kept++] = offsets[i];
+    }
+
+    return kept;
+}
+
+
+// Add scale times every diagonal of src to dest, which stores all of src's diagonals
+void band_accumulate(Band* dest, Band* src, double scale) {
+    for(int d = 0; d < src->num_diags; d++) {
+        int offset = src->offsets[d];
+        double* dest_diag = dest->vals + (long)band_find(dest, offset) * dest->rows;
+
+        for(int i = 0; i < src->rows; i++) {
+            if(band_has_cell(src, i, offset))
+                dest_diag[i] += scale * band_diag_val(src, d, i);
+        }
+    }
+}
+
+
+// a plus sign times b, for bands of equal dimensions
+Band* band_add(Band* a, Band* b, double sign) {
+    int* offsets = malloc((a->num_diags + b->num_diags) * sizeof(int));
+    memcpy(offsets, a->offsets, a->num_diags * sizeof(int));
+    memcpy(offsets + a->num_diags, b->offsets, b->num_diags * sizeof(int));
+
+    int count = unique_offsets(offsets, a->num_diags + b->num_diags);
+    Band* result = band_create(a->rows, a->cols, count, offsets);
+    free(offsets);
+
+    band_accumulate(result, a, 1);
+    band_accumulate(result, b, sign);
+
+    return result;
+}
+
+
+Band* band_scale(Band* band, double scalar) {
+    Band* result = band_create(band->rows, band->cols, band->num_diags, band->offsets);
+    band_accumulate(result, band, scalar);
+
+    return result;
+}
+
+
+// Product of a and b, diagonal pairs at offsets p and q add to the diagonal at p + q
+Band* band_mult(Band* a, Band* b) {
+    int* offsets = malloc((a->num_diags * b->num_diags > 0 ? a->num_diags * b->num_diags : 1) * sizeof(int));
+    int count = 0;
+
+    for(int da = 0; da < a->num_diags; da++) {
+        for(int db = 0; db < b->num_diags; db++) {
+            int offset = a->offsets[da] + b->offsets[db];
+
+            if(offset > -a->rows && offset < b->cols)
+                offsets[count++] = offset;
+        }
+    }
+
+    count = unique_offsets(offsets, count);
+    Band* result = band_create(a->rows, b->cols, count, offsets);
+    free(offsets);
+
+    for(int da = 0; da < a->num_diags; da++) {
+        for(int db = 0; db < b->num_diags; db++) {
+            int p = a->offsets[da], q = b->offsets[db];
+            int dr = band_find(result, p + q);
+            if(dr < 0)
+                continue;
+
+            double* dest = result->vals + (long)dr * result->rows;
+
+            for(int i = 0; i < a->rows; i++) {
+                int k = i + p; // Row of b the cell of a meets
+                if(k < 0 || k >= a->cols || k + q < 0 || k + q >= b->cols)
+                    continue;
+
+                dest[i] += band_diag_val(a, da, i) * band_diag_val(b, db, k);
+            }
+        }
+    }
+
+    return result;
+}
+
+
+// Transpose, the diagonal at offset p becomes the one at -p
+Band* band_transpose(Band* band) {
+    if(!band->vals && band->rows == band->cols)
+        return band_identity(band->rows);
+
+    int* offsets = malloc(band->num_diags * sizeof(int));
+    for(int d = 0; d < band->num_diags; d++)
+        offsets[d] = -band->offsets[band->num_diags - 1 - d];
+
+    Band* result = band_create(band->cols, band->rows, band->num_diags, offsets);
+    free(offsets);
+
+    for(int d = 0; d < band->num_diags; d++) {
+        int offset = band->offsets[d];
+        double* dest = result->vals + (long)(band->num_diags - 1 - d) * result->rows;
+
+        for(int i = 0; i < band->rows; i++) {
+            if(band_has_cell(band, i, offset))
+                dest[i + offset] = band_diag_val(band, d, i);
+        }
+    }
+
+    return result;
+}
+
+
+// Determinant of square band by LU decomposition with partial pivoting. Row swaps widen the upper
+// band by the lower bandwidth, so rows are held from kl left to ku + kl right of the diagonal
+double band_determinant(Band* band) {
+    int n = band->rows;
+    if(!band->vals)
+        return 1;
+    if(band->num_diags == 0)
+        return 0;
+
+    int kl = band->offsets[0] < 0 ? -band->offsets[0] : 0;
+    int ku = band->offsets[band->num_diags - 1] > 0 ? band->offsets[band->num_diags - 1] : 0;
+    int width = 2 * kl + ku + 1;
+
+    double* lu = calloc((long)n * width, sizeof(double));
+    if(!lu) {
+        fprintf(stderr, "Memory allocation failed for Band\n");
+        exit(1);
+    }
+
+    #define LU(i, j) lu[(long)(i) * width + ((j) - (i) + kl)]
+
+    for(int d = 0; d < band->num_diags; d++) {
+        for(int i = 0; i < n; i++) {
+            if(band_has_cell(band, i, band->offsets[d]))
+                LU(i, i + band->offsets[d]) = band_diag_val(band, d, i);
+        }
+    }
+
+    double det = 1;
+
+    for(int k = 0; k < n; k++) {
+        int last_row = k + kl < n ? k + kl : n - 1;
+        int last_col = k + ku + kl < n ? k + ku + kl : n - 1;
+
+        // Partial pivoting among the rows that reach column k
+        int r = k;
+        double max_val = fabs(LU(k, k));
+        for(int i = k + 1; i <= last_row; i++) {
+            if(fabs(LU(i, k)) > max_val) {
+                max_val = fabs(LU(i, k));
+                r = i;
+            }
+        }
+
+        if(r != k) {
+            for(int j = k; j <= last_col; j++) {
+                double temp = LU(k, j);
+                LU(k, j) = LU(r, j);
+                LU(r, j) = temp;
+            }
+            det = -det;
+        }
+
+        double pivot = LU(k, k);
+        if(fabs(pivot) < 1e-15) { // Singular matrix
+            free(lu);
+            return 0.0;
+        }
+
+        det *= pivot;
+
+        // Elimination below pivot
+        for(int i = k + 1; i <= last_row; i++) {
+            double multiplier = LU(i, k) / pivot;
+            if(multiplier == 0)
+                continue;
+
+            for(int j = k; j <= last_col; j++)
+                LU(i, j) -= multiplier * LU(k, j);
+        }
+    }
+
+    #undef LU
+
+    free(lu);
+
+    return det;
+}
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "../include/cholesky.h"
+#include "../include/ordering.h"
+
+
+void* cholesky_alloc(size_t bytes) {
+    void* ptr = malloc(bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for Cholesky factor\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+// Lower triangle of P A P^T, row k holds C(k, j) for j <= k. By symmetry that is column k of the
+// upper triangle, which is what each step of the factorization reads
+Csr* permuted_lower(Csr* a, int* perm) {
+    int n = a->rows;
+    int* pinv = cholesky_alloc(n * sizeof(int));
+    for(int k = 0; k < n; k++)
+        pinv[perm[k]] = k;
+
+    long nnz = 0;
+    long* count = calloc(n + 1, sizeof(long));
+    if(!count) {
+        fprintf(stderr, "Memory allocation failed for Cholesky factor\n");
+        exit(1);
+    }
+
+    for(int i = 0; i < n; i++) {
+        for(long k = a->row_ptr[i]; k < a->row_ptr[i + 1]; k++) {
+            if(pinv[a->col_idx[k]] <= pinv[i]) {
+                count[pinv[i] + 1]++;
+                nnz++;
+            }
+        }
+    }
+
+    Csr* lower = csr_create(n, n, nnz);
+    for(int k = 0; k < n; k++)
+        count[k + 1] += count[k];
+    for(int k = 0; k <= n; k++)
+        lower->row_ptr[k] = count[k];
+
+    for(int i = 0; i < n; i++) {
+        for(long k = a->row_ptr[i]; k < a->row_ptr[i + 1]; k++) {
+            if(pinv[a->col_idx[k]] <= pinv[i]) {
+                long pos = count[pinv[i]]++;
+                lower->col_idx[pos] = pinv[a->col_idx[k]];
+                lower->vals[pos] = a->vals[k];
+            }
+        }
+    }
+
+    free(count);
+    free(pinv);
+
+    return lower;
+}
+
+
+// Elimination tree of the matrix whose upper triangle columns are the rows of lower, using path
+// compressed ancestors
+int* elimination_tree(Csr* lower) {
+    int n = lower->rows;
+    int* parent = cholesky_alloc(n * sizeof(int));
+    int* ancestor = cholesky_alloc(n * sizeof(int));
+
+    for(int k = 0; k < n; k++) {
+        parent[k] = -1;
+        ancestor[k] = -1;
+
+        for(long p = lower->row_ptr[k]; p < lower->row_ptr[k + 1]; p++) {
+            int i = lower->col_idx[p];
+
+            while(i != -1 && i < k) {
+                int next = ancestor[i];
+                ancestor[i] = k;
+                if(next == -1)
+                    parent[i] = k;
+                i = next;
+            }
+        }
+    }
+
+    free(ancestor);
+
+    return parent;
+}
+
+
+// Columns of the non-zeros in row k of L before the diagonal, found by walking up the elimination
+// tree from each entry of row k of lower. They are left in stack[top..n) in topological order and
+// top is returned, mark[i] == k flags visited columns
+int row_pattern(Csr* lower, int* parent, int k, int* stack, int* mark) {
+    int n = lower->rows;
+    int top = n;
+    mark[k] = k;
+
+    for(long p = lower->row_ptr[k]; p < lower->row_ptr[k + 1]; p++) {
+        int i = lower->col_idx[p];
+        int len = 0;
+
+        for(; mark[i] != k; i = parent[i]) { // Path up to a visited column, stacked in reverse
+            stack[len++] = i;
+            mark[i] = k;
+        }
+
+        while(len > 0)
+            stack[--top] = stack[--len];
+    }
+
+    return top;
+}
+
+
+// Up-looking sparse Cholesky with a minimum degree ordering. The elimination tree gives the pattern
+// of every row of L, so columns are allocated exactly before the numeric phase computes each row of
+// L by a sparse triangular solve. NULL if a is not positive definite, a pivot of at most n DBL_EPSILON
+// times the largest diagonal value counts as zero
+Cholesky* cholesky_factor(Csr* a) {
+    int n = a->rows;
+    if(a->cols != n)
+        return NULL;
+
+    Cholesky* chol = cholesky_alloc(sizeof(Cholesky));
+    chol->n = n;
+    chol->perm = order_min_degree(a);
+
+    Csr* lower = permuted_lower(a, chol->perm);
+    chol->parent = elimination_tree(lower);
+
+    int* stack = cholesky_alloc(n * sizeof(int));
+    int* mark = cholesky_alloc(n * sizeof(int));
+    long* next = cholesky_alloc(n * sizeof(long)); // Next free slot of each column of L
+    double* x = calloc(n, sizeof(double));
+    if(!x) {
+        fprintf(stderr, "Memory allocation failed for Cholesky factor\n");
+        exit(1);
+    }
+
+    // Symbolic phase, count entries of each column of L
+    long* count = calloc(n + 1, sizeof(long));
+    if(!count) {
+        fprintf(stderr, "Memory allocation failed for Cholesky factor\n");
+        exit(1);
+    }
+
+    for(int k = 0; k < n; k++)
+        mark[k] = -1;
+
+    for(int k = 0; k < n; k++) {
+        count[k + 1]++; // Diagonal
+        for(int top = row_pattern(lower, chol->parent, k, stack, mark); top < n; top++)
+            count[stack[top] + 1]++;
+    }
+
+    for(int k = 0; k < n; k++)
+        count[k + 1] += count[k];
+
+    chol->l = csr_create(n, n, count[n]);
+    for(int k = 0; k <= n; k++)
+        chol->l->row_ptr[k] = count[k];
+    free(count);
+
+    long* lp = chol->l->row_ptr;
+    int* li = chol->l->col_idx;
+    double* lx = chol->l->vals;
+
+    // Numeric phase, row k of L solves L(0..k-1, 0..k-1) l = C(0..k-1, k)
+    for(int k = 0; k < n; k++) {
+        mark[k] = -1;
+        next[k] = lp[k];
+    }
+
+    // Pivots within rounding of zero next to the largest diagonal value mean a is singular or indefinite,
+    // rounding in a pivot grows with the up to n updates it takes
+    double max_diag = 0;
+    for(int k = 0; k < n; k++) {
+        for(long p = lower->row_ptr[k]; p < lower->row_ptr[k + 1]; p++) {
+            if(lower->col_idx[p] == k)
+                max_diag = fmax(max_diag, fabs(lower->vals[p]));
+        }
+    }
+
+    bool positive = true;
+    chol->log_det = 0;
+
+    for(int k = 0; k < n && positive; k++) {
+        int top = row_pattern(lower, chol->parent, k, stack, mark);
+
+        for(long p = lower->row_ptr[k]; p < lower->row_ptr[k + 1]; p++)
+            x[lower->col_idx[p]] = lower->vals[p];
+
+        double d = x[k];
+        x[k] = 0;
+
+        for(; top < n; top++) {
+            int i = stack[top];
+            double lki = x[i] / lx[lp[i]];
+            x[i] = 0;
+
+            for(long p = lp[i] + 1; p < next[i]; p++)
+                x[li[p]] -= lx[p] * lki;
+
+            d -= lki * lki;
+            long p = next[i]++;
+            li[p] = k;
+            lx[p] = lki;
+        }
+
+        if(d <= n * DBL_EPSILON * max_diag) {
+            positive = false;
+            break;
+        }
+
+        long p = next[k]++;
+        li[p] = k;
+        lx[p] = sqrt(d);
+        chol->log_det += log(d);
+    }
+
+    free(stack);
+    free(mark);
+    free(next);
+    free(x);
+    csr_free(lower);
+
+    if(!positive) {
+        cholesky_free(chol);
+        return NULL;
+    }
+
+    return chol;
+}
+
+
+// Solve A x = b with the factor, permuting b in and x back out
+void cholesky_solve(Cholesky* chol, const double* b, double* x) {
+    int n = chol->n;
+    long* lp = chol->l->row_ptr;
+    int* li = chol->l->col_idx;
+    double* lx = chol->l->vals;
+    double* y = cholesky_alloc(n * sizeof(double));
+
+    for(int k = 0; k < n; k++)
+        y[k] = b[chol->perm[k]];
+
+    for(int j = 0; j < n; j++) { // L y = P b
+        y[j] /= lx[lp[j]];
+        for(long p = lp[j] + 1; p < lp[j + 1]; p++)
+            y[li[p]] -= lx[p] * y[j];
+    }
+
+    for(int j = n - 1; j >= 0; j--) { // L^T z = y
+        for(long p = lp[j] + 1; p < lp[j + 1]; p++)
+            y[j] -= lx[p] * y[li[p]];
+        y[j] /= lx[lp[j]];
+    }
+
+    for(int k = 0; k < n; k++)
+        x[chol->perm[k]] = y[k];
+
+    free(y);
+}
+
+
+size_t cholesky_bytes(Cholesky* chol) {
+    if(!chol)
+        return 0;
+
+    return sizeof(Cholesky) + 2 * chol->n * sizeof(int) + sizeof(Csr) + (chol->n + 1) * sizeof(long)
+        + chol->l->nnz * (sizeof(int) + sizeof(double));
+}
+
+
+void cholesky_free(Cholesky* chol) {
+    if(!chol)
+        return;
+
+    free(chol->perm);
+    free(chol->parent);
+    csr_free(chol->l);
+    free(chol);
+}
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../include/csr.h"
+#include "../include/map_iterator.h"
+#include "../include/thread_pool.h"
+
+#define TASK_NNZ 65536  // Entries below which another transpose or merge task is not worth starting
+
+// Transpose split into tasks over consecutive rows of the source
+typedef struct {
+    Csr* csr;
+    Csr* result;
+    int num_tasks;
+    long* next;     // next[t * cols + j]: entries of column j in task t's rows, then where t writes them
+} TransposeTasks;
+
+// Merge of two csr matrices split into tasks over consecutive rows
+typedef struct {
+    Csr* a;
+    Csr* b;
+    double sign;
+    Csr* result;    // NULL while counting entries of each row into row_ptr
+    long* row_ptr;
+    int num_tasks;
+} MergeTasks;
+
+// Product of csr and a vector, or a row-major block of width columns, split into tasks over
+// consecutive rows
+typedef struct {
+    Csr* csr;
+    const double* x;
+    double* y;
+    int width;
+    int num_tasks;
+} MultVecTasks;
+
+// Kronecker product of two csr matrices split into tasks over consecutive rows of a
+typedef struct {
+    Csr* a;
+    Csr* b;
+    Csr* result;
+    int num_tasks;
+} KronTasks;
+
+// Allocate csr with room for nnz entries
+Csr* csr_create(int rows, int cols, long nnz) {
+    Csr* csr = malloc(sizeof(Csr));
+    if(!csr) {
+        fprintf(stderr, "Memory allocation failed for Csr\n");
+        exit(1);
+    }
+
+    csr->rows = rows;
+    csr->cols = cols;
+    csr->nnz = nnz;
+    csr->row_ptr = calloc(rows + 1, sizeof(long));
+    csr->col_idx = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    csr->vals = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+
+    if(!csr->row_ptr || !csr->col_idx || !csr->vals) {
+        fprintf(stderr, "Memory allocation failed for Csr\n");
+        exit(1);
+    }
+
+    return csr;
+}
+
+
+// Build row-ordered copy of map with two counting sort passes, by column then stably by row
+Csr* csr_from_map(HashMap* map, int rows, int cols) {
+    long nnz = 0;
+    long* col_ptr = calloc(cols + 1, sizeof(long));
+    Csr* csr;
+
+    // Count entries per column, ignoring any outside the matrix
+    MapIterator map_it = map_iterator_create(map);
+    while(map_iterator_has_next(&map_it)) {
+        int row, col;
+        double val;
+        map_iterator_next(&map_it, &row, &col, &val);
+
+        if(row >= 0 && row < rows && col >= 0 && col < cols) {
+            col_ptr[col + 1]++;
+            nnz++;
+        }
+    }
+
+    for(int j = 0; j < cols; j++)
+        col_ptr[j + 1] += col_ptr[j];
+
+    // Scatter entries into column order
+    int* by_col_row = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    int* by_col_col = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    double* by_col_val = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+    long* next = malloc((cols > 0 ? cols : 1) * sizeof(long));
+
+    for(int j = 0; j < cols; j++)
+        next[j] = col_ptr[j];
+
+    map_it = map_iterator_create(map);
+    while(map_iterator_has_next(&map_it)) {
+        int row, col;
+        double val;
+        map_iterator_next(&map_it, &row, &col, &val);
+
+        if(row >= 0 && row < rows && col >= 0 && col < cols) {
+            long pos = next[col]++;
+            by_col_row[pos] = row;
+            by_col_col[pos] = col;
+            by_col_val[pos] = val;
+        }
+    }
+
+    // Stable scatter by row keeps columns ascending within each row
+    csr = csr_create(rows, cols, nnz);
+
+    for(long k = 0; k < nnz; k++)
+        csr->row_ptr[by_col_row[k] + 1]++;
+
+    for(int i = 0; i < rows; i++)
+        csr->row_ptr[i + 1] += csr->row_ptr[i];
+
+    free(next);
+    next = malloc((rows > 0 ? rows : 1) * sizeof(long));
+    for(int i = 0; i < rows; i++)
+        next[i] = csr->row_ptr[i];
+
+    for(long k = 0; k < nnz; k++) {
+        long pos = next[by_col_row[k]]++;
+        csr->col_idx[pos] = by_col_col[k];
+        csr->vals[pos] = by_col_val[k];
+    }
+
+    free(next);
+    free(col_ptr);
+    free(by_col_row);
+    free(by_col_col);
+    free(by_col_val);
+
+    return csr;
+}
+
+
+// Build map holding the entries of csr, which are unique so none is looked up
+HashMap* csr_to_map(Csr* csr) {
+    HashMap* map = map_create();
+
+    for(int i = 0; i < csr->rows; i++) {
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++)
+            map_append(map, i, csr->col_idx[k], csr->vals[k]);
+    }
+
+    return map;
+}
+
+
+// First row of task, tasks split rows so each holds about the same number of entries
+int task_first_row(Csr* csr, int task, int num_tasks) {
+    long target = csr->nnz * task / num_tasks;
+    int lo = 0, hi = csr->rows;
+
+    while(lo < hi) { // First row starting at or after target
+        int mid = lo + (hi - lo) / 2;
+
+        if(csr->row_ptr[mid] < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return task == num_tasks ? csr->rows : lo;
+}
+
+
+void count_task_columns(int task, void* ctx) {
+    TransposeTasks* tasks = ctx;
+    Csr* csr = tasks->csr;
+    long* count = tasks->next + (long)task * csr->cols;
+    int end = task_first_row(csr, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(csr, task, tasks->num_tasks); i < end; i++) {
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++)
+            count[csr->col_idx[k]]++;
+    }
+}
+
+
+void scatter_task_columns(int task, void* ctx) {
+    TransposeTasks* tasks = ctx;
+    Csr* csr = tasks->csr;
+    long* next = tasks->next + (long)task * csr->cols;
+    int end = task_first_row(csr, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(csr, task, tasks->num_tasks); i < end; i++) {
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++) {
+            long pos = next[csr->col_idx[k]]++;
+            tasks->result->col_idx[pos] = i;
+            tasks->result->vals[pos] = csr->vals[k];
+        }
+    }
+}
+
+
+// Transpose by counting entries per column then scattering them, rows of the result are the
+// columns of csr with ascending columns, tasks count and scatter their own rows concurrently
+Csr* csr_transpose(Csr* csr) {
+    Csr* result = csr_create(csr->cols, csr->rows, csr->nnz);
+
+    // Every task keeps a count per column, so only split while counts stay small next to nnz
+    int num_tasks = 1 + csr->nnz / TASK_NNZ;
+    if(num_tasks > pool_size())
+        num_tasks = pool_size();
+    while(num_tasks > 1 && (long)num_tasks * csr->cols > csr->nnz)
+        num_tasks--;
+
+    TransposeTasks tasks = {csr, result, num_tasks, calloc((long)num_tasks * csr->cols + 1, sizeof(long))};
+    if(!tasks.next) {
+        fprintf(stderr, "Memory allocation failed for Csr\n");
+        exit(1);
+    }
+
+    pool_parallel_for(num_tasks, count_task_columns, &tasks);
+
+    // Column j of task t follows the same column of earlier tasks, keeping rows ascending
+    long pos = 0;
+    for(int j = 0; j < csr->cols; j++) {
+        result->row_ptr[j] = pos;
+
+        for(int t = 0; t < num_tasks; t++) {
+            long count = tasks.next[(long)t * csr->cols + j];
+            tasks.next[(long)t * csr->cols + j] = pos;
+            pos += count;
+        }
+    }
+    result->row_ptr[csr->cols] = pos;
+
+    pool_parallel_for(num_tasks, scatter_task_columns, &tasks);
+    free(tasks.next);
+
+    return result;
+}
+
+
+// Merge row i of a and sign times row i of b, dropping cells that cancel, entries are written to
+// cols and vals unless they are NULL, returns number of entries
+long merge_row(Csr* a, Csr* b, int i, double sign, int* cols, double* vals) {
+    long ka = a->row_ptr[i], end_a = a->row_ptr[i + 1];
+    long kb = b->row_ptr[i], end_b = b->row_ptr[i + 1];
+    long len = 0;
+
+    while(ka < end_a || kb < end_b) {
+        int col;
+        double val;
+
+        if(kb >= end_b || (ka < end_a && a->col_idx[ka] < b->col_idx[kb])) {
+            col = a->col_idx[ka];
+            val = a->vals[ka++];
+        } else if(ka >= end_a || b->col_idx[kb] < a->col_idx[ka]) {
+            col = b->col_idx[kb];
+            val = sign * b->vals[kb++];
+        } else {
+            col = a->col_idx[ka];
+            val = a->vals[ka++] + sign * b->vals[kb++];
+        }
+
+        if(val == 0)
+            continue;
+
+        if(cols) {
+            cols[len] = col;
+            vals[len] = val;
+        }
+        len++;
+    }
+
+    return len;
+}
+
+
+void merge_task_rows(int task, void* ctx) {
+    MergeTasks* tasks = ctx;
+    int end = task_first_row(tasks->a, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(tasks->a, task, tasks->num_tasks); i < end; i++) {
+        if(!tasks->result) {
+            tasks->row_ptr[i + 1] = merge_row(tasks->a, tasks->b, i, tasks->sign, NULL, NULL);
+        } else {
+            long start = tasks->row_ptr[i];
+            merge_row(tasks->a, tasks->b, i, tasks->sign, tasks->result->col_idx + start, tasks->result->vals + start);
+        }
+    }
+}
+
+
+// a plus sign times b of the same size, a first pass counts each merged row so the second writes
+// the result into exactly sized arrays, rows are merged by concurrent tasks in both passes
+Csr* csr_add(Csr* a, Csr* b, double sign) {
+    int num_tasks = 1 + (a->nnz + b->nnz) / TASK_NNZ;
+    if(num_tasks > pool_size())
+        num_tasks = pool_size();
+
+    MergeTasks tasks = {a, b, sign, NULL, calloc(a->rows + 1, sizeof(long)), num_tasks};
+    if(!tasks.row_ptr) {
+        fprintf(stderr, "Memory allocation failed for Csr\n");
+        exit(1);
+    }
+
+    pool_parallel_for(num_tasks, merge_task_rows, &tasks);
+
+    for(int i = 0; i < a->rows; i++)
+        tasks.row_ptr[i + 1] += tasks.row_ptr[i];
+
+    tasks.result = csr_create(a->rows, a->cols, tasks.row_ptr[a->rows]);
+    free(tasks.result->row_ptr);
+    tasks.result->row_ptr = tasks.row_ptr;
+
+    pool_parallel_for(num_tasks, merge_task_rows, &tasks);
+
+    return tasks.result;
+}
+
+
+void mult_vec_task(int task, void* ctx) {
+    MultVecTasks* tasks = ctx;
+    Csr* csr = tasks->csr;
+    int end = task_first_row(csr, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(csr, task, tasks->num_tasks); i < end; i++) {
+        double sum = 0;
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++)
+            sum += csr->vals[k] * tasks->x[csr->col_idx[k]];
+
+        tasks->y[i] = sum;
+    }
+}
+
+
+// Set y to csr times x, rows are split between concurrent tasks
+void csr_mult_vec(Csr* csr, const double* x, double* y) {
+    int num_tasks = 1 + csr->nnz / TASK_NNZ;
+    if(num_tasks > pool_size())
+        num_tasks = pool_size();
+
+    MultVecTasks tasks = {csr, x, y, 1, num_tasks};
+    pool_parallel_for(num_tasks, mult_vec_task, &tasks);
+}
+
+
+void mult_block_task(int task, void* ctx) {
+    MultVecTasks* tasks = ctx;
+    Csr* csr = tasks->csr;
+    int width = tasks->width;
+    int end = task_first_row(csr, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(csr, task, tasks->num_tasks); i < end; i++) {
+        double* y = tasks->y + (long)i * width;
+        memset(y, 0, width * sizeof(double));
+
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++) {
+            double val = csr->vals[k];
+            const double* x = tasks->x + (long)csr->col_idx[k] * width;
+
+            for(int c = 0; c < width; c++)
+                y[c] += val * x[c];
+        }
+    }
+}
+
+
+// Set y to csr times x, both row-major with width columns. Each stored value is read once for all
+// columns, rows are split between concurrent tasks
+void csr_mult_block(Csr* csr, const double* x, int width, double* y) {
+    int num_tasks = 1 + csr->nnz * width / TASK_NNZ;
+    if(num_tasks > pool_size())
+        num_tasks = pool_size();
+
+    MultVecTasks tasks = {csr, x, y, width, num_tasks};
+    pool_parallel_for(num_tasks, mult_block_task, &tasks);
+}
+
+
+void kron_task_rows(int task, void* ctx) {
+    KronTasks* tasks = ctx;
+    Csr* a = tasks->a;
+    Csr* b = tasks->b;
+    Csr* result = tasks->result;
+    int end = task_first_row(a, task + 1, tasks->num_tasks);
+
+    for(int i = task_first_row(a, task, tasks->num_tasks); i < end; i++) {
+        for(int r = 0; r < b->rows; r++) {
+            long pos = result->row_ptr[(long)i * b->rows + r];
+
+            // Blocks of a's row ascend and b's row ascends within each, so columns come out in order
+            for(long ka = a->row_ptr[i]; ka < a->row_ptr[i + 1]; ka++) {
+                int offset = a->col_idx[ka] * b->cols;
+                double val = a->vals[ka];
+
+                for(long kb = b->row_ptr[r]; kb < b->row_ptr[r + 1]; kb++) {
+                    result->col_idx[pos] = offset + b->col_idx[kb];
+                    result->vals[pos++] = val * b->vals[kb];
+                }
+            }
+        }
+    }
+}
+
+
+// Kronecker product of a and b, row i * b->rows + r holds row i of a times row r of b. Every row
+// length is known from the operands, so the result is allocated exactly and rows of a are expanded
+// by concurrent tasks
+Csr* csr_kron(Csr* a, Csr* b) {
+    Csr* result = csr_create(a->rows * b->rows, a->cols * b->cols, a->nnz * b->nnz);
+
+    for(int i = 0; i < a->rows; i++) {
+        long len_a = a->row_ptr[i + 1] - a->row_ptr[i];
+
+        for(int r = 0; r < b->rows; r++) {
+            long row = (long)i * b->rows + r;
+            result->row_ptr[row + 1] = result->row_ptr[row] + len_a * (b->row_ptr[r + 1] - b->row_ptr[r]);
+        }
+    }
+
+    int num_tasks = 1 + result->nnz / TASK_NNZ;
+    if(num_tasks > pool_size())
+        num_tasks = pool_size();
+
+    KronTasks tasks = {a, b, result, num_tasks};
+    pool_parallel_for(num_tasks, kron_task_rows, &tasks);
+
+    return result;
+}
+
+
+// Check if square csr equals its transpose, values may differ by rounding
+bool csr_is_symmetric(Csr* csr) {
+    if(csr->rows != csr->cols)
+        return false;
+
+    Csr* t = csr_transpose(csr);
+    bool symmetric = true;
+
+    for(int i = 0; i <= csr->rows && symmetric; i++)
+        symmetric = csr->row_ptr[i] == t->row_ptr[i];
+
+    for(long k = 0; k < csr->nnz && symmetric; k++) {
+        double diff = fabs(csr->vals[k] - t->vals[k]);
+        symmetric = csr->col_idx[k] == t->col_idx[k] && diff <= 1e-12 * fmax(fabs(csr->vals[k]), fabs(t->vals[k]));
+    }
+
+    csr_free(t);
+
+    return symmetric;
+}
+
+
+void csr_free(Csr* csr) {
+    if(!csr)
+        return;
+
+    free(csr->row_ptr);
+    free(csr->col_idx);
+    free(csr->vals);
+    free(csr);
+}
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../include/dense.h"
+
+
+int min_int(int a, int b) {
+    return a < b ? a : b;
+}
+
+
+// c += a * b for rows x inner a and inner x cols b, tiled so each block of b stays in cache
+void dense_mult(const double* a, const double* b, double* c, int rows, int inner, int cols) {
+    for(int kk = 0; kk < inner; kk += DENSE_BLOCK) {
+        int k_end = min_int(kk + DENSE_BLOCK, inner);
+
+        for(int jj = 0; jj < cols; jj += DENSE_BLOCK) {
+            int j_end = min_int(jj + DENSE_BLOCK, cols);
+
+            for(int i = 0; i < rows; i++) {
+                const double* a_row = a + (long)i * inner;
+                double* c_row = c + (long)i * cols;
+
+                for(int k = kk; k < k_end; k++) {
+                    double a_ik = a_row[k];
+                    if(a_ik == 0)
+                        continue;
+
+                    const double* b_row = b + (long)k * cols;
+                    for(int j = jj; j < j_end; j++)
+                        c_row[j] += a_ik * b_row[j];
+                }
+            }
+        }
+    }
+}
+
+
+// c += a * b for sparse a, adding rows of b scaled by each stored entry of a
+void csr_dense_mult(Csr* a, const double* b, double* c, int cols) {
+    for(int i = 0; i < a->rows; i++) {
+        double* c_row = c + (long)i * cols;
+
+        for(long e = a->row_ptr[i]; e < a->row_ptr[i + 1]; e++) {
+            const double* b_row = b + (long)a->col_idx[e] * cols;
+            double val = a->vals[e];
+
+            for(int j = 0; j < cols; j++)
+                c_row[j] += val * b_row[j];
+        }
+    }
+}
+
+
+// c += a * b for sparse b, scattering each row of b scaled by the matching cell of a
+void dense_csr_mult(const double* a, Csr* b, double* c, int rows) {
+    for(int i = 0; i < rows; i++) {
+        const double* a_row = a + (long)i * b->rows;
+        double* c_row = c + (long)i * b->cols;
+
+        for(int k = 0; k < b->rows; k++) {
+            double a_ik = a_row[k];
+            if(a_ik == 0)
+                continue;
+
+            for(long e = b->row_ptr[k]; e < b->row_ptr[k + 1]; e++)
+                c_row[b->col_idx[e]] += a_ik * b->vals[e];
+        }
+    }
+}
+
+
+// Write cols x rows transpose of a into t one tile at a time
+void dense_transpose(const double* a, double* t, int rows, int cols) {
+    for(int ii = 0; ii < rows; ii += DENSE_BLOCK) {
+        int i_end = min_int(ii + DENSE_BLOCK, rows);
+
+        for(int jj = 0; jj < cols; jj += DENSE_BLOCK) {
+            int j_end = min_int(jj + DENSE_BLOCK, cols);
+
+            for(int i = ii; i < i_end; i++) {
+                for(int j = jj; j < j_end; j++)
+                    t[(long)j * rows + i] = a[(long)i * cols + j];
+            }
+        }
+    }
+}
+
+
+void swap_dense_rows(double* a, int n, int row1, int row2) {
+    double* r1 = a + (long)row1 * n;
+    double* r2 = a + (long)row2 * n;
+
+    for(int j = 0; j < n; j++) {
+        double temp = r1[j];
+        r1[j] = r2[j];
+        r2[j] = temp;
+    }
+}
+
+
+// Determinant by LU decomposition with partial pivoting, overwrites a with U
+double dense_determinant(double* a, int n) {
+    double det = 1;
+
+    for(int k = 0; k < n; k++) {
+        // Partial pivoting: find pivot row r in column k starting at k
+        int r = k;
+        double max_val = fabs(a[(long)k * n + k]);
+        for(int i = k + 1; i < n; i++) {
+            double val = fabs(a[(long)i * n + k]);
+            if(val > max_val) {
+                max_val = val;
+                r = i;
+            }
+        }
+
+        if(r != k) {
+            swap_dense_rows(a, n, k, r);
+            det = -det;
+        }
+
+        double* pivot_row = a + (long)k * n;
+        double pivot = pivot_row[k];
+        if(fabs(pivot) < 1e-15) // Singular matrix
+            return 0.0;
+
+        det *= pivot;
+
+        // Elimination below pivot
+        for(int i = k + 1; i < n; i++) {
+            double* row = a + (long)i * n;
+            double multiplier = row[k] / pivot;
+            if(multiplier == 0)
+                continue;
+
+            for(int j = k; j < n; j++)
+                row[j] -= multiplier * pivot_row[j];
+        }
+    }
+
+    return det;
+}
+
+
+// Gauss-Jordan elimination of a into the identity, applying the same row operations to inv.
+// inv must hold the identity, returns false if a is singular
+bool dense_inverse(double* a, double* inv, int n) {
+    for(int i = 0; i < n; i++) {
+        double* a_row = a + (long)i * n;
+        double* inv_row = inv + (long)i * n;
+        double pivot = a_row[i];
+
+        if(pivot == 0.0) { // Swap with the first lower row holding a non-zero in this column
+            int swap_row = -1;
+            for(int k = i + 1; k < n; k++) {
+                if(a[(long)k * n + i] != 0.0) {
+                    swap_row = k;
+                    break;
+                }
+            }
+
+            if(swap_row == -1)
+                return false;
+
+            swap_dense_rows(a, n, i, swap_row);
+            swap_dense_rows(inv, n, i, swap_row);
+            pivot = a_row[i];
+        }
+
+        // Normalize pivot row
+        for(int j = 0; j < n; j++) {
+            a_row[j] /= pivot;
+            inv_row[j] /= pivot;
+        }
+
+        // Eliminate other rows
+        for(int k = 0; k < n; k++) {
+            if(k == i)
+                continue;
+
+            double* a_k = a + (long)k * n;
+            double* inv_k = inv + (long)k * n;
+            double factor = a_k[i];
+            if(factor == 0)
+                continue;
+
+            for(int j = 0; j < n; j++) {
+                a_k[j] -= factor * a_row[j];
+                inv_k[j] -= factor * inv_row[j];
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,714 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <complex.h>
+#include "../include/eigen.h"
+#include "../include/solver.h"
+#include "../include/profile.h"
+
+#define EIGEN_MIN_BASIS 40
+#define EIGEN_JACOBI_SWEEPS 50
+#define EIGEN_QR_ITER 30        // QR iterations allowed per eigenvalue of the projected matrix
+#define EIGEN_ROW_BLOCK 512     // Basis rows combined at a time on restart
+
+// Restarted Krylov basis of a Lanczos or Arnoldi run
+typedef struct {
+    System sys;
+    int n;
+    int m;                  // Basis size at which the run restarts
+    EigenWhich which;
+    bool symmetric;         // Projected matrix is symmetric, so Ritz values are real
+    int seed;               // Start vectors drawn so far
+    double* v;              // Basis columns v_0..v_m, each n long
+    double* h;              // (m + 1) x m projected matrix, row-major, A V_m = V_{m+1} H
+    double* coef;           // Projections of the vector being orthogonalized
+    double complex* theta;  // Ritz values, wanted first
+    double complex* y;      // Eigenvectors of the projected matrix, y[i * m + j] is entry i of vector j
+    double* residual;       // ||A x - theta x|| of each Ritz pair
+} Krylov;
+
+
+bool eigen_which(const char* name, EigenWhich* which) {
+    if(!strcmp(name, "largest"))
+        *which = EIGEN_LARGEST;
+    else if(!strcmp(name, "smallest"))
+        *which = EIGEN_SMALLEST;
+    else
+        return false;
+
+    return true;
+}
+
+
+void* eigen_alloc(size_t bytes) {
+    void* ptr = calloc(1, bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for eigensolver\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+// Pseudo-random entry in [-1, 1) of a start vector, fixed so repeated runs agree
+double start_entry(long i) {
+    unsigned long x = (unsigned long)i * 0x9E3779B97F4A7C15ul + 0x632BE59BD9B4E019ul;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ul;
+    x ^= x >> 27;
+
+    return (x >> 11) * (1.0 / 4503599627370496.0) - 1;
+}
+
+
+// Eigenvalues and orthonormal eigenvectors of symmetric m x m s by cyclic Jacobi rotations,
+// s is overwritten. vecs[i * m + j] is entry i of the vector of vals[j]
+void jacobi_eigen(double* s, int m, double* vals, double* vecs) {
+    double total = 0;
+    for(int i = 0; i < m * m; i++) {
+        vecs[i] = i % (m + 1) == 0;
+        total += s[i] * s[i];
+    }
+
+    for(int sweep = 0; sweep < EIGEN_JACOBI_SWEEPS; sweep++) {
+        double off = 0;
+        for(int p = 0; p < m; p++) {
+            for(int q = p + 1; q < m; q++)
+                off += s[p * m + q] * s[p * m + q];
+        }
+
+        if(off <= DBL_EPSILON * DBL_EPSILON * total)
+            break;
+
+        for(int p = 0; p < m; p++) {
+            for(int q = p + 1; q < m; q++) {
+                double apq = s[p * m + q];
+                if(apq == 0)
+                    continue;
+
+                // Rotation in the (p, q) plane that zeroes s[p][q]
+                double phi = (s[q * m + q] - s[p * m + p]) / (2 * apq);
+                double t = (phi >= 0 ? 1 : -1) / (fabs(phi) + sqrt(phi * phi + 1));
+                double c = 1 / sqrt(t * t + 1), sn = t * c;
+
+                for(int r = 0; r < m; r++) {
+                    double rp = s[r * m + p], rq = s[r * m + q];
+                    s[r * m + p] = c * rp - sn * rq;
+                    s[r * m + q] = sn * rp + c * rq;
+                }
+
+                for(int r = 0; r < m; r++) {
+                    double pr = s[p * m + r], qr = s[q * m + r];
+                    s[p * m + r] = c * pr - sn * qr;
+                    s[q * m + r] = sn * pr + c * qr;
+                }
+
+                for(int r = 0; r < m; r++) {
+                    double rp = vecs[r * m + p], rq = vecs[r * m + q];
+                    vecs[r * m + p] = c * rp - sn * rq;
+                    vecs[r * m + q] = sn * rp + c * rq;
+                }
+            }
+        }
+    }
+
+    for(int i = 0; i < m; i++)
+        vals[i] = s[i * m + i];
+}
+
+
+// Reduce m x m a to upper Hessenberg form Q^T a Q by Householder reflections, q receives Q
+void hessenberg_reduce(double* a, int m, double* q) {
+    double* v = eigen_alloc(m * sizeof(double));
+
+    for(int i = 0; i < m * m; i++)
+        q[i] = i % (m + 1) == 0;
+
+    for(int k = 0; k + 2 < m; k++) {
+        int len = m - k - 1;
+        double alpha = 0;
+        for(int i = 0; i < len; i++) {
+            v[i] = a[(k + 1 + i) * m + k];
+            alpha += v[i] * v[i];
+        }
+
+        alpha = v[0] > 0 ? -sqrt(alpha) : sqrt(alpha);
+        v[0] -= alpha;
+
+        double vv = 0;
+        for(int i = 0; i < len; i++)
+            vv += v[i] * v[i];
+        if(vv == 0)
+            continue;
+
+        // Reflect rows k + 1.. of a, then columns k + 1.. of a and q
+        for(int j = 0; j < m; j++) {
+            double dot = 0;
+            for(int i = 0; i < len; i++)
+                dot += v[i] * a[(k + 1 + i) * m + j];
+            for(int i = 0; i < len; i++)
+                a[(k + 1 + i) * m + j] -= 2 * dot / vv * v[i];
+        }
+
+        for(int r = 0; r < m; r++) {
+            double dot_a = 0, dot_q = 0;
+            for(int i = 0; i < len; i++) {
+                dot_a += a[r * m + k + 1 + i] * v[i];
+                dot_q += q[r * m + k + 1 + i] * v[i];
+            }
+            for(int i = 0; i < len; i++) {
+                a[r * m + k + 1 + i] -= 2 * dot_a / vv * v[i];
+                q[r * m + k + 1 + i] -= 2 * dot_q / vv * v[i];
+            }
+        }
+
+        for(int i = k + 2; i < m; i++)
+            a[i * m + k] = 0;
+    }
+
+    free(v);
+}
+
+
+// Eigenvalues and unit eigenvectors of general m x m a, overwritten. Reduces a to Hessenberg form,
+// then to complex Schur form T by shifted QR, and solves T y = lambda y. Returns false if the QR
+// iteration does not converge
+bool general_eigen(double* a, int m, double complex* vals, double complex* vecs) {
+    double* q = eigen_alloc(m * m * sizeof(double));
+    double complex* t = eigen_alloc(m * m * sizeof(double complex));
+    double complex* z = eigen_alloc(m * m * sizeof(double complex));
+    double complex* cosines = eigen_alloc(m * sizeof(double complex));
+    double complex* sines = eigen_alloc(m * sizeof(double complex));
+
+    hessenberg_reduce(a, m, q);
+
+    double norm = 0;
+    for(int i = 0; i < m * m; i++) {
+        t[i] = a[i];
+        z[i] = q[i];
+        norm = fmax(norm, fabs(a[i]));
+    }
+
+    int hi = m - 1, iter = 0, total = 0;
+    bool converged = true;
+
+    while(hi > 0) {
+        // Deflate at the lowest negligible subdiagonal entry
+        int lo = hi;
+        while(lo > 0) {
+            double scale = cabs(t[(lo - 1) * m + lo - 1]) + cabs(t[lo * m + lo]);
+            if(cabs(t[lo * m + lo - 1]) <= DBL_EPSILON * (scale > 0 ? scale : norm)) {
+                t[lo * m + lo - 1] = 0;
+                break;
+            }
+            lo--;
+        }
+
+        if(lo == hi) {
+            hi--;
+            iter = 0;
+            continue;
+        }
+
+        if(++total > EIGEN_QR_ITER * m) {
+            converged = false;
+            break;
+        }
+
+        // Wilkinson shift, the eigenvalue of the trailing 2 x 2 block nearer its last entry
+        double complex p = t[(hi - 1) * m + hi - 1], b = t[(hi - 1) * m + hi];
+        double complex c = t[hi * m + hi - 1], d = t[hi * m + hi];
+        double complex half = (p - d) / 2, disc = csqrt(half * half + b * c);
+        double complex large = cabs(half + disc) > cabs(half - disc) ? half + disc : half - disc;
+        double complex mu = large != 0 ? d - b * c / large : d;
+        if(++iter % 10 == 0) // Exceptional shift breaks cycles
+            mu = d + 0.75 * cabs(c);
+
+        // QR step on rows and columns lo..hi of T - mu I by Givens rotations, then RQ
+        for(int k = lo; k <= hi; k++)
+            t[k * m + k] -= mu;
+
+        for(int k = lo; k < hi; k++) {
+            double complex x = t[k * m + k], y = t[(k + 1) * m + k];
+            double r = hypot(cabs(x), cabs(y));
+            cosines[k] = r > 0 ? x / r : 1;
+            sines[k] = r > 0 ? y / r : 0;
+
+            for(int j = k; j < m; j++) {
+                double complex t1 = t[k * m + j], t2 = t[(k + 1) * m + j];
+                t[k * m + j] = conj(cosines[k]) * t1 + conj(sines[k]) * t2;
+                t[(k + 1) * m + j] = -sines[k] * t1 + cosines[k] * t2;
+            }
+        }
+
+        for(int k = lo; k < hi; k++) {
+            double complex g = cosines[k], sn = sines[k];
+
+            for(int r = 0; r <= hi; r++) {
+                double complex t1 = t[r * m + k], t2 = t[r * m + k + 1];
+                t[r * m + k] = t1 * g + t2 * sn;
+                t[r * m + k + 1] = -t1 * conj(sn) + t2 * conj(g);
+            }
+
+            for(int r = 0; r < m; r++) {
+                double complex z1 = z[r * m + k], z2 = z[r * m + k + 1];
+                z[r * m + k] = z1 * g + z2 * sn;
+                z[r * m + k + 1] = -z1 * conj(sn) + z2 * conj(g);
+            }
+        }
+
+        for(int k = lo; k <= hi; k++)
+            t[k * m + k] += mu;
+    }
+
+    if(converged) {
+        // Eigenvectors of T by back substitution, mapped back through Z
+        double complex* w = cosines;
+
+        for(int i = 0; i < m; i++)
+            vals[i] = t[i * m + i];
+
+        for(int j = 0; j < m; j++) {
+            for(int i = 0; i < m; i++)
+                w[i] = i == j;
+
+            for(int i = j - 1; i >= 0; i--) {
+                double complex sum = 0;
+                for(int c = i + 1; c <= j; c++)
+                    sum += t[i * m + c] * w[c];
+
+                double complex diff = t[i * m + i] - vals[j];
+                if(cabs(diff) < DBL_EPSILON * norm) // Repeated eigenvalue, perturb to stay finite
+                    diff = DBL_EPSILON * norm;
+                w[i] = -sum / diff;
+            }
+
+            double length = 0;
+            for(int r = 0; r < m; r++) {
+                double complex sum = 0;
+                for(int c = 0; c <= j; c++)
+                    sum += z[r * m + c] * w[c];
+                vecs[r * m + j] = sum;
+                length += creal(sum * conj(sum));
+            }
+
+            length = sqrt(length);
+            for(int r = 0; r < m; r++)
+                vecs[r * m + j] /= length;
+        }
+    }
+
+    free(q);
+    free(t);
+    free(z);
+    free(cosines);
+    free(sines);
+
+    return converged;
+}
+
+
+// Make w orthogonal to basis columns 0..count-1 by two passes of classical Gram-Schmidt, adding the
+// projections to coef unless it is NULL. Returns the norm left
+double orthogonalize(Krylov* kr, int count, double* w, double* coef) {
+    int n = kr->n;
+    double* dots = kr->coef + kr->m + 1;
+
+    for(int pass = 0; pass < 2; pass++) {
+        for(int i = 0; i < count; i++)
+            dots[i] = vec_dot(kr->v + (long)i * n, w, n);
+
+        for(int i = 0; i < count; i++) {
+            vec_axpy(w, -dots[i], kr->v + (long)i * n, n);
+            if(coef)
+                coef[i] += dots[i];
+        }
+    }
+
+    return sqrt(vec_dot(w, w, n));
+}
+
+
+// Extend A V_j = V_{j+1} H_j from column start until the basis has m + 1 vectors
+void krylov_expand(Krylov* kr, int start) {
+    int n = kr->n, m = kr->m;
+
+    for(int j = start; j < m; j++) {
+        double* w = kr->v + (long)(j + 1) * n;
+        system_apply(&kr->sys, kr->v + (long)j * n, w);
+
+        double norm = sqrt(vec_dot(w, w, n));
+        memset(kr->coef, 0, (j + 1) * sizeof(double));
+        double beta = orthogonalize(kr, j + 1, w, kr->coef);
+
+        for(int i = 0; i <= j; i++)
+            kr->h[i * m + j] = kr->coef[i];
+
+        if(beta > 1e-12 * norm && beta > 0) {
+            kr->h[(j + 1) * m + j] = beta;
+        } else { // Invariant subspace found, continue in a new direction not coupled to it
+            kr->h[(j + 1) * m + j] = 0;
+
+            if(j + 1 == n) { // Basis spans the whole space
+                memset(w, 0, n * sizeof(double));
+                continue;
+            }
+
+            kr->seed++;
+            for(int i = 0; i < n; i++)
+                w[i] = start_entry((long)kr->seed * n + i);
+            beta = orthogonalize(kr, j + 1, w, NULL);
+        }
+
+        for(int i = 0; i < n; i++)
+            w[i] /= beta;
+    }
+}
+
+
+// Check if Ritz value a is wanted before b, a conjugate pair keeps the positive imaginary part first
+bool ritz_before(double complex a, double complex b, EigenWhich which) {
+    if(creal(a) != creal(b))
+        return which == EIGEN_LARGEST ? creal(a) > creal(b) : creal(a) < creal(b);
+
+    return cimag(a) > cimag(b);
+}
+
+
+// Eigenpairs of the projected matrix ordered wanted first, and the residual of each as an eigenpair
+// of A. Returns false if they cannot be computed
+bool krylov_ritz(Krylov* kr) {
+    int m = kr->m;
+    double* s = eigen_alloc(m * m * sizeof(double));
+    double complex* vals = eigen_alloc(m * sizeof(double complex));
+    double complex* vecs = eigen_alloc(m * m * sizeof(double complex));
+    bool found = true;
+
+    if(kr->symmetric) {
+        double* real_vals = eigen_alloc(m * sizeof(double));
+        double* real_vecs = eigen_alloc(m * m * sizeof(double));
+
+        for(int i = 0; i < m; i++) {
+            for(int j = 0; j < m; j++)
+                s[i * m + j] = (kr->h[i * m + j] + kr->h[j * m + i]) / 2;
+        }
+
+        jacobi_eigen(s, m, real_vals, real_vecs);
+
+        for(int i = 0; i < m; i++)
+            vals[i] = real_vals[i];
+        for(int i = 0; i < m * m; i++)
+            vecs[i] = real_vecs[i];
+
+        free(real_vals);
+        free(real_vecs);
+    } else {
+        double norm = 0;
+        for(int i = 0; i < m * m; i++) {
+            s[i] = kr->h[i];
+            norm = fmax(norm, fabs(s[i]));
+        }
+
+        found = general_eigen(s, m, vals, vecs);
+
+        // Values of a real matrix are real or conjugate pairs, remove rounding that breaks this
+        for(int j = 0; found && j < m; j++) {
+            if(fabs(cimag(vals[j])) <= 1e-10 * norm) {
+                // Rotate the largest entry onto the real axis, the vector is then real
+                int big = 0;
+                for(int i = 1; i < m; i++) {
+                    if(cabs(vecs[i * m + j]) > cabs(vecs[big * m + j]))
+                        big = i;
+                }
+
+                double complex phase = conj(vecs[big * m + j]) / cabs(vecs[big * m + j]);
+                double length = 0;
+                for(int i = 0; i < m; i++) {
+                    vecs[i * m + j] = creal(vecs[i * m + j] * phase);
+                    length += creal(vecs[i * m + j]) * creal(vecs[i * m + j]);
+                }
+
+                for(int i = 0; i < m; i++)
+                    vecs[i * m + j] /= sqrt(length);
+                vals[j] = creal(vals[j]);
+            } else if(cimag(vals[j]) > 0) {
+                int pair = -1;
+                for(int i = 0; i < m; i++) {
+                    if(cimag(vals[i]) < -1e-10 * norm && (pair < 0 || cabs(vals[i] - conj(vals[j])) < cabs(vals[pair] - conj(vals[j]))))
+                        pair = i;
+                }
+
+                if(pair >= 0) {
+                    vals[pair] = conj(vals[j]);
+                    for(int i = 0; i < m; i++)
+                        vecs[i * m + pair] = conj(vecs[i * m + j]);
+                }
+            }
+        }
+    }
+
+    if(found) {
+        // Insertion sort of the values, m is small
+        int* order = eigen_alloc(m * sizeof(int));
+        for(int j = 0; j < m; j++) {
+            int i = j;
+            while(i > 0 && ritz_before(vals[j], vals[order[i - 1]], kr->which)) {
+                order[i] = order[i - 1];
+                i--;
+            }
+            order[i] = j;
+        }
+
+        double beta = fabs(kr->h[m * m + m - 1]);
+
+        for(int j = 0; j < m; j++) {
+            kr->theta[j] = vals[order[j]];
+            for(int i = 0; i < m; i++)
+                kr->y[i * m + j] = vecs[i * m + order[j]];
+
+            kr->residual[j] = beta * cabs(kr->y[(m - 1) * m + j]);
+        }
+
+        free(order);
+    }
+
+    free(s);
+    free(vals);
+    free(vecs);
+
+    return found;
+}
+
+
+// Orthonormal real basis, as m long columns of yb, of the Ritz vectors of the first p Ritz values.
+// A conjugate pair contributes the real and imaginary parts of one vector. Returns the column count
+int ritz_basis(Krylov* kr, int p, double* yb) {
+    int m = kr->m, count = 0;
+
+    for(int j = 0; j < p; j++) {
+        double im = cimag(kr->theta[j]);
+        if(im < 0) // Conjugate of the previous value, spans the same plane
+            continue;
+
+        for(int part = 0; part < (im > 0 ? 2 : 1); part++) {
+            double* col = yb + count * m;
+            for(int i = 0; i < m; i++)
+                col[i] = part ? cimag(kr->y[i * m + j]) : creal(kr->y[i * m + j]);
+
+            // Two passes of modified Gram-Schmidt against the columns so far
+            for(int pass = 0; pass < 2; pass++) {
+                for(int c = 0; c < count; c++)
+                    vec_axpy(col, -vec_dot(yb + c * m, col, m), yb + c * m, m);
+            }
+
+            double norm = sqrt(vec_dot(col, col, m));
+            if(norm > 1e-8) {
+                for(int i = 0; i < m; i++)
+                    col[i] /= norm;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+// Thick restart keeping the Ritz vectors of the first p Ritz values, followed by the last basis
+// vector, so A V_p = V_{p+1} H_p holds again. Equivalent to implicit restarting with the unwanted
+// Ritz values as shifts. Returns the new basis size
+int krylov_restart(Krylov* kr, int p) {
+    int n = kr->n, m = kr->m;
+    double* yb = eigen_alloc(m * p * sizeof(double));
+    int count = ritz_basis(kr, p, yb);
+
+    // New basis V_m Y, a block of rows at a time so the old basis is read once
+    double* block = eigen_alloc(EIGEN_ROW_BLOCK * count * sizeof(double));
+
+    for(int r0 = 0; r0 < n; r0 += EIGEN_ROW_BLOCK) {
+        int len = n - r0 < EIGEN_ROW_BLOCK ? n - r0 : EIGEN_ROW_BLOCK;
+        memset(block, 0, EIGEN_ROW_BLOCK * count * sizeof(double));
+
+        for(int c = 0; c < count; c++) {
+            for(int i = 0; i < m; i++) {
+                if(yb[c * m + i] != 0)
+                    vec_axpy(block + c * EIGEN_ROW_BLOCK, yb[c * m + i], kr->v + (long)i * n + r0, len);
+            }
+        }
+
+        for(int c = 0; c < count; c++)
+            memcpy(kr->v + (long)c * n + r0, block + c * EIGEN_ROW_BLOCK, len * sizeof(double));
+    }
+
+    memmove(kr->v + (long)count * n, kr->v + (long)m * n, n * sizeof(double));
+
+    // Projected matrix Y^T H Y, with the coupling to the kept last vector in row count
+    double* hy = eigen_alloc(m * count * sizeof(double));
+    for(int i = 0; i < m; i++) {
+        for(int c = 0; c < count; c++)
+            hy[i * count + c] = vec_dot(kr->h + i * m, yb + c * m, m);
+    }
+
+    double beta = kr->h[m * m + m - 1];
+    memset(kr->h, 0, (m + 1) * m * sizeof(double));
+
+    for(int r = 0; r < count; r++) {
+        for(int c = 0; c < count; c++) {
+            double sum = 0;
+            for(int i = 0; i < m; i++)
+                sum += yb[r * m + i] * hy[i * count + c];
+            kr->h[r * m + c] = sum;
+        }
+    }
+
+    for(int c = 0; c < count; c++)
+        kr->h[count * m + c] = beta * yb[c * m + m - 1];
+
+    free(yb);
+    free(block);
+    free(hy);
+
+    return count;
+}
+
+
+// Ritz vectors of the first k Ritz values as the columns of an n x k matrix. A conjugate pair is
+// stored as the real and then the imaginary part of the vector of its first value
+Matrix* ritz_vectors(Krylov* kr, int k) {
+    int n = kr->n, m = kr->m;
+    double* cells = eigen_alloc((long)n * k * sizeof(double));
+    double* col = eigen_alloc(n * sizeof(double));
+
+    for(int j = 0; j < k; j++) {
+        bool complex_pair = cimag(kr->theta[j]) > 0;
+        int parts = complex_pair && j + 1 < k ? 2 : 1;
+
+        for(int part = 0; part < parts; part++) {
+            memset(col, 0, n * sizeof(double));
+            for(int i = 0; i < m; i++) {
+                double complex yi = kr->y[i * m + j];
+                vec_axpy(col, part ? cimag(yi) : creal(yi), kr->v + (long)i * n, n);
+            }
+
+            for(int r = 0; r < n; r++)
+                cells[(long)r * k + j + part] = col[r];
+        }
+
+        if(complex_pair)
+            j++;
+    }
+
+    Matrix* vectors = matrix_from_cells(cells, n, k);
+    free(cells);
+    free(col);
+
+    return vectors;
+}
+
+
+// Eigenvalues of square a with the k largest or smallest real parts, by restarted Lanczos if a is
+// symmetric and Arnoldi otherwise. values is k x 1, or k x 2 with imaginary parts if any is
+// complex. vectors, if not NULL, receives the eigenvectors as columns. Returns false if a is not
+// square, k is out of range or the projected eigenproblem fails
+bool eigen_solve(Matrix* a, int k, EigenWhich which, Matrix** values, Matrix** vectors, EigenStats* stats) {
+    if(a->rows != a->cols || k < 1 || k > a->rows)
+        return false;
+
+    Csr* csr = matrix_csr(a);
+    if(!csr)
+        return false;
+
+    PROFILE_BEGIN(span);
+    int n = a->rows;
+    int m = 2 * k + 1 > EIGEN_MIN_BASIS ? 2 * k + 1 : EIGEN_MIN_BASIS;
+    if(m > n)
+        m = n;
+
+    Krylov kr = {
+        {csr, a->scalar_val, n, NULL}, n, m, which, csr_is_symmetric(csr), 0,
+        eigen_alloc((long)(m + 1) * n * sizeof(double)), eigen_alloc((m + 1) * m * sizeof(double)),
+        eigen_alloc(2 * (m + 1) * sizeof(double)), eigen_alloc(m * sizeof(double complex)),
+        eigen_alloc(m * m * sizeof(double complex)), eigen_alloc(m * sizeof(double))
+    };
+
+    stats->restarts = 0;
+    stats->converged = 0;
+    stats->symmetric = kr.symmetric;
+
+    double norm = 0;
+    for(int i = 0; i < n; i++) {
+        kr.v[i] = start_entry(i);
+        norm += kr.v[i] * kr.v[i];
+    }
+    for(int i = 0; i < n; i++)
+        kr.v[i] /= sqrt(norm);
+
+    double floor = pow(DBL_EPSILON, 2.0 / 3);
+    int p = 0;
+    bool found = true;
+
+    while(found) {
+        krylov_expand(&kr, p);
+        if(!(found = krylov_ritz(&kr)))
+            break;
+
+        int wanted = k < m && cimag(kr.theta[k - 1]) > 0 ? k + 1 : k; // Keep a conjugate pair whole
+        int done = 0;
+
+        stats->converged = 0;
+        for(int j = 0; j < wanted; j++) {
+            if(kr.residual[j] <= EIGEN_TOL * fmax(cabs(kr.theta[j]), floor)) {
+                done++;
+                if(j < k)
+                    stats->converged++;
+            }
+        }
+
+        if(done == wanted || stats->restarts == EIGEN_MAX_RESTARTS || m == n)
+            break;
+
+        // Keep the wanted vectors and a third of the rest, again without splitting a pair
+        p = wanted + (m - wanted) / 3;
+        if(p > m - 1)
+            p = m - 1;
+        if(cimag(kr.theta[p - 1]) > 0)
+            p = p + 1 < m ? p + 1 : p - 1;
+
+        p = krylov_restart(&kr, p);
+        stats->restarts++;
+    }
+
+    if(found) {
+        bool complex_values = false;
+        for(int j = 0; j < k; j++)
+            complex_values |= cimag(kr.theta[j]) != 0;
+
+        int cols = complex_values ? 2 : 1;
+        double* cells = eigen_alloc(k * cols * sizeof(double));
+        for(int j = 0; j < k; j++) {
+            cells[j * cols] = creal(kr.theta[j]);
+            if(complex_values)
+                cells[j * cols + 1] = cimag(kr.theta[j]);
+        }
+
+        *values = matrix_from_cells(cells, k, cols);
+        if(vectors)
+            *vectors = ritz_vectors(&kr, k);
+        free(cells);
+    }
+
+    PROFILE_END(PROF_EIGEN, span, csr->nnz, (long)k * (vectors ? n + 1 : 1));
+
+    csr_free(csr);
+    free(kr.v);
+    free(kr.h);
+    free(kr.coef);
+    free(kr.theta);
+    free(kr.y);
+    free(kr.residual);
+
+    return found;
+}
@@ -2,10 +2,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <math.h>
 #include <float.h>
 #include "../include/eval_expr.h"
 #include "../include/runtime_data.h"
+#include "../include/parse_expr.h"
+#include "../include/profile.h"
+#include "../include/norm.h"
 
 
 typedef struct {
@@ -14,6 +18,26 @@ typedef struct {
     bool err;
 } Operand;
 
+// Suppresses expression errors on the calling thread
+_Thread_local bool quiet_errors = false;
+
+
+void expr_set_quiet(bool quiet) {
+    quiet_errors = quiet;
+}
+
+
+// Report expression error to stream unless errors are suppressed on this thread
+void expr_error(FILE* stream, const char* format, ...) {
+    if(quiet_errors)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stream, format, args);
+    va_end(args);
+}
+
 Operand operand_create(Matrix* matrix, double val) {
     Operand op;
     op.matrix = matrix;
@@ -77,10 +101,21 @@ Token* convert_rpn(Token* tokens, int num_tokens, int* out_rpn_len) {
                 op_stack[++op_top] = tok;
                 break;
 
+            case TOKEN_FUNC: // Function applies once its closing parentheses is reached
             case TOKEN_LPAREN: // Add left parentheses to stack
                 op_stack[++op_top] = tok;
                 break;
 
+            case TOKEN_COMMA: // Finish previous argument
+                while (op_top >= 0 && op_stack[op_top]->type != TOKEN_LPAREN)
+                    output[output_pos++] = *op_stack[op_top--];
+
+                if(op_top < 1 || op_stack[op_top - 1]->type != TOKEN_FUNC) { // Comma outside function call
+                    expr_error(stderr, "Misplaced comma\n");
+                    return NULL;
+                }
+                break;
+
             case TOKEN_RPAREN: // Handle right parentheses]
                 // Find accompanying left parentheses
                 while (op_top >= 0 && op_stack[op_top]->type != TOKEN_LPAREN)
@@ -88,8 +123,14 @@ Token* convert_rpn(Token* tokens, int num_tokens, int* out_rpn_len) {
                 
                 if(op_top >= 0 && op_stack[op_top]->type == TOKEN_LPAREN) {
                     op_top--; // discard left parentheses
+
+                    if(op_top >= 0 && op_stack[op_top]->type == TOKEN_FUNC) { // Parentheses held arguments
+                        Token call = *op_stack[op_top--];
+                        call.type = TOKEN_BIN_OP;
+                        output[output_pos++] = call;
+                    }
                 } else { // Opening parentheses missing
-                    fprintf(stderr, "Mismatched parentheses\n");
+                    expr_error(stderr, "Mismatched parentheses\n");
                     return NULL;
                 }
                 break;
@@ -113,7 +154,7 @@ Token* convert_rpn(Token* tokens, int num_tokens, int* out_rpn_len) {
                     det_token.val = 0;
                     output[output_pos++] = det_token;
                 } else { // Missing left determinant
-                    fprintf(stderr, "Mismatched determinant delimiters\n");
+                    expr_error(stderr, "Mismatched determinant delimiters\n");
                     return NULL;
                 }
                 break;
@@ -124,8 +165,8 @@ Token* convert_rpn(Token* tokens, int num_tokens, int* out_rpn_len) {
     }
 
     while (op_top >= 0) {
-        if (op_stack[op_top]->type == TOKEN_LPAREN || op_stack[op_top]->type == TOKEN_RPAREN) {
-            fprintf(stderr, "Mismatched parentheses\n");
+        if (op_stack[op_top]->type == TOKEN_LPAREN || op_stack[op_top]->type == TOKEN_RPAREN || op_stack[op_top]->type == TOKEN_FUNC) {
+            expr_error(stderr, "Mismatched parentheses\n");
             return NULL;
         }
         output[output_pos++] = *op_stack[op_top--];
@@ -211,13 +252,24 @@ Operand handle_exp(Operand a, Operand b) {
         if(b.val < 0) { // Find inverse of a to power of b
             Matrix* result = matrix_inverse(a.matrix);
 
-            if(!result) // Matrix has no inverse
+            if(!result) { // Matrix has no inverse
+                expr_error(stdout, "Expression error: Matrix is singular and has no inverse\n");
                 return operand_error();
+            }
+
+            // The inverse exists but rounding may swamp it. With the inverse in hand the 1-norm condition
+            // number is exact and costs two norms, where matrix_cond would factor a dense a again
+            double cond = matrix_norm(a.matrix, NORM_ONE) * matrix_norm(result, NORM_ONE);
+            if(cond > COND_WARN)
+                expr_error(stderr, "Warning: Matrix is ill-conditioned, condition number %.3e\n", cond);
 
             Matrix* temp_inverse = matrix_scalar_add(result, 0);
             
-            for(int i = 1; i < b.val; i++) // Take inverse to power of b
-                result = matrix_mult(result, temp_inverse);
+            for(int i = 1; i < -b.val; i++) { // Take inverse to power of -b
+                Matrix* next = matrix_mult(result, temp_inverse);
+                matrix_free(result);
+                result = next;
+            }
 
             matrix_free(temp_inverse);
 
@@ -226,8 +278,11 @@ Operand handle_exp(Operand a, Operand b) {
 
         // Raise matrix to positive integer power
         Matrix* result = matrix_scalar_add(a.matrix, 0); // Matrix to store result
-        for(int i = 1; i < b.val; i++)
-            result = matrix_mult(result, a.matrix);
+        for(int i = 1; i < b.val; i++) { // Free each partial power once the next is computed
+            Matrix* next = matrix_mult(result, a.matrix);
+            matrix_free(result);
+            result = next;
+        }
         
         return operand_create(result, 0);
     } else { // Both operands numeric
@@ -249,6 +304,18 @@ Operand handle_div(Operand a, Operand b) {
 
 }
 
+// Evaluate Kronecker product, a scalar factor scales the other operand
+Operand handle_kron(Operand a, Operand b) {
+    if(!a.matrix || !b.matrix)
+        return handle_mult(a, b);
+
+    Matrix* result = matrix_kron(a.matrix, b.matrix);
+    if(!result)
+        return operand_error();
+
+    return operand_create(result, 0);
+}
+
 Operand handle_numeric(char* op, Operand a, Operand b) {
     if(a.matrix == NULL || b.matrix == NULL)
         return operand_error();
@@ -274,6 +341,8 @@ Operand apply_bin_op(char* op, Operand a, Operand b) {
         return handle_exp(b, a);
     if(!strcmp(op, "/")) // Divison
         return handle_div(b, a);
+    if(!strcmp(op, "kron")) // Kronecker product
+        return handle_kron(b, a);
     
     return operand_error(); // Not recognized
 }
@@ -318,15 +387,22 @@ Operand apply_un_op(char* op, Operand a) {
 }
 
 
-// Evaluate tokenized expression
-Matrix* eval_expr(Token* infix_expr, int infix_len) {
+// Release matrices of operands left on stack after an error
+void release_stack(Operand* stack, int top) {
+    for(int i = 0; i <= top; i++)
+        matrix_release(stack[i].matrix);
+}
+
+
+// Evaluate tokenized expression, caller owns a reference to the returned matrix
+Matrix* eval_tokens(Token* infix_expr, int infix_len) {
     int len; // Length of rpn expression
     Token* expr = convert_rpn(infix_expr, infix_len, &len); // get rpn expression
 
     if(!expr) // Conversion to rpn failed
         return NULL;
     
-    // Create operand stack
+    // Create operand stack, each operand owns a reference to its matrix
     Operand stack[32];
     int top = -1;
 
@@ -344,25 +420,39 @@ Matrix* eval_expr(Token* infix_expr, int infix_len) {
         }
         #endif
 
-        if(expr[i].type == TOKEN_MATRIX) { // Add matrix to stack
+        if(expr[i].type == TOKEN_MATRIX && strchr(expr[i].symbol, '[')) { // Add block of matrix to stack
+            Matrix* slice = get_slice(expr[i].symbol);
+            if(!slice) {
+                expr_error(stdout, "Expression error: slice %s is empty or out of matrix bounds\n", expr[i].symbol);
+                release_stack(stack, top);
+                return NULL;
+            }
+            stack[++top] = operand_create(slice, 0);
+        } else if(expr[i].type == TOKEN_MATRIX) { // Add matrix to stack
             Matrix* matrix = rd_get_matrix(expr[i].symbol); // Get matrix
-            stack[++top] = operand_create(matrix, 0); // Add to stack
+            stack[++top] = operand_create(matrix_retain(matrix), 0); // Add to stack
         } else if(expr[i].type == TOKEN_NUMERIC) { // Add number to stack
             stack[++top] = operand_create(NULL, expr[i].val); // Add number to stack
         } else {
             if(expr[i].type == TOKEN_UN_OP) { // Apply unary operator
                 if(top < 0) { // Missing operand
-                    printf("Expression error, not enough operands\n");
+                    expr_error(stdout, "Expression error, not enough operands\n");
                     return NULL;
                 }
 
                 Operand op = stack[top--]; // Get operand
                 Operand result = apply_un_op(expr[i].symbol, op);
-                if(result.err) return NULL; // Error occurred while applying operator
+                matrix_release(op.matrix);
+
+                if(result.err) { // Error occurred while applying operator
+                    release_stack(stack, top);
+                    return NULL;
+                }
                 stack[++top] = result; // Push result
             } else if(expr[i].type == TOKEN_BIN_OP) { // Apply binary operator
-                if(top < 0) { // Missing operand
-                    printf("Expression error, not enough operands\n");
+                if(top < 1) { // Missing operand
+                    expr_error(stdout, "Expression error, not enough operands\n");
+                    release_stack(stack, top);
                     return NULL;
                 }
 
@@ -371,17 +461,25 @@ Matrix* eval_expr(Token* infix_expr, int infix_len) {
                 Operand b = stack[top--];
 
                 Operand result = apply_bin_op(expr[i].symbol, a, b); // Get result
-                if(result.err) return NULL; // Error occurred while applying operator
+                matrix_release(a.matrix);
+                matrix_release(b.matrix);
+
+                if(result.err) { // Error occurred while applying operator
+                    release_stack(stack, top);
+                    return NULL;
+                }
                 stack[++top] = result; // Push result
             } else { // Error, parentheses in RPN expression
-                printf("Expression error, mismatched parentheses\n");
+                expr_error(stdout, "Expression error, mismatched parentheses\n");
+                release_stack(stack, top);
                 return NULL;
             }
         }
     }
 
     if(top != 0) { // Invalid expression, missing operators
-        printf("Expression error, not enough operators\n");
+        expr_error(stdout, "Expression error, not enough operators\n");
+        release_stack(stack, top);
         return NULL;
     }
 
@@ -394,4 +492,13 @@ Matrix* eval_expr(Token* infix_expr, int infix_len) {
     }
 
     return result.matrix;
-}
\ No newline at end of file
+}
+
+
+Matrix* eval_expr(Token* infix_expr, int infix_len) {
+    PROFILE_BEGIN(span);
+    Matrix* result = eval_tokens(infix_expr, infix_len);
+    PROFILE_END(PROF_EVAL_EXPR, span, 0, result && !result->pager ? matrix_stored(result) : 0);
+
+    return result;
+}
@@ -1,8 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <math.h>
 #include <time.h>
 #include "../include/matrix.h"
+#include "../include/export.h"
+#include "../include/csr.h"
+#include "../include/thread_pool.h"
+#include "../include/jobs.h"
+#include "../include/profile.h"
+
+#define EXPORT_BLOCK_ROWS 256   // Rows formatted per parallel task
+#define FILL_CELLS 1024         // Cells of scalar_val copied at once for runs of zeros
+#define FORMAT_MAX_LEN 32       // Longest formatted double
 
 
 char* generate_name(const char* name) {
@@ -24,10 +35,288 @@ char* generate_name(const char* name) {
 }
 
 
-bool export_csv(Matrix* matrix, const char* filename) {
-    char* name = generate_name(filename); // Generate filename
-    
-    if(!name)  // Name generation failed
+// Growable output buffer for one block of formatted rows
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// State shared by tasks formatting one wave of row blocks
+typedef struct {
+    Matrix* matrix;
+    Csr* csr;
+    ExportFormat format;
+    int first_block;    // Block formatted by task 0
+    Buffer* buffers;    // Output of each task
+    char* fill;         // Formatted scalar_val cell repeated FILL_CELLS times
+    int fill_cell_len;  // Length of one cell in fill, including its comma
+} ExportState;
+
+
+// Make room for extra bytes in buffer
+void buffer_reserve(Buffer* buf, size_t extra) {
+    if(buf->len + extra <= buf->cap)
+        return;
+
+    while(buf->len + extra > buf->cap)
+        buf->cap = buf->cap ? buf->cap * 2 : 1 << 16;
+
+    buf->data = realloc(buf->data, buf->cap);
+    if(!buf->data) {
+        fprintf(stderr, "Memory allocation failed for export buffer\n");
+        exit(1);
+    }
+}
+
+
+// Exact powers of ten, products and quotients with them round like strtod does
+const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// Copy first len of 17 significant digits to out, rounding the last one up if up is set. Returns 1
+// if rounding carried into a new leading digit
+int round_digits(const char* digits, char* out, int len, bool up) {
+    memcpy(out, digits, len);
+    if(!up)
+        return 0;
+
+    for(int i = len - 1; i >= 0; i--) {
+        if(out[i] != '9') {
+            out[i]++;
+            return 0;
+        }
+        out[i] = '0';
+    }
+
+    out[0] = '1'; // All nines rounded up to 10...0
+    return 1;
+}
+
+
+// Write len digits with decimal exponent exp the way %g does, returns length written
+int write_digits(const char* digits, int len, int exp, int precision, char* out) {
+    int pos = 0;
+
+    if(exp < -4 || exp >= precision) { // Scientific notation
+        out[pos++] = digits[0];
+        if(len > 1) {
+            out[pos++] = '.';
+            memcpy(out + pos, digits + 1, len - 1);
+            pos += len - 1;
+        }
+        return pos + sprintf(out + pos, "e%c%02d", exp < 0 ? '-' : '+', abs(exp));
+    }
+
+    if(exp < 0) { // 0.000ddd
+        out[pos++] = '0';
+        out[pos++] = '.';
+        for(int i = 1; i < -exp; i++)
+            out[pos++] = '0';
+        memcpy(out + pos, digits, len);
+        return pos + len;
+    }
+
+    for(int i = 0; i <= exp; i++) // Integer part, padded with zeros past the last digit
+        out[pos++] = i < len ? digits[i] : '0';
+
+    if(len > exp + 1) {
+        out[pos++] = '.';
+        memcpy(out + pos, digits + exp + 1, len - exp - 1);
+        pos += len - exp - 1;
+    }
+
+    return pos;
+}
+
+
+// Check if len digits with decimal exponent exp parse back to exactly val
+bool digits_round_trip(const char* digits, int len, int exp, double val) {
+    long long mantissa = 0;
+    for(int i = 0; i < len; i++)
+        mantissa = mantissa * 10 + (digits[i] - '0');
+
+    int scale = exp - (len - 1); // Value is mantissa * 10^scale
+
+    // Both factors are exact, so one correctly rounded operation gives what strtod would
+    if(mantissa < (1LL << 53) && scale >= -22 && scale <= 22)
+        return (scale >= 0 ? mantissa * exact_pow10[scale] : mantissa / exact_pow10[-scale]) == val;
+
+    char text[FORMAT_MAX_LEN];
+    snprintf(text, sizeof(text), "%.*se%d", len, digits, scale);
+    return strtod(text, NULL) == val;
+}
+
+
+// Write shortest decimal string that parses back to exactly val, returns its length
+int format_double(double val, char* out) {
+    // Integers are exact, format them without printf
+    if(isfinite(val) && fabs(val) < 1e15 && val == (double)(long long)val) {
+        long long int_val = (long long)val;
+        char digits[24];
+        int len = 0, n = 0;
+
+        if(int_val < 0) {
+            out[len++] = '-';
+            int_val = -int_val;
+        }
+
+        do {
+            digits[n++] = '0' + int_val % 10;
+            int_val /= 10;
+        } while(int_val > 0);
+
+        while(n > 0)
+            out[len++] = digits[--n];
+
+        return len;
+    }
+
+    if(!isfinite(val))
+        return snprintf(out, FORMAT_MAX_LEN, "%g", val);
+
+    // 17 significant digits always round-trip, print them once and round them down to 15 and 16.
+    // 15 digits round-trip if a representation that short exists, and trailing zeros drop out
+    char text[FORMAT_MAX_LEN];
+    snprintf(text, sizeof(text), "%.16e", fabs(val));
+
+    char digits[18];
+    digits[0] = text[0];
+    memcpy(digits + 1, text + 2, 16);
+    digits[17] = '\0';
+    int exp = atoi(text + 19);
+
+    int sign = 0;
+    if(val < 0)
+        out[sign++] = '-';
+
+    char rounded[17];
+    for(int precision = 15; precision < 17; precision++) {
+        // Dropped digits of exactly 5 are a tie only in the printed digits, the exact value may lie
+        // either side of it, so try both neighbours
+        bool up = digits[precision] >= '5';
+        bool tie = digits[precision] == '5' && digits[precision + 1 + strspn(digits + precision + 1, "0")] == '\0';
+
+        for(int attempt = 0; attempt < (tie ? 2 : 1); attempt++, up = false) {
+            int rounded_exp = exp + round_digits(digits, rounded, precision, up);
+            int len = precision;
+
+            while(len > 1 && rounded[len - 1] == '0')
+                len--;
+
+            if(digits_round_trip(rounded, len, rounded_exp, fabs(val)))
+                return sign + write_digits(rounded, len, rounded_exp, precision, out + sign);
+        }
+    }
+
+    int len = 17;
+    while(len > 1 && digits[len - 1] == '0')
+        len--;
+
+    return sign + write_digits(digits, len, exp, 17, out + sign);
+}
+
+
+// Append val followed by sep to buffer
+void append_val(Buffer* buf, double val, char sep) {
+    buffer_reserve(buf, FORMAT_MAX_LEN + 1);
+    buf->len += format_double(val, buf->data + buf->len);
+    buf->data[buf->len++] = sep;
+}
+
+
+// Append count cells holding scalar_val, each followed by a comma
+void append_fill(ExportState* state, Buffer* buf, int count) {
+    while(count > 0) {
+        int cells = count < FILL_CELLS ? count : FILL_CELLS;
+        size_t bytes = (size_t)cells * state->fill_cell_len;
+
+        buffer_reserve(buf, bytes);
+        memcpy(buf->data + buf->len, state->fill, bytes);
+        buf->len += bytes;
+        count -= cells;
+    }
+}
+
+
+// Append row, col, val line to buffer
+void append_triplet(Buffer* buf, int row, int col, double val) {
+    buffer_reserve(buf, 2 * FORMAT_MAX_LEN + 3);
+    buf->len += format_double(row, buf->data + buf->len);
+    buf->data[buf->len++] = ',';
+    buf->len += format_double(col, buf->data + buf->len);
+    buf->data[buf->len++] = ',';
+    append_val(buf, val, '\n');
+}
+
+
+// Format row of matrix as one line of comma separated values
+void format_dense_row(ExportState* state, Buffer* buf, int row) {
+    Csr* csr = state->csr;
+    double scalar_val = state->matrix->scalar_val;
+    int col = 0;
+
+    for(long k = csr->row_ptr[row]; k < csr->row_ptr[row + 1]; k++) {
+        append_fill(state, buf, csr->col_idx[k] - col); // Cells before next non-zero
+        append_val(buf, csr->vals[k] + scalar_val, ',');
+        col = csr->col_idx[k] + 1;
+    }
+
+    append_fill(state, buf, csr->cols - col);
+    buf->data[buf->len - 1] = '\n'; // Replace trailing comma
+}
+
+
+// Format non-zero cells of row as row, col, val lines
+void format_triplet_row(ExportState* state, Buffer* buf, int row) {
+    Csr* csr = state->csr;
+    double scalar_val = state->matrix->scalar_val;
+
+    if(scalar_val == 0) { // Only stored cells are non-zero
+        for(long k = csr->row_ptr[row]; k < csr->row_ptr[row + 1]; k++)
+            append_triplet(buf, row, csr->col_idx[k], csr->vals[k]);
+        return;
+    }
+
+    // Every cell holds at least scalar_val
+    long k = csr->row_ptr[row];
+    for(int col = 0; col < csr->cols; col++) {
+        double val = scalar_val;
+
+        if(k < csr->row_ptr[row + 1] && csr->col_idx[k] == col)
+            val += csr->vals[k++];
+
+        if(val != 0)
+            append_triplet(buf, row, col, val);
+    }
+}
+
+
+// Format one block of rows into its task's buffer
+void format_block(int task, void* ctx) {
+    ExportState* state = ctx;
+    Buffer* buf = &state->buffers[task];
+    int first_row = (state->first_block + task) * EXPORT_BLOCK_ROWS;
+    int last_row = first_row + EXPORT_BLOCK_ROWS;
+
+    if(last_row > state->csr->rows)
+        last_row = state->csr->rows;
+
+    for(int row = first_row; row < last_row; row++) {
+        if(state->format == EXPORT_TRIPLET)
+            format_triplet_row(state, buf, row);
+        else
+            format_dense_row(state, buf, row);
+    }
+}
+
+
+// Write matrix to file name in format, leaving its storage as it is
+bool export_csv_file(Matrix* matrix, const char* name, ExportFormat format) {
+    if(!matrix_materialize(matrix))
         return false;
 
     FILE* file = fopen(name, "w"); // Open file to write
@@ -37,23 +326,73 @@ bool export_csv(Matrix* matrix, const char* filename) {
         return false;
     }
 
-    for(int i = 0; i < matrix->rows; ++i) { 
-        for (int j = 0; j < matrix->cols; ++j) {
-            double val = matrix_get(matrix, i, j); // Get value
-            fprintf(file, "%f", val); // Print value
-            if(j < matrix->cols - 1) // Print comma
-                fprintf(file, ",");
+    ExportState state;
+    state.matrix = matrix;
+    state.csr = matrix_csr(matrix); // Stored non-zeros in row order, whatever the storage
+    state.format = format;
+
+    // Pre-format the repeated cell used for runs of zeros
+    char cell[FORMAT_MAX_LEN + 1];
+    state.fill_cell_len = format_double(matrix->scalar_val, cell) + 1;
+    cell[state.fill_cell_len - 1] = ',';
+    state.fill = malloc((size_t)state.fill_cell_len * FILL_CELLS);
+    for(int i = 0; i < FILL_CELLS; i++)
+        memcpy(state.fill + (size_t)i * state.fill_cell_len, cell, state.fill_cell_len);
+
+    // Blocks are formatted in parallel waves and written in order
+    int num_blocks = (matrix->rows + EXPORT_BLOCK_ROWS - 1) / EXPORT_BLOCK_ROWS;
+    int wave = pool_size() * 2;
+    state.buffers = calloc(wave, sizeof(Buffer));
+    bool success = true;
+
+    if(format == EXPORT_TRIPLET && fputs("row,col,val\n", file) == EOF)
+        success = false;
+
+    for(int first = 0; first < num_blocks && success; first += wave) {
+        int blocks = num_blocks - first < wave ? num_blocks - first : wave;
+        state.first_block = first;
+
+        pool_parallel_for(blocks, format_block, &state);
+
+        for(int b = 0; b < blocks; b++) {
+            if(fwrite(state.buffers[b].data, 1, state.buffers[b].len, file) != state.buffers[b].len)
+                success = false;
+            state.buffers[b].len = 0;
         }
 
-        fprintf(file, "\n"); // New row
+        long rows_done = (long)(first + blocks) * EXPORT_BLOCK_ROWS;
+        jobs_report_progress(rows_done < matrix->rows ? rows_done : matrix->rows, matrix->rows);
     }
 
-    printf("Matrix saved as %s\n", name);
+    if(fclose(file) != 0)
+        success = false;
+
+    if(!success)
+        printf("Error: writing %s failed\n", name);
+
+    for(int b = 0; b < wave; b++)
+        free(state.buffers[b].data);
+    free(state.buffers);
+    free(state.fill);
+    csr_free(state.csr);
+
+    return success;
+}
+
+
+bool export_csv(Matrix* matrix, const char* filename, ExportFormat format) {
+    char* name = generate_name(filename); // Generate filename
+    
+    if(!name)  // Name generation failed
+        return false;
+
+    bool success = export_csv_file(matrix, name, format);
+    if(success)
+        printf("Matrix saved as %s\n", name);
 
     free(name);
-    fclose(file);
 
-    return true;
+    return success;
 }
 
 
@@ -105,7 +444,8 @@ int count_columns(const char* filename) {
 }
 
 
-Matrix* import_csv(const char* filename) {
+// Parse dense csv file into a new matrix
+Matrix* read_csv(const char* filename) {
     int rows = count_rows(filename);
     int cols = count_columns(filename);
     if(rows < 1 || cols < 1) 
@@ -167,3 +507,13 @@ Matrix* import_csv(const char* filename) {
     fclose(file);
     return matrix;
 }
+
+
+Matrix* import_csv(const char* filename) {
+    PROFILE_BEGIN(span);
+    Matrix* matrix = read_csv(filename);
+    matrix_fit_storage(matrix);
+    PROFILE_END(PROF_IMPORT_CSV, span, 0, matrix ? matrix_stored(matrix) : 0);
+
+    return matrix;
+}
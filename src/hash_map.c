@@ -3,11 +3,15 @@
 #include <stdbool.h>
 #include "../include/list.h"
 #include "../include/hash_map.h"
+#include "../include/profile.h"
+#include "../include/mem_stats.h"
 
 // Function to create a new hashmap
 HashMap* map_create() {
     // Allocate memory for a new HashMap
     HashMap* map = (HashMap*)malloc(sizeof(HashMap));
+    PROFILE_ALLOC();
+    MEM_TRACK(MEM_HASH_MAP, 1, sizeof(HashMap));
     if (map == NULL) {
         // Handle memory allocation failure
         fprintf(stderr, "Memory allocation failed for the HashMap.\n");
@@ -25,6 +29,60 @@ HashMap* map_create() {
 }
 
 
+// Create map sharing every bucket of map, buckets are cloned when first modified
+HashMap* map_share(HashMap* map) {
+    HashMap* copy = (HashMap*)malloc(sizeof(HashMap));
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation failed for the HashMap.\n");
+        exit(1);
+    }
+    MEM_TRACK(MEM_HASH_MAP, 1, sizeof(HashMap));
+
+    copy->size = map->size;
+    copy->used_buckets = list_copy(map->used_buckets);
+
+    for(int i = 0; i < HASH_MAP_SIZE; ++i) {
+        copy->table[i] = map->table[i];
+
+        if(copy->table[i])
+            __atomic_add_fetch(&copy->table[i]->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    return copy;
+}
+
+
+// Drop map's reference to bucket, freeing it once no map shares it
+void release_bucket(List* bucket) {
+    if(bucket && __atomic_sub_fetch(&bucket->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        list_free(bucket);
+}
+
+
+// Give map its own copy of bucket index before it is modified
+void own_bucket(HashMap* map, unsigned int index) {
+    List* bucket = map->table[index];
+
+    if(bucket && __atomic_load_n(&bucket->refs, __ATOMIC_ACQUIRE) > 1) {
+        map->table[index] = list_copy(bucket);
+        release_bucket(bucket);
+    }
+}
+
+
+// Free bucket index once its last entry is removed and drop it from the used buckets, so the bucket
+// is listed once if it is used again
+void drop_empty_bucket(HashMap* map, unsigned int index) {
+    if(map->table[index]->head != NULL)
+        return;
+
+    free(map->table[index]);
+    MEM_TRACK(MEM_LIST, -1, -(long)sizeof(List));
+    map->table[index] = NULL;
+    list_remove_val(map->used_buckets, index, 0);
+}
+
+
 // Hash function for implementation
 unsigned int hash(int row, int col) {
     unsigned int hash = 17;
@@ -37,6 +95,7 @@ unsigned int hash(int row, int col) {
 // Add element to hashmap
 void map_set(HashMap* map, int row, int col, double val) {
     unsigned int index = hash(row, col); // Get hash of (row, col)
+    own_bucket(map, index);
 
     if(!map->table[index] && val != 0) { // Add new bucket to used_bucket list if necessary
         list_prepend(map->used_buckets, index, 0, 0);
@@ -59,10 +118,7 @@ void map_set(HashMap* map, int row, int col, double val) {
             list_prepend(list, row, col, val);
         } else { // Remove current from list if new value zero
             map->size--;
-            if(map->table[index]->head == NULL) {
-                free(map->table[index]);
-                map->table[index] = NULL;
-            }
+            drop_empty_bucket(map, index);
         }
     }
 }
@@ -75,6 +131,8 @@ void map_insert(HashMap* map, int row, int col, double val) {
     if(val == 0)
         return;
 
+    own_bucket(map, index);
+
     if(map->table[index] == NULL) { // Add used bucket to list if necessary
         list_prepend(map->used_buckets, index, 0, 0);
         map->table[index] = list_create();
@@ -89,15 +147,32 @@ void map_insert(HashMap* map, int row, int col, double val) {
     } else if(cur_val + val == 0) {
         list_remove_val(list, row, col);
         map->size--;
-
-        if(list->head == NULL)
-            list_remove_val(map->used_buckets, row, col);
+        drop_empty_bucket(map, index);
     } else {
         list_update_val(list, row, col, cur_val + val);
     }
 }
 
 
+// Add entry known to be absent from map, skipping the bucket search map_set does
+void map_append(HashMap* map, int row, int col, double val) {
+    unsigned int index = hash(row, col);
+
+    if(val == 0)
+        return;
+
+    own_bucket(map, index);
+
+    if(map->table[index] == NULL) {
+        list_prepend(map->used_buckets, index, 0, 0);
+        map->table[index] = list_create();
+    }
+
+    list_prepend(map->table[index], row, col, val);
+    map->size++;
+}
+
+
 // Get entry from hashmap
 double map_get(HashMap* map, int row, int col) {
     unsigned int index = hash(row, col); // Get hash of new entry
@@ -112,9 +187,26 @@ double map_get(HashMap* map, int row, int col) {
 // Deallocate used memory 
 void free_hash_map(HashMap* map) { 
     for (int i = 0; i < HASH_MAP_SIZE; ++i)
-        list_free(map->table[i]); // Free each bucket
+        release_bucket(map->table[i]); // Free each bucket no other map shares
         
     list_free(map->used_buckets); // Free used buckets
     free(map); // Free map struct
+    MEM_TRACK(MEM_HASH_MAP, -1, -(long)sizeof(HashMap));
+}
+
+
+// Bytes allocated for map, buckets shared with other maps are split evenly between them
+size_t map_bytes(HashMap* map) {
+    if(!map)
+        return 0;
+
+    size_t bytes = sizeof(HashMap) + list_bytes(map->used_buckets);
+
+    for(int i = 0; i < HASH_MAP_SIZE; ++i) {
+        if(map->table[i])
+            bytes += list_bytes(map->table[i]) / __atomic_load_n(&map->table[i]->refs, __ATOMIC_RELAXED);
+    }
+
+    return bytes;
 }
 
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/jobs.h"
+#include "../include/repository.h"
+#include "../include/export.h"
+
+Job* jobs_head = NULL;
+Job* jobs_tail = NULL;
+int next_job_id = 1;
+
+pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t jobs_changed = PTHREAD_COND_INITIALIZER;
+pthread_t writer;
+bool writer_started = false;
+
+// Job being run by the calling thread, NULL outside the writer thread
+_Thread_local Job* current_job = NULL;
+
+
+// Run job on writer thread, returns true if successful
+bool run_job(Job* job) {
+    if(job->type == JOB_SAVE) {
+        RepoWrite* write = job->data;
+        bool saved = repo_commit_save(write);
+        repo_write_free(write);
+
+        return saved;
+    }
+
+    Matrix* snapshot = job->data;
+    bool exported = export_csv(snapshot, job->name, job->format);
+    matrix_free(snapshot);
+
+    return exported;
+}
+
+
+// Writer thread, runs queued jobs in submission order
+void* writer_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&jobs_lock);
+
+    while(1) {
+        // Find oldest queued job
+        Job* job = jobs_head;
+        while(job && job->status != JOB_QUEUED)
+            job = job->next;
+
+        if(!job) { // Sleep until a job is submitted
+            pthread_cond_wait(&jobs_changed, &jobs_lock);
+            continue;
+        }
+
+        job->status = JOB_RUNNING;
+        pthread_mutex_unlock(&jobs_lock);
+
+        current_job = job;
+        bool success = run_job(job);
+        current_job = NULL;
+
+        pthread_mutex_lock(&jobs_lock);
+        job->data = NULL;
+        job->status = success ? JOB_DONE : JOB_FAILED;
+        pthread_cond_broadcast(&jobs_changed); // Wake waiting commands
+    }
+
+    return NULL;
+}
+
+
+// Add job to queue, starting writer thread if necessary
+Job* submit_job(JobType type, char* name, void* data, ExportFormat format) {
+    Job* job = malloc(sizeof(Job));
+    if(!job) {
+        fprintf(stderr, "Memory allocation failed for Job\n");
+        exit(1);
+    }
+
+    job->type = type;
+    job->name = strdup(name);
+    job->data = data;
+    job->format = format;
+    job->status = JOB_QUEUED;
+    job->progress = 0;
+    job->total = 0;
+    job->next = NULL;
+
+    pthread_mutex_lock(&jobs_lock);
+
+    if(!writer_started) {
+        if(pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+            pthread_mutex_unlock(&jobs_lock);
+            fprintf(stderr, "Error: Background writer could not be started\n");
+            free(job->name);
+            free(job);
+            return NULL;
+        }
+
+        pthread_detach(writer);
+        writer_started = true;
+    }
+
+    job->id = next_job_id++;
+
+    if(jobs_tail)
+        jobs_tail->next = job;
+    else
+        jobs_head = job;
+    jobs_tail = job;
+
+    pthread_cond_broadcast(&jobs_changed);
+    pthread_mutex_unlock(&jobs_lock);
+
+    return job;
+}
+
+
+// Queue save of matrix as name, returns job id or -1 if the save cannot be planned
+int jobs_submit_save(char* name, Matrix* matrix) {
+    RepoWrite* write = repo_prepare_save(name, matrix);
+    if(!write)
+        return -1;
+
+    Job* job = submit_job(JOB_SAVE, name, write, EXPORT_DENSE);
+    if(!job) {
+        repo_write_free(write);
+        return -1;
+    }
+
+    return job->id;
+}
+
+
+// Queue export of matrix to a csv file prefixed with name, returns job id or -1
+int jobs_submit_export(char* name, Matrix* matrix, ExportFormat format) {
+    Matrix* snapshot = matrix_copy(matrix);
+    if(!snapshot)
+        return -1;
+
+    Job* job = submit_job(JOB_EXPORT, name, snapshot, format);
+
+    if(!job) {
+        matrix_free(snapshot);
+        return -1;
+    }
+
+    return job->id;
+}
+
+
+// Update progress of the job run by the calling thread
+void jobs_report_progress(long progress, long total) {
+    if(!current_job)
+        return;
+
+    __atomic_store_n(&current_job->total, total, __ATOMIC_RELAXED);
+    __atomic_store_n(&current_job->progress, progress, __ATOMIC_RELAXED);
+}
+
+
+// Check if job is queued or running, jobs_lock must be held
+bool is_pending(Job* job) {
+    return job->status == JOB_QUEUED || job->status == JOB_RUNNING;
+}
+
+
+// Wait until no save of name is pending
+void jobs_wait_name(const char* name) {
+    pthread_mutex_lock(&jobs_lock);
+
+    bool pending = true;
+    while(pending) {
+        pending = false;
+
+        for(Job* job = jobs_head; job; job = job->next) {
+            if(job->type == JOB_SAVE && is_pending(job) && !strcmp(job->name, name))
+                pending = true;
+        }
+
+        if(pending)
+            pthread_cond_wait(&jobs_changed, &jobs_lock);
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+
+const char* job_type_name(Job* job) {
+    return job->type == JOB_SAVE ? "save" : "export";
+}
+
+
+const char* job_status_name(Job* job) {
+    switch(job->status) {
+        case JOB_QUEUED: return "queued";
+        case JOB_RUNNING: return "running";
+        case JOB_DONE: return "done";
+        default: return "failed";
+    }
+}
+
+
+// Print id, status and progress of every job not yet collected by jobs_wait
+void jobs_print() {
+    pthread_mutex_lock(&jobs_lock);
+
+    if(!jobs_head)
+        printf("No background jobs\n");
+
+    for(Job* job = jobs_head; job; job = job->next) {
+        long progress = __atomic_load_n(&job->progress, __ATOMIC_RELAXED);
+        long total = __atomic_load_n(&job->total, __ATOMIC_RELAXED);
+
+        printf("Job %d\t%s %s\t%s", job->id, job_type_name(job), job->name, job_status_name(job));
+        if(job->status == JOB_RUNNING && total > 0)
+            printf("\t%ld%%", progress * 100 / total);
+        printf("\n");
+    }
+
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+
+// Wait for all jobs, report failures and clear finished jobs, returns true if none failed
+bool jobs_wait() {
+    pthread_mutex_lock(&jobs_lock);
+
+    bool pending = true;
+    while(pending) {
+        pending = false;
+
+        for(Job* job = jobs_head; job; job = job->next) {
+            if(is_pending(job))
+                pending = true;
+        }
+
+        if(pending)
+            pthread_cond_wait(&jobs_changed, &jobs_lock);
+    }
+
+    // Report and free finished jobs
+    bool success = true;
+    Job* job = jobs_head;
+
+    while(job) {
+        Job* next = job->next;
+
+        if(job->status == JOB_FAILED) {
+            printf("Error: Job %d (%s %s) failed\n", job->id, job_type_name(job), job->name);
+            success = false;
+        }
+
+        free(job->name);
+        free(job);
+        job = next;
+    }
+
+    jobs_head = NULL;
+    jobs_tail = NULL;
+
+    pthread_mutex_unlock(&jobs_lock);
+
+    return success;
+}
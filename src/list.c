@@ -2,12 +2,16 @@
 #include <stdlib.h>
 #include <float.h>
 #include "../include/list.h"
+#include "../include/profile.h"
+#include "../include/mem_stats.h"
 
 
 // Function to create a new node
 Node* node_create(int row, int col, double val) {
     // Allocate memory for the new node
     Node* new_node = (Node*)malloc(sizeof(Node));
+    PROFILE_ALLOC();
+    MEM_TRACK(MEM_LIST, 0, sizeof(Node));
 
     if (new_node == NULL) { // Handle memory allocation failure
         fprintf(stderr, "Memory allocation failed for new node.\n");
@@ -28,6 +32,8 @@ Node* node_create(int row, int col, double val) {
 List* list_create() {
     // Allocate memory for the List
     List* list = (List*)malloc(sizeof(List));
+    PROFILE_ALLOC();
+    MEM_TRACK(MEM_LIST, 1, sizeof(List));
     
     // Handle memory allocation failure
     if (list == NULL) {
@@ -38,11 +44,28 @@ List* list_create() {
     // Initialize the list: head is NULL and size is 0
     list->head = NULL;
     list->size = 0;
+    list->refs = 1;
 
     return list;
 }
 
 
+// Create unshared copy of list with nodes in the same order
+List* list_copy(List* list) {
+    List* copy = list_create();
+    Node** tail = &copy->head;
+
+    for(Node* node = list->head; node != NULL; node = node->next) {
+        *tail = node_create(node->row, node->col, node->val);
+        tail = &(*tail)->next;
+    }
+
+    copy->size = list->size;
+
+    return copy;
+}
+
+
 // Append entry to end of list
 void list_append(List* list, int row, int col, double val) {
     Node* node = node_create(row, col, val); // Create new node
@@ -138,6 +161,7 @@ double list_remove_val(List* list, int row, int col) {
         list->head = temp->next;
         double val = temp->val;
         free(temp); // Deallocate removed node's memory
+        MEM_TRACK(MEM_LIST, 0, -(long)sizeof(Node));
         
         return val; // Return nodes original value
     }
@@ -150,6 +174,7 @@ double list_remove_val(List* list, int row, int col) {
             double val = to_delete->val;
             temp->next = to_delete->next;
             free(to_delete); // Deallocate removed node's memory
+            MEM_TRACK(MEM_LIST, 0, -(long)sizeof(Node));
 
             return val; // Return node's original value
         }
@@ -171,15 +196,27 @@ void list_free(List* list) {
     // Create nodes to traverse list
     Node* current = list->head;
     Node* next;
+    long freed = 0;
 
     // Iterate through the list and free each node
     while(current) {
         next = current->next; // Save next node
         free(current); // Deallocate node's memory
         current = next; // Iterate node
+        freed++;
     }
 
     free(list); // Deallocate memory for list struct
+    MEM_TRACK(MEM_LIST, -1, -(long)(sizeof(List) + freed * sizeof(Node)));
+}
+
+
+// Bytes allocated for list and its nodes
+size_t list_bytes(List* list) {
+    if(!list)
+        return 0;
+
+    return sizeof(List) + list->size * sizeof(Node);
 }
 
 
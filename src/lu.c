@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "../include/lu.h"
+#include "../include/ordering.h"
+
+// Row of a matrix being eliminated, columns ascending
+typedef struct {
+    int* cols;
+    double* vals;
+    int len;
+} ElimRow;
+
+// Rows that have or had a non-zero in a column, may repeat rows and include ones since cancelled
+typedef struct {
+    int* rows;
+    int len;
+    int capacity;
+} ColRows;
+
+// Multipliers in the order elimination produces them, so each row's steps ascend
+typedef struct {
+    int* rows;          // Row the multiplier eliminated from
+    int* steps;         // Step whose pivot row was subtracted
+    double* vals;
+    long len;
+    long capacity;
+} Multipliers;
+
+
+void* lu_alloc(size_t bytes) {
+    void* ptr = malloc(bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for LU factor\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+void col_rows_add(ColRows* col, int row) {
+    if(col->len == col->capacity) {
+        col->capacity = col->capacity ? col->capacity * 2 : 4;
+        col->rows = realloc(col->rows, col->capacity * sizeof(int));
+        if(!col->rows) {
+            fprintf(stderr, "Memory allocation failed for column rows\n");
+            exit(1);
+        }
+    }
+
+    col->rows[col->len++] = row;
+}
+
+
+void multipliers_add(Multipliers* mults, int row, int step, double val) {
+    if(mults->len == mults->capacity) {
+        mults->capacity = mults->capacity ? mults->capacity * 2 : 64;
+        mults->rows = realloc(mults->rows, mults->capacity * sizeof(int));
+        mults->steps = realloc(mults->steps, mults->capacity * sizeof(int));
+        mults->vals = realloc(mults->vals, mults->capacity * sizeof(double));
+        if(!mults->rows || !mults->steps || !mults->vals) {
+            fprintf(stderr, "Memory allocation failed for LU factor\n");
+            exit(1);
+        }
+    }
+
+    mults->rows[mults->len] = row;
+    mults->steps[mults->len] = step;
+    mults->vals[mults->len++] = val;
+}
+
+
+// Set row to row - factor * pivot, both lead with column k which is dropped, exact zeros are dropped
+// and rows gaining a column are added to that column's rows
+void eliminate_row(ElimRow* row, int row_num, ElimRow* pivot, double factor, ColRows* cols) {
+    int capacity = row->len + pivot->len;
+    int* new_cols = lu_alloc(capacity * sizeof(int));
+    double* new_vals = lu_alloc(capacity * sizeof(double));
+
+    int a = 1, b = 1, len = 0;
+
+    while(a < row->len || b < pivot->len) {
+        int col;
+        double val;
+
+        if(b >= pivot->len || (a < row->len && row->cols[a] < pivot->cols[b])) {
+            col = row->cols[a];
+            val = row->vals[a++];
+        } else if(a >= row->len || pivot->cols[b] < row->cols[a]) { // Fill-in
+            col = pivot->cols[b];
+            val = -factor * pivot->vals[b++];
+            col_rows_add(&cols[col], row_num);
+        } else {
+            col = row->cols[a];
+            val = row->vals[a++] - factor * pivot->vals[b++];
+        }
+
+        if(val != 0) {
+            new_cols[len] = col;
+            new_vals[len++] = val;
+        }
+    }
+
+    free(row->cols);
+    free(row->vals);
+    row->cols = new_cols;
+    row->vals = new_vals;
+    row->len = len;
+}
+
+
+// Copy of a with rows and columns both reordered, row k of the result is row perm[k] of a
+Csr* lu_permuted(Csr* a, int* perm) {
+    int n = a->rows;
+    int* pinv = lu_alloc(n * sizeof(int));
+    for(int k = 0; k < n; k++)
+        pinv[perm[k]] = k;
+
+    // Transposing twice sorts the renamed columns of each row
+    Csr* renamed = csr_create(n, n, a->nnz);
+    for(int k = 0; k < n; k++) {
+        long start = renamed->row_ptr[k];
+        renamed->row_ptr[k + 1] = start + a->row_ptr[perm[k] + 1] - a->row_ptr[perm[k]];
+
+        for(long p = a->row_ptr[perm[k]]; p < a->row_ptr[perm[k] + 1]; p++) {
+            renamed->col_idx[start] = pinv[a->col_idx[p]];
+            renamed->vals[start++] = a->vals[p];
+        }
+    }
+
+    Csr* t = csr_transpose(renamed);
+    Csr* result = csr_transpose(t);
+    csr_free(renamed);
+    csr_free(t);
+    free(pinv);
+
+    return result;
+}
+
+
+// Sparse LU of square a. A minimum degree ordering of a + a^T is applied to rows and columns, then
+// column k is eliminated right-looking with threshold partial pivoting: among the rows holding it,
+// the shortest whose value is within LU_PIVOT_THRESHOLD of the largest is the pivot. Rows are never
+// swapped, only those the transpose lists for column k are searched and eliminated. NULL if a pivot
+// is negligible next to the largest value of a, which makes a singular to working precision
+SparseLu* lu_factor(Csr* a) {
+    int n = a->rows;
+    if(a->cols != n)
+        return NULL;
+
+    int* order = order_min_degree(a);
+    Csr* b = lu_permuted(a, order);
+    Csr* by_col = csr_transpose(b);
+
+    ElimRow* rows = lu_alloc(n * sizeof(ElimRow));
+    ColRows* cols = calloc(n, sizeof(ColRows));
+    int* perm = lu_alloc(n * sizeof(int));  // perm[k]: row of b holding the pivot of column k
+    bool* used = calloc(n, sizeof(bool));
+    if(!cols || !used) {
+        fprintf(stderr, "Memory allocation failed for LU factor\n");
+        exit(1);
+    }
+
+    double max_abs = 0;
+
+    for(int i = 0; i < n; i++) {
+        long start = b->row_ptr[i], len = b->row_ptr[i + 1] - start;
+
+        rows[i].cols = lu_alloc(len * sizeof(int));
+        rows[i].vals = lu_alloc(len * sizeof(double));
+        rows[i].len = 0;
+
+        for(long k = start; k < start + len; k++) {
+            if(b->vals[k] != 0) {
+                rows[i].cols[rows[i].len] = b->col_idx[k];
+                rows[i].vals[rows[i].len++] = b->vals[k];
+                max_abs = fmax(max_abs, fabs(b->vals[k]));
+            }
+        }
+
+        for(long k = by_col->row_ptr[i]; k < by_col->row_ptr[i + 1]; k++)
+            col_rows_add(&cols[i], by_col->col_idx[k]);
+    }
+
+    csr_free(by_col);
+    csr_free(b);
+
+    Multipliers mults = {NULL, NULL, NULL, 0, 0};
+    double det = 1;
+    bool singular = max_abs == 0;
+
+    // Unused rows hold no columns before k, so a row's value in column k leads it if non-zero
+    for(int k = 0; k < n && !singular; k++) {
+        double max_val = 0;
+
+        for(int c = 0; c < cols[k].len; c++) {
+            ElimRow* row = &rows[cols[k].rows[c]];
+
+            if(!used[cols[k].rows[c]] && row->len > 0 && row->cols[0] == k)
+                max_val = fmax(max_val, fabs(row->vals[0]));
+        }
+
+        if(max_val <= DBL_EPSILON * max_abs) {
+            singular = true;
+            break;
+        }
+
+        int pivot = -1;
+        for(int c = 0; c < cols[k].len; c++) {
+            int r = cols[k].rows[c];
+
+            if(!used[r] && rows[r].len > 0 && rows[r].cols[0] == k
+                && fabs(rows[r].vals[0]) >= LU_PIVOT_THRESHOLD * max_val
+                && (pivot < 0 || rows[r].len < rows[pivot].len))
+                pivot = r;
+        }
+
+        perm[k] = pivot;
+        used[pivot] = true;
+        det *= rows[pivot].vals[0];
+
+        for(int c = 0; c < cols[k].len; c++) {
+            int r = cols[k].rows[c];
+
+            if(!used[r] && rows[r].len > 0 && rows[r].cols[0] == k) {
+                double factor = rows[r].vals[0] / rows[pivot].vals[0];
+                multipliers_add(&mults, r, k, factor);
+                eliminate_row(&rows[r], r, &rows[pivot], factor, cols);
+            }
+        }
+    }
+
+    SparseLu* lu = NULL;
+
+    if(!singular) {
+        lu = lu_alloc(sizeof(SparseLu));
+        lu->n = n;
+        lu->row_perm = lu_alloc(n * sizeof(int));
+        lu->col_perm = order;
+
+        // Each cycle of the row permutation of length m takes m - 1 swaps, the symmetric ordering
+        // takes as many on both sides
+        for(int k = 0; k < n; k++)
+            used[k] = false;
+
+        for(int k = 0; k < n; k++) {
+            for(int j = k; !used[j]; j = perm[j]) {
+                used[j] = true;
+                if(perm[j] != k)
+                    det = -det;
+            }
+        }
+        lu->det = det;
+
+        // Pivot rows were final once chosen, U keeps them in step order
+        long nnz = 0;
+        for(int k = 0; k < n; k++)
+            nnz += rows[perm[k]].len;
+
+        lu->u = csr_create(n, n, nnz);
+        for(int k = 0; k < n; k++) {
+            ElimRow* row = &rows[perm[k]];
+            long start = lu->u->row_ptr[k];
+
+            for(int c = 0; c < row->len; c++) {
+                lu->u->col_idx[start + c] = row->cols[c];
+                lu->u->vals[start + c] = row->vals[c];
+            }
+            lu->u->row_ptr[k + 1] = start + row->len;
+            lu->row_perm[k] = order[perm[k]];
+        }
+
+        // Multipliers of the row pivoted at step k form row k of L
+        int* step = lu_alloc(n * sizeof(int));
+        for(int k = 0; k < n; k++)
+            step[perm[k]] = k;
+
+        lu->l = csr_create(n, n, mults.len);
+        for(long e = 0; e < mults.len; e++)
+            lu->l->row_ptr[step[mults.rows[e]] + 1]++;
+        for(int k = 0; k < n; k++)
+            lu->l->row_ptr[k + 1] += lu->l->row_ptr[k];
+
+        long* next = lu_alloc(n * sizeof(long));
+        for(int k = 0; k < n; k++)
+            next[k] = lu->l->row_ptr[k];
+
+        for(long e = 0; e < mults.len; e++) {
+            long p = next[step[mults.rows[e]]]++;
+            lu->l->col_idx[p] = mults.steps[e];
+            lu->l->vals[p] = mults.vals[e];
+        }
+
+        free(next);
+        free(step);
+    } else {
+        free(order);
+    }
+
+    for(int i = 0; i < n; i++) {
+        free(rows[i].cols);
+        free(rows[i].vals);
+        free(cols[i].rows);
+    }
+
+    free(rows);
+    free(cols);
+    free(perm);
+    free(used);
+    free(mults.rows);
+    free(mults.steps);
+    free(mults.vals);
+
+    return lu;
+}
+
+
+// Solve A x = b with the factor, permuting b in and x back out
+void lu_solve(SparseLu* lu, const double* b, double* x) {
+    int n = lu->n;
+    Csr* l = lu->l;
+    Csr* u = lu->u;
+    double* y = lu_alloc(n * sizeof(double));
+
+    for(int k = 0; k < n; k++) { // L y = P b
+        double sum = b[lu->row_perm[k]];
+        for(long p = l->row_ptr[k]; p < l->row_ptr[k + 1]; p++)
+            sum -= l->vals[p] * y[l->col_idx[p]];
+        y[k] = sum;
+    }
+
+    for(int k = n - 1; k >= 0; k--) { // U z = y
+        double sum = y[k];
+        for(long p = u->row_ptr[k] + 1; p < u->row_ptr[k + 1]; p++)
+            sum -= u->vals[p] * y[u->col_idx[p]];
+        y[k] = sum / u->vals[u->row_ptr[k]];
+    }
+
+    for(int k = 0; k < n; k++)
+        x[lu->col_perm[k]] = y[k];
+
+    free(y);
+}
+
+
+// Solve A^T x = b with the same factor, U^T and L^T are applied by columns of the stored rows
+void lu_solve_transpose(SparseLu* lu, const double* b, double* x) {
+    int n = lu->n;
+    Csr* l = lu->l;
+    Csr* u = lu->u;
+    double* y = lu_alloc(n * sizeof(double));
+
+    for(int k = 0; k < n; k++)
+        y[k] = b[lu->col_perm[k]];
+
+    for(int k = 0; k < n; k++) { // U^T z = Q^T b
+        y[k] /= u->vals[u->row_ptr[k]];
+        for(long p = u->row_ptr[k] + 1; p < u->row_ptr[k + 1]; p++)
+            y[u->col_idx[p]] -= u->vals[p] * y[k];
+    }
+
+    for(int k = n - 1; k >= 0; k--) { // L^T w = z
+        for(long p = l->row_ptr[k]; p < l->row_ptr[k + 1]; p++)
+            y[l->col_idx[p]] -= l->vals[p] * y[k];
+    }
+
+    for(int k = 0; k < n; k++)
+        x[lu->row_perm[k]] = y[k];
+
+    free(y);
+}
+
+
+size_t lu_bytes(SparseLu* lu) {
+    if(!lu)
+        return 0;
+
+    return sizeof(SparseLu) + 2 * lu->n * sizeof(int) + 2 * (sizeof(Csr) + (lu->n + 1) * sizeof(long))
+        + (lu->l->nnz + lu->u->nnz) * (sizeof(int) + sizeof(double));
+}
+
+
+void lu_free(SparseLu* lu) {
+    if(!lu)
+        return;
+
+    free(lu->row_perm);
+    free(lu->col_perm);
+    csr_free(lu->l);
+    csr_free(lu->u);
+    free(lu);
+}
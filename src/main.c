@@ -5,9 +5,11 @@
 #include "../include/map_iterator.h"
 #include "../include/matrix.h"
 #include "../test/test.h"
+#include "../bench/bench.h"
 #include "../include/matrix_cli.h"
 #include "../include/parse_input.h"
 #include "../include/repository.h"
+#include "../include/jobs.h"
 
 
 #define MAX_INPUT_LENGTH 256
@@ -31,6 +33,8 @@ void run_app() {
 
         handle_input(input);
     }
+
+    jobs_wait(); // Finish background saves before exiting
 }
 
 void test_inverse() {
@@ -45,10 +49,16 @@ void test_inverse() {
 }
 
 
-int main() {
-#ifdef TEST
+int main(int argc, char** argv) {
+#ifdef BENCH
+    return run_benchmarks(argc, argv);
+#elif defined(TEST)
+    (void)argc;
+    (void)argv;
     run_tests();
 #else
+    (void)argc;
+    (void)argv;
     test_inverse();
     //run_app();
 #endif
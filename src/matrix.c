@@ -2,96 +2,916 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include "../include/matrix.h"
 #include "../include/map_iterator.h"
+#include "../include/profile.h"
+#include "../include/mem_stats.h"
+#include "../include/dense.h"
+#include "../include/band.h"
+#include "../include/csr.h"
 
 #define MATRIX_REGISTRY "matrix_registry.dat"
 
+// Serializes building mult_vals of a matrix several products read at once
+pthread_mutex_t mult_vals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Serializes factoring a matrix several determinants read at once
+pthread_mutex_t factor_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Stored density from which results switch to dense storage, they switch back below half of it
+double dense_threshold = DENSE_THRESHOLD;
+
 Matrix* matrix_create(int rows, int cols) {
     if(rows < 1 || cols < 1)
         return NULL;
 
-    // Allocate memory for a new Matrix
-    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
-    if (matrix == NULL) {
-        // Handle memory allocation failure
-        fprintf(stderr, "Memory allocation failed for the HashMap.\n");
-        exit(1);
+    // Allocate memory for a new Matrix
+    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
+    if (matrix == NULL) {
+        // Handle memory allocation failure
+        fprintf(stderr, "Memory allocation failed for the HashMap.\n");
+        exit(1);
+    }
+
+    PROFILE_ALLOC();
+    MEM_TRACK(MEM_MATRIX, 1, sizeof(Matrix));
+
+    // Instantiate fields
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->vals = map_create();
+    matrix->mult_vals = NULL;
+    matrix->scalar_val = 0;
+    matrix->dirty = NULL;
+    matrix->repo_token = 0;
+    matrix->pager = NULL;
+    matrix->refs = 1;
+    matrix->dense = NULL;
+    matrix->dense_refs = NULL;
+    matrix->band = NULL;
+    matrix->precond = NULL;
+    matrix->chol = NULL;
+    matrix->chol_failed = false;
+    matrix->lu = NULL;
+
+    return matrix;
+}
+
+
+long matrix_cells(Matrix* matrix) {
+    return (long)matrix->rows * matrix->cols;
+}
+
+
+// Allocate zeroed value array for matrix
+double* dense_alloc(Matrix* matrix) {
+    double* dense = calloc(matrix_cells(matrix), sizeof(double));
+    if(!dense) {
+        fprintf(stderr, "Memory allocation failed for dense matrix\n");
+        exit(1);
+    }
+
+    MEM_TRACK(MEM_DENSE, 1, matrix_cells(matrix) * sizeof(double));
+
+    return dense;
+}
+
+
+// Store matrix in value array dense, which matrix alone owns
+void dense_attach(Matrix* matrix, double* dense) {
+    matrix->dense_refs = malloc(sizeof(int));
+    if(!matrix->dense_refs) {
+        fprintf(stderr, "Memory allocation failed for dense matrix\n");
+        exit(1);
+    }
+
+    *matrix->dense_refs = 1;
+    matrix->dense = dense;
+}
+
+
+// Drop matrix's reference to its value array, freeing it once no copy shares it
+void dense_free(Matrix* matrix) {
+    if(!matrix->dense)
+        return;
+
+    if(__atomic_sub_fetch(matrix->dense_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        MEM_TRACK(MEM_DENSE, -1, -(long)(matrix_cells(matrix) * sizeof(double)));
+        free(matrix->dense);
+        free(matrix->dense_refs);
+    }
+
+    matrix->dense = NULL;
+    matrix->dense_refs = NULL;
+}
+
+
+// Give matrix its own copy of its value array before it is modified
+void own_dense(Matrix* matrix) {
+    if(!matrix->dense || __atomic_load_n(matrix->dense_refs, __ATOMIC_ACQUIRE) == 1)
+        return;
+
+    double* dense = dense_alloc(matrix);
+    memcpy(dense, matrix->dense, matrix_cells(matrix) * sizeof(double));
+    dense_free(matrix);
+    dense_attach(matrix, dense);
+}
+
+
+// Create dense matrix with every cell zero
+Matrix* dense_create(int rows, int cols) {
+    Matrix* matrix = matrix_create(rows, cols);
+    if(matrix)
+        dense_attach(matrix, dense_alloc(matrix));
+
+    return matrix;
+}
+
+
+// Create matrix held as band
+Matrix* band_matrix(Band* band) {
+    Matrix* matrix = matrix_create(band->rows, band->cols);
+    if(matrix && band->num_diags > 0)
+        matrix->band = band;
+    else // No diagonal left, e.g. a product of shifts, the zero matrix is sparse
+        band_free(band);
+
+    return matrix;
+}
+
+
+// Check if matrix is the implicit identity, the only band storing no values
+bool is_identity(Matrix* matrix) {
+    return matrix->band && !matrix->band->vals;
+}
+
+
+// Sparse copy of banded matrix for kernels iterating a map, other matrices are returned as they are
+Matrix* unband(Matrix* matrix) {
+    if(!matrix->band)
+        return matrix;
+
+    Matrix* sparse = matrix_copy(matrix);
+    matrix_make_sparse(sparse);
+
+    return sparse;
+}
+
+
+// Free copy made by unband
+void unband_free(Matrix* matrix, Matrix* sparse) {
+    if(sparse != matrix)
+        matrix_free(sparse);
+}
+
+
+// Add sign times every cell of matrix to row-major cells, matrix must be fully loaded
+void add_cells(double* cells, Matrix* matrix, double sign) {
+    long count = matrix_cells(matrix);
+
+    if(matrix->band) {
+        Band* band = matrix->band;
+
+        for(int d = 0; d < band->num_diags; d++) {
+            int offset = band->offsets[d];
+
+            for(int i = 0; i < band->rows; i++) {
+                if(band_has_cell(band, i, offset))
+                    cells[(long)i * matrix->cols + i + offset] += sign * band_diag_val(band, d, i);
+            }
+        }
+        return;
+    }
+
+    if(matrix->dense) {
+        for(long i = 0; i < count; i++)
+            cells[i] += sign * matrix->dense[i];
+        return;
+    }
+
+    if(matrix->scalar_val != 0) {
+        for(long i = 0; i < count; i++)
+            cells[i] += sign * matrix->scalar_val;
+    }
+
+    MapIterator map_it = map_iterator_create(matrix->vals);
+    while(map_iterator_has_next(&map_it)) {
+        int row, col;
+        double val;
+        map_iterator_next(&map_it, &row, &col, &val);
+        cells[(long)row * matrix->cols + col] += sign * val;
+    }
+}
+
+
+// Number of non-zero cells of dense matrix
+long dense_nnz(Matrix* matrix) {
+    long nnz = 0;
+    long count = matrix_cells(matrix);
+
+    for(long i = 0; i < count; i++)
+        nnz += matrix->dense[i] != 0;
+
+    return nnz;
+}
+
+
+// Values held in memory without loading any rows, every cell of a dense matrix
+long matrix_stored(Matrix* matrix) {
+    if(matrix->dense)
+        return matrix_cells(matrix);
+
+    if(matrix->band)
+        return matrix->band->vals ? (long)matrix->band->num_diags * matrix->rows : 0;
+
+    return matrix->vals->size;
+}
+
+
+// Switch matrix to dense storage, folding scalar_val into its cells
+void matrix_make_dense(Matrix* matrix) {
+    if(matrix->dense || !matrix_materialize(matrix))
+        return;
+
+    double* dense = dense_alloc(matrix);
+    add_cells(dense, matrix, 1);
+
+    free_hash_map(matrix->vals);
+    matrix->vals = map_create();
+
+    if(matrix->mult_vals != NULL) {
+        free_row_map(matrix->mult_vals);
+        matrix->mult_vals = NULL;
+    }
+
+    band_free(matrix->band);
+    matrix->band = NULL;
+    dense_attach(matrix, dense);
+    matrix->scalar_val = 0;
+}
+
+
+// Switch matrix to sparse storage of its non-zero cells, vals is empty while dense or banded
+void matrix_make_sparse(Matrix* matrix) {
+    if(matrix->band) {
+        Band* band = matrix->band;
+
+        for(int d = 0; d < band->num_diags; d++) {
+            int offset = band->offsets[d];
+
+            for(int i = 0; i < band->rows; i++) {
+                if(band_has_cell(band, i, offset) && band_diag_val(band, d, i) != 0)
+                    map_append(matrix->vals, i, i + offset, band_diag_val(band, d, i));
+            }
+        }
+
+        band_free(band);
+        matrix->band = NULL;
+    }
+
+    if(!matrix->dense)
+        return;
+
+    for(int row = 0; row < matrix->rows; row++) {
+        double* cells = matrix->dense + (long)row * matrix->cols;
+
+        for(int col = 0; col < matrix->cols; col++) {
+            if(cells[col] != 0)
+                map_append(matrix->vals, row, col, cells[col]);
+        }
+    }
+
+    dense_free(matrix);
+}
+
+
+// Switch sparse matrix to band storage if its non-zeros lie on few diagonals that are at least half full
+void fit_band(Matrix* matrix) {
+    int rows = matrix->rows;
+    char* used = calloc(rows + matrix->cols - 1, 1); // Diagonal at offset p is at rows - 1 + p
+    int num_diags = 0;
+
+    MapIterator map_it = map_iterator_create(matrix->vals);
+    while(map_iterator_has_next(&map_it) && num_diags <= BAND_MAX_DIAGS) {
+        int row, col;
+        double val;
+        map_iterator_next(&map_it, &row, &col, &val);
+
+        if(!used[rows - 1 + col - row]) {
+            used[rows - 1 + col - row] = 1;
+            num_diags++;
+        }
+    }
+
+    long diag_len = rows < matrix->cols ? rows : matrix->cols;
+
+    if(num_diags == 0 || num_diags > BAND_MAX_DIAGS || num_diags * diag_len > 2 * (long)matrix->vals->size) {
+        free(used);
+        return;
+    }
+
+    int* offsets = malloc(num_diags * sizeof(int));
+    int count = 0;
+    for(int p = 1 - rows; p < matrix->cols; p++) {
+        if(used[rows - 1 + p])
+            offsets[count++] = p;
+    }
+    free(used);
+
+    Band* band = band_create(rows, matrix->cols, num_diags, offsets);
+    free(offsets);
+
+    map_it = map_iterator_create(matrix->vals);
+    while(map_iterator_has_next(&map_it)) {
+        int row, col;
+        double val;
+        map_iterator_next(&map_it, &row, &col, &val);
+        band->vals[(long)band_find(band, col - row) * rows + row] = val;
+    }
+
+    free_hash_map(matrix->vals);
+    matrix->vals = map_create();
+
+    if(matrix->mult_vals != NULL) {
+        free_row_map(matrix->mult_vals);
+        matrix->mult_vals = NULL;
+    }
+
+    matrix->band = band;
+}
+
+
+// Pick storage for a newly computed matrix from the share of cells it stores and their layout
+void matrix_fit_storage(Matrix* matrix) {
+    if(!matrix || matrix->band)
+        return;
+
+    long cells = matrix_cells(matrix);
+
+    if(matrix->dense) {
+        if(cells < DENSE_MIN_CELLS || dense_threshold > 1 || dense_nnz(matrix) < dense_threshold / 2 * cells)
+            matrix_make_sparse(matrix);
+    } else if(!matrix->pager && cells >= DENSE_MIN_CELLS && matrix->vals->size >= dense_threshold * cells) {
+        matrix_make_dense(matrix);
+    } else if(!matrix->pager && cells >= DENSE_MIN_CELLS && matrix->scalar_val == 0) {
+        fit_band(matrix);
+    }
+}
+
+
+// Stored non-zeros of row of a dense or banded matrix in column order, written to cols and vals
+// unless they are NULL, returns number of entries
+long row_entries(Matrix* matrix, int row, int* cols, double* vals) {
+    long len = 0;
+
+    if(matrix->dense) {
+        double* cells = matrix->dense + (long)row * matrix->cols;
+
+        for(int col = 0; col < matrix->cols; col++) {
+            if(cells[col] != 0) {
+                if(cols) {
+                    cols[len] = col;
+                    vals[len] = cells[col];
+                }
+                len++;
+            }
+        }
+        return len;
+    }
+
+    Band* band = matrix->band;
+    for(int d = 0; d < band->num_diags; d++) { // Offsets ascend, so columns do
+        if(band_has_cell(band, row, band->offsets[d]) && band_diag_val(band, d, row) != 0) {
+            if(cols) {
+                cols[len] = row + band->offsets[d];
+                vals[len] = band_diag_val(band, d, row);
+            }
+            len++;
+        }
+    }
+
+    return len;
+}
+
+
+// Row-ordered copy of the stored values of matrix, scalar_val is not applied
+Csr* matrix_csr(Matrix* matrix) {
+    if(!matrix_materialize(matrix))
+        return NULL;
+
+    if(!matrix->dense && !matrix->band)
+        return csr_from_map(matrix->vals, matrix->rows, matrix->cols);
+
+    long nnz = 0;
+    for(int i = 0; i < matrix->rows; i++)
+        nnz += row_entries(matrix, i, NULL, NULL);
+
+    Csr* csr = csr_create(matrix->rows, matrix->cols, nnz);
+
+    for(int i = 0; i < matrix->rows; i++) {
+        long start = csr->row_ptr[i];
+        csr->row_ptr[i + 1] = start + row_entries(matrix, i, csr->col_idx + start, csr->vals + start);
+    }
+
+    return csr;
+}
+
+
+// Row-major copy of every cell of matrix, caller frees it, NULL if matrix cannot be loaded
+double* matrix_cells_copy(Matrix* matrix) {
+    if(!matrix_materialize(matrix))
+        return NULL;
+
+    double* cells = calloc(matrix_cells(matrix), sizeof(double));
+    if(!cells) {
+        fprintf(stderr, "Memory allocation failed for dense matrix\n");
+        exit(1);
+    }
+
+    add_cells(cells, matrix, 1);
+
+    return cells;
+}
+
+
+// Row-ordered copy of every cell of matrix, a non-zero scalar_val makes it dense. NULL if matrix
+// cannot be loaded
+Csr* matrix_cells_csr(Matrix* matrix) {
+    if(matrix->scalar_val == 0)
+        return matrix_csr(matrix);
+
+    double* cells = matrix_cells_copy(matrix);
+    if(!cells)
+        return NULL;
+
+    Matrix* full = matrix_from_cells(cells, matrix->rows, matrix->cols);
+    Csr* csr = matrix_csr(full);
+    matrix_free(full);
+    free(cells);
+
+    return csr;
+}
+
+
+// Create matrix holding row-major cells in whichever storage fits them
+Matrix* matrix_from_cells(double* cells, int rows, int cols) {
+    Matrix* matrix = dense_create(rows, cols);
+    if(!matrix)
+        return NULL;
+
+    memcpy(matrix->dense, cells, matrix_cells(matrix) * sizeof(double));
+    matrix_fit_storage(matrix);
+
+    return matrix;
+}
+
+
+// Matrix whose cell (k, l) is cell (row_perm[k], col_perm[l]) of matrix, NULL perms keep rows or
+// columns in place. Entries are moved once each, NULL if matrix cannot be loaded
+Matrix* matrix_permute(Matrix* matrix, const int* row_perm, const int* col_perm) {
+    Csr* csr = matrix_csr(matrix);
+    if(!csr)
+        return NULL;
+
+    int* col_pinv = NULL;
+    if(col_perm) {
+        col_pinv = malloc(matrix->cols * sizeof(int));
+        if(!col_pinv) {
+            fprintf(stderr, "Memory allocation failed for permutation\n");
+            exit(1);
+        }
+        for(int l = 0; l < matrix->cols; l++)
+            col_pinv[col_perm[l]] = l;
+    }
+
+    Matrix* result = matrix_create(matrix->rows, matrix->cols);
+
+    for(int k = 0; k < matrix->rows; k++) {
+        int i = row_perm ? row_perm[k] : k;
+
+        for(long p = csr->row_ptr[i]; p < csr->row_ptr[i + 1]; p++) {
+            int col = col_pinv ? col_pinv[csr->col_idx[p]] : csr->col_idx[p];
+            map_append(result->vals, k, col, csr->vals[p]);
+        }
+    }
+
+    result->scalar_val = matrix->scalar_val;
+    matrix_fit_storage(result);
+
+    free(col_pinv);
+    csr_free(csr);
+
+    return result;
+}
+
+
+// Stored values of the block of rows [r0, r1) and columns [c0, c1) of sparse matrix, added to result
+// at rows and columns relative to the block. Reads only the block's rows if a product left the row
+// index, otherwise looks up each cell of a block smaller than the stored values or filters them all
+void sparse_slice(Matrix* matrix, int r0, int r1, int c0, int c1, Matrix* result) {
+    RowMap* index = __atomic_load_n(&matrix->mult_vals, __ATOMIC_ACQUIRE);
+
+    if(index) {
+        for(int i = r0; i < r1; i++) {
+            List* row = row_map_get_row(index, i);
+            if(!row)
+                continue;
+
+            ListIterator iter = list_iter_create(row);
+            while(list_iter_has_next(&iter)) {
+                int row_idx, col;
+                double val;
+                list_iter_next(&iter, &row_idx, &col, &val);
+
+                if(col >= c0 && col < c1)
+                    map_append(result->vals, i - r0, col - c0, val);
+            }
+        }
+    } else if((long)(r1 - r0) * (c1 - c0) <= matrix_stored(matrix) || matrix->pager) {
+        for(int i = r0; i < r1; i++) {
+            for(int j = c0; j < c1; j++)
+                map_append(result->vals, i - r0, j - c0, matrix_get_stored(matrix, i, j));
+        }
+    } else {
+        MapIterator iter = map_iterator_create(matrix->vals);
+        while(map_iterator_has_next(&iter)) {
+            int row, col;
+            double val;
+            map_iterator_next(&iter, &row, &col, &val);
+
+            if(row >= r0 && row < r1 && col >= c0 && col < c1)
+                map_append(result->vals, row - r0, col - c0, val);
+        }
+    }
+}
+
+
+// Block of rows [r0, r1) and columns [c0, c1) of matrix, only the stored values of those rows are
+// read. NULL if the block is empty or outside matrix, or matrix cannot be loaded
+Matrix* matrix_slice(Matrix* matrix, int r0, int r1, int c0, int c1) {
+    if(r0 < 0 || r1 > matrix->rows || r0 >= r1 || c0 < 0 || c1 > matrix->cols || c0 >= c1)
+        return NULL;
+
+    int rows = r1 - r0, cols = c1 - c0;
+
+    if(matrix->dense) {
+        Matrix* result = dense_create(rows, cols);
+
+        for(int i = 0; i < rows; i++)
+            memcpy(result->dense + (long)i * cols, matrix->dense + (long)(r0 + i) * matrix->cols + c0, cols * sizeof(double));
+
+        matrix_fit_storage(result);
+        return result;
+    }
+
+    Matrix* result = matrix_create(rows, cols);
+
+    if(matrix->band) {
+        int* row_cols = malloc(matrix->band->num_diags * sizeof(int));
+        double* row_vals = malloc(matrix->band->num_diags * sizeof(double));
+        if(!row_cols || !row_vals) {
+            fprintf(stderr, "Memory allocation failed for dense matrix\n");
+            exit(1);
+        }
+
+        for(int i = r0; i < r1; i++) {
+            long len = row_entries(matrix, i, row_cols, row_vals);
+
+            for(long k = 0; k < len; k++) {
+                if(row_cols[k] >= c0 && row_cols[k] < c1)
+                    map_append(result->vals, i - r0, row_cols[k] - c0, row_vals[k]);
+            }
+        }
+
+        free(row_cols);
+        free(row_vals);
+    } else {
+        // Cells of a small block of a lazily loaded matrix are fetched with their rows, a larger
+        // block is read once every row is loaded
+        if(matrix->pager && (long)rows * cols > DENSE_MIN_CELLS && !matrix_materialize(matrix)) {
+            matrix_free(result);
+            return NULL;
+        }
+
+        sparse_slice(matrix, r0, r1, c0, c1, result);
+    }
+
+    result->scalar_val = matrix->scalar_val;
+    matrix_fit_storage(result);
+
+    return result;
+}
+
+
+// Overwrite the cells of matrix from (row, col) on with the cells of block. Without scalar values
+// only cells stored in the old or new block are written, row by row in column order, otherwise
+// every cell of the block is. false if block does not fit or a matrix cannot be loaded
+bool matrix_assign_slice(Matrix* matrix, int row, int col, Matrix* block) {
+    if(row < 0 || col < 0 || row + block->rows > matrix->rows || col + block->cols > matrix->cols)
+        return false;
+
+    if(matrix->dense || matrix->scalar_val != 0 || block->scalar_val != 0) {
+        double* cells = matrix_cells_copy(block);
+        if(!cells)
+            return false;
+
+        bool set = true;
+        for(int i = 0; i < block->rows && set; i++) {
+            for(int j = 0; j < block->cols && set; j++)
+                set = matrix_set(matrix, row + i, col + j, cells[(long)i * block->cols + j]);
+        }
+
+        free(cells);
+        return set;
+    }
+
+    Matrix* old = matrix_slice(matrix, row, row + block->rows, col, col + block->cols);
+    Csr* old_csr = old ? matrix_csr(old) : NULL;
+    Csr* new_csr = matrix_csr(block);
+    matrix_free(old);
+
+    if(!old_csr || !new_csr) {
+        csr_free(old_csr);
+        csr_free(new_csr);
+        return false;
+    }
+
+    // Old entries missing from the block are cleared, the block's entries are written over the rest
+    bool set = true;
+    for(int i = 0; i < block->rows && set; i++) {
+        long k = new_csr->row_ptr[i];
+
+        for(long p = old_csr->row_ptr[i]; p < old_csr->row_ptr[i + 1]; p++) {
+            int j = old_csr->col_idx[p];
+
+            while(k < new_csr->row_ptr[i + 1] && new_csr->col_idx[k] < j)
+                k++;
+            if(k == new_csr->row_ptr[i + 1] || new_csr->col_idx[k] != j)
+                set = matrix_set(matrix, row + i, col + j, 0) && set;
+        }
+
+        for(k = new_csr->row_ptr[i]; k < new_csr->row_ptr[i + 1]; k++)
+            set = matrix_set(matrix, row + i, col + new_csr->col_idx[k], new_csr->vals[k]) && set;
+    }
+
+    csr_free(old_csr);
+    csr_free(new_csr);
+
+    return set;
+}
+
+
+// Build preconditioner of type from matrix and keep it for solves, false if it cannot be built
+bool matrix_precondition(Matrix* matrix, PrecondType type) {
+    Csr* csr = matrix_csr(matrix);
+    if(!csr || matrix->rows != matrix->cols) {
+        csr_free(csr);
+        return false;
+    }
+
+    Precond* precond = precond_create(csr, matrix->scalar_val, type);
+    csr_free(csr);
+
+    if(!precond)
+        return false;
+
+    matrix_drop_precond(matrix);
+    matrix->precond = precond;
+
+    return true;
+}
+
+
+void matrix_drop_precond(Matrix* matrix) {
+    precond_free(matrix->precond);
+    matrix->precond = NULL;
+}
+
+
+// Drop preconditioner and factor computed from values that changed
+void drop_factors(Matrix* matrix) {
+    matrix_drop_precond(matrix);
+    cholesky_free(matrix->chol);
+    matrix->chol = NULL;
+    matrix->chol_failed = false;
+    lu_free(matrix->lu);
+    matrix->lu = NULL;
+}
+
+
+// Cholesky factor of matrix, built on first use. NULL unless matrix is symmetric positive definite
+// and held sparse or banded without scalar_val, dense matrices have their own kernels. A failed
+// attempt is remembered so later callers go straight to LU
+Cholesky* matrix_cholesky(Matrix* matrix) {
+    Cholesky* chol = __atomic_load_n(&matrix->chol, __ATOMIC_ACQUIRE);
+    if(chol || __atomic_load_n(&matrix->chol_failed, __ATOMIC_ACQUIRE) || matrix->dense || matrix->scalar_val != 0
+        || matrix->rows != matrix->cols)
+        return chol;
+
+    pthread_mutex_lock(&factor_lock);
+
+    if(!matrix->chol && !matrix->chol_failed) {
+        Csr* csr = matrix_csr(matrix);
+
+        if(csr && csr_is_symmetric(csr))
+            __atomic_store_n(&matrix->chol, cholesky_factor(csr), __ATOMIC_RELEASE);
+        if(csr && !matrix->chol) // A failed load is retried, a failed factorization waits for a cell change
+            __atomic_store_n(&matrix->chol_failed, true, __ATOMIC_RELEASE);
+        csr_free(csr);
+    }
+
+    chol = matrix->chol;
+    pthread_mutex_unlock(&factor_lock);
+
+    return chol;
+}
+
+
+// LU factor of square matrix, built on first use. Every cell is factored, including those a
+// non-zero scalar_val fills. NULL if matrix is singular or cannot be loaded
+SparseLu* matrix_lu(Matrix* matrix) {
+    SparseLu* lu = __atomic_load_n(&matrix->lu, __ATOMIC_ACQUIRE);
+    if(lu || matrix->rows != matrix->cols)
+        return lu;
+
+    pthread_mutex_lock(&factor_lock);
+
+    if(!matrix->lu) {
+        Csr* csr = matrix_cells_csr(matrix);
+
+        if(csr)
+            __atomic_store_n(&matrix->lu, lu_factor(csr), __ATOMIC_RELEASE);
+        csr_free(csr);
     }
 
-    // Instantiate fields
-    matrix->rows = rows;
-    matrix->cols = cols;
-    matrix->vals = map_create();
-    matrix->mult_vals = NULL;
-    matrix->scalar_val = 0;
+    lu = matrix->lu;
+    pthread_mutex_unlock(&factor_lock);
 
-    return matrix;
+    return lu;
+}
+
+
+// Thresholds above 1 keep every matrix sparse
+void matrix_set_dense_threshold(double threshold) {
+    dense_threshold = threshold;
+}
+
+
+double matrix_dense_threshold() {
+    return dense_threshold;
+}
+
+
+// Load all rows of a lazily loaded matrix into vals
+bool matrix_materialize(Matrix* matrix) {
+    if(!matrix || !matrix->pager)
+        return true;
+
+    if(!pager_materialize(matrix->pager, matrix->vals)) {
+        fprintf(stderr, "Error: Matrix could not be fully loaded\n");
+        return false;
+    }
+
+    pager_free(matrix->pager);
+    matrix->pager = NULL;
+
+    return true;
+}
+
+// Record cell as changed if matrix mirrors a persisted copy
+void matrix_mark_dirty(Matrix* matrix, int row, int col) {
+    if(matrix->dirty != NULL)
+        map_set(matrix->dirty, row, col, 1);
 }
 
 void matrix_inc_val(Matrix* matrix, int row, int col, double val) {
-    map_insert(matrix->vals, row, col, val);
+    if(matrix->band) // Band storage is read-only, edits switch to sparse
+        matrix_make_sparse(matrix);
+
+    if(matrix->dense) {
+        own_dense(matrix);
+        matrix->dense[(long)row * matrix->cols + col] += val;
+    } else
+        map_insert(matrix->vals, row, col, val);
+    matrix_mark_dirty(matrix, row, col);
+    drop_factors(matrix);
 
     if(matrix->mult_vals != NULL)
         matrix->mult_vals = NULL;
 }
 
 int matrix_size(Matrix* matrix) {
+    if(matrix->dense)
+        return dense_nnz(matrix);
+
+    if(matrix->band)
+        return band_nnz(matrix->band);
+
+    matrix_materialize(matrix);
     return matrix->vals->size;
 }
 
-void matrix_append(Matrix* dest, Matrix* source) {
-    MapIterator map_it = map_iterator_create(source->vals);
+// Dense a plus sign times b
+Matrix* dense_add(Matrix* a, Matrix* b, double sign) {
+    Matrix* result = dense_create(a->rows, a->cols);
 
-    while(map_iterator_has_next(&map_it)) {
-        int row, col;
-        double val;
-        map_iterator_next(&map_it, &row ,&col, &val);
-        matrix_inc_val(dest, row, col, val);
-    }
-}
+    add_cells(result->dense, a, 1);
+    add_cells(result->dense, b, sign);
+    matrix_fit_storage(result);
 
-Matrix* matrix_add(Matrix* a, Matrix* b) {
-    if(a->rows != b->rows || a->cols != b->cols)
-        return NULL;
+    return result;
+}
 
+// Sparse a plus sign times b, merging their sorted rows in one pass
+Matrix* sparse_add(Matrix* a, Matrix* b, double sign) {
+    Matrix* sparse_a = unband(a);
+    Matrix* sparse_b = unband(b);
+    Csr* csr_a = csr_from_map(sparse_a->vals, a->rows, a->cols);
+    Csr* csr_b = csr_from_map(sparse_b->vals, b->rows, b->cols);
+    Csr* sum = csr_add(csr_a, csr_b, sign);
     Matrix* result = matrix_create(a->rows, a->cols);
 
-    matrix_append(result, a);
-    matrix_append(result, b);
+    free_hash_map(result->vals);
+    result->vals = csr_to_map(sum);
+    result->scalar_val = a->scalar_val + sign * b->scalar_val;
+    matrix_fit_storage(result);
 
-    result->scalar_val = a->scalar_val + b->scalar_val;
+    csr_free(csr_a);
+    csr_free(csr_b);
+    csr_free(sum);
+    unband_free(a, sparse_a);
+    unband_free(b, sparse_b);
 
     return result;
 }
 
-void matrix_decrement(Matrix* dest, Matrix* source) {
-    MapIterator map_it = map_iterator_create(source->vals);
+Matrix* matrix_add(Matrix* a, Matrix* b) {
+    if(a->rows != b->rows || a->cols != b->cols)
+        return NULL;
 
-    while(map_iterator_has_next(&map_it)) {
-        int row, col;
-        double val;
-        map_iterator_next(&map_it, &row ,&col, &val);
-        double old_val = map_get(dest->vals, row, col);
-        matrix_set(dest, row, col, old_val - val);
+    if(!matrix_materialize(a) || !matrix_materialize(b))
+        return NULL;
+
+    PROFILE_BEGIN(span);
+    Matrix* result;
+
+    if(a->band && b->band) {
+        result = band_matrix(band_add(a->band, b->band, 1));
+    } else if(a->dense || b->dense) {
+        result = dense_add(a, b, 1);
+    } else {
+        result = sparse_add(a, b, 1);
     }
+
+    PROFILE_END(PROF_MATRIX_ADD, span, matrix_stored(a) + matrix_stored(b), matrix_stored(result));
+
+    return result;
 }
 
 Matrix* matrix_sub(Matrix* a, Matrix* b) {
     if(a->rows != b->rows || a->cols != b->cols)
         return NULL;
 
-    Matrix* result = matrix_create(a->rows, a->cols);
+    if(!matrix_materialize(a) || !matrix_materialize(b))
+        return NULL;
+
+    PROFILE_BEGIN(span);
+    Matrix* result;
 
-    matrix_append(result, a);
-    matrix_decrement(result, b);
+    if(a->band && b->band) {
+        result = band_matrix(band_add(a->band, b->band, -1));
+    } else if(a->dense || b->dense) {
+        result = dense_add(a, b, -1);
+    } else {
+        result = sparse_add(a, b, -1);
+    }
 
-    result->scalar_val = a->scalar_val -  b->scalar_val;
+    PROFILE_END(PROF_MATRIX_ADD, span, matrix_stored(a) + matrix_stored(b), matrix_stored(result));
 
     return result;
 }
 
 Matrix* matrix_scalar_mult(Matrix* matrix, double scalar) {
+    if(!matrix_materialize(matrix))
+        return NULL;
+
+    if(matrix->band)
+        return band_matrix(band_scale(matrix->band, scalar));
+
+    if(matrix->dense) {
+        Matrix* result = dense_create(matrix->rows, matrix->cols);
+        long count = matrix_cells(matrix);
+
+        for(long i = 0; i < count; i++)
+            result->dense[i] = matrix->dense[i] * scalar;
+
+        matrix_fit_storage(result);
+        return result;
+    }
+
     Matrix* result = matrix_create(matrix->rows, matrix->cols);
     MapIterator map_it = map_iterator_create(matrix->vals);
 
@@ -102,14 +922,31 @@ Matrix* matrix_scalar_mult(Matrix* matrix, double scalar) {
         matrix_set(result, row, col, val * scalar);
     }
 
-    matrix->scalar_val *= scalar;
+    result->scalar_val = matrix->scalar_val * scalar;
 
     return result;
 }
 
 Matrix* matrix_scalar_add(Matrix* matrix, double scalar) {
-    Matrix* result = matrix_create(matrix->rows, matrix->cols);
-    matrix_append(result, matrix);
+    Matrix* result = matrix_copy(matrix);
+    if(!result)
+        return NULL;
+
+    if(result->band && scalar != 0) // Every cell changes, band no longer fits
+        matrix_make_sparse(result);
+
+    if(result->dense) { // Dense cells hold scalar_val already
+        long count = matrix_cells(result);
+
+        if(scalar != 0)
+            own_dense(result);
+
+        for(long i = 0; i < count && scalar != 0; i++)
+            result->dense[i] += scalar;
+
+        return result;
+    }
+
     result->scalar_val = matrix->scalar_val + scalar;
 
     return result;
@@ -117,26 +954,63 @@ Matrix* matrix_scalar_add(Matrix* matrix, double scalar) {
 
 
 Matrix* matrix_transpose(Matrix* matrix) {
-    if(!matrix)
+    if(!matrix || !matrix_materialize(matrix))
         return NULL;
 
-    Matrix* result = matrix_create(matrix->cols, matrix->rows);
-    MapIterator map_iter= map_iterator_create(matrix->vals);
+    if(matrix->band)
+        return band_matrix(band_transpose(matrix->band));
 
-    #ifdef DEBUG
-    matrix_print(matrix);
-    #endif
+    if(matrix->dense) {
+        Matrix* result = dense_create(matrix->cols, matrix->rows);
+        dense_transpose(matrix->dense, result->dense, matrix->rows, matrix->cols);
 
-    while(map_iterator_has_next(&map_iter)) {
-        int row, col;
-        double val;
-        map_iterator_next(&map_iter, &row, &col, &val);
-        
-        matrix_set(result, col, row, val);
+        return result;
     }
 
+    // Rows of the transposed csr come out in order, so entries are added without lookups
+    Csr* csr = csr_from_map(matrix->vals, matrix->rows, matrix->cols);
+    Csr* transposed = csr_transpose(csr);
+    Matrix* result = matrix_create(matrix->cols, matrix->rows);
+
+    free_hash_map(result->vals);
+    result->vals = csr_to_map(transposed);
     result->scalar_val = matrix->scalar_val;
 
+    csr_free(csr);
+    csr_free(transposed);
+
+    return result;
+}
+
+
+// Kronecker product of a and b, block (i, j) is a(i, j) times b. Every cell including scalar_val is
+// used, NULL if the result has too many rows or columns or a matrix cannot be loaded
+Matrix* matrix_kron(Matrix* a, Matrix* b) {
+    if((long)a->rows * b->rows > INT_MAX || (long)a->cols * b->cols > INT_MAX)
+        return NULL;
+
+    Csr* csr_a = matrix_cells_csr(a);
+    Csr* csr_b = matrix_cells_csr(b);
+    if(!csr_a || !csr_b) {
+        csr_free(csr_a);
+        csr_free(csr_b);
+        return NULL;
+    }
+
+    PROFILE_BEGIN(span);
+    Csr* product = csr_kron(csr_a, csr_b);
+    Matrix* result = matrix_create(product->rows, product->cols);
+
+    free_hash_map(result->vals);
+    result->vals = csr_to_map(product);
+    matrix_fit_storage(result);
+
+    PROFILE_END(PROF_KRON, span, csr_a->nnz + csr_b->nnz, matrix_stored(result));
+
+    csr_free(csr_a);
+    csr_free(csr_b);
+    csr_free(product);
+
     return result;
 }
 
@@ -152,58 +1026,122 @@ void init_mult_vals(Matrix* matrix) {
         row_map_increment(mult_vals, row, col, val);
     }
 
-    matrix->mult_vals = mult_vals;
+    __atomic_store_n(&matrix->mult_vals, mult_vals, __ATOMIC_RELEASE);
+}
+
+
+// Stored values of sparse matrix grouped by row, built by the first product or slice that needs it
+// and kept until a cell changes
+RowMap* matrix_row_index(Matrix* matrix) {
+    if(__atomic_load_n(&matrix->mult_vals, __ATOMIC_ACQUIRE) == NULL) {
+        pthread_mutex_lock(&mult_vals_lock);
+        if(matrix->mult_vals == NULL)
+            init_mult_vals(matrix);
+        pthread_mutex_unlock(&mult_vals_lock);
+    }
+
+    return matrix->mult_vals;
 }
 
 
-// Add 1st operand multiplied by b-sized matrix of only its scalar val to result
+// Add 1st operand multiplied by b-sized matrix of only its scalar val to result, every cell of a
+// row gains scalar_val times the row's sum
 void scalar_a(Matrix* matrix, Matrix* result, double scalar_val) {
-    MapIterator map_it = map_iterator_create(matrix->vals);
+    Csr* csr = csr_from_map(matrix->vals, matrix->rows, matrix->cols);
 
-    while(map_iterator_has_next(&map_it)) {
-        // Get next non-zero value in a
-        int row, col;
-        double val;
-        map_iterator_next(&map_it, &row, &col, &val);
-        
-        for(int i = 0; i < result->cols; i++) {
-            double old_val = matrix_get(result, row, i);
-            matrix_set(result, row, i, val * scalar_val + old_val);
+    for(int i = 0; i < csr->rows; i++) {
+        double row_sum = 0;
+        for(long k = csr->row_ptr[i]; k < csr->row_ptr[i + 1]; k++)
+            row_sum += csr->vals[k];
+
+        for(int j = 0; j < result->cols && row_sum != 0; j++) {
+            double old_val = matrix_get(result, i, j);
+            matrix_set(result, i, j, row_sum * scalar_val + old_val);
         }
     }
+
+    csr_free(csr);
 }
 
-// Add 2st operand multiplied by a-sized matrix of only its scalar val to result
+// Add 2nd operand multiplied by a-sized matrix of only its scalar val to result, every cell of a
+// column gains scalar_val times the column's sum, read from the rows of the transpose
 void scalar_b(Matrix* matrix, Matrix* result, double scalar_val) {
-    MapIterator map_it = map_iterator_create(matrix->vals);
+    Csr* csr = csr_from_map(matrix->vals, matrix->rows, matrix->cols);
+    Csr* by_col = csr_transpose(csr);
 
-    while (map_iterator_has_next(&map_it)) {
-        // Get next non-zero value in b
-        int row, col;
-        double val;
-        map_iterator_next(&map_it, &row, &col, &val);
+    for(int j = 0; j < by_col->rows; j++) {
+        double col_sum = 0;
+        for(long k = by_col->row_ptr[j]; k < by_col->row_ptr[j + 1]; k++)
+            col_sum += by_col->vals[k];
 
-        for (int i = 0; i < result->rows; i++) {
-            double old_val = matrix_get(result, i, col);
-            matrix_set(result, i, col, val * scalar_val + old_val);
+        for(int i = 0; i < result->rows && col_sum != 0; i++) {
+            double old_val = matrix_get(result, i, j);
+            matrix_set(result, i, j, col_sum * scalar_val + old_val);
         }
     }
+
+    csr_free(csr);
+    csr_free(by_col);
 }
 
 
-Matrix* matrix_mult(Matrix* a, Matrix* b) {
-    if(!a || !b) 
-        return NULL;
+// Product with at least one dense operand, a sparse operand's scalar_val adds sums of the other's
+// rows or columns to every cell
+Matrix* dense_mult_matrix(Matrix* a, Matrix* b) {
+    Matrix* result = dense_create(a->rows, b->cols);
+    double* c = result->dense;
+
+    if(a->dense && b->dense) {
+        dense_mult(a->dense, b->dense, c, a->rows, a->cols, b->cols);
+    } else if(b->dense) { // Sparse a
+        Csr* csr = csr_from_map(a->vals, a->rows, a->cols);
+        csr_dense_mult(csr, b->dense, c, b->cols);
+        csr_free(csr);
+
+        if(a->scalar_val != 0) { // Every row gains scalar_val times b's column sums
+            double* col_sums = calloc(b->cols, sizeof(double));
+
+            for(int k = 0; k < b->rows; k++) {
+                for(int j = 0; j < b->cols; j++)
+                    col_sums[j] += b->dense[(long)k * b->cols + j];
+            }
+
+            for(int i = 0; i < a->rows; i++) {
+                for(int j = 0; j < b->cols; j++)
+                    c[(long)i * b->cols + j] += a->scalar_val * col_sums[j];
+            }
+
+            free(col_sums);
+        }
+    } else { // Sparse b
+        Csr* csr = csr_from_map(b->vals, b->rows, b->cols);
+        dense_csr_mult(a->dense, csr, c, a->rows);
+        csr_free(csr);
+
+        if(b->scalar_val != 0) { // Every cell of a row gains scalar_val times a's row sum
+            for(int i = 0; i < a->rows; i++) {
+                double row_sum = 0;
+                for(int k = 0; k < a->cols; k++)
+                    row_sum += a->dense[(long)i * a->cols + k];
+
+                for(int j = 0; j < b->cols; j++)
+                    c[(long)i * b->cols + j] += b->scalar_val * row_sum;
+            }
+        }
+    }
+
+    matrix_fit_storage(result);
+
+    return result;
+}
 
-    if(a->cols != b->rows)
-        return NULL; // Dimensions invalid for dot product
 
+// Product of sparse a and b
+Matrix* sparse_mult(Matrix* a, Matrix* b) {
     // Create matrix to hold result
     Matrix* result = matrix_create(a->rows, b->cols);
 
-    if(b->mult_vals == NULL)
-        init_mult_vals(b); // Initialize RowMap in b if necessary
-
+    RowMap* b_rows = matrix_row_index(b);
     MapIterator a_iter = map_iterator_create(a->vals);
 
     while(map_iterator_has_next(&a_iter)) { // Iterate through non-zero a values
@@ -213,7 +1151,7 @@ Matrix* matrix_mult(Matrix* a, Matrix* b) {
         map_iterator_next(&a_iter, &row_a, &col_a, &val_a);
         
         // Get b row
-        List* row_b_list = row_map_get_row(b->mult_vals, col_a);
+        List* row_b_list = row_map_get_row(b_rows, col_a);
         if(row_b_list == NULL) 
             continue;
         ListIterator row_b_iter = list_iter_create(row_b_list);
@@ -241,122 +1179,116 @@ Matrix* matrix_mult(Matrix* a, Matrix* b) {
     // Set results scalar value
     if(a->scalar_val != 0 && b->scalar_val != 0)
         result->scalar_val = a->scalar_val * b->scalar_val * a->cols;
-        
-
-    return result;
-}
-
-Matrix* matrix_identity(int rows, int cols) {
-    Matrix* result = matrix_create(rows, cols);
 
-    // Ensure valid matrix dimensions
-    if(rows != cols || rows < 1 || cols < 1)
-        return NULL;
+    matrix_fit_storage(result);
 
-    // Set diagonal vals to 1
-    for(int i = 0; i < rows; i++)
-        matrix_set(result, i, i, 1.0);
-    
     return result;
 }
 
 
-void matrix_swap_rows(Matrix* matrix, int row1, int row2) {
-    if (!matrix || row1 == row2 || row1 < 0 || row2 < 0 || row1 >= matrix->rows || row2 >= matrix->rows) {
-        return; // Invalid input or no-op
-    }
+Matrix* matrix_mult(Matrix* a, Matrix* b) {
+    if(!a || !b) 
+        return NULL;
 
-    for (int col = 0; col < matrix->cols; col++) {
-        double val1 = matrix_get(matrix, row1, col);
-        double val2 = matrix_get(matrix, row2, col);
+    if(a->cols != b->rows)
+        return NULL; // Dimensions invalid for dot product
 
-        matrix_set(matrix, row1, col, val2);
-        matrix_set(matrix, row2, col, val1);
-    }
-}
+    if(!matrix_materialize(a) || !matrix_materialize(b))
+        return NULL;
 
+    // Multiplying by the identity copies the other operand, sharing its storage
+    if(is_identity(a))
+        return matrix_copy(b);
+    if(is_identity(b))
+        return matrix_copy(a);
 
-double matrix_determinant(Matrix* a) {
-    if(a->rows != a->cols)
-        return -DBL_MAX; // Matrix must be square
+    PROFILE_BEGIN(span);
+    Matrix* result;
 
-    int n = a->rows;
+    if(a->band && b->band) {
+        result = band_matrix(band_mult(a->band, b->band));
+    } else {
+        Matrix* sparse_a = unband(a);
+        Matrix* sparse_b = unband(b);
 
-    // Initialize matrices as p * a = l * u
-    Matrix* l = matrix_create(a->rows, a->cols); // Zero matrix
-    Matrix* u = matrix_scalar_add(a, 0); // Copy of a
+        if(a->dense || b->dense)
+            result = dense_mult_matrix(sparse_a, sparse_b);
+        else
+            result = sparse_mult(sparse_a, sparse_b);
 
-    // Create permutation vector p (identity initially)
-    int* p = (int*)malloc(n * sizeof(int));
-    for (int i = 0; i < n; i++) {
-        p[i] = i;
+        unband_free(a, sparse_a);
+        unband_free(b, sparse_b);
     }
 
-    int sign = 1;  // Track parity of row swaps
+    PROFILE_END(PROF_MATRIX_MULT, span, matrix_stored(a) + matrix_stored(b), matrix_stored(result));
 
-    for (int k = 0; k < n; k++) {
-        // Partial pivoting: find pivot row r in column k starting at k
-        int r = k;
-        double max_val = fabs(matrix_get(u, k, k));
-        for (int i = k + 1; i < n; i++) {
-            double val = fabs(matrix_get(u, i, k));
-            if (val > max_val) {
-                max_val = val;
-                r = i;
-            }
-        }
+    return result;
+}
 
-        if (r != k) {
-            // Swap rows r and k in U
-            matrix_swap_rows(u, k, r);
+// Identity held implicitly, its diagonal is not stored
+Matrix* matrix_identity(int rows, int cols) {
+    // Ensure valid matrix dimensions
+    if(rows != cols || rows < 1 || cols < 1)
+        return NULL;
 
-            // Swap rows in L for columns < k
-            for (int col = 0; col < k; col++) {
-                double temp = matrix_get(l, k, col);
-                matrix_set(l, k, col, matrix_get(l, r, col));
-                matrix_set(l, r, col, temp);
-            }
+    return band_matrix(band_identity(rows));
+}
 
-            // Swap in permutation vector
-            int temp = p[k];
-            p[k] = p[r];
-            p[r] = temp;
 
-            sign = -sign;  // flip determinant sign
-        }
+// Determinant of sparse a, factored sparse unless a non-zero scalar_val fills every cell. Symmetric
+// positive definite matrices use the Cholesky factor, others the LU factor, both kept for later solves
+double determinant_lu(Matrix* a) {
+    if(!matrix_materialize(a))
+        return -DBL_MAX;
 
-        double pivot = matrix_get(u, k, k);
-        if(fabs(pivot) < 1e-15) {
-            // Singular matrix => determinant is zero
-            free(p);
-            //matrix_destroy(l);
-            //matrix_destroy(u);
-            return 0.0;
-        }
+    double det;
+    Cholesky* chol;
+    SparseLu* lu;
 
-        // Elimination below pivot
-        for(int i = k + 1; i < n; i++) {
-            double multiplier = matrix_get(u, i, k) / pivot;
-            matrix_set(l, i, k, multiplier);
-            for (int j = k; j < n; j++) {
-                double val = matrix_get(u, i, j) - multiplier * matrix_get(u, k, j);
-                matrix_set(u, i, j, val);
-            }
+    if(a->scalar_val != 0) {
+        double* cells = calloc(matrix_cells(a), sizeof(double));
+        if(!cells) {
+            fprintf(stderr, "Memory allocation failed for dense matrix\n");
+            exit(1);
         }
 
-        matrix_set(l, k, k, 1.0);  // L diagonal = 1
+        add_cells(cells, a, 1);
+        det = dense_determinant(cells, a->rows);
+        free(cells);
+    } else if((chol = matrix_cholesky(a))) {
+        det = exp(chol->log_det);
+    } else {
+        det = (lu = matrix_lu(a)) ? lu->det : 0;
     }
 
-    // Compute determinant = sign * product of U diagonal
-    double det = (double)sign;
-    for(int i = 0; i < n; i++) {
-        det *= matrix_get(u, i, i);
+    return det;
+}
+
+double matrix_determinant(Matrix* a) {
+    if(a->rows != a->cols)
+        return -DBL_MAX; // Matrix must be square
+
+    PROFILE_BEGIN(span);
+    double det;
+
+    if(a->band) {
+        det = band_determinant(a->band);
+    } else if(a->dense) { // Factor a copy of the cells in place
+        long count = matrix_cells(a);
+        double* cells = malloc(count * sizeof(double));
+        if(!cells) {
+            fprintf(stderr, "Memory allocation failed for dense matrix\n");
+            exit(1);
+        }
+
+        memcpy(cells, a->dense, count * sizeof(double));
+        det = dense_determinant(cells, a->rows);
+        free(cells);
+    } else {
+        det = determinant_lu(a);
     }
 
-    // Cleanup
-    free(p);
-    //matrix_destroy(l);
-    //matrix_destroy(u);
+    PROFILE_END(PROF_MATRIX_DETERMINANT, span, a->pager ? 0 : matrix_stored(a), 0);
 
     return det;
 }
@@ -369,80 +1301,117 @@ Matrix* matrix_inverse(Matrix* a) {
 
     double det = matrix_determinant(a);
 
-    if(det == 0) // Matrix is singular
+    if(det == 0 || !matrix_materialize(a)) // Matrix is singular
         return NULL;
 
-    Matrix* b = matrix_scalar_add(a, 0); // Copy matrix a into b
-    Matrix* inv = matrix_identity(n, n);
-
-    for(int i = 0; i < n; i++) {
-        // Pivot element
-        double pivot = matrix_get(b, i, i);
-        if(pivot == 0.0) {
-            // Try to swap with a lower row
-            int swap_row = -1;
-            for(int k = i + 1; k < n; k++) {
-                if(matrix_get(b, k, i) != 0.0) {
-                    swap_row = k;
-                    break;
-                }
-            }
+    if(is_identity(a))
+        return matrix_identity(n, n);
+
+    // Solve for each column of the identity with the factor of a symmetric positive definite matrix,
+    // or the LU factor of another sparse one
+    Cholesky* chol = matrix_cholesky(a);
+    SparseLu* lu = chol || a->dense ? NULL : matrix_lu(a);
+    if(chol || lu) {
+        double* e = calloc(n, sizeof(double));
+        double* x = malloc(n * sizeof(double));
+        double* cells = malloc((long)n * n * sizeof(double));
+        if(!e || !x || !cells) {
+            fprintf(stderr, "Memory allocation failed for dense matrix\n");
+            exit(1);
+        }
 
-            if(swap_row == -1) { // Cannot comupute inverse if pivot is zero
-                matrix_free(b);
-                matrix_free(inv);
-                return NULL;
-            }
+        for(int j = 0; j < n; j++) {
+            e[j] = 1;
+            if(chol)
+                cholesky_solve(chol, e, x);
+            else
+                lu_solve(lu, e, x);
+            e[j] = 0;
 
-            // Swap rows in both A and inv
-            for(int j = 0; j < n; j++) {
-                double tmp_a = matrix_get(b, i, j);
-                matrix_set(b, i, j, matrix_get(b, swap_row, j));
-                matrix_set(b, swap_row, j, tmp_a);
+            for(int i = 0; i < n; i++)
+                cells[(long)i * n + j] = x[i];
+        }
 
-                double tmp_inv = matrix_get(inv, i, j);
-                matrix_set(inv, i, j, matrix_get(inv, swap_row, j));
-                matrix_set(inv, swap_row, j, tmp_inv);
-            }
+        Matrix* inv = matrix_from_cells(cells, n, n);
+        free(e);
+        free(x);
+        free(cells);
 
-            pivot = matrix_get(b, i, i);
-        }
+        return inv;
+    }
 
-        // Normalize pivot row
-        for (int j = 0; j < n; j++) {
-            matrix_set(b, i, j, matrix_get(b, i, j) / pivot);
-            matrix_set(inv, i, j, matrix_get(inv, i, j) / pivot);
-        }
+    // Eliminate on a dense copy, the inverse is rarely sparse
+    double* cells = calloc((long)n * n, sizeof(double));
+    if(!cells) {
+        fprintf(stderr, "Memory allocation failed for dense matrix\n");
+        exit(1);
+    }
+    add_cells(cells, a, 1);
 
-        // Eliminate other rows
-        for (int k = 0; k < n; k++) {
-            if (k == i) continue;
-            double factor = matrix_get(b, k, i);
-            for (int j = 0; j < n; j++) {
-                matrix_set(b, k, j, matrix_get(b, k, j) - factor * matrix_get(b, i, j));
-                matrix_set(inv, k, j, matrix_get(inv, k, j) - factor * matrix_get(inv, i, j));
-            }
-        }
+    Matrix* inv = dense_create(n, n);
+    for(int i = 0; i < n; i++)
+        inv->dense[(long)i * n + i] = 1;
+
+    bool inverted = dense_inverse(cells, inv->dense, n);
+    free(cells);
+
+    if(!inverted) { // Cannot comupute inverse if pivot is zero
+        matrix_free(inv);
+        return NULL;
     }
 
-    matrix_free(b);
+    matrix_fit_storage(inv);
+
     return inv;
 }
 
 
-// Set value in matrix
-void matrix_set(Matrix* matrix, int row, int col, double val) {
+// Set value in matrix, false if the row of a lazily loaded matrix could not be fetched and the cell
+// is left unchanged
+bool matrix_set(Matrix* matrix, int row, int col, double val) {
     if(matrix->mult_vals != NULL) 
         matrix->mult_vals = NULL;
+
+    if(matrix->band) // Band storage is read-only, edits switch to sparse
+        matrix_make_sparse(matrix);
     
-    map_set(matrix->vals, row, col, val - matrix->scalar_val);
+    if(matrix->dense) {
+        if(row >= 0 && row < matrix->rows && col >= 0 && col < matrix->cols) {
+            own_dense(matrix);
+            matrix->dense[(long)row * matrix->cols + col] = val;
+        }
+    } else if(matrix->pager) { // Edit row block of lazily loaded matrix
+        // A cell that was not edited must not be saved, its persisted value was never read
+        if(!pager_set(matrix->pager, row, col, val - matrix->scalar_val))
+            return false;
+    } else
+        map_set(matrix->vals, row, col, val - matrix->scalar_val);
+
+    matrix_mark_dirty(matrix, row, col);
+    drop_factors(matrix);
+
+    return true;
+}
+
+// Get stored value at row, col, without scalar_val applied
+double matrix_get_stored(Matrix* matrix, int row, int col) {
+    if(matrix->dense)
+        return matrix->dense[(long)row * matrix->cols + col];
+
+    if(matrix->band)
+        return band_get(matrix->band, row, col);
+
+    if(matrix->pager) // Fetch row block of lazily loaded matrix if needed
+        return pager_get(matrix->pager, row, col);
+
+    return map_get(matrix->vals, row, col);
 }
 
 double matrix_get(Matrix* matrix, int row, int col) {
-    if(row < 0 || row > matrix->rows || col < 0 || col > matrix->cols)
+    if(row < 0 || row >= matrix->rows || col < 0 || col >= matrix->cols)
         return -DBL_MAX;
 
-    return map_get(matrix->vals, row, col) + matrix->scalar_val;
+    return matrix_get_stored(matrix, row, col) + matrix->scalar_val;
 }
 
 void matrix_print(Matrix* matrix) {
@@ -463,7 +1432,7 @@ void matrix_print(Matrix* matrix) {
     for (int i = 0; i < matrix->rows; ++i) { // Iterate through rows
         printf("%s\n", sep_line); // Print horizontal border
         for (int j = 0; j < matrix->cols; ++j) { // Iterate columns
-            double val = map_get(matrix->vals, i, j) + matrix->scalar_val; // Get value to print
+            double val = matrix_get_stored(matrix, i, j) + matrix->scalar_val; // Get value to print
             printf("| %6.2f ", val); // Print val
         }
         printf("|\n");
@@ -472,19 +1441,85 @@ void matrix_print(Matrix* matrix) {
 }
 
 
+// Copy sharing matrix's storage, each side clones a bucket or dense array when it first modifies it
 Matrix* matrix_copy(Matrix* matrix) {
+    if(!matrix_materialize(matrix))
+        return NULL;
+
+    if(matrix->band)
+        return band_matrix(band_copy(matrix->band));
+
+    if(matrix->dense) {
+        Matrix* copy = matrix_create(matrix->rows, matrix->cols);
+        __atomic_add_fetch(matrix->dense_refs, 1, __ATOMIC_RELAXED);
+        copy->dense = matrix->dense;
+        copy->dense_refs = matrix->dense_refs;
+
+        return copy;
+    }
+
     Matrix* copy = matrix_create(matrix->rows, matrix->cols);
-    matrix_append(copy, matrix);
+    free_hash_map(copy->vals);
+    copy->vals = map_share(matrix->vals);
     copy->scalar_val = matrix->scalar_val;
 
     return copy;
 }
 
 
+// Start tracking changes against repository version repo_token
+void matrix_mark_clean(Matrix* matrix, long repo_token) {
+    if(matrix->dirty != NULL)
+        free_hash_map(matrix->dirty);
+
+    matrix->dirty = map_create();
+    matrix->repo_token = repo_token;
+}
+
+
+// Move changed cells and their current values into a new matrix, source stops tracking
+Matrix* matrix_take_changes(Matrix* matrix) {
+    Matrix* changes = matrix_create(matrix->rows, matrix->cols);
+    changes->scalar_val = matrix->scalar_val;
+    changes->dirty = matrix->dirty;
+    changes->repo_token = matrix->repo_token;
+
+    if(changes->dirty != NULL) {
+        MapIterator dirty_it = map_iterator_create(changes->dirty);
+
+        while(map_iterator_has_next(&dirty_it)) {
+            int row, col;
+            double unused_val;
+            map_iterator_next(&dirty_it, &row, &col, &unused_val);
+            map_set(changes->vals, row, col, matrix_get_stored(matrix, row, col));
+        }
+    }
+
+    matrix->dirty = NULL;
+    matrix->repo_token = 0;
+
+    return changes;
+}
+
+
+// Stop tracking changes, next save must write the full matrix
+void matrix_untrack(Matrix* matrix) {
+    if(matrix->dirty != NULL)
+        free_hash_map(matrix->dirty);
+
+    matrix->dirty = NULL;
+    matrix->repo_token = 0;
+}
+
+
 void matrix_free(Matrix* matrix) {
     if(matrix == NULL) 
         return;
 
+    // Free the dirty cell set
+    if(matrix->dirty != NULL)
+        free_hash_map(matrix->dirty);
+
     // Free the vals HashMap
     if(matrix->vals != NULL)
         free_hash_map(matrix->vals);
@@ -493,5 +1528,47 @@ void matrix_free(Matrix* matrix) {
     if(matrix->mult_vals != NULL)
         free_row_map(matrix->mult_vals);
 
+    // Free cached row blocks of lazily loaded matrix
+    pager_free(matrix->pager);
+
+    dense_free(matrix);
+    band_free(matrix->band);
+    precond_free(matrix->precond);
+    cholesky_free(matrix->chol);
+    lu_free(matrix->lu);
     free(matrix);
+    MEM_TRACK(MEM_MATRIX, -1, -(long)sizeof(Matrix));
+}
+
+
+// Account bytes held by matrix without loading any rows, storage shared with copies is split between them
+void matrix_mem(Matrix* matrix, MatrixMem* mem) {
+    mem->nnz = matrix->dense ? dense_nnz(matrix) : matrix->vals->size + pager_resident(matrix->pager);
+    mem->vals = map_bytes(matrix->vals);
+    if(matrix->dense)
+        mem->vals += matrix_cells(matrix) * sizeof(double) / __atomic_load_n(matrix->dense_refs, __ATOMIC_RELAXED);
+
+    if(matrix->band) {
+        mem->nnz = band_nnz(matrix->band);
+        mem->vals += band_bytes(matrix->band);
+    }
+    mem->index = row_map_bytes(matrix->mult_vals) + precond_bytes(matrix->precond) + cholesky_bytes(matrix->chol)
+        + lu_bytes(matrix->lu);
+    mem->other = sizeof(Matrix) + map_bytes(matrix->dirty) + pager_bytes(matrix->pager);
+}
+
+
+// Add an owner to matrix
+Matrix* matrix_retain(Matrix* matrix) {
+    if(matrix != NULL)
+        __atomic_add_fetch(&matrix->refs, 1, __ATOMIC_RELAXED);
+
+    return matrix;
+}
+
+
+// Drop an owner of matrix, freeing it once no owners remain
+void matrix_release(Matrix* matrix) {
+    if(matrix != NULL && __atomic_sub_fetch(&matrix->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        matrix_free(matrix);
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/matrix_pager.h"
+#include "../include/map_iterator.h"
+
+
+// Create pager reading rows of persisted matrix name on demand
+MatrixPager* pager_create(const char* name, int rows, PagerFetchFn fetch, PagerReleaseFn release) {
+    MatrixPager* pager = malloc(sizeof(MatrixPager));
+    if(!pager) {
+        fprintf(stderr, "Memory allocation failed for MatrixPager\n");
+        exit(1);
+    }
+
+    pager->name = strdup(name);
+    pager->num_blocks = (rows + PAGER_BLOCK_ROWS - 1) / PAGER_BLOCK_ROWS;
+    pager->blocks = calloc(pager->num_blocks, sizeof(PagerBlock*));
+    pager->lru_head = NULL;
+    pager->lru_tail = NULL;
+    pager->cached = 0;
+    pager->fetch = fetch;
+    pager->release = release;
+
+    if(!pager->blocks) {
+        fprintf(stderr, "Memory allocation failed for MatrixPager\n");
+        exit(1);
+    }
+
+    return pager;
+}
+
+
+// Unlink block from LRU list
+void lru_remove(MatrixPager* pager, PagerBlock* block) {
+    if(block->prev)
+        block->prev->next = block->next;
+    else
+        pager->lru_head = block->next;
+
+    if(block->next)
+        block->next->prev = block->prev;
+    else
+        pager->lru_tail = block->prev;
+}
+
+
+// Link block as most recently used
+void lru_push_front(MatrixPager* pager, PagerBlock* block) {
+    block->prev = NULL;
+    block->next = pager->lru_head;
+
+    if(pager->lru_head)
+        pager->lru_head->prev = block;
+    else
+        pager->lru_tail = block;
+
+    pager->lru_head = block;
+}
+
+
+// Drop least recently used unpinned block
+void evict_block(MatrixPager* pager) {
+    PagerBlock* block = pager->lru_tail;
+
+    while(block && block->pinned) // Skip blocks holding edits
+        block = block->prev;
+
+    if(!block)
+        return;
+
+    lru_remove(pager, block);
+    pager->blocks[block->index] = NULL;
+    pager->cached--;
+
+    free_hash_map(block->vals);
+    free(block);
+}
+
+
+// Get cached block holding row, fetching it if necessary
+PagerBlock* get_block(MatrixPager* pager, int row) {
+    int index = row / PAGER_BLOCK_ROWS;
+
+    if(row < 0 || index >= pager->num_blocks)
+        return NULL;
+
+    PagerBlock* block = pager->blocks[index];
+
+    if(block) { // Cache hit, mark as most recently used
+        lru_remove(pager, block);
+        lru_push_front(pager, block);
+        return block;
+    }
+
+    // Fetch block's rows from persisted matrix
+    HashMap* vals = map_create();
+    int first_row = index * PAGER_BLOCK_ROWS;
+
+    if(!pager->fetch(pager->name, first_row, first_row + PAGER_BLOCK_ROWS - 1, vals)) {
+        fprintf(stderr, "Failed to load rows %d-%d of matrix %s\n", first_row, first_row + PAGER_BLOCK_ROWS - 1, pager->name);
+        free_hash_map(vals);
+        return NULL;
+    }
+
+    if(pager->cached >= PAGER_MAX_BLOCKS) // Keep cache bounded
+        evict_block(pager);
+
+    block = malloc(sizeof(PagerBlock));
+    if(!block) {
+        fprintf(stderr, "Memory allocation failed for PagerBlock\n");
+        exit(1);
+    }
+
+    block->index = index;
+    block->vals = vals;
+    block->pinned = false;
+
+    pager->blocks[index] = block;
+    pager->cached++;
+    lru_push_front(pager, block);
+
+    return block;
+}
+
+
+// Get stored value at row, col
+double pager_get(MatrixPager* pager, int row, int col) {
+    PagerBlock* block = get_block(pager, row);
+
+    if(!block)
+        return 0;
+
+    return map_get(block->vals, row, col);
+}
+
+
+// Set stored value at row, col, keeping its block cached until materialized. False if the block
+// could not be fetched, the edit is then not made
+bool pager_set(MatrixPager* pager, int row, int col, double val) {
+    PagerBlock* block = get_block(pager, row);
+
+    if(!block)
+        return false;
+
+    if(!block->pinned) { // Edited blocks no longer count towards cache bound
+        block->pinned = true;
+        pager->cached--;
+    }
+
+    map_set(block->vals, row, col, val);
+    return true;
+}
+
+
+// Load every stored value into dest, cached blocks take precedence over persisted rows
+bool pager_materialize(MatrixPager* pager, HashMap* dest) {
+    int block = 0;
+
+    while(block < pager->num_blocks) {
+        if(pager->blocks[block]) { // Copy cached block
+            MapIterator map_it = map_iterator_create(pager->blocks[block]->vals);
+
+            while(map_iterator_has_next(&map_it)) {
+                int row, col;
+                double val;
+                map_iterator_next(&map_it, &row, &col, &val);
+                map_set(dest, row, col, val);
+            }
+
+            block++;
+            continue;
+        }
+
+        // Fetch run of consecutive uncached blocks with one query
+        int end = block;
+        while(end < pager->num_blocks && !pager->blocks[end])
+            end++;
+
+        if(!pager->fetch(pager->name, block * PAGER_BLOCK_ROWS, end * PAGER_BLOCK_ROWS - 1, dest))
+            return false;
+
+        block = end;
+    }
+
+    return true;
+}
+
+
+// Deallocate cached blocks and release persisted matrix
+void pager_free(MatrixPager* pager) {
+    if(!pager)
+        return;
+
+    PagerBlock* block = pager->lru_head;
+    while(block) {
+        PagerBlock* next = block->next;
+        free_hash_map(block->vals);
+        free(block);
+        block = next;
+    }
+
+    if(pager->release)
+        pager->release(pager->name);
+
+    free(pager->blocks);
+    free(pager->name);
+    free(pager);
+}
+
+
+// Values held by cached blocks
+long pager_resident(MatrixPager* pager) {
+    if(!pager)
+        return 0;
+
+    long nnz = 0;
+    for(PagerBlock* block = pager->lru_head; block; block = block->next)
+        nnz += block->vals->size;
+
+    return nnz;
+}
+
+
+// Bytes allocated for pager and its cached blocks
+size_t pager_bytes(MatrixPager* pager) {
+    if(!pager)
+        return 0;
+
+    size_t bytes = sizeof(MatrixPager) + strlen(pager->name) + 1 + pager->num_blocks * sizeof(PagerBlock*);
+    for(PagerBlock* block = pager->lru_head; block; block = block->next)
+        bytes += sizeof(PagerBlock) + map_bytes(block->vals);
+
+    return bytes;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/mem_stats.h"
+
+const char* mem_kind_names[NUM_MEM_KINDS] = {
+    "Matrix",
+    "HashMap",
+    "RowMap",
+    "List",
+    "Dense",
+    "Band"
+};
+
+#ifdef NO_PROFILE
+
+void mem_print_structures() {
+    printf("Allocation tracking is disabled in this build\n");
+}
+
+#else
+
+// Live allocations changed by one thread, only written by that thread so updates need no locking.
+// Structures freed by another thread than the one that made them leave negative counts here
+typedef struct MemCounters {
+    long objects[NUM_MEM_KINDS];
+    long bytes[NUM_MEM_KINDS];
+    struct MemCounters* next;
+} MemCounters;
+
+_Thread_local MemCounters* local_mem = NULL;
+
+MemCounters* all_mem = NULL;    // Counters of every thread that allocated or freed a structure
+pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Counters of calling thread, registered on first use
+MemCounters* get_mem_counters() {
+    if(local_mem)
+        return local_mem;
+
+    local_mem = calloc(1, sizeof(MemCounters));
+    if(!local_mem) {
+        fprintf(stderr, "Memory allocation failed for MemCounters\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&mem_lock);
+    local_mem->next = all_mem;
+    all_mem = local_mem;
+    pthread_mutex_unlock(&mem_lock);
+
+    return local_mem;
+}
+
+
+// Record objects structures of kind totalling bytes allocated, negative when freed
+void mem_track(MemKind kind, long objects, long bytes) {
+    MemCounters* counters = get_mem_counters();
+
+    __atomic_store_n(&counters->objects[kind], counters->objects[kind] + objects, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters->bytes[kind], counters->bytes[kind] + bytes, __ATOMIC_RELAXED);
+}
+
+
+// Print live count and bytes of every tracked structure
+void mem_print_structures() {
+    long objects[NUM_MEM_KINDS] = {0};
+    long bytes[NUM_MEM_KINDS] = {0};
+
+    pthread_mutex_lock(&mem_lock);
+    for(MemCounters* counters = all_mem; counters; counters = counters->next) {
+        for(int kind = 0; kind < NUM_MEM_KINDS; kind++) {
+            objects[kind] += __atomic_load_n(&counters->objects[kind], __ATOMIC_RELAXED);
+            bytes[kind] += __atomic_load_n(&counters->bytes[kind], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+
+    long total = 0;
+
+    printf("%-12s %12s %14s\n", "Structure", "Live", "Bytes");
+    for(int kind = 0; kind < NUM_MEM_KINDS; kind++) {
+        printf("%-12s %12ld %14ld\n", mem_kind_names[kind], objects[kind], bytes[kind]);
+        total += bytes[kind];
+    }
+    printf("%-12s %12s %14ld\n", "Total", "", total);
+}
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../include/norm.h"
+#include "../include/solver.h"
+#include "../include/profile.h"
+
+// Factor kept with a matrix, Cholesky if it is symmetric positive definite, LU otherwise
+typedef struct {
+    Cholesky* chol;
+    SparseLu* lu;
+} Factor;
+
+
+// Solve A x = b, or A^T x = b if transpose, with whichever factor is held
+void factor_solve(Factor* factor, bool transpose, const double* b, double* x) {
+    if(factor->chol)
+        cholesky_solve(factor->chol, b, x);
+    else if(transpose)
+        lu_solve_transpose(factor->lu, b, x);
+    else
+        lu_solve(factor->lu, b, x);
+}
+
+
+// Norm of every cell of a, each stored value is offset by scalar_val and so is every cell not stored.
+// -1 if a cannot be loaded
+double matrix_norm(Matrix* a, NormType type) {
+    Csr* csr = matrix_csr(a);
+    if(!csr)
+        return -1;
+
+    double s = a->scalar_val;
+    double norm = 0;
+
+    if(type == NORM_FRO) {
+        double sum = ((double)a->rows * a->cols - csr->nnz) * s * s;
+        for(long p = 0; p < csr->nnz; p++)
+            sum += (csr->vals[p] + s) * (csr->vals[p] + s);
+        norm = sqrt(sum);
+    } else if(type == NORM_INF) {
+        for(int i = 0; i < a->rows; i++) {
+            long len = csr->row_ptr[i + 1] - csr->row_ptr[i];
+            double sum = (a->cols - len) * fabs(s);
+
+            for(long p = csr->row_ptr[i]; p < csr->row_ptr[i + 1]; p++)
+                sum += fabs(csr->vals[p] + s);
+            norm = fmax(norm, sum);
+        }
+    } else {
+        double* sums = vec_create(a->cols);
+        long* counts = calloc(a->cols, sizeof(long));
+        if(!counts) {
+            fprintf(stderr, "Memory allocation failed for vector\n");
+            exit(1);
+        }
+
+        for(long p = 0; p < csr->nnz; p++) {
+            sums[csr->col_idx[p]] += fabs(csr->vals[p] + s);
+            counts[csr->col_idx[p]]++;
+        }
+
+        for(int j = 0; j < a->cols; j++)
+            norm = fmax(norm, sums[j] + (a->rows - counts[j]) * fabs(s));
+
+        free(sums);
+        free(counts);
+    }
+
+    csr_free(csr);
+
+    return norm;
+}
+
+
+// Signs of y as +-1 into sign, true if none changed from the previous sign vector
+bool sign_vector(const double* y, double* sign, int n) {
+    bool same = true;
+
+    for(int i = 0; i < n; i++) {
+        double next = y[i] >= 0 ? 1 : -1;
+        same = same && next == sign[i];
+        sign[i] = next;
+    }
+
+    return same;
+}
+
+
+int max_abs_index(const double* z, int n) {
+    int best = 0;
+    for(int i = 1; i < n; i++) {
+        if(fabs(z[i]) > fabs(z[best]))
+            best = i;
+    }
+
+    return best;
+}
+
+
+double vec_norm1(const double* x, int n) {
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+        sum += fabs(x[i]);
+
+    return sum;
+}
+
+
+// Lower bound on ||A^-1||_1 from a few solves with the factor of A, Hager's method as refined by
+// Higham. The solve with A^-T sign(A^-1 x) is the subgradient at x, whose largest entry picks the
+// column of A^-1 to try next. The iteration stops once signs repeat or the estimate stops growing,
+// then the estimate is checked against a vector of alternating signs that defeats the worst cases
+double inverse_norm1(Factor* factor, int n) {
+    double* x = vec_create(n);
+    double* y = vec_create(n);
+    double* sign = vec_create(n);
+    double* z = vec_create(n);
+
+    for(int i = 0; i < n; i++)
+        x[i] = 1.0 / n;
+
+    factor_solve(factor, false, x, y);
+    double est = vec_norm1(y, n);
+
+    if(n > 1) {
+        sign_vector(y, sign, n);
+        factor_solve(factor, true, sign, z);
+        int j = max_abs_index(z, n);
+
+        for(int iter = 1; iter < COND_MAX_ITER; iter++) {
+            for(int i = 0; i < n; i++)
+                x[i] = i == j ? 1 : 0;
+
+            factor_solve(factor, false, x, y);
+            double prev = est;
+            est = vec_norm1(y, n);
+
+            if(sign_vector(y, sign, n) || est <= prev) {
+                est = fmax(est, prev);
+                break;
+            }
+
+            factor_solve(factor, true, sign, z);
+            int prev_j = j;
+            j = max_abs_index(z, n);
+
+            if(fabs(z[prev_j]) == fabs(z[j]))
+                break;
+        }
+
+        for(int i = 0; i < n; i++)
+            x[i] = (i % 2 ? -1 : 1) * (1 + (double)i / (n - 1));
+
+        factor_solve(factor, false, x, y);
+        est = fmax(est, 2 * vec_norm1(y, n) / (3.0 * n));
+    }
+
+    free(x);
+    free(y);
+    free(sign);
+    free(z);
+
+    return est;
+}
+
+
+// Estimate of the 1-norm condition number ||A||_1 ||A^-1||_1 of square a, using the Cholesky or LU
+// factor kept with a, which is built if a has neither. INFINITY if a is singular to working
+// precision, -1 if a is not square or cannot be loaded
+double matrix_cond(Matrix* a) {
+    if(a->rows != a->cols || !matrix_materialize(a))
+        return -1;
+
+    PROFILE_BEGIN(span);
+    Factor factor = {matrix_cholesky(a), NULL};
+    if(!factor.chol)
+        factor.lu = matrix_lu(a);
+
+    double cond = INFINITY;
+    if(factor.chol || factor.lu)
+        cond = matrix_norm(a, NORM_ONE) * inverse_norm1(&factor, a->rows);
+
+    PROFILE_END(PROF_COND, span, matrix_stored(a), 0);
+
+    return cond;
+}
@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "../include/ordering.h"
+
+// Undirected graph of a matrix's pattern, neighbours of each vertex ascending
+typedef struct {
+    int n;
+    int** adj;
+    int* deg;
+} Graph;
+
+// Growable list of vertices
+typedef struct {
+    int* items;
+    int len;
+    int capacity;
+} VertexList;
+
+// Quotient graph of the elimination. Eliminated vertices become elements that stand for the clique
+// of their remaining neighbours, so eliminating a vertex never builds that clique explicitly
+typedef struct {
+    VertexList* vars;   // Variables adjacent to each variable by original edges not yet covered
+    VertexList* elems;  // Elements adjacent to each variable
+    VertexList* bound;  // Variables adjacent to each element
+    bool* eliminated;   // Variables already ordered
+    bool* absorbed;     // Elements merged into a later element
+    int n;              // Variables, element p is formed when variable p is eliminated
+    int num_elems;      // Elements, those past n are given before elimination starts
+} QuotientGraph;
+
+
+void* ordering_alloc(size_t bytes) {
+    void* ptr = malloc(bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for ordering\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+// Graph with an edge between i and j for every off-diagonal entry of a or its transpose
+Graph* graph_create(Csr* a) {
+    int n = a->rows;
+    Csr* at = csr_transpose(a);
+    Graph* graph = ordering_alloc(sizeof(Graph));
+
+    graph->n = n;
+    graph->adj = ordering_alloc(n * sizeof(int*));
+    graph->deg = ordering_alloc(n * sizeof(int));
+
+    // Rows of a and its transpose are sorted, merge them dropping duplicates and the diagonal
+    for(int i = 0; i < n; i++) {
+        long ka = a->row_ptr[i], end_a = a->row_ptr[i + 1];
+        long kt = at->row_ptr[i], end_t = at->row_ptr[i + 1];
+        int* adj = ordering_alloc((end_a - ka + end_t - kt) * sizeof(int));
+        int len = 0;
+
+        while(ka < end_a || kt < end_t) {
+            int col;
+
+            if(kt >= end_t || (ka < end_a && a->col_idx[ka] < at->col_idx[kt]))
+                col = a->col_idx[ka++];
+            else if(ka >= end_a || at->col_idx[kt] < a->col_idx[ka])
+                col = at->col_idx[kt++];
+            else {
+                col = a->col_idx[ka++];
+                kt++;
+            }
+
+            if(col != i)
+                adj[len++] = col;
+        }
+
+        graph->adj[i] = adj;
+        graph->deg[i] = len;
+    }
+
+    csr_free(at);
+
+    return graph;
+}
+
+
+void graph_free(Graph* graph) {
+    for(int i = 0; i < graph->n; i++)
+        free(graph->adj[i]);
+
+    free(graph->adj);
+    free(graph->deg);
+    free(graph);
+}
+
+
+void vertex_list_add(VertexList* list, int v) {
+    if(list->len == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 4;
+        list->items = realloc(list->items, list->capacity * sizeof(int));
+        if(!list->items) {
+            fprintf(stderr, "Memory allocation failed for ordering\n");
+            exit(1);
+        }
+    }
+
+    list->items[list->len++] = v;
+}
+
+
+// Empty quotient graph of n variables and num_elems elements, the first n of which are the elements
+// variables become when eliminated
+QuotientGraph quotient_create(int n, int num_elems) {
+    QuotientGraph qg = {
+        calloc(n, sizeof(VertexList)), calloc(n, sizeof(VertexList)), calloc(num_elems, sizeof(VertexList)),
+        calloc(n, sizeof(bool)), calloc(num_elems, sizeof(bool)), n, num_elems
+    };
+    if(!qg.vars || !qg.elems || !qg.bound || !qg.eliminated || !qg.absorbed) {
+        fprintf(stderr, "Memory allocation failed for ordering\n");
+        exit(1);
+    }
+
+    return qg;
+}
+
+
+void quotient_free(QuotientGraph* qg) {
+    for(int i = 0; i < qg->n; i++) {
+        free(qg->vars[i].items);
+        free(qg->elems[i].items);
+    }
+    for(int e = 0; e < qg->num_elems; e++)
+        free(qg->bound[e].items);
+
+    free(qg->vars);
+    free(qg->elems);
+    free(qg->bound);
+    free(qg->eliminated);
+    free(qg->absorbed);
+}
+
+
+// Approximate minimum degree order of the variables of qg, starting from degree. Eliminating p forms
+// element p from p's variables and the elements p touches, which are absorbed. Degrees of its
+// variables are bounded from the sizes of their elements outside element p instead of counted
+// exactly. Returns perm, perm[k] is the variable eliminated k-th
+int* quotient_min_degree(QuotientGraph qg, int* degree) {
+    int n = qg.n;
+    int* perm = ordering_alloc(n * sizeof(int));
+
+    int* mark = ordering_alloc(n * sizeof(int));  // mark[v] == stamp flags v in the new element
+    int* w_mark = ordering_alloc(qg.num_elems * sizeof(int));
+    int* w = ordering_alloc(qg.num_elems * sizeof(int)); // Size of element outside the new element
+
+    // Vertices bucketed by degree in doubly linked lists
+    int* head = ordering_alloc(n * sizeof(int));
+    int* next = ordering_alloc(n * sizeof(int));
+    int* prev = ordering_alloc(n * sizeof(int));
+
+    for(int v = 0; v < n; v++) {
+        head[v] = -1;
+        mark[v] = -1;
+    }
+    for(int e = 0; e < qg.num_elems; e++)
+        w_mark[e] = -1;
+
+    for(int v = n - 1; v >= 0; v--) {
+        prev[v] = -1;
+        next[v] = head[degree[v]];
+        if(next[v] >= 0)
+            prev[next[v]] = v;
+        head[degree[v]] = v;
+    }
+
+    int min_deg = 0;
+
+    for(int k = 0; k < n; k++) {
+        while(head[min_deg] < 0)
+            min_deg++;
+
+        int p = head[min_deg];
+        head[min_deg] = next[p];
+        if(next[p] >= 0)
+            prev[next[p]] = -1;
+
+        perm[k] = p;
+        qg.eliminated[p] = true;
+        mark[p] = k;
+
+        // New element is the union of p's variables and its elements' variables
+        VertexList* lp = &qg.bound[p];
+
+        for(int t = 0; t < qg.vars[p].len; t++) {
+            int j = qg.vars[p].items[t];
+
+            if(!qg.eliminated[j] && mark[j] != k) {
+                mark[j] = k;
+                vertex_list_add(lp, j);
+            }
+        }
+
+        for(int t = 0; t < qg.elems[p].len; t++) {
+            int e = qg.elems[p].items[t];
+            if(qg.absorbed[e])
+                continue;
+
+            for(int u = 0; u < qg.bound[e].len; u++) {
+                int j = qg.bound[e].items[u];
+
+                if(!qg.eliminated[j] && mark[j] != k) {
+                    mark[j] = k;
+                    vertex_list_add(lp, j);
+                }
+            }
+
+            qg.absorbed[e] = true;
+            free(qg.bound[e].items);
+            qg.bound[e] = (VertexList){NULL, 0, 0};
+        }
+
+        free(qg.vars[p].items);
+        free(qg.elems[p].items);
+        qg.vars[p] = (VertexList){NULL, 0, 0};
+        qg.elems[p] = (VertexList){NULL, 0, 0};
+
+        // Size of each other element touching the new one outside of it
+        for(int t = 0; t < lp->len; t++) {
+            VertexList* elems = &qg.elems[lp->items[t]];
+
+            for(int u = 0; u < elems->len; u++) {
+                int e = elems->items[u];
+                if(qg.absorbed[e])
+                    continue;
+
+                if(w_mark[e] != k) {
+                    w_mark[e] = k;
+                    w[e] = qg.bound[e].len;
+                }
+                w[e]--;
+            }
+        }
+
+        for(int t = 0; t < lp->len; t++) {
+            int i = lp->items[t];
+            VertexList* vars = &qg.vars[i];
+            VertexList* elems = &qg.elems[i];
+            int bound = 0, len = 0;
+
+            // Elements inside the new one are absorbed, it covers their variables
+            for(int u = 0; u < elems->len; u++) {
+                int e = elems->items[u];
+
+                if(!qg.absorbed[e] && w[e] == 0) {
+                    qg.absorbed[e] = true;
+                    free(qg.bound[e].items);
+                    qg.bound[e] = (VertexList){NULL, 0, 0};
+                }
+
+                if(!qg.absorbed[e]) {
+                    elems->items[len++] = e;
+                    bound += w[e];
+                }
+            }
+            elems->len = len;
+            vertex_list_add(elems, p);
+
+            // Edges to variables of the new element are covered by it
+            len = 0;
+            for(int u = 0; u < vars->len; u++) {
+                int j = vars->items[u];
+                if(!qg.eliminated[j] && mark[j] != k)
+                    vars->items[len++] = j;
+            }
+            vars->len = len;
+
+            int d = vars->len + lp->len - 1 + bound;
+            if(d > degree[i] + lp->len - 1)
+                d = degree[i] + lp->len - 1;
+            if(d > n - k - 2)
+                d = n - k - 2;
+
+            // Relink i in the bucket of its new degree
+            if(prev[i] >= 0)
+                next[prev[i]] = next[i];
+            else
+                head[degree[i]] = next[i];
+            if(next[i] >= 0)
+                prev[next[i]] = prev[i];
+
+            degree[i] = d;
+            prev[i] = -1;
+            next[i] = head[d];
+            if(head[d] >= 0)
+                prev[head[d]] = i;
+            head[d] = i;
+
+            if(d < min_deg)
+                min_deg = d;
+        }
+    }
+
+    free(mark);
+    free(w_mark);
+    free(w);
+    free(head);
+    free(next);
+    free(prev);
+
+    return perm;
+}
+
+
+// Approximate minimum degree order of square a. Returns perm, perm[k] is the row eliminated k-th
+int* order_min_degree(Csr* a) {
+    int n = a->rows;
+    Graph* graph = graph_create(a);
+    QuotientGraph qg = quotient_create(n, n);
+
+    for(int i = 0; i < n; i++) { // Graph adjacency becomes the variable lists
+        qg.vars[i] = (VertexList){graph->adj[i], graph->deg[i], graph->deg[i]};
+        graph->adj[i] = NULL;
+    }
+
+    int* perm = quotient_min_degree(qg, graph->deg);
+
+    quotient_free(&qg);
+    graph_free(graph);
+
+    return perm;
+}
+
+
+// Approximate minimum degree order of the columns of a for factoring a^T a, which is never formed.
+// Each row of a is an element joining its columns from the start, rows longer than
+// ORDER_DENSE_ROWS times the square root of the columns would join nearly all of them and are left
+// out. Returns perm, perm[k] is the column eliminated k-th
+int* order_column_min_degree(Csr* a) {
+    int n = a->cols, m = a->rows;
+    QuotientGraph qg = quotient_create(n, n + m);
+    int* degree = calloc(n, sizeof(int));
+    if(!degree) {
+        fprintf(stderr, "Memory allocation failed for ordering\n");
+        exit(1);
+    }
+
+    long dense_len = ORDER_DENSE_ROWS * sqrt(n);
+    if(dense_len < 16)
+        dense_len = 16;
+
+    for(int i = 0; i < m; i++) {
+        long start = a->row_ptr[i], len = a->row_ptr[i + 1] - start;
+        if(len > dense_len)
+            continue;
+
+        for(long p = start; p < start + len; p++) {
+            int j = a->col_idx[p];
+
+            vertex_list_add(&qg.bound[n + i], j);
+            vertex_list_add(&qg.elems[j], n + i);
+            degree[j] += len - 1; // Bound, rows may share columns
+        }
+    }
+
+    for(int j = 0; j < n; j++) {
+        if(degree[j] > n - 1)
+            degree[j] = n - 1;
+    }
+
+    int* perm = quotient_min_degree(qg, degree);
+
+    quotient_free(&qg);
+    free(degree);
+
+    return perm;
+}
+
+
+int compare_keys(const void* a, const void* b) {
+    long x = *(const long*)a, y = *(const long*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+// Breadth-first search of root's component, which must be unvisited in level. Fills queue in visit
+// order and level with each vertex's distance from root, returns the number of vertices reached
+int bfs_levels(Graph* graph, int root, int* level, int* queue) {
+    int head = 0, tail = 0;
+    queue[tail++] = root;
+    level[root] = 0;
+
+    while(head < tail) {
+        int v = queue[head++];
+
+        for(int t = 0; t < graph->deg[v]; t++) {
+            int u = graph->adj[v][t];
+
+            if(level[u] < 0) {
+                level[u] = level[v] + 1;
+                queue[tail++] = u;
+            }
+        }
+    }
+
+    return tail;
+}
+
+
+// Pseudo-peripheral vertex of start's component by George and Liu's search. Restarts from the least
+// connected vertex of the deepest level while that deepens the level structure
+int pseudo_peripheral(Graph* graph, int start, int* level, int* queue) {
+    int root = start, depth = -1;
+
+    while(true) {
+        int count = bfs_levels(graph, root, level, queue);
+        int last = queue[count - 1];
+        int next = last;
+
+        for(int t = count - 1; t >= 0 && level[queue[t]] == level[last]; t--) {
+            if(graph->deg[queue[t]] < graph->deg[next])
+                next = queue[t];
+        }
+
+        bool deeper = level[last] > depth;
+        depth = level[last];
+
+        for(int t = 0; t < count; t++)
+            level[queue[t]] = -1;
+
+        if(!deeper || next == root)
+            return root;
+        root = next;
+    }
+}
+
+
+// Reverse Cuthill-McKee order of square a, which narrows the band of a + a^T. Each component is
+// searched breadth first from a pseudo-peripheral vertex, visiting the neighbours of a vertex by
+// ascending degree, and the visit order is reversed. Returns perm, perm[k] is the row placed k-th
+int* order_rcm(Csr* a) {
+    int n = a->rows;
+    Graph* graph = graph_create(a);
+    int* perm = ordering_alloc(n * sizeof(int));
+    int* level = ordering_alloc(n * sizeof(int));
+    int* queue = ordering_alloc(n * sizeof(int));
+    long* keys = ordering_alloc(n * sizeof(long));
+    bool* visited = calloc(n, sizeof(bool));
+    if(!visited) {
+        fprintf(stderr, "Memory allocation failed for ordering\n");
+        exit(1);
+    }
+
+    for(int v = 0; v < n; v++)
+        level[v] = -1;
+
+    int count = 0;
+
+    for(int start = 0; start < n; start++) {
+        if(visited[start])
+            continue;
+
+        int root = pseudo_peripheral(graph, start, level, queue);
+        int head = count;
+        perm[count++] = root;
+        visited[root] = true;
+
+        while(head < count) {
+            int v = perm[head++];
+            int num_keys = 0;
+
+            // Degree in the high half keeps ties in vertex order
+            for(int t = 0; t < graph->deg[v]; t++) {
+                int u = graph->adj[v][t];
+
+                if(!visited[u]) {
+                    visited[u] = true;
+                    keys[num_keys++] = (long)graph->deg[u] << 32 | u;
+                }
+            }
+
+            qsort(keys, num_keys, sizeof(long), compare_keys);
+            for(int t = 0; t < num_keys; t++)
+                perm[count++] = (int)(keys[t] & 0xffffffff);
+        }
+    }
+
+    for(int k = 0; k < n / 2; k++) {
+        int swap = perm[k];
+        perm[k] = perm[n - 1 - k];
+        perm[n - 1 - k] = swap;
+    }
+
+    free(level);
+    free(queue);
+    free(keys);
+    free(visited);
+    graph_free(graph);
+
+    return perm;
+}
+
+
+// Bandwidth and profile of square a + a^T with rows and columns placed in the order of perm, NULL
+// for their current order
+void envelope_measure(Csr* a, const int* perm, Envelope* env) {
+    int n = a->rows;
+    int* pinv = ordering_alloc(n * sizeof(int));
+    int* first = ordering_alloc(n * sizeof(int)); // Leftmost column of each placed row
+    for(int k = 0; k < n; k++) {
+        pinv[perm ? perm[k] : k] = k;
+        first[k] = k;
+    }
+
+    env->bandwidth = 0;
+    for(int i = 0; i < n; i++) {
+        for(long p = a->row_ptr[i]; p < a->row_ptr[i + 1]; p++) {
+            int r = pinv[i], c = pinv[a->col_idx[p]];
+            int lo = r < c ? r : c, hi = r < c ? c : r;
+
+            if(hi - lo > env->bandwidth)
+                env->bandwidth = hi - lo;
+            if(lo < first[hi])
+                first[hi] = lo;
+        }
+    }
+
+    env->profile = 0;
+    for(int k = 0; k < n; k++)
+        env->profile += k - first[k];
+
+    free(pinv);
+    free(first);
+}
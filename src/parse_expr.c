@@ -92,6 +92,76 @@ int parse_pattern(const char* str, int start, int* end) {
 }
 
 
+// Parses a single index or a range start:end, either bound may be left out, followed by ']'. Sets
+// is_range if a colon was found, returns the position after the ']' or 0 if there is none
+int parse_range(const char* str, int i, SliceRange* range, bool* is_range) {
+    bool has_start = isdigit(str[i]);
+    range->start = has_start ? atoi(str + i) : 0;
+    while(isdigit(str[i])) i++;
+
+    *is_range = str[i] == ':';
+    if(*is_range) {
+        i++;
+        range->end = isdigit(str[i]) ? atoi(str + i) : -1;
+        while(isdigit(str[i])) i++;
+    } else if(has_start) {
+        range->end = range->start + 1;
+    } else {
+        return 0;
+    }
+
+    return str[i] == ']' ? i + 1 : 0;
+}
+
+
+// Checks if the string at pos is a slice name[r0:r1][c0:c1] where at least one index is a range, gets
+// its length, and its name unless name is NULL
+int parse_slice(const char* str, int start, int* end, char** name, SliceRange* rows, SliceRange* cols) {
+    int i = start;
+    bool row_range, col_range;
+
+    if(!is_name_char(str[i]))
+        return 0;
+    while(is_name_char(str[i])) i++;
+
+    int name_end = i;
+    if(str[i] != '[' || !(i = parse_range(str, i + 1, rows, &row_range)))
+        return 0;
+    if(str[i] != '[' || !(i = parse_range(str, i + 1, cols, &col_range)))
+        return 0;
+    if(!row_range && !col_range) // Single cell, replaced by its value
+        return 0;
+
+    if(name)
+        *name = strndup(str + start, name_end - start);
+    *end = i;
+    return 1;
+}
+
+
+// Block of a matrix named by a slice, the caller owns it. NULL if the matrix does not exist or the
+// slice is empty or outside it
+Matrix* get_slice(const char* input) {
+    int end;
+    char* name;
+    SliceRange rows, cols;
+
+    if(!parse_slice(input, 0, &end, &name, &rows, &cols))
+        return NULL;
+
+    Matrix* matrix = rd_get_matrix(name);
+    free(name);
+    if(!matrix)
+        return NULL;
+
+    if(rows.end < 0)
+        rows.end = matrix->rows;
+    if(cols.end < 0)
+        cols.end = matrix->cols;
+
+    return matrix_slice(matrix, rows.start, rows.end, cols.start, cols.end);
+}
+
 // Replace indexed matrices with numeric value
 char* replace_all(const char* input_str) {
     int len = strlen(input_str);
@@ -116,7 +186,7 @@ char* replace_all(const char* input_str) {
 
             char* replacement = get_val(match); // Get numeric value
             if(replacement == NULL) { // Index out of bounds
-                printf("Expression error: index at %s is out of matrix bounds\n", input_str);
+                expr_error(stdout, "Expression error: index at %s is out of matrix bounds\n", input_str);
                 return NULL;
             }
 
@@ -142,6 +212,11 @@ char* replace_all(const char* input_str) {
     return output;
 }
 
+// Checks if name is a function taking two arguments in parentheses
+bool is_function(const char* name) {
+    return !strcmp(name, "kron");
+}
+
 bool is_unary(Token last) {
     if(last.type == TOKEN_MATRIX || last.type == TOKEN_NUMERIC || last.type == TOKEN_RPAREN)
         return false;
@@ -243,6 +318,13 @@ Token* parse_expr(char* expr, int* token_count) {
                 i++;
                 break;
 
+            case ',': // Separates function arguments
+                token.type = TOKEN_COMMA;
+                token.symbol = strdup(",");
+                token.val = 4;
+                i++;
+                break;
+
             case ']': // Closing determinant
                 token.type = TOKEN_DET_R;
                 token.symbol = strdup("]");
@@ -253,11 +335,20 @@ Token* parse_expr(char* expr, int* token_count) {
             default: // Token is not operator
                 if (isalpha(c) || c == '_') { // Matrix name
                     int start = i;
+                    int slice_end;
+                    SliceRange rows, cols;
                     while (isalpha(expr[i]) || expr[i] == '_') i++;
+                    if (parse_slice(expr, start, &slice_end, NULL, &rows, &cols))
+                        i = slice_end; // Slice is kept whole and read when evaluated
                     int length = i - start;
                     token.type = TOKEN_MATRIX;
                     token.symbol = strndup(expr + start, length);
                     token.val = 3; // unused
+
+                    int next = i;
+                    while (isspace(expr[next])) next++;
+                    if (expr[next] == '(' && is_function(token.symbol)) // Function call
+                        token.type = TOKEN_FUNC;
                 } else if (isdigit(c) || (c == '.' && isdigit(expr[i + 1]))) { // Numeric value
                     int start = i;
                     int has_dot = 0;
@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <time.h>
+#include <math.h>
 #include "../include/parse_input.h"
 #include "../include/matrix.h"
 #include "../include/eval_expr.h"
@@ -12,10 +13,20 @@
 #include "../include/runtime_data.h"
 #include "../include/repository.h"
 #include "../include/export.h"
+#include "../include/jobs.h"
+#include "../include/run_script.h"
+#include "../include/profile.h"
+#include "../include/mem_stats.h"
+#include "../include/solver.h"
+#include "../include/eigen.h"
+#include "../include/svd.h"
+#include "../include/norm.h"
+#include "../include/qr.h"
+#include "../include/reorder.h"
 
 
 typedef bool (*CommandFn)(char *input);
-#define NUM_COMMANDS 14
+#define NUM_COMMANDS 29
 #define MAX_MATRICES 200
 
 typedef struct
@@ -38,6 +49,21 @@ bool delete_matrix(char* input);
 bool exec_script(char* input);
 bool export(char* input);
 bool import(char* input);
+bool list_jobs(char* input);
+bool wait_jobs(char* input);
+bool stats(char* input);
+bool mem(char* input);
+bool set_dense(char* input);
+bool solve(char* input);
+bool precond(char* input);
+bool eigs(char* input);
+bool svd(char* input);
+bool norm_one(char* input);
+bool norm_inf(char* input);
+bool norm_fro(char* input);
+bool cond(char* input);
+bool lstsq(char* input);
+bool reorder(char* input);
 
 Command commands[] = {
     {"matrix", set_matrix},
@@ -53,7 +79,22 @@ Command commands[] = {
     {"delete", delete_matrix},
     {"exec", exec_script},
     {"export", export},
-    {"import", import}
+    {"import", import},
+    {"jobs", list_jobs},
+    {"wait", wait_jobs},
+    {"stats", stats},
+    {"mem", mem},
+    {"dense", set_dense},
+    {"solve", solve},
+    {"precond", precond},
+    {"eigs", eigs},
+    {"svd", svd},
+    {"norm1", norm_one},
+    {"normInf", norm_inf},
+    {"normF", norm_fro},
+    {"cond", cond},
+    {"lstsq", lstsq},
+    {"reorder", reorder}
 };
 
 
@@ -70,6 +111,7 @@ bool create_matrix(char *name)
     if (!res)
     {
         printf("Error: Matrix with name %s already exists\n", name);
+        matrix_release(new);
         return false;
     }
 
@@ -135,17 +177,20 @@ bool show_matrix(char *input)
 
 bool help(char *input)
 {
+    (void)input;
     return false;
 }
 
 bool list_matrices(char *input)
 {
+    (void)input;
     rd_print_all();
     return true;
 }
 
 bool clear_terminal(char *input)
 {
+    (void)input;
 #ifdef _WIN32
     system("cls");
 #else
@@ -157,7 +202,8 @@ bool clear_terminal(char *input)
 
 bool list_saved(char *input)
 {
-    repo_list();
+    (void)input;
+    return repo_list();
 }
 
 bool save_matrix_repo(char *name, char *save_name)
@@ -183,8 +229,8 @@ bool save_matrix_repo(char *name, char *save_name)
     if (!save) // If name not unique, check if user wants to overwrite
         save = replace_saved_matrix(save_name);
 
-    if (save) // Save matrix
-        return repo_matrix_save(save_name, matrix);
+    if (save) // Queue save on background writer
+        return jobs_submit_save(save_name, matrix) > 0;
 
     return false; // Matrix not saved
 }
@@ -215,7 +261,7 @@ bool save_as_matrix(char *input)
             printf("Matrix name invalid\n");
 
         if (saved)
-            printf("Matrix %s saved as %s\n", trim(args[i]), save_name);
+            printf("Matrix %s queued to save as %s\n", trim(args[i]), save_name);
         else
             printf("Matrix %s not saved\n", trim(args[i]));
     }
@@ -242,7 +288,7 @@ bool save_matrix(char *input)
         bool saved = save_matrix_repo(trim(args[0]), trim(args[0]));
 
         if (saved)
-            printf("Matrix %s saved\n", trim(args[i]));
+            printf("Matrix %s queued to save\n", trim(args[i]));
         else
             printf("Matrix %s not saved\n", trim(args[i]));
     }
@@ -263,19 +309,55 @@ bool load_matrix(char *input)
         return false;
     }
 
-    // Iterate through arguments
+    // Check names are free and loads will see queued saves
     for (int i = 0; i < num_args; i++)
     {
-        Matrix *matrix = repo_matrix_load(trim(args[i]));
+        if (rd_get_matrix(args[i]))
+        {
+            printf("Error: Matrix with name %s already exists\n", args[i]);
+            return false;
+        }
+
+        jobs_wait_name(args[i]);
+    }
+
+    // Single matrix is loaded lazily, rows are fetched on first use
+    if (num_args == 1)
+    {
+        Matrix *matrix = repo_matrix_load(args[0]);
 
         if (!matrix)
             return false;
 
-        rd_save_matrix(trim(args[i]), matrix);
+        return rd_save_matrix(args[0], matrix);
+    }
+
+    // Several matrices are loaded fully and concurrently, all or none
+    Matrix **matrices = calloc(num_args, sizeof(Matrix *));
+    if (!matrices)
+    {
+        fprintf(stderr, "Memory allocation failed for Matrix list\n");
+        exit(1);
+    }
+
+    if (!repo_matrix_load_many(args, num_args, matrices))
+    {
+        printf("Error: Matrices not loaded\n");
+        free(matrices);
+        return false;
     }
 
+    for (int i = 0; i < num_args; i++)
+    {
+        if (!rd_save_matrix(args[i], matrices[i]))
+        {
+            printf("Error: Matrix with name %s already exists\n", args[i]);
+            matrix_release(matrices[i]);
+        }
+    }
+
+    free(matrices);
     return true;
-    ;
 }
 
 // Delete matrix from runtime memory
@@ -323,7 +405,8 @@ bool delete_matrix(char *input)
     // Iterate through arguments
     for (int i = 0; i < num_args; i++)
     {
-        // Attempt to delete
+        // Attempt to delete after queued saves of the same name
+        jobs_wait_name(trim(args[i]));
         bool exists = repo_matrix_delete(trim(args[i]));
 
         if (!exists)
@@ -358,14 +441,24 @@ bool exec_script(char* input) {
         return false;
     }
 
-    bool has_err = false;
+    // -parallel runs independent statements of each script concurrently
+    bool parallel = false;
+    for(int i = 0; i < num_args; i++) {
+        if(!strcmp(args[i], "-parallel"))
+            parallel = true;
+    }
+
+    bool success = true;
 
     for(int i = 0; i < num_args; i++) {
-        if(!execute_file(trim(args[i])))
-            has_err = false;
+        if(!strcmp(args[i], "-parallel"))
+            continue;
+
+        if(!execute_file(args[i], parallel))
+            success = false;
     }
     
-    return has_err;
+    return success;
 }
 
 
@@ -380,19 +473,525 @@ bool export(char* input) {
         return false;
     }
 
+    // -triplet writes one row,col,val line per non-zero instead of every cell
+    ExportFormat format = EXPORT_DENSE;
     for(int i = 0; i < num_args; i++) {
+        if(!strcmp(trim(args[i]), "-triplet"))
+            format = EXPORT_TRIPLET;
+    }
+
+    for(int i = 0; i < num_args; i++) {
+        if(!strcmp(trim(args[i]), "-triplet"))
+            continue;
+
         Matrix* saving = rd_get_matrix(trim(args[i]));
 
         if(!saving) // Matrix name not valid
             printf("Matrix %s does not exist\n", trim(args[i]));
-        else
-            export_csv(saving, trim(args[i]));
+        else if(jobs_submit_export(trim(args[i]), saving, format) > 0) // Queue export on background writer
+            printf("Matrix %s queued to export\n", trim(args[i]));
     }
 
     return true;
 }
 
 
+// Print background save and export jobs
+bool list_jobs(char* input) {
+    (void)input;
+    jobs_print();
+    return true;
+}
+
+
+// Block until background jobs finish and report failures
+bool wait_jobs(char* input) {
+    (void)input;
+    return jobs_wait();
+}
+
+
+// Print operation profile, or clear it with stats reset
+bool stats(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args > 0 && !strcmp(args[0], "reset")) {
+        profile_reset();
+        printf("Statistics reset\n");
+        return true;
+    }
+
+    profile_print();
+    return true;
+}
+
+
+// Print memory held by each matrix and live allocations of each structure
+bool mem(char* input) {
+    (void)input;
+    rd_print_mem();
+    printf("\n");
+    mem_print_structures();
+    return true;
+}
+
+
+// Print density from which results are stored dense, or set it with dense <threshold>
+bool set_dense(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args == 0) {
+        printf("Dense threshold: %g\n", matrix_dense_threshold());
+        return true;
+    }
+
+    char* end;
+    double threshold = strtod(args[0], &end);
+
+    if(end == args[0] || *end != '\0' || threshold <= 0) {
+        printf("Error: Threshold must be a positive number\n");
+        return false;
+    }
+
+    matrix_set_dense_threshold(threshold);
+    printf("Dense threshold: %g\n", threshold);
+    return true;
+}
+
+
+// Solve A x = b with solve <cg|bicgstab|chol|lu> A b x [tol] [maxit], binding the solution to x.
+// Errors are reported here, so the input is never parsed as an expression
+bool solve(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 4) {
+        printf("Error: Usage: solve <cg|bicgstab|chol|lu> A b x [tol] [maxit]\n");
+        return true;
+    }
+
+    SolverMethod method;
+    if(!solver_method(args[0], &method)) {
+        printf("Error: Unknown solver %s\n", args[0]);
+        return true;
+    }
+
+    for(int i = 1; i <= 2; i++) {
+        if(!rd_get_matrix(args[i])) {
+            printf("Error: Matrix %s not found\n", args[i]);
+            return true;
+        }
+    }
+
+    double tol = SOLVER_TOL;
+    int max_iter = SOLVER_MAX_ITER;
+    char* end;
+
+    if(num_args > 4) {
+        tol = strtod(args[4], &end);
+        if(end == args[4] || *end != '\0' || tol <= 0) {
+            printf("Error: Tolerance must be a positive number\n");
+            return true;
+        }
+    }
+
+    if(num_args > 5) {
+        max_iter = strtol(args[5], &end, 10);
+        if(end == args[5] || *end != '\0' || max_iter < 1) {
+            printf("Error: Iteration limit must be a positive integer\n");
+            return true;
+        }
+    }
+
+    Matrix* a = rd_get_matrix(args[1]);
+    Matrix* b = rd_get_matrix(args[2]);
+
+    if(a->rows != a->cols || b->rows != a->rows || b->cols != 1) {
+        printf("Error: %s must be square and %s a column vector with as many rows\n", args[1], args[2]);
+        return true;
+    }
+
+    SolveStats stats;
+    Matrix* x = solver_solve(a, b, method, tol, max_iter, &stats);
+
+    if(!x) {
+        if(method == SOLVER_CHOLESKY)
+            printf("Error: %s is not symmetric positive definite\n", args[1]);
+        else if(method == SOLVER_LU)
+            printf("Error: %s is singular\n", args[1]);
+        else if(stats.breakdown)
+            printf("Error: %s broke down after %d iterations, %s may be singular or indefinite\n", args[0], stats.iterations, args[1]);
+        return true;
+    }
+
+    bool direct = method == SOLVER_CHOLESKY || method == SOLVER_LU;
+
+    if(direct)
+        printf("Solved by %s factor", method == SOLVER_LU ? "LU" : "Cholesky");
+    else
+        printf("%s after %d iterations", stats.converged ? "Converged" : "Not converged", stats.iterations);
+
+    if(!direct && a->precond)
+        printf(" with %s", precond_name(a->precond));
+    printf(", relative residual %.3e\n", stats.residual);
+
+    rd_overwrite_matrix(args[3], x);
+
+    return true;
+}
+
+
+// Keep a preconditioner with A for later solves with precond <jacobi|ilu0> A, or drop it with
+// precond none A
+bool precond(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 2) {
+        printf("Error: Usage: precond <jacobi|ilu0|none> A\n");
+        return true;
+    }
+
+    Matrix* matrix = rd_get_matrix(args[1]);
+    if(!matrix) {
+        printf("Error: Matrix %s not found\n", args[1]);
+        return true;
+    }
+
+    if(!strcmp(args[0], "none")) {
+        matrix_drop_precond(matrix);
+        printf("Matrix %s has no preconditioner\n", args[1]);
+        return true;
+    }
+
+    PrecondType type;
+    if(!precond_type(args[0], &type)) {
+        printf("Error: Unknown preconditioner %s\n", args[0]);
+        return true;
+    }
+
+    if(!matrix_precondition(matrix, type))
+        printf("Error: %s needs %s to be square with non-zero diagonal and pivots\n", args[0], args[1]);
+    else
+        printf("Matrix %s preconditioned with %s\n", args[1], args[0]);
+
+    return true;
+}
+
+
+// Eigenvalues with eigs A k D [V] [largest|smallest], binding the k eigenvalues of largest, or
+// smallest, real part to D and their eigenvectors to V
+bool eigs(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 3) {
+        printf("Error: Usage: eigs A k D [V] [largest|smallest]\n");
+        return true;
+    }
+
+    Matrix* a = rd_get_matrix(args[0]);
+    if(!a) {
+        printf("Error: Matrix %s not found\n", args[0]);
+        return true;
+    }
+
+    char* end;
+    int k = strtol(args[1], &end, 10);
+    if(end == args[1] || *end != '\0' || k < 1) {
+        printf("Error: Number of eigenvalues must be a positive integer\n");
+        return true;
+    }
+
+    EigenWhich which = EIGEN_LARGEST;
+    char* vectors_name = NULL;
+
+    for(int i = 3; i < num_args; i++) {
+        if(eigen_which(args[i], &which))
+            continue;
+
+        if(vectors_name) {
+            printf("Error: Usage: eigs A k D [V] [largest|smallest]\n");
+            return true;
+        }
+        vectors_name = args[i];
+    }
+
+    if(a->rows != a->cols || k > a->rows) {
+        printf("Error: %s must be square with at least %d rows\n", args[0], k);
+        return true;
+    }
+
+    EigenStats stats;
+    Matrix* values;
+    Matrix* vectors = NULL;
+
+    if(!eigen_solve(a, k, which, &values, vectors_name ? &vectors : NULL, &stats)) {
+        printf("Error: Eigenvalues of %s could not be computed\n", args[0]);
+        return true;
+    }
+
+    printf("%s %d of %d eigenvalues by %s after %d restarts\n", stats.converged == k ? "Converged" : "Not converged:",
+        stats.converged, k, stats.symmetric ? "Lanczos" : "Arnoldi", stats.restarts);
+
+    rd_overwrite_matrix(args[2], values);
+    if(vectors)
+        rd_overwrite_matrix(vectors_name, vectors);
+
+    return true;
+}
+
+
+// Truncated singular value decomposition with svd A k U S V [power_iters], binding the k largest
+// singular values to S and their left and right singular vectors to the columns of U and V
+bool svd(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 5) {
+        printf("Error: Usage: svd A k U S V [power_iters]\n");
+        return true;
+    }
+
+    Matrix* a = rd_get_matrix(args[0]);
+    if(!a) {
+        printf("Error: Matrix %s not found\n", args[0]);
+        return true;
+    }
+
+    char* end;
+    int k = strtol(args[1], &end, 10);
+    int small = a->rows < a->cols ? a->rows : a->cols;
+
+    if(end == args[1] || *end != '\0' || k < 1 || k > small) {
+        printf("Error: Number of singular values must be an integer from 1 to %d\n", small);
+        return true;
+    }
+
+    int power_iters = SVD_POWER_ITERS;
+    if(num_args > 5) {
+        power_iters = strtol(args[5], &end, 10);
+        if(end == args[5] || *end != '\0' || power_iters < 0) {
+            printf("Error: Power iterations must be a non-negative integer\n");
+            return true;
+        }
+    }
+
+    Matrix* u;
+    Matrix* s;
+    Matrix* v;
+
+    if(!svd_truncated(a, k, power_iters, &u, &s, &v)) {
+        printf("Error: Singular values of %s could not be computed\n", args[0]);
+        return true;
+    }
+
+    if(s->rows < k)
+        printf("Matrix %s has rank %d, computed %d singular triplets\n", args[0], s->rows, s->rows);
+    else
+        printf("Computed %d singular triplets with %d power iterations\n", k, power_iters);
+
+    rd_overwrite_matrix(args[2], u);
+    rd_overwrite_matrix(args[3], s);
+    rd_overwrite_matrix(args[4], v);
+
+    return true;
+}
+
+
+// Print the norm of type of the matrix named by the command's argument
+bool print_norm(char* input, NormType type, const char* label) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 1) {
+        printf("Error: Usage: %s A\n", label);
+        return true;
+    }
+
+    Matrix* a = rd_get_matrix(args[0]);
+    if(!a) {
+        printf("Error: Matrix %s not found\n", args[0]);
+        return true;
+    }
+
+    double norm = matrix_norm(a, type);
+    if(norm < 0)
+        printf("Error: Matrix %s could not be loaded\n", args[0]);
+    else
+        printf("%s(%s) = %.10g\n", label, args[0], norm);
+
+    return true;
+}
+
+
+// Largest absolute column sum with norm1 A
+bool norm_one(char* input) {
+    return print_norm(input, NORM_ONE, "norm1");
+}
+
+
+// Largest absolute row sum with normInf A
+bool norm_inf(char* input) {
+    return print_norm(input, NORM_INF, "normInf");
+}
+
+
+// Frobenius norm with normF A
+bool norm_fro(char* input) {
+    return print_norm(input, NORM_FRO, "normF");
+}
+
+
+// Estimate the 1-norm condition number with cond A. The factor it solves with is kept with A, so a
+// following determinant, inverse or direct solve reuses it
+bool cond(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 1) {
+        printf("Error: Usage: cond A\n");
+        return true;
+    }
+
+    Matrix* a = rd_get_matrix(args[0]);
+    if(!a) {
+        printf("Error: Matrix %s not found\n", args[0]);
+        return true;
+    }
+
+    if(a->rows != a->cols) {
+        printf("Error: %s must be square\n", args[0]);
+        return true;
+    }
+
+    double estimate = matrix_cond(a);
+
+    if(estimate < 0)
+        printf("Error: Matrix %s could not be loaded\n", args[0]);
+    else if(isinf(estimate))
+        printf("Matrix %s is singular to working precision\n", args[0]);
+    else
+        printf("cond1(%s) ~ %.3e, reciprocal %.3e\n", args[0], estimate, 1 / estimate);
+
+    return true;
+}
+
+
+// Least-squares solve with lstsq X y b, binding to b the solution minimizing ||y - X b|| found by
+// sparse QR of X
+bool lstsq(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 3) {
+        printf("Error: Usage: lstsq X y b\n");
+        return true;
+    }
+
+    for(int i = 0; i < 2; i++) {
+        if(!rd_get_matrix(args[i])) {
+            printf("Error: Matrix %s not found\n", args[i]);
+            return true;
+        }
+    }
+
+    Matrix* x = rd_get_matrix(args[0]);
+    Matrix* y = rd_get_matrix(args[1]);
+
+    if(y->rows != x->rows || y->cols != 1) {
+        printf("Error: %s must be a column vector with as many rows as %s\n", args[1], args[0]);
+        return true;
+    }
+
+    LstsqStats stats;
+    Matrix* b = qr_lstsq(x, y, &stats);
+
+    if(!b) {
+        printf("Error: Matrices could not be loaded\n");
+        return true;
+    }
+
+    printf("Solved by sparse QR, residual %.3e, relative residual %.3e\n", stats.residual, stats.relative);
+    if(stats.rank < x->cols)
+        printf("Matrix %s has rank %d of %d columns, dependent columns are 0 in %s\n", args[0], stats.rank, x->cols, args[2]);
+
+    rd_overwrite_matrix(args[2], b);
+
+    return true;
+}
+
+
+// Symmetric reordering with reorder <rcm|amd> A P [B], binding to B, or to A if B is left out, the
+// reordered matrix and to P the column of 1-based original indices of its rows. reorder <apply|undo>
+// X P [Y] maps X into the reordered order, or back out of it, so right-hand sides and solutions can
+// follow the matrix
+bool reorder(char* input) {
+    int num_args = 0;
+    char **args = get_args(input, &num_args);
+
+    if(num_args < 3) {
+        printf("Error: Usage: reorder <rcm|amd> A P [B] or reorder <apply|undo> X P [Y]\n");
+        return true;
+    }
+
+    Matrix* a = rd_get_matrix(args[1]);
+    if(!a) {
+        printf("Error: Matrix %s not found\n", args[1]);
+        return true;
+    }
+
+    char* target = num_args > 3 ? args[3] : args[1];
+    ReorderMethod method;
+
+    if(reorder_method(args[0], &method)) {
+        if(a->rows != a->cols) {
+            printf("Error: %s must be square\n", args[1]);
+            return true;
+        }
+
+        Envelope before, after;
+        Matrix* perm;
+        Matrix* result = matrix_reorder(a, method, &perm, &before, &after);
+
+        if(!result) {
+            printf("Error: Matrix %s could not be loaded\n", args[1]);
+            return true;
+        }
+
+        printf("Bandwidth %d -> %d, profile %ld -> %ld\n", before.bandwidth, after.bandwidth, before.profile, after.profile);
+
+        rd_overwrite_matrix(args[2], perm);
+        rd_overwrite_matrix(target, result);
+
+        return true;
+    }
+
+    if(strcmp(args[0], "apply") && strcmp(args[0], "undo")) {
+        printf("Error: Unknown reordering %s, expected rcm, amd, apply or undo\n", args[0]);
+        return true;
+    }
+
+    Matrix* perm = rd_get_matrix(args[2]);
+    if(!perm) {
+        printf("Error: Matrix %s not found\n", args[2]);
+        return true;
+    }
+
+    Matrix* result = reorder_apply(a, perm, !strcmp(args[0], "undo"));
+    if(!result) {
+        printf("Error: %s is not a permutation of the rows of %s\n", args[2], args[1]);
+        return true;
+    }
+
+    rd_overwrite_matrix(target, result);
+
+    return true;
+}
+
+
 bool import(char* input) {
     int num_args = 0;
     char **args = get_args(input, &num_args);
@@ -412,12 +1011,15 @@ bool import(char* input) {
         else {
             char* save_name = NULL;
 
-            if(trim(args[i + 1][0]) == '-') // Matrix name specified
+            if(i + 1 < num_args && args[i + 1][0] == '-') // Matrix name specified
                 save_name = trim(args[++i] + 1);
             else
                 save_name = trim(args[i]);
             
-            rd_save_matrix(save_name, matrix);
+            if(!rd_save_matrix(save_name, matrix)) {
+                printf("Error: Matrix with name %s already exists\n", save_name);
+                matrix_release(matrix);
+            }
         }
     }
 
@@ -444,11 +1046,22 @@ bool starts_with(const char *input, const char *command) {
 }
 
 
+// Check if input invokes command, the name must be followed by a space or end the line so
+// assignments to names like mem2 or condA are not taken for commands
+bool matches_command(const char *input, const char *command) {
+    if(!starts_with(input, command))
+        return false;
+
+    char next = input[strlen(command)];
+    return next == '\0' || isspace((unsigned char)next);
+}
+
+
 bool find_command(char *input)
 {
     for (int i = 0; i < NUM_COMMANDS; i++)
     {
-        if (starts_with(input, commands[i].name))
+        if (matches_command(input, commands[i].name))
             return commands[i].fn(input);
     }
 
@@ -501,17 +1114,103 @@ char** split_expr(const char *str, int *count) {
     return result;
 }
 
+// Bind result to target, taking ownership of the caller's reference to result
 bool save_result(Matrix *result, char *target) {
-    Matrix *matrix = NULL;
-    matrix = rd_get_matrix(target);
-    bool res_flag = true;
+    // Result may be another named matrix, e.g. B = A, give target its own copy
+    if(result->refs > 1) {
+        Matrix *copy = matrix_copy(result);
+        matrix_release(result);
 
-    if(!matrix)
-        res_flag = rd_overwrite_matrix(target, result);
-    else
-        res_flag = rd_overwrite_matrix(target, result);
+        if(!copy)
+            return false;
+        result = copy;
+    }
 
-    return res_flag;
+    return rd_overwrite_matrix(target, result);
+}
+
+// Check if input assigns an expression to a whole matrix, if so split it into target and expression
+bool parse_assignment(char *input, char **target, char **expr)
+{
+    for (int i = 0; i < NUM_COMMANDS; i++)
+    {
+        if (matches_command(input, commands[i].name))
+            return false;
+    }
+
+    int num_args = 0;
+    char **parts = split_expr(input, &num_args);
+    if (!parts)
+        return false;
+
+    if (num_args != 2)
+    {
+        for (int i = 0; i < num_args; i++)
+            free(parts[i]);
+        free(parts);
+        return false;
+    }
+
+    int end;
+    SliceRange rows, cols;
+    *target = trim(parts[0]);
+    *expr = parts[1];
+    free(parts);
+
+    // Index and slice assignments modify an existing matrix in place
+    if (**target == '\0' || (parse_pattern(*target, 0, &end) && (*target)[end] == '\0') ||
+        (parse_slice(*target, 0, &end, NULL, &rows, &cols) && (*target)[end] == '\0'))
+    {
+        free(*target);
+        free(*expr);
+        return false;
+    }
+
+    return true;
+}
+
+// Write the result of expr over the block of matrix name given by rows and cols, a number fills
+// every cell of the block
+bool assign_slice(char *name, SliceRange rows, SliceRange cols, char *expr) {
+    Matrix *matrix = rd_get_matrix(name);
+    if (!matrix) {
+        printf("Error: Matrix %s not found\n", name);
+        return false;
+    }
+
+    if (rows.end < 0)
+        rows.end = matrix->rows;
+    if (cols.end < 0)
+        cols.end = matrix->cols;
+
+    if (rows.start >= rows.end || rows.end > matrix->rows || cols.start >= cols.end || cols.end > matrix->cols) {
+        printf("Error: Slice [%d:%d][%d:%d] is empty or out of bounds for matrix %s\n", rows.start, rows.end, cols.start, cols.end, name);
+        return false;
+    }
+
+    Matrix *result = solve_expr(expr);
+    if (!result)
+        return false;
+
+    int height = rows.end - rows.start, width = cols.end - cols.start;
+
+    if (result->rows == 1 && result->cols == 1 && (height > 1 || width > 1)) {
+        Matrix *fill = matrix_create(height, width);
+        fill->scalar_val = matrix_get(result, 0, 0);
+        matrix_release(result);
+        result = fill;
+    } else if (result->rows != height || result->cols != width) {
+        printf("Error: Expression must produce a number or a %d x %d matrix to assign to the slice\n", height, width);
+        matrix_release(result);
+        return false;
+    }
+
+    bool assigned = matrix_assign_slice(matrix, rows.start, cols.start, result);
+    if (!assigned)
+        printf("Error: Matrix %s could not be loaded\n", name);
+    matrix_release(result);
+
+    return assigned;
 }
 
 bool handle_input(char *input) {
@@ -538,6 +1237,14 @@ bool handle_input(char *input) {
     int end, row, col;
     char *name;
     Matrix *matrix = NULL; // Will contain valid Matrix if index is being assigned
+    SliceRange rows, cols;
+
+    // Check if a block of a matrix is being assigned
+    if (parse_slice(expr[0], 0, &end, &name, &rows, &cols) && expr[0][end] == '\0') {
+        bool assigned = assign_slice(name, rows, cols, expr[1]);
+        free(name);
+        return assigned;
+    }
 
     // Check if matrix index is being assigned
     if(parse_pattern(expr[0], 0, &end) && expr[0][end] == '\0') {
@@ -573,12 +1280,14 @@ bool handle_input(char *input) {
         if (!result || result->rows != 1 || result->cols != 1)
         {
             printf("Error: Expression must produce number to assign to matrix index\n");
+            matrix_release(result);
             return false;
         }
 
         if (row >= matrix->rows || row < 0 || col >= matrix->cols || col < 0)
         {
             printf("Error: Indices [%d][%d] out of bounds for matrix %s\n", row, col, name);
+            matrix_release(result);
             return false;
         }
 
@@ -586,7 +1295,13 @@ bool handle_input(char *input) {
         printf("result = (%d x %d)\n", matrix->rows, matrix->cols);
         #endif
 
-        matrix_set(matrix, row, col, matrix_get(result, 0, 0));
+        if (!matrix_set(matrix, row, col, matrix_get(result, 0, 0)))
+        {
+            printf("Error: Row %d of matrix %s could not be loaded, cell not changed\n", row, name);
+            matrix_release(result);
+            return false;
+        }
+        matrix_release(result);
         
         #ifdef DBG
         printf("result = (%d x %d)\n", matrix->rows, matrix->cols);
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/precond.h"
+
+
+bool precond_type(const char* name, PrecondType* type) {
+    if(!strcmp(name, "jacobi"))
+        *type = PRECOND_JACOBI;
+    else if(!strcmp(name, "ilu0"))
+        *type = PRECOND_ILU0;
+    else
+        return false;
+
+    return true;
+}
+
+
+const char* precond_name(Precond* precond) {
+    return precond->type == PRECOND_JACOBI ? "jacobi" : "ilu0";
+}
+
+
+// Position of each row's diagonal entry in a, false if a row has none or it is zero
+bool find_diagonal(Csr* a, long* diag) {
+    for(int i = 0; i < a->rows; i++) {
+        diag[i] = -1;
+
+        for(long k = a->row_ptr[i]; k < a->row_ptr[i + 1] && a->col_idx[k] <= i; k++) {
+            if(a->col_idx[k] == i && a->vals[k] != 0)
+                diag[i] = k;
+        }
+
+        if(diag[i] < 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+// Factor lu in place keeping its pattern, row i subtracts multiples of earlier rows only where it
+// already has entries, false on a zero pivot
+bool factor_ilu0(Csr* lu, long* diag) {
+    int n = lu->rows;
+    long* pos = malloc(n * sizeof(long)); // pos[j]: entry of the current row in column j, -1 if none
+    if(!pos) {
+        fprintf(stderr, "Memory allocation failed for preconditioner\n");
+        exit(1);
+    }
+
+    for(int j = 0; j < n; j++)
+        pos[j] = -1;
+
+    bool ok = true;
+
+    for(int i = 0; i < n && ok; i++) {
+        long start = lu->row_ptr[i], end = lu->row_ptr[i + 1];
+
+        for(long k = start; k < end; k++)
+            pos[lu->col_idx[k]] = k;
+
+        for(long k = start; k < diag[i]; k++) { // Columns before the diagonal, ascending
+            int col = lu->col_idx[k];
+            lu->vals[k] /= lu->vals[diag[col]];
+
+            for(long m = diag[col] + 1; m < lu->row_ptr[col + 1]; m++) {
+                long target = pos[lu->col_idx[m]];
+
+                if(target >= 0)
+                    lu->vals[target] -= lu->vals[k] * lu->vals[m];
+            }
+        }
+
+        if(lu->vals[diag[i]] == 0)
+            ok = false;
+
+        for(long k = start; k < end; k++)
+            pos[lu->col_idx[k]] = -1;
+    }
+
+    free(pos);
+
+    return ok;
+}
+
+
+// Build preconditioner of square a, whose cells are its entries plus scalar_val. ILU(0) adds
+// scalar_val to stored entries only. NULL if a diagonal entry or pivot is zero
+Precond* precond_create(Csr* a, double scalar_val, PrecondType type) {
+    int n = a->rows;
+    if(a->cols != n)
+        return NULL;
+
+    Precond* precond = calloc(1, sizeof(Precond));
+    long* diag = malloc((n > 0 ? n : 1) * sizeof(long));
+    if(!precond || !diag) {
+        fprintf(stderr, "Memory allocation failed for preconditioner\n");
+        exit(1);
+    }
+
+    precond->type = type;
+    precond->n = n;
+
+    // Copy of a with scalar_val applied to every stored entry
+    Csr* lu = csr_create(n, n, a->nnz);
+    memcpy(lu->row_ptr, a->row_ptr, (n + 1) * sizeof(long));
+    memcpy(lu->col_idx, a->col_idx, a->nnz * sizeof(int));
+    for(long k = 0; k < a->nnz; k++)
+        lu->vals[k] = a->vals[k] + scalar_val;
+
+    bool ok = find_diagonal(lu, diag);
+
+    if(type == PRECOND_JACOBI) {
+        if(ok) {
+            precond->inv_diag = malloc(n * sizeof(double));
+            if(!precond->inv_diag) {
+                fprintf(stderr, "Memory allocation failed for preconditioner\n");
+                exit(1);
+            }
+
+            for(int i = 0; i < n; i++)
+                precond->inv_diag[i] = 1 / lu->vals[diag[i]];
+        }
+
+        csr_free(lu);
+        free(diag);
+    } else {
+        precond->lu = lu;
+        precond->diag = diag;
+        ok = ok && factor_ilu0(lu, diag);
+
+        // Back substitution multiplies by reciprocal pivots, keeping divisions off its critical path
+        precond->inv_diag = malloc(n * sizeof(double));
+        if(!precond->inv_diag) {
+            fprintf(stderr, "Memory allocation failed for preconditioner\n");
+            exit(1);
+        }
+
+        for(int i = 0; i < n && ok; i++)
+            precond->inv_diag[i] = 1 / lu->vals[diag[i]];
+    }
+
+    if(!ok) {
+        precond_free(precond);
+        return NULL;
+    }
+
+    return precond;
+}
+
+
+// Set z to the preconditioner applied to r
+void precond_apply(Precond* precond, const double* r, double* z) {
+    int n = precond->n;
+
+    if(precond->type == PRECOND_JACOBI) {
+        for(int i = 0; i < n; i++)
+            z[i] = precond->inv_diag[i] * r[i];
+        return;
+    }
+
+    Csr* lu = precond->lu;
+
+    // Forward substitution with unit lower triangle
+    for(int i = 0; i < n; i++) {
+        double sum = r[i];
+        for(long k = lu->row_ptr[i]; k < precond->diag[i]; k++)
+            sum -= lu->vals[k] * z[lu->col_idx[k]];
+
+        z[i] = sum;
+    }
+
+    // Back substitution with upper triangle
+    for(int i = n - 1; i >= 0; i--) {
+        double sum = z[i];
+        for(long k = precond->diag[i] + 1; k < lu->row_ptr[i + 1]; k++)
+            sum -= lu->vals[k] * z[lu->col_idx[k]];
+
+        z[i] = sum * precond->inv_diag[i];
+    }
+}
+
+
+size_t precond_bytes(Precond* precond) {
+    if(!precond)
+        return 0;
+
+    size_t bytes = sizeof(Precond);
+
+    if(precond->inv_diag)
+        bytes += precond->n * sizeof(double);
+
+    if(precond->lu)
+        bytes += sizeof(Csr) + (precond->n + 1) * sizeof(long) + precond->n * sizeof(long)
+            + precond->lu->nnz * (sizeof(int) + sizeof(double));
+
+    return bytes;
+}
+
+
+void precond_free(Precond* precond) {
+    if(!precond)
+        return;
+
+    free(precond->inv_diag);
+    csr_free(precond->lu);
+    free(precond->diag);
+    free(precond);
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/profile.h"
+
+const char* profile_op_names[NUM_PROFILE_OPS] = {
+    "eval_expr",
+    "matrix_add",
+    "matrix_mult",
+    "matrix_determinant",
+    "solve",
+    "eigs",
+    "svd",
+    "cond",
+    "lstsq",
+    "reorder",
+    "kron",
+    "import_csv",
+    "repo_save",
+    "repo_load",
+    "repo_fetch_rows",
+    "repo_delete",
+    "repo_list"
+};
+
+// Totals of one operation
+typedef struct {
+    long calls;
+    long ns;
+    long nnz_in;
+    long nnz_out;
+    long allocs;
+} ProfileStats;
+
+#ifdef NO_PROFILE
+
+bool profile_enabled() {
+    return false;
+}
+
+void profile_print() {
+    printf("Profiling is disabled in this build\n");
+}
+
+void profile_reset() {
+}
+
+#else
+
+// Counters of one thread, only written by that thread so updates need no locking
+typedef struct ProfileCounters {
+    ProfileStats ops[NUM_PROFILE_OPS];
+    struct ProfileCounters* next;
+} ProfileCounters;
+
+_Thread_local long profile_allocs = 0;
+_Thread_local ProfileCounters* local_counters = NULL;
+
+ProfileCounters* all_counters = NULL;   // Counters of every thread that recorded an operation
+ProfileStats baseline[NUM_PROFILE_OPS]; // Totals at the last reset, subtracted when printing
+pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+// Counters of calling thread, registered on first use
+ProfileCounters* get_counters() {
+    if(local_counters)
+        return local_counters;
+
+    local_counters = calloc(1, sizeof(ProfileCounters));
+    if(!local_counters) {
+        fprintf(stderr, "Memory allocation failed for ProfileCounters\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&counters_lock);
+    local_counters->next = all_counters;
+    all_counters = local_counters;
+    pthread_mutex_unlock(&counters_lock);
+
+    return local_counters;
+}
+
+
+// Add val to counter owned by the calling thread, readable by stats while it runs
+void add_counter(long* counter, long val) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+
+ProfileSpan profile_begin() {
+    ProfileSpan span = {now_ns(), profile_allocs};
+    return span;
+}
+
+
+// Record call started at span
+void profile_end(ProfileOp op, ProfileSpan* span, long nnz_in, long nnz_out) {
+    ProfileStats* stats = &get_counters()->ops[op];
+
+    add_counter(&stats->calls, 1);
+    add_counter(&stats->ns, now_ns() - span->start_ns);
+    add_counter(&stats->nnz_in, nnz_in);
+    add_counter(&stats->nnz_out, nnz_out);
+    add_counter(&stats->allocs, profile_allocs - span->start_allocs);
+}
+
+
+// Sum counters of all threads, counters_lock must be held
+void sum_counters(ProfileStats* totals) {
+    memset(totals, 0, NUM_PROFILE_OPS * sizeof(ProfileStats));
+
+    for(ProfileCounters* counters = all_counters; counters; counters = counters->next) {
+        for(int op = 0; op < NUM_PROFILE_OPS; op++) {
+            ProfileStats* stats = &counters->ops[op];
+
+            totals[op].calls += __atomic_load_n(&stats->calls, __ATOMIC_RELAXED);
+            totals[op].ns += __atomic_load_n(&stats->ns, __ATOMIC_RELAXED);
+            totals[op].nnz_in += __atomic_load_n(&stats->nnz_in, __ATOMIC_RELAXED);
+            totals[op].nnz_out += __atomic_load_n(&stats->nnz_out, __ATOMIC_RELAXED);
+            totals[op].allocs += __atomic_load_n(&stats->allocs, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+
+bool profile_enabled() {
+    return true;
+}
+
+
+// Print table of operations recorded since the last reset
+void profile_print() {
+    ProfileStats totals[NUM_PROFILE_OPS];
+
+    pthread_mutex_lock(&counters_lock);
+    sum_counters(totals);
+    pthread_mutex_unlock(&counters_lock);
+
+    bool any = false;
+
+    for(int op = 0; op < NUM_PROFILE_OPS; op++) {
+        long calls = totals[op].calls - baseline[op].calls;
+        if(calls == 0)
+            continue;
+
+        if(!any)
+            printf("%-20s %10s %12s %12s %12s %12s %12s\n",
+                "Operation", "Calls", "Total ms", "Avg us", "nnz in", "nnz out", "Allocs");
+        any = true;
+
+        double ms = (totals[op].ns - baseline[op].ns) / 1e6;
+        printf("%-20s %10ld %12.3f %12.3f %12ld %12ld %12ld\n", profile_op_names[op], calls, ms, ms * 1000 / calls,
+            totals[op].nnz_in - baseline[op].nnz_in,
+            totals[op].nnz_out - baseline[op].nnz_out,
+            totals[op].allocs - baseline[op].allocs);
+    }
+
+    if(!any)
+        printf("No operations recorded\n");
+}
+
+
+// Start counting from zero, threads keep their counters and stats subtracts the current totals
+void profile_reset() {
+    pthread_mutex_lock(&counters_lock);
+    sum_counters(baseline);
+    pthread_mutex_unlock(&counters_lock);
+}
+
+#endif
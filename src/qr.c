@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "../include/qr.h"
+#include "../include/ordering.h"
+#include "../include/solver.h"
+#include "../include/profile.h"
+
+// Sparse row of R, or a row of A or of a reduced front waiting for the front of its leading column.
+// Columns ascending, rhs is the row's entry of b as transformed so far
+typedef struct {
+    int* cols;
+    double* vals;
+    int len;
+    double rhs;
+} QrRow;
+
+// Rows waiting for the front of one column
+typedef struct {
+    QrRow* items;
+    int len;
+    int capacity;
+} RowList;
+
+
+void* qr_alloc(size_t bytes) {
+    void* ptr = malloc(bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for QR factor\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+void row_list_add(RowList* list, QrRow row) {
+    if(list->len == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 4;
+        list->items = realloc(list->items, list->capacity * sizeof(QrRow));
+        if(!list->items) {
+            fprintf(stderr, "Memory allocation failed for QR factor\n");
+            exit(1);
+        }
+    }
+
+    list->items[list->len++] = row;
+}
+
+
+// Sparse copy of the non-zeros of dense row, whose entry t is column cols[t], from entry start on
+QrRow qr_row_from_dense(const double* row, const int* cols, int start, int len, double rhs) {
+    int count = 0;
+    for(int t = start; t < len; t++)
+        count += row[t] != 0;
+
+    QrRow sparse = {qr_alloc(count * sizeof(int)), qr_alloc(count * sizeof(double)), 0, rhs};
+    for(int t = start; t < len; t++) {
+        if(row[t] != 0) {
+            sparse.cols[sparse.len] = cols[t];
+            sparse.vals[sparse.len++] = row[t];
+        }
+    }
+
+    return sparse;
+}
+
+
+int compare_columns(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+
+// Copy of a with columns renamed so column perm[k] becomes k, rows keep their order
+Csr* qr_permuted_columns(Csr* a, int* perm) {
+    int* pinv = qr_alloc(a->cols * sizeof(int));
+    for(int k = 0; k < a->cols; k++)
+        pinv[perm[k]] = k;
+
+    Csr* renamed = csr_create(a->rows, a->cols, a->nnz);
+    memcpy(renamed->row_ptr, a->row_ptr, (a->rows + 1) * sizeof(long));
+    memcpy(renamed->vals, a->vals, a->nnz * sizeof(double));
+    for(long p = 0; p < a->nnz; p++)
+        renamed->col_idx[p] = pinv[a->col_idx[p]];
+
+    // Transposing twice sorts the renamed columns of each row
+    Csr* t = csr_transpose(renamed);
+    Csr* result = csr_transpose(t);
+    csr_free(renamed);
+    csr_free(t);
+    free(pinv);
+
+    return result;
+}
+
+
+// Householder QR of the rows x width row-major front f in place, triangularizing its first cols
+// columns and applying each reflection to the columns after them. Rows are first sorted by their
+// leading column into g, which becomes the front, so each reflection only spans the rows whose
+// leading column it has reached. Returns the rows left non-zero in the first cols columns, the rest
+// hold only the part of the right-hand side no solution reaches
+int qr_reduce(double** f, double** g, int rows, int width, int cols, int* lead, int* start, double* v, double* w) {
+    for(int l = 0; l <= cols; l++)
+        start[l] = 0;
+
+    for(int i = 0; i < rows; i++) {
+        double* row = *f + (long)i * width;
+        int l = 0;
+        while(l < cols && row[l] == 0)
+            l++;
+        lead[i] = l;
+        start[l]++;
+    }
+
+    for(int l = 0, sum = 0; l <= cols; l++) {
+        int count = start[l];
+        start[l] = sum;
+        sum += count;
+    }
+
+    for(int i = 0; i < rows; i++)
+        memcpy(*g + (long)start[lead[i]]++ * width, *f + (long)i * width, width * sizeof(double));
+
+    double* swap = *f;
+    *f = *g;
+    *g = swap;
+    double* front = *f;
+
+    // start[j] is now the number of rows leading at or before column j
+    int top = 0;
+    for(int j = 0; j < cols && top < rows; j++) {
+        int end = start[j];
+
+        double norm = 0;
+        for(int i = top; i < end; i++)
+            norm += front[(long)i * width + j] * front[(long)i * width + j];
+        norm = sqrt(norm);
+
+        if(norm == 0)
+            continue;
+
+        double lead_val = front[(long)top * width + j];
+        double alpha = lead_val > 0 ? -norm : norm;
+        for(int i = top; i < end; i++)
+            v[i] = front[(long)i * width + j];
+        v[top] -= alpha;
+        double scale = 1 / (norm * (norm + fabs(lead_val))); // 2 / ||v||^2
+
+        // w = v^T front over the remaining columns, accumulated a row at a time
+        for(int l = j + 1; l < width; l++)
+            w[l] = 0;
+        for(int i = top; i < end; i++) {
+            double* row = front + (long)i * width;
+            for(int l = j + 1; l < width; l++)
+                w[l] += v[i] * row[l];
+        }
+
+        for(int i = top; i < end; i++) {
+            double* row = front + (long)i * width;
+            double vi = v[i] * scale;
+            for(int l = j + 1; l < width; l++)
+                row[l] -= vi * w[l];
+            row[j] = 0;
+        }
+        front[(long)top * width + j] = alpha;
+        top++;
+    }
+
+    return top;
+}
+
+
+// Least-squares solution x of a x = b by sparse QR, returns the rank of a. Columns are ordered by
+// minimum degree of a^T a, computed without forming it. Each row of a waits for the front of its
+// leading column. The front of column k gathers the rows waiting for it into a dense block over the
+// union of their columns, with b as a last column, and Householder reflections reduce it to upper
+// trapezoidal form. Its first row is row k of R, the others wait for the fronts of their new leading
+// columns. Tall fronts are reduced every few rows, so a front holds at most twice as many rows as
+// columns. Neither Q nor a^T a is ever formed. A diagonal of R below QR_RANK_TOL times the largest
+// column norm of a makes its column dependent, it gets 0 in x and the rest of its row moves on
+int qr_solve(Csr* a, const double* b, double* x) {
+    int m = a->rows, n = a->cols;
+    int* perm = order_column_min_degree(a);
+    Csr* pa = qr_permuted_columns(a, perm);
+
+    RowList* pending = calloc(n, sizeof(RowList));
+    QrRow* r = calloc(n, sizeof(QrRow));
+    double* col_norms = calloc(n, sizeof(double));
+    if(!pending || !r || !col_norms) {
+        fprintf(stderr, "Memory allocation failed for QR factor\n");
+        exit(1);
+    }
+
+    for(int i = 0; i < m; i++) {
+        QrRow row = {qr_alloc((pa->row_ptr[i + 1] - pa->row_ptr[i]) * sizeof(int)),
+            qr_alloc((pa->row_ptr[i + 1] - pa->row_ptr[i]) * sizeof(double)), 0, b[i]};
+
+        for(long p = pa->row_ptr[i]; p < pa->row_ptr[i + 1]; p++) {
+            if(pa->vals[p] != 0) {
+                row.cols[row.len] = pa->col_idx[p];
+                row.vals[row.len++] = pa->vals[p];
+                col_norms[pa->col_idx[p]] += pa->vals[p] * pa->vals[p];
+            }
+        }
+
+        if(row.len > 0) {
+            row_list_add(&pending[row.cols[0]], row);
+        } else {
+            free(row.cols);
+            free(row.vals);
+        }
+    }
+
+    double max_norm = 0;
+    for(int k = 0; k < n; k++)
+        max_norm = fmax(max_norm, sqrt(col_norms[k]));
+    double tol = QR_RANK_TOL * max_norm;
+
+    int* mark = qr_alloc(n * sizeof(int));
+    int* cols = qr_alloc(n * sizeof(int));
+    int* pos = qr_alloc(n * sizeof(int));
+    double* v = qr_alloc(2 * ((long)n + 1) * sizeof(double));
+    double* w = qr_alloc(((long)n + 1) * sizeof(double));
+    int* lead = qr_alloc(2 * (long)n * sizeof(int));
+    int* start = qr_alloc(((long)n + 1) * sizeof(int));
+    double* f = NULL;
+    double* g = NULL;
+    long f_capacity = 0;
+
+    for(int k = 0; k < n; k++)
+        mark[k] = -1;
+
+    for(int k = 0; k < n; k++) {
+        RowList* list = &pending[k];
+        if(list->len == 0)
+            continue;
+
+        int num_cols = 0;
+        for(int t = 0; t < list->len; t++) {
+            for(int p = 0; p < list->items[t].len; p++) {
+                int col = list->items[t].cols[p];
+
+                if(mark[col] != k) {
+                    mark[col] = k;
+                    cols[num_cols++] = col;
+                }
+            }
+        }
+
+        qsort(cols, num_cols, sizeof(int), compare_columns);
+        for(int t = 0; t < num_cols; t++)
+            pos[cols[t]] = t;
+
+        int width = num_cols + 1, max_rows = 2 * num_cols;
+        if((long)max_rows * width > f_capacity) {
+            f_capacity = (long)max_rows * width;
+            free(f);
+            free(g);
+            f = qr_alloc(f_capacity * sizeof(double));
+            g = qr_alloc(f_capacity * sizeof(double));
+        }
+
+        int rows = 0;
+        for(int t = 0; t < list->len; t++) {
+            QrRow* row = &list->items[t];
+            double* dense = f + (long)rows * width;
+
+            for(int l = 0; l < width; l++)
+                dense[l] = 0;
+            for(int p = 0; p < row->len; p++)
+                dense[pos[row->cols[p]]] = row->vals[p];
+            dense[num_cols] = row->rhs;
+
+            free(row->cols);
+            free(row->vals);
+
+            if(++rows == max_rows)
+                rows = qr_reduce(&f, &g, rows, width, num_cols, lead, start, v, w);
+        }
+
+        free(list->items);
+        *list = (RowList){NULL, 0, 0};
+
+        rows = qr_reduce(&f, &g, rows, width, num_cols, lead, start, v, w);
+
+        int first = 0;
+        if(fabs(f[0]) > tol) {
+            r[k] = qr_row_from_dense(f, cols, 0, num_cols, f[num_cols]);
+            first = 1;
+        } else {
+            f[0] = 0;
+        }
+
+        for(int t = first; t < rows; t++) {
+            double* dense = f + (long)t * width;
+            QrRow row = qr_row_from_dense(dense, cols, t, num_cols, dense[num_cols]);
+
+            if(row.len > 0) {
+                row_list_add(&pending[row.cols[0]], row);
+            } else {
+                free(row.cols);
+                free(row.vals);
+            }
+        }
+    }
+
+    double* y = qr_alloc(n * sizeof(double));
+    int rank = 0;
+
+    for(int k = n - 1; k >= 0; k--) { // R y = Q^T b over the independent columns
+        if(r[k].len == 0) {
+            y[k] = 0;
+            continue;
+        }
+
+        double sum = r[k].rhs;
+        for(int p = 1; p < r[k].len; p++)
+            sum -= r[k].vals[p] * y[r[k].cols[p]];
+        y[k] = sum / r[k].vals[0];
+        rank++;
+    }
+
+    for(int k = 0; k < n; k++)
+        x[perm[k]] = y[k];
+
+    for(int k = 0; k < n; k++) {
+        free(r[k].cols);
+        free(r[k].vals);
+    }
+
+    free(pending);
+    free(r);
+    free(col_norms);
+    free(mark);
+    free(cols);
+    free(pos);
+    free(v);
+    free(w);
+    free(lead);
+    free(start);
+    free(f);
+    free(g);
+    free(y);
+    free(perm);
+    csr_free(pa);
+
+    return rank;
+}
+
+
+// Solution x minimizing ||b - a x|| for column vector b, every cell of a including scalar_val is
+// used. stats gets the rank of a and the residual. NULL if dimensions do not match or a matrix cannot
+// be loaded
+Matrix* qr_lstsq(Matrix* a, Matrix* b, LstsqStats* stats) {
+    if(b->rows != a->rows || b->cols != 1)
+        return NULL;
+
+    Csr* csr = matrix_cells_csr(a);
+    double* rhs = matrix_cells_copy(b);
+    if(!csr || !rhs) {
+        csr_free(csr);
+        free(rhs);
+        return NULL;
+    }
+
+    PROFILE_BEGIN(span);
+    double* x = vec_create(a->cols);
+    double* r = vec_create(a->rows);
+
+    stats->rank = qr_solve(csr, rhs, x);
+
+    // Report the true residual, not the part of b the rotations left over
+    csr_mult_vec(csr, x, r);
+    for(int i = 0; i < a->rows; i++)
+        r[i] = rhs[i] - r[i];
+
+    double b_norm = sqrt(vec_dot(rhs, rhs, a->rows));
+    stats->residual = sqrt(vec_dot(r, r, a->rows));
+    stats->relative = b_norm > 0 ? stats->residual / b_norm : stats->residual;
+
+    Matrix* result = matrix_from_cells(x, a->cols, 1);
+    PROFILE_END(PROF_LSTSQ, span, csr->nnz, matrix_stored(result));
+
+    free(x);
+    free(r);
+    free(rhs);
+    csr_free(csr);
+
+    return result;
+}
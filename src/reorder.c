@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/reorder.h"
+#include "../include/solver.h"
+#include "../include/profile.h"
+
+bool reorder_method(const char* name, ReorderMethod* method) {
+    if(!strcmp(name, "rcm"))
+        *method = REORDER_RCM;
+    else if(!strcmp(name, "amd"))
+        *method = REORDER_AMD;
+    else
+        return false;
+
+    return true;
+}
+
+
+// Symmetric reordering P^T A P of square a by method. perm gets the n x 1 matrix whose row k holds
+// the 1-based index of the row and column of a placed k-th, before and after the envelope of the
+// stored entries in either order. NULL if a is not square or cannot be loaded
+Matrix* matrix_reorder(Matrix* a, ReorderMethod method, Matrix** perm, Envelope* before, Envelope* after) {
+    if(a->rows != a->cols)
+        return NULL;
+
+    Csr* csr = matrix_csr(a);
+    if(!csr)
+        return NULL;
+
+    PROFILE_BEGIN(span);
+    int* order = method == REORDER_RCM ? order_rcm(csr) : order_min_degree(csr);
+
+    envelope_measure(csr, NULL, before);
+    envelope_measure(csr, order, after);
+
+    Matrix* result = matrix_permute(a, order, order);
+
+    double* indices = vec_create(a->rows);
+    for(int k = 0; k < a->rows; k++)
+        indices[k] = order[k] + 1;
+    *perm = matrix_from_cells(indices, a->rows, 1);
+
+    PROFILE_END(PROF_REORDER, span, csr->nnz, matrix_stored(result));
+
+    free(indices);
+    free(order);
+    csr_free(csr);
+
+    return result;
+}
+
+
+// 0-based permutation held in the 1-based column perm, NULL unless it holds each index once
+int* perm_indices(Matrix* perm) {
+    if(perm->cols != 1)
+        return NULL;
+
+    double* indices = matrix_cells_copy(perm);
+    if(!indices)
+        return NULL;
+
+    int n = perm->rows;
+    int* order = malloc(n * sizeof(int));
+    bool* seen = calloc(n, sizeof(bool));
+    if(!order || !seen) {
+        fprintf(stderr, "Memory allocation failed for permutation\n");
+        exit(1);
+    }
+
+    for(int k = 0; k < n; k++) {
+        double index = indices[k];
+
+        if(index < 1 || index > n || index != (int)index || seen[(int)index - 1]) {
+            free(indices);
+            free(order);
+            free(seen);
+            return NULL;
+        }
+
+        order[k] = (int)index - 1;
+        seen[order[k]] = true;
+    }
+
+    free(indices);
+    free(seen);
+
+    return order;
+}
+
+
+// x reordered as the matrix perm came from, or restored to the original order if undo. Square x of
+// the size of perm is permuted symmetrically, any other x with as many rows only has its rows
+// permuted, which maps a right-hand side or solution vector. NULL if perm is not a permutation of
+// the rows of x or x cannot be loaded
+Matrix* reorder_apply(Matrix* x, Matrix* perm, bool undo) {
+    if(perm->rows != x->rows)
+        return NULL;
+
+    int* order = perm_indices(perm);
+    if(!order)
+        return NULL;
+
+    if(undo) {
+        int* inverse = malloc(x->rows * sizeof(int));
+        if(!inverse) {
+            fprintf(stderr, "Memory allocation failed for permutation\n");
+            exit(1);
+        }
+
+        for(int k = 0; k < x->rows; k++)
+            inverse[order[k]] = k;
+
+        free(order);
+        order = inverse;
+    }
+
+    Matrix* result = matrix_permute(x, order, x->cols == x->rows ? order : NULL);
+    free(order);
+
+    return result;
+}
@@ -1,11 +1,42 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <sqlite3.h>
 #include "../include/hash_map.h"
 #include "../include/map_iterator.h"
 #include "../include/repository.h"
-
-sqlite3* db = NULL;
+#include "../include/jobs.h"
+#include "../include/thread_pool.h"
+#include "../include/profile.h"
+
+#define BUSY_TIMEOUT_MS 5000
+#define REPO_POOL_SIZE 8    // Connections shared by all threads
+
+// Connections are opened on first use and handed to one thread at a time,
+// so concurrent loads and background writes never share a transaction
+sqlite3* conn_pool[REPO_POOL_SIZE];
+bool conn_in_use[REPO_POOL_SIZE];
+pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t conn_released = PTHREAD_COND_INITIALIZER;
+
+// Connection held by the calling thread and how many nested calls use it
+_Thread_local sqlite3* db = NULL;
+_Thread_local int db_depth = 0;
+
+// Persisted version of a named matrix, used to validate delta saves
+typedef struct {
+    char* name;
+    long token;     // Version produced by the latest load or planned save
+    long committed; // Version currently stored in the database
+    int readers;    // Lazily loaded matrices still fetching rows of this name
+} RepoVersion;
+
+RepoVersion* versions = NULL;
+int num_versions = 0;
+int versions_capacity = 0;
+long next_token = 1;
+pthread_mutex_t versions_lock = PTHREAD_MUTEX_INITIALIZER;
 
 bool exec_sql(const char *sql) {
     char *err_msg = NULL;
@@ -41,7 +72,11 @@ bool init_data() {
         return false;
     }
 
+    // Wait for other connections' writes instead of failing
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+
     // Create database schema if needed
+    const char* journal = "PRAGMA journal_mode = WAL;"; // Readers are not blocked by a background write
     const char* pragma = "PRAGMA foreign_keys = ON;";
     const char* sql_create_matrices =
         "CREATE TABLE IF NOT EXISTS matrices ("
@@ -60,6 +95,7 @@ bool init_data() {
         "   FOREIGN KEY(name) REFERENCES matrices(name) ON DELETE CASCADE);";
     
     // Attempt to execute schema creation
+    if(!exec_sql(journal)) return false;
     if(!exec_sql(pragma)) return false;
     if(!exec_sql(sql_create_matrices)) return false;
     if(!exec_sql(sql_create_matrix_vals)) return false;
@@ -67,34 +103,197 @@ bool init_data() {
     return true;
 }
 
+// Take connection from pool for the calling thread, waiting if all are in use
 bool connect() {
-    bool connected = true;
+    if(db_depth++ > 0) // Thread already holds a connection
+        return true;
+
+    pthread_mutex_lock(&conn_lock);
+
+    int slot = -1;
+    while(slot < 0) {
+        for(int i = 0; i < REPO_POOL_SIZE && slot < 0; i++) {
+            if(!conn_in_use[i])
+                slot = i;
+        }
+
+        if(slot < 0)
+            pthread_cond_wait(&conn_released, &conn_lock);
+    }
+
+    conn_in_use[slot] = true;
+    pthread_mutex_unlock(&conn_lock);
+
+    db = conn_pool[slot];
+
+    if(!db) { // Open connection on first use of slot
+        if(!init_data()) {
+            sqlite3_close(db);
+            db = NULL;
+            db_depth = 0;
+
+            pthread_mutex_lock(&conn_lock);
+            conn_in_use[slot] = false;
+            pthread_cond_signal(&conn_released);
+            pthread_mutex_unlock(&conn_lock);
+
+            return false;
+        }
+
+        conn_pool[slot] = db;
+    }
+
+    return true;
+}
+
+
+// Return calling thread's connection to the pool once its outermost call finishes
+void disconnect() {
+    if(--db_depth > 0)
+        return;
+
+    pthread_mutex_lock(&conn_lock);
+
+    for(int i = 0; i < REPO_POOL_SIZE; i++) {
+        if(conn_pool[i] == db)
+            conn_in_use[i] = false;
+    }
+
+    pthread_cond_signal(&conn_released);
+    pthread_mutex_unlock(&conn_lock);
+
+    db = NULL;
+}
+
+// Get version slot for matrix name, creating it if necessary, versions_lock must be held
+RepoVersion* get_version(const char* name) {
+    for(int i = 0; i < num_versions; i++) {
+        if(!strcmp(versions[i].name, name))
+            return &versions[i];
+    }
+
+    if(num_versions >= versions_capacity) { // Grow version table
+        versions_capacity = versions_capacity ? versions_capacity * 2 : 16;
+        versions = realloc(versions, versions_capacity * sizeof(RepoVersion));
+    }
+
+    versions[num_versions].name = strdup(name);
+    versions[num_versions].token = 0;
+    versions[num_versions].committed = 0;
+    versions[num_versions].readers = 0;
 
-    if(!db)
-        connected = init_data();
+    return &versions[num_versions++];
+}
+
+
+// Record version of name just read from the database, returns its token
+long loaded_version(const char* name) {
+    pthread_mutex_lock(&versions_lock);
+    RepoVersion* version = get_version(name);
+    version->token = next_token++;
+    version->committed = version->token;
+    long token = version->token;
+    pthread_mutex_unlock(&versions_lock);
+
+    return token;
+}
+
+
+// Record that write producing token is stored in the database
+void commit_version(const char* name, long token) {
+    pthread_mutex_lock(&versions_lock);
+    get_version(name)->committed = token;
+    pthread_mutex_unlock(&versions_lock);
+}
+
+
+// Record failed write producing token so later saves rewrite name fully
+void fail_version(const char* name, long token) {
+    pthread_mutex_lock(&versions_lock);
+    RepoVersion* version = get_version(name);
+    if(version->token == token)
+        version->token = 0;
+    pthread_mutex_unlock(&versions_lock);
+}
+
+
+// Forget persisted version of name so the next save rewrites it fully
+void invalidate_version(const char* name) {
+    pthread_mutex_lock(&versions_lock);
+    RepoVersion* version = get_version(name);
+    version->token = 0;
+    version->committed = 0;
+    pthread_mutex_unlock(&versions_lock);
+}
+
+
+// Check if matrix mirrors the latest version of name, versions_lock must be held
+bool can_save_delta(const char* name, Matrix* matrix) {
+    if(matrix->dirty == NULL || matrix->repo_token == 0)
+        return false;
+
+    return get_version(name)->token == matrix->repo_token;
+}
+
+
+// Check if persisted copy of name can be rewritten by matrix without corrupting lazy readers,
+// versions_lock must be held
+bool can_overwrite(const char* name, Matrix* matrix) {
+    int readers = get_version(name)->readers;
+
+    // A lazily loaded matrix may only update its own persisted copy
+    if(matrix && matrix->pager && !strcmp(matrix->pager->name, name))
+        readers--;
+
+    if(readers > 0) {
+        printf("Error: Matrix %s is lazily loaded, drop it before overwriting or deleting its saved copy\n", name);
+        return false;
+    }
+
+    return true;
+}
 
-    return connected;
+
+// Stop pinning name once a lazily loaded matrix is fully loaded or freed
+void release_reader(const char* name) {
+    pthread_mutex_lock(&versions_lock);
+    get_version(name)->readers--;
+    pthread_mutex_unlock(&versions_lock);
 }
 
+
 bool repo_is_unique(char* name) {
+    (void)name;
     if(!connect()) // Connect to database
         return false; // Connection failed
 
+    disconnect();
     return true;
 }
 
 bool delete_matrix_vals(char* name) {
-    if(!connect()) // Connect to database
-        return false; // Connection failed
+    // Create query and statement
+    const char *sql = "DELETE FROM matrix_vals WHERE name = ?;";
+    sqlite3_stmt *stmt;
 
-    return true;
+    // Attempt to prepare statement
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    bool success = exec_prepared_stmt(stmt);
+    
+    if(success)
+        sqlite3_finalize(stmt);
+
+    return success;
 }
 
 
 bool insert_matrix_vals(char* name, Matrix* matrix) {
-    if(!connect()) // Connect to database
-        return false; // Connection failed
-
     // Create statement with placeholders
     const char* sql = "INSERT OR REPLACE INTO matrix_vals (name, row, col, val) VALUES (?, ?, ?, ?)";
     sqlite3_stmt* stmt;
@@ -107,12 +306,14 @@ bool insert_matrix_vals(char* name, Matrix* matrix) {
         return false;
     }
 
+    long written = 0;
     MapIterator map_it = map_iterator_create(matrix->vals);
     while(map_iterator_has_next(&map_it)) {
         // Get next non-zero value
         int row, col;
         double val;
         map_iterator_next(&map_it, &row, &col, &val);
+        jobs_report_progress(written++, matrix->vals->size);
 
         #ifdef DBG
         printf("Values Inserted:\n");
@@ -143,9 +344,11 @@ bool insert_matrix_vals(char* name, Matrix* matrix) {
 }
 
 
-bool repo_matrix_delete(char* name) {
-    if(!connect()) // Connect to database
-        return false; // Connection failed
+// Delete matrices row and values of name
+bool delete_matrix_data(char* name) {
+    // Delete values first, databases created before cascading deletes keep them otherwise
+    if(!delete_matrix_vals(name))
+        return false;
 
     // Create query and statement
     const char *sql = "DELETE FROM matrices WHERE name = ?;";
@@ -160,18 +363,49 @@ bool repo_matrix_delete(char* name) {
 
     sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
     bool success = exec_prepared_stmt(stmt);
-    sqlite3_finalize(stmt);
+
+    if(success)
+        sqlite3_finalize(stmt);
 
     return success;
 }
 
 
-bool repo_matrix_save(char* name, Matrix* matrix) {
+// Delete persisted copy of name unless lazily loaded matrices still read it
+bool delete_checked(char* name) {
+    pthread_mutex_lock(&versions_lock);
+    bool can_delete = can_overwrite(name, NULL);
+    pthread_mutex_unlock(&versions_lock);
+
+    if(!can_delete || !delete_matrix_data(name))
+        return false;
+
+    invalidate_version(name); // Persisted copy no longer exists
+
+    return true;
+}
+
+
+bool repo_matrix_delete(char* name) {
+    PROFILE_BEGIN(span);
+
     if(!connect()) // Connect to database
         return false; // Connection failed
 
-    // Delete existing matrix to cascade delete vals
-    repo_matrix_delete(name);
+    bool deleted = delete_checked(name);
+    disconnect();
+
+    PROFILE_END(PROF_REPO_DELETE, span, 0, 0);
+
+    return deleted;
+}
+
+
+// Write matrices row and every non-zero value of matrix
+bool save_matrix_full(char* name, Matrix* matrix) {
+    // Delete existing matrix and its values
+    if(!delete_matrix_data(name))
+        return false;
 
     // Create statement with placeholders
     const char* sql = "INSERT OR REPLACE INTO matrices (name, rows, cols, scalar_val) VALUES (?, ?, ?, ?)";
@@ -204,12 +438,202 @@ bool repo_matrix_save(char* name, Matrix* matrix) {
 }
 
 
-bool load_matrix_vals(char* name, Matrix* matrix) {
+// Write only the matrices row and the cells changed since the last load/save
+bool save_matrix_delta(char* name, Matrix* matrix) {
+    // Create statements with placeholders
+    const char* sql_update = "UPDATE matrices SET rows = ?, cols = ?, scalar_val = ? WHERE name = ?;";
+    const char* sql_upsert = "INSERT OR REPLACE INTO matrix_vals (name, row, col, val) VALUES (?, ?, ?, ?);";
+    const char* sql_delete = "DELETE FROM matrix_vals WHERE name = ? AND row = ? AND col = ?;";
+    sqlite3_stmt *update, *upsert, *delete;
+
+    // Attempt to prepare statements
+    if(sqlite3_prepare_v2(db, sql_update, -1, &update, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return false;
+    }
+
+    // Update dimensions and scalar value
+    sqlite3_bind_int(update, 1, matrix->rows);
+    sqlite3_bind_int(update, 2, matrix->cols);
+    sqlite3_bind_double(update, 3, matrix->scalar_val);
+    sqlite3_bind_text(update, 4, name, -1, SQLITE_STATIC);
+
+    if(!exec_prepared_stmt(update))
+        return false; // Update failed
+
+    sqlite3_finalize(update);
+
+    if(sqlite3_prepare_v2(db, sql_upsert, -1, &upsert, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return false;
+    }
+
+    if(sqlite3_prepare_v2(db, sql_delete, -1, &delete, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(upsert);
+        return false;
+    }
+
+    long written = 0;
+    MapIterator dirty_it = map_iterator_create(matrix->dirty);
+    while(map_iterator_has_next(&dirty_it)) {
+        // Get next changed cell
+        int row, col;
+        double unused_val;
+        map_iterator_next(&dirty_it, &row, &col, &unused_val);
+        jobs_report_progress(written++, matrix->dirty->size);
+
+        double val = matrix_get_stored(matrix, row, col);
+        sqlite3_stmt* stmt = val != 0 ? upsert : delete; // Upsert changed, delete zeroed
+
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, row);
+        sqlite3_bind_int(stmt, 3, col);
+        if(val != 0)
+            sqlite3_bind_double(stmt, 4, val);
+
+        if(!exec_prepared_stmt(stmt)) { // Write failed, statement already finalized
+            sqlite3_finalize(stmt == upsert ? delete : upsert);
+            return false;
+        }
+
+        // Reset stmt and clear bindings
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+    // Free allocated memory for statements
+    sqlite3_finalize(upsert);
+    sqlite3_finalize(delete);
+
+    return true;
+}
+
+
+// Plan save of matrix as name, snapshotting what must be written so later edits are not saved
+RepoWrite* repo_prepare_save(char* name, Matrix* matrix) {
+    pthread_mutex_lock(&versions_lock);
+
+    if(!can_overwrite(name, matrix)) {
+        pthread_mutex_unlock(&versions_lock);
+        return NULL;
+    }
+
+    RepoWrite* write = malloc(sizeof(RepoWrite));
+    if(!write) {
+        fprintf(stderr, "Memory allocation failed for RepoWrite\n");
+        exit(1);
+    }
+
+    // Only cells changed since last load/save need writing if persisted copy is current
+    write->name = strdup(name);
+    write->delta = can_save_delta(name, matrix);
+    write->base_token = matrix->repo_token;
+
+    // Reserve version the write produces, later saves are planned against it
+    RepoVersion* version = get_version(name);
+    version->token = next_token++;
+    write->token = version->token;
+
+    pthread_mutex_unlock(&versions_lock);
+
+    if(write->delta) // Changed cells and the change set move to the snapshot
+        write->snapshot = matrix_take_changes(matrix);
+    else
+        write->snapshot = matrix_copy(matrix);
+
+    if(!write->snapshot) { // Lazily loaded matrix could not be read
+        fail_version(name, write->token);
+        free(write->name);
+        free(write);
+        return NULL;
+    }
+
+    // Track later changes against the planned version
+    matrix_mark_clean(matrix, write->token);
+
+    return write;
+}
+
+
+// Write planned save to the database in one transaction
+bool commit_write(RepoWrite* write) {
+    if(write->delta) { // Delta must apply to the version it was planned against
+        pthread_mutex_lock(&versions_lock);
+        bool current = get_version(write->name)->committed == write->base_token;
+        pthread_mutex_unlock(&versions_lock);
+
+        if(!current) {
+            fprintf(stderr, "Error: Earlier save of %s failed, save it again\n", write->name);
+            fail_version(write->name, write->token);
+            return false;
+        }
+    }
+
+    matrix_make_sparse(write->snapshot); // Values are written from the snapshot's map
+
+    if(!exec_sql("BEGIN;")) {
+        fail_version(write->name, write->token);
+        return false;
+    }
+
+    bool saved = write->delta ? save_matrix_delta(write->name, write->snapshot)
+                              : save_matrix_full(write->name, write->snapshot);
+
+    if(!saved || !exec_sql("COMMIT;")) { // Discard partial write
+        exec_sql("ROLLBACK;");
+        fail_version(write->name, write->token);
+        return false;
+    }
+
+    commit_version(write->name, write->token);
+
+    return true;
+}
+
+
+// Write planned save to the database, may run on any thread
+bool repo_commit_save(RepoWrite* write) {
+    PROFILE_BEGIN(span);
+
     if(!connect()) // Connect to database
         return false; // Connection failed
-    
-    // Create query and statement
-    const char *sql = "SELECT row, col, val FROM matrix_vals WHERE name = ?;";
+
+    bool saved = commit_write(write);
+    disconnect();
+
+    PROFILE_END(PROF_REPO_SAVE, span, write->snapshot->vals->size, 0);
+
+    return saved;
+}
+
+
+void repo_write_free(RepoWrite* write) {
+    if(!write)
+        return;
+
+    matrix_free(write->snapshot);
+    free(write->name);
+    free(write);
+}
+
+
+bool repo_matrix_save(char* name, Matrix* matrix) {
+    RepoWrite* write = repo_prepare_save(name, matrix);
+    if(!write)
+        return false;
+
+    bool saved = repo_commit_save(write);
+    repo_write_free(write);
+
+    return saved;
+}
+
+
+// Query stored values of rows [first_row, last_row] of matrix name into dest
+bool fetch_rows(const char* name, int first_row, int last_row, HashMap* dest) {
+    // Create query and statement, range is served by the (name, row, col) primary key
+    const char *sql = "SELECT row, col, val FROM matrix_vals WHERE name = ? AND row BETWEEN ? AND ?;";
     sqlite3_stmt* stmt;
 
     // Attempt to prepare statement
@@ -219,8 +643,10 @@ bool load_matrix_vals(char* name, Matrix* matrix) {
         return false;
     }
 
-    // Bind matrix name to prepared statement
+    // Bind matrix name and row range to prepared statement
     sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, first_row);
+    sqlite3_bind_int(stmt, 3, last_row);
 
     // Iterate result rows
     while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
@@ -234,22 +660,34 @@ bool load_matrix_vals(char* name, Matrix* matrix) {
         printf("Row: %d, Col: %d, Value: %.2f\n", row, col, val);
         #endif
     
-        matrix_set(matrix, row, col, val); // Add to matrix
+        map_set(dest, row, col, val); // Add stored offset to matrix
     }
 
-    if(rc != SQLITE_DONE)
-        return false;
-
     // Free allocated memory for statement
     sqlite3_finalize(stmt);
 
-    return true;
+    return rc == SQLITE_DONE;
 }
 
-Matrix* repo_matrix_load(char* name) {
+
+// Load stored values of rows [first_row, last_row] of matrix name into dest, may run on any thread
+bool load_matrix_rows(const char* name, int first_row, int last_row, HashMap* dest) {
+    PROFILE_BEGIN(span);
+    int start_size = dest->size;
+
     if(!connect()) // Connect to database
-        return NULL; // Connection failed
+        return false; // Connection failed
 
+    bool loaded = fetch_rows(name, first_row, last_row, dest);
+    disconnect();
+
+    PROFILE_END(PROF_REPO_FETCH_ROWS, span, 0, dest->size - start_size);
+
+    return loaded;
+}
+
+// Read dimensions and scalar value of name into a lazily loaded matrix
+Matrix* load_header(char* name) {
     // Create query and statement
     const char *sql = "SELECT rows, cols, scalar_val FROM matrices WHERE name = ? LIMIT 1;";
     sqlite3_stmt* stmt;
@@ -272,7 +710,7 @@ Matrix* repo_matrix_load(char* name) {
         // Retrieve values from query
         int row = sqlite3_column_int(stmt, 0);
         int col = sqlite3_column_int(stmt, 1);
-        int scalar_val = sqlite3_column_double(stmt, 2);
+        double scalar_val = sqlite3_column_double(stmt, 2);
 
         // Instantiate matrix
         matrix = matrix_create(row, col);
@@ -290,18 +728,80 @@ Matrix* repo_matrix_load(char* name) {
     // Free allocated memory for statement
     sqlite3_finalize(stmt);
 
-    if(!load_matrix_vals(name, matrix))
-        return NULL;
+    // Rows are fetched in blocks on first access
+    matrix->pager = pager_create(name, matrix->rows, load_matrix_rows, release_reader);
+
+    pthread_mutex_lock(&versions_lock);
+    get_version(name)->readers++;
+    pthread_mutex_unlock(&versions_lock);
+
+    // Track changes against the version just loaded
+    matrix_mark_clean(matrix, loaded_version(name));
 
     return matrix;
 }
 
 
-// Print names and dimensions of all saved matrices
-bool repo_list() {
+Matrix* repo_matrix_load(char* name) {
+    PROFILE_BEGIN(span);
+
     if(!connect()) // Connect to database
-        return false; // Connection failed
+        return NULL; // Connection failed
+
+    Matrix* matrix = load_header(name);
+    disconnect();
 
+    PROFILE_END(PROF_REPO_LOAD, span, 0, 0);
+
+    return matrix;
+}
+
+
+// Names to load together and the fully loaded matrices, NULL where a load failed
+typedef struct {
+    char** names;
+    Matrix** matrices;
+} LoadBatch;
+
+
+// Load one matrix of batch completely on its own connection
+void load_task(int task, void* ctx) {
+    LoadBatch* batch = ctx;
+    Matrix* matrix = repo_matrix_load(batch->names[task]);
+
+    if(matrix && !matrix_materialize(matrix)) {
+        matrix_free(matrix);
+        matrix = NULL;
+    }
+
+    batch->matrices[task] = matrix;
+}
+
+
+// Fully load count matrices concurrently into matrices, loads none unless all succeed
+bool repo_matrix_load_many(char** names, int count, Matrix** matrices) {
+    LoadBatch batch = {names, matrices};
+    pool_parallel_for(count, load_task, &batch);
+
+    bool loaded = true;
+    for(int i = 0; i < count; i++) {
+        if(!matrices[i])
+            loaded = false;
+    }
+
+    if(!loaded) { // Discard partial results
+        for(int i = 0; i < count; i++) {
+            matrix_free(matrices[i]);
+            matrices[i] = NULL;
+        }
+    }
+
+    return loaded;
+}
+
+
+// Print names and dimensions of all saved matrices
+bool print_saved() {
     // Create query and statement
     const char *sql = "SELECT name, rows, cols FROM matrices;";
     sqlite3_stmt* stmt;
@@ -331,5 +831,19 @@ bool repo_list() {
     sqlite3_finalize(stmt);
 
     return true;
+}
 
-}
\ No newline at end of file
+
+bool repo_list() {
+    PROFILE_BEGIN(span);
+
+    if(!connect()) // Connect to database
+        return false; // Connection failed
+
+    bool listed = print_saved();
+    disconnect();
+
+    PROFILE_END(PROF_REPO_LIST, span, 0, 0);
+
+    return listed;
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include "../include/row_map.h"
 #include "../include/list.h"
+#include "../include/mem_stats.h"
 
 // Hash function to map row indices to bucket indices
 unsigned int row_map_hash(int row) {
@@ -15,6 +16,7 @@ RowMap* row_map_create() {
         fprintf(stderr, "Memory allocation failed for RowMap\n");
         exit(1);
     }
+    MEM_TRACK(MEM_ROW_MAP, 1, sizeof(RowMap));
     map->size = 0;
     for (int i = 0; i < ROW_MAP_SIZE; i++) {
         map->table[i] = NULL;  // Initialize all entries to NULL
@@ -44,6 +46,7 @@ void row_map_insert(RowMap* map, int row, int col, double val) {
         fprintf(stderr, "Memory allocation failed for RowNode\n");
         exit(1);
     }
+    MEM_TRACK(MEM_ROW_MAP, 0, sizeof(RowNode));
     node->row = row;
     node->col_vals = list_create();
     list_append(node->col_vals, row, col, val);  // Add the (col, val) pair to the list
@@ -94,6 +97,7 @@ double row_map_increment(RowMap* map, int row, int col, double val) {
         fprintf(stderr, "Memory allocation failed for RowNode\n");
         exit(1);
     }
+    MEM_TRACK(MEM_ROW_MAP, 0, sizeof(RowNode));
     node->row = row;
     node->col_vals = list_create();
     list_append(node->col_vals, row, col, val);  // Add the (col, val) pair to the list
@@ -141,6 +145,7 @@ void row_map_remove(RowMap* map, int row, int col) {
                     map->table[bucket_index] = node->next;
                 }
                 free(node);
+                MEM_TRACK(MEM_ROW_MAP, 0, -(long)sizeof(RowNode));
                 map->size--;
             }
             return;
@@ -161,5 +166,22 @@ void free_row_map(RowMap* map) {
             node = next;
         }
     }
+    MEM_TRACK(MEM_ROW_MAP, -1, -(long)(sizeof(RowMap) + map->size * sizeof(RowNode)));
     free(map);  // Free the RowMap structure
+}
+
+
+// Bytes allocated for map, its row nodes and their lists
+size_t row_map_bytes(RowMap* map) {
+    if(!map)
+        return 0;
+
+    size_t bytes = sizeof(RowMap);
+
+    for (int i = 0; i < ROW_MAP_SIZE; i++) {
+        for (RowNode* node = map->table[i]; node != NULL; node = node->next)
+            bytes += sizeof(RowNode) + list_bytes(node->col_vals);
+    }
+
+    return bytes;
 }
\ No newline at end of file
@@ -2,24 +2,64 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
 #include "../include/run_script.h"
+#include "../include/parse_input.h"
+#include "../include/parse_expr.h"
+#include "../include/eval_expr.h"
+#include "../include/runtime_data.h"
+#include "../include/thread_pool.h"
 
 #define MAX_COMMAND_LEN 1024
 
-bool handle_input(char *input);
+// Statements of the wave being evaluated
+typedef struct {
+    Statement* stmts;
+    int* batch;
+} WaveBatch;
 
-// Function to execute commands from a file with commands separated by ';'
-void execute_file(const char* filepath) {
-    #ifdef DBG
-    printf("File Path: %s\n", filepath);
-    #endif
 
-    FILE* file = fopen(filepath, "r");
-    if (!file) {
-        perror("Failed to open file");
+// Add statement in buffer to list, trimming surrounding whitespace and skipping empty ones
+void add_statement(char* buffer, char*** stmts, int* count, int* capacity) {
+    // Trim leading and trailing spaces
+    char* cmd_start = buffer;
+    while (*cmd_start == ' ' || *cmd_start == '\t' || *cmd_start == '\n') cmd_start++;
+
+    // Remove trailing whitespace
+    for (int i = strlen(cmd_start) - 1; i >= 0; i--) {
+        if (cmd_start[i] == ' ' || cmd_start[i] == '\t' || cmd_start[i] == '\n') {
+            cmd_start[i] = '\0';
+        } else {
+            break;
+        }
+    }
+
+    if (strlen(cmd_start) == 0)
         return;
+
+    if (*count >= *capacity) {
+        *capacity *= 2;
+        *stmts = realloc(*stmts, *capacity * sizeof(char*));
+        if (!*stmts) {
+            fprintf(stderr, "Memory allocation failed for script statements\n");
+            exit(1);
+        }
     }
 
+    (*stmts)[(*count)++] = strdup(cmd_start);
+}
+
+
+// Read statements separated by ';' from file
+char** read_statements(FILE* file, int* count) {
+    int capacity = 16;
+    char** stmts = malloc(capacity * sizeof(char*));
+    if (!stmts) {
+        fprintf(stderr, "Memory allocation failed for script statements\n");
+        exit(1);
+    }
+    *count = 0;
+
     char buffer[MAX_COMMAND_LEN];
     size_t buf_len = 0;
 
@@ -28,28 +68,7 @@ void execute_file(const char* filepath) {
         if (c == ';') {
             // End of a command
             buffer[buf_len] = '\0';
-
-            // Trim leading and trailing spaces
-            char* cmd_start = buffer;
-            while (*cmd_start == ' ' || *cmd_start == '\t' || *cmd_start == '\n') cmd_start++;
-
-            // Remove trailing whitespace
-            for (int i = strlen(cmd_start) - 1; i >= 0; i--) {
-                if (cmd_start[i] == ' ' || cmd_start[i] == '\t' || cmd_start[i] == '\n') {
-                    cmd_start[i] = '\0';
-                } else {
-                    break;
-                }
-            }
-
-            if (strlen(cmd_start) > 0) {
-                #ifdef DBG
-                printf("Executing line: %s\n", cmd_start);
-                #endif
-
-                handle_input(cmd_start);
-            }
-
+            add_statement(buffer, &stmts, count, &capacity);
             buf_len = 0; // Reset buffer for next command
         } else {
             if (buf_len < MAX_COMMAND_LEN - 1) {
@@ -66,9 +85,197 @@ void execute_file(const char* filepath) {
     // If file didn't end with ';', process remaining buffer
     if (buf_len > 0) {
         buffer[buf_len] = '\0';
-        handle_input(buffer);
+        add_statement(buffer, &stmts, count, &capacity);
     }
 
-    fclose(file);
+    return stmts;
+}
+
+
+// Collect matrix names read by expression, named the way the tokenizer reads them
+char** expr_reads(const char* expr, int* count) {
+    int capacity = 4;
+    char** reads = malloc(capacity * sizeof(char*));
+    *count = 0;
+
+    for(int i = 0; expr[i] != '\0';) {
+        if(!isalpha((unsigned char)expr[i]) && expr[i] != '_') {
+            i++;
+            continue;
+        }
+
+        int start = i;
+        while(isalpha((unsigned char)expr[i]) || expr[i] == '_') i++;
+
+        if(*count >= capacity) {
+            capacity *= 2;
+            reads = realloc(reads, capacity * sizeof(char*));
+        }
+
+        reads[(*count)++] = strndup(expr + start, i - start);
+    }
+
+    return reads;
+}
+
+
+bool reads_name(Statement* stmt, const char* name) {
+    for(int i = 0; i < stmt->num_reads; i++) {
+        if(!strcmp(stmt->reads[i], name))
+            return true;
+    }
+
+    return false;
+}
+
+
+// Assign each statement the earliest wave that keeps results identical to serial execution
+int plan_waves(Statement* stmts, int count) {
+    int num_waves = 0;
+    int first = 0; // First statement after the latest one that runs alone
+
+    for(int i = 0; i < count; i++) {
+        Statement* stmt = &stmts[i];
+
+        if(!stmt->target) { // Runs alone, after everything before it
+            stmt->wave = num_waves++;
+            first = i + 1;
+            continue;
+        }
+
+        stmt->wave = first > 0 ? stmts[first - 1].wave + 1 : 0;
+
+        for(int j = first; j < i; j++) {
+            Statement* prev = &stmts[j];
+
+            // Reading a result needs the wave after it, results are bound in statement order
+            // at the end of a wave so overwriting something read or written earlier may share it
+            if(reads_name(stmt, prev->target) && prev->wave + 1 > stmt->wave)
+                stmt->wave = prev->wave + 1;
+            else if((!strcmp(stmt->target, prev->target) || reads_name(prev, stmt->target)) && prev->wave > stmt->wave)
+                stmt->wave = prev->wave;
+        }
+
+        if(stmt->wave + 1 > num_waves)
+            num_waves = stmt->wave + 1;
+    }
+
+    return num_waves;
+}
+
+
+// Evaluate one statement of the wave, errors are reported when the statement is bound
+void eval_statement(int task, void* ctx) {
+    WaveBatch* wave = ctx;
+    Statement* stmt = &wave->stmts[wave->batch[task]];
+
+    expr_set_quiet(true);
+    stmt->result = solve_expr(stmt->expr);
+    expr_set_quiet(false);
+}
+
+
+// Run statements wave by wave, evaluating assignments of a wave concurrently
+void run_parallel(Statement* stmts, int count) {
+    int num_waves = plan_waves(stmts, count);
+    int* batch = malloc(count * sizeof(int));
+
+    for(int w = 0; w < num_waves; w++) {
+        int size = 0;
+        for(int i = 0; i < count; i++) {
+            if(stmts[i].wave == w)
+                batch[size++] = i;
+        }
+
+        if(size == 1 && !stmts[batch[0]].target) { // Command or index assignment
+            handle_input(stmts[batch[0]].text);
+            continue;
+        }
+
+        // Fully load matrices read by the wave so workers only read shared state
+        for(int k = 0; k < size; k++) {
+            Statement* stmt = &stmts[batch[k]];
+
+            for(int r = 0; r < stmt->num_reads; r++)
+                matrix_materialize(rd_get_matrix(stmt->reads[r]));
+        }
+
+        WaveBatch wave = {stmts, batch};
+        pool_parallel_for(size, eval_statement, &wave);
+
+        // Bind results in statement order, rerun failures to report their errors in order
+        for(int k = 0; k < size; k++) {
+            Statement* stmt = &stmts[batch[k]];
+
+            if(stmt->result)
+                save_result(stmt->result, stmt->target);
+            else
+                handle_input(stmt->text);
+        }
+    }
+
+    free(batch);
 }
 
+
+// Function to execute commands from a file with commands separated by ';'
+bool execute_file(const char* filepath, bool parallel) {
+    #ifdef DBG
+    printf("File Path: %s\n", filepath);
+    #endif
+
+    FILE* file = fopen(filepath, "r");
+    if (!file) {
+        perror("Failed to open file");
+        return false;
+    }
+
+    int count;
+    char** texts = read_statements(file, &count);
+    fclose(file);
+
+    if (!parallel) {
+        for (int i = 0; i < count; i++) {
+            #ifdef DBG
+            printf("Executing line: %s\n", texts[i]);
+            #endif
+
+            handle_input(texts[i]);
+            free(texts[i]);
+        }
+
+        free(texts);
+        return true;
+    }
+
+    // Parse all statements up front to find which may run together
+    Statement* stmts = calloc(count > 0 ? count : 1, sizeof(Statement));
+    if (!stmts) {
+        fprintf(stderr, "Memory allocation failed for script statements\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        stmts[i].text = texts[i];
+
+        if (parse_assignment(texts[i], &stmts[i].target, &stmts[i].expr))
+            stmts[i].reads = expr_reads(stmts[i].expr, &stmts[i].num_reads);
+    }
+
+    run_parallel(stmts, count);
+
+    for (int i = 0; i < count; i++) {
+        for (int r = 0; r < stmts[i].num_reads; r++)
+            free(stmts[i].reads[r]);
+
+        free(stmts[i].reads);
+        free(stmts[i].target);
+        free(stmts[i].expr);
+        free(stmts[i].text);
+    }
+
+    free(stmts);
+    free(texts);
+
+    return true;
+}
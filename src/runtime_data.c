@@ -1,86 +1,262 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../include/runtime_data.h"
 #include "../include/matrix_cli.h"
 
-#define MAX_MATRICES 100
+#define SYMBOLS_MIN_CAPACITY 64 // Initial slot count, always a power of two
 
-Matrix* matrices[MAX_MATRICES];
-char* matrix_names[MAX_MATRICES];
+// Named matrix, the table holds one reference to matrix
+typedef struct {
+    char* name;         // Interned name, NULL for an empty slot
+    unsigned int hash;
+    Matrix* matrix;
+} Symbol;
+
+// Open addressing table with linear probing, kept at most half full
+Symbol* symbols = NULL;
+int capacity = 0;
 int num_matrices = 0;
 
-int find_matrix(char* name) {
-    name = name;
-    for(int i = 0; i < num_matrices; i++) {
-        if(!strcmp(name, matrix_names[i]))
-            return i;
+
+// FNV-1a hash of name
+unsigned int hash_name(const char* name) {
+    unsigned int hash = 2166136261u;
+
+    for(; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
     }
 
-    return -1;
+    return hash;
 }
 
-void shift_vals(int index) {
-    for(int i = index; i < num_matrices - 1; i++) {
-        matrices[i] = matrices[i + 1];
-        matrix_names[i] = matrix_names[i + 1];
+
+// Find slot holding name, or the empty slot it would be inserted into
+int find_slot(const char* name, unsigned int hash) {
+    int mask = capacity - 1;
+    int slot = hash & mask;
+
+    while(symbols[slot].name) {
+        if(symbols[slot].hash == hash && !strcmp(symbols[slot].name, name))
+            return slot;
+
+        slot = (slot + 1) & mask;
     }
+
+    return slot;
+}
+
+
+// Index of matrix name in the table, -1 if not defined
+int find_matrix(const char* name) {
+    if(!name || num_matrices == 0)
+        return -1;
+
+    int slot = find_slot(name, hash_name(name));
+
+    return symbols[slot].name ? slot : -1;
 }
 
+
+// Resize table to new_capacity slots and reinsert all symbols
+void resize_symbols(int new_capacity) {
+    Symbol* old = symbols;
+    int old_capacity = capacity;
+
+    symbols = calloc(new_capacity, sizeof(Symbol));
+    if(!symbols) {
+        fprintf(stderr, "Memory allocation failed for symbol table\n");
+        exit(1);
+    }
+    capacity = new_capacity;
+
+    for(int i = 0; i < old_capacity; i++) {
+        if(old[i].name)
+            symbols[find_slot(old[i].name, old[i].hash)] = old[i];
+    }
+
+    free(old);
+}
+
+
+// Add name, which the table takes ownership of, bound to matrix
+void insert_symbol(char* name, Matrix* matrix) {
+    if((num_matrices + 1) * 2 > capacity) // Keep load factor at most 1/2
+        resize_symbols(capacity ? capacity * 2 : SYMBOLS_MIN_CAPACITY);
+
+    unsigned int hash = hash_name(name);
+    int slot = find_slot(name, hash);
+
+    symbols[slot].name = name;
+    symbols[slot].hash = hash;
+    symbols[slot].matrix = matrix;
+    num_matrices++;
+}
+
+
+// Empty slot, shifting later entries of its probe run back so lookups need no tombstones
+void remove_slot(int slot) {
+    int mask = capacity - 1;
+
+    free(symbols[slot].name);
+    symbols[slot].name = NULL;
+    num_matrices--;
+
+    int next = (slot + 1) & mask;
+    while(symbols[next].name) {
+        int home = symbols[next].hash & mask;
+
+        // Move entry into the hole unless its home lies between the hole and it
+        if(((next - home) & mask) >= ((next - slot) & mask)) {
+            symbols[slot] = symbols[next];
+            symbols[next].name = NULL;
+            slot = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+}
+
+
+// Bind name to matrix, replacing and releasing any matrix it was bound to
 bool rd_overwrite_matrix(char* name, Matrix* matrix) {
-    name = trim(name);
-    int index = find_matrix(name);
+    char* trimmed = trim(name);
+    int index = find_matrix(trimmed);
 
     if(index >= 0) {
-        matrices[index] = matrix;
+        Matrix* old = symbols[index].matrix;
+        symbols[index].matrix = matrix;
+
+        if(old != matrix)
+            matrix_release(old);
+
+        free(trimmed);
         return true;
     }
 
-    if(num_matrices >= MAX_MATRICES)
-        return false;
-    
-    matrix_names[num_matrices] = name;
-    matrices[num_matrices++] = matrix;
+    insert_symbol(trimmed, matrix);
 
     return true;
 }
 
+
+// Bind name to matrix if name is not yet defined, table takes the caller's reference
 bool rd_save_matrix(char* name, Matrix* matrix) {
     char* trimmed = trim(name);
 
-    if(num_matrices >= MAX_MATRICES)
-        return false;
-    
-    if(find_matrix(trimmed) > 0)
+    if(find_matrix(trimmed) >= 0) {
+        free(trimmed);
         return false;
+    }
 
-    matrix_names[num_matrices] = strdup(trimmed);
-    matrices[num_matrices++] = matrix;
+    insert_symbol(trimmed, matrix);
 
     return true;
 }
 
+
+// Remove name and release its matrix
 bool rd_delete_matrix(char* name) {
     int matrix_index = find_matrix(name);
 
     if(matrix_index < 0)
         return false;
 
-    matrix_free(matrices[matrix_index]);
-    shift_vals(matrix_index);
-    
+    matrix_release(symbols[matrix_index].matrix);
+    remove_slot(matrix_index);
+
     return true;
 }
 
+
 Matrix* rd_get_matrix(char* name) {
     int matrix_index = find_matrix(name);
-    
+
     if(matrix_index < 0)
         return NULL;
 
-    return matrices[matrix_index];
+    return symbols[matrix_index].matrix;
+}
+
+
+int compare_symbols(const void* a, const void* b) {
+    return strcmp((*(Symbol* const*)a)->name, (*(Symbol* const*)b)->name);
 }
 
+
+// Symbols ordered by name, caller frees the array
+Symbol** sorted_symbols() {
+    Symbol** sorted = malloc(num_matrices * sizeof(Symbol*));
+    if(!sorted) {
+        fprintf(stderr, "Memory allocation failed for symbol list\n");
+        exit(1);
+    }
+
+    int count = 0;
+    for(int i = 0; i < capacity; i++) {
+        if(symbols[i].name)
+            sorted[count++] = &symbols[i];
+    }
+
+    qsort(sorted, count, sizeof(Symbol*), compare_symbols);
+
+    return sorted;
+}
+
+
+// Print all matrices ordered by name
 void rd_print_all() {
+    if(num_matrices == 0)
+        return;
+
+    Symbol** sorted = sorted_symbols();
+
     for(int i = 0; i < num_matrices; i++)
-        printf("Matrix %s (%d x %d)\n", matrix_names[i], matrices[i]->rows, matrices[i]->cols);
-}
\ No newline at end of file
+        printf("Matrix %s (%d x %d)\n", sorted[i]->name, sorted[i]->matrix->rows, sorted[i]->matrix->cols);
+
+    free(sorted);
+}
+
+
+// Print memory held by each matrix ordered by name, then totals
+void rd_print_mem() {
+    if(num_matrices == 0) {
+        printf("No matrices defined\n");
+        return;
+    }
+
+    Symbol** sorted = sorted_symbols();
+    long total_nnz = 0;
+    size_t total_bytes = 0, total_index = 0;
+
+    printf("%-16s %12s %14s %10s %14s\n", "Matrix", "nnz", "Bytes", "Bytes/nnz", "Index bytes");
+
+    for(int i = 0; i < num_matrices; i++) {
+        MatrixMem mem;
+        matrix_mem(sorted[i]->matrix, &mem);
+
+        size_t bytes = mem.vals + mem.other;
+        printf("%-16s %12ld %14zu ", sorted[i]->name, mem.nnz, bytes);
+
+        if(mem.nnz > 0)
+            printf("%10.1f", (double)bytes / mem.nnz);
+        else
+            printf("%10s", "-");
+
+        printf(" %14zu\n", mem.index);
+
+        total_nnz += mem.nnz;
+        total_bytes += bytes;
+        total_index += mem.index;
+    }
+
+    printf("%-16s %12ld %14zu ", "Total", total_nnz, total_bytes);
+    if(total_nnz > 0)
+        printf("%10.1f", (double)total_bytes / total_nnz);
+    else
+        printf("%10s", "-");
+    printf(" %14zu\n", total_index);
+
+    free(sorted);
+}
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "../include/solver.h"
+#include "../include/csr.h"
+#include "../include/profile.h"
+
+bool solver_method(const char* name, SolverMethod* method) {
+    if(!strcmp(name, "cg"))
+        *method = SOLVER_CG;
+    else if(!strcmp(name, "bicgstab"))
+        *method = SOLVER_BICGSTAB;
+    else if(!strcmp(name, "chol"))
+        *method = SOLVER_CHOLESKY;
+    else if(!strcmp(name, "lu"))
+        *method = SOLVER_LU;
+    else
+        return false;
+
+    return true;
+}
+
+
+double* vec_create(int n) {
+    double* vec = calloc(n, sizeof(double));
+    if(!vec) {
+        fprintf(stderr, "Memory allocation failed for vector\n");
+        exit(1);
+    }
+
+    return vec;
+}
+
+
+double vec_dot(const double* x, const double* y, int n) {
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+        sum += x[i] * y[i];
+
+    return sum;
+}
+
+
+// Set y to y + alpha * x
+void vec_axpy(double* y, double alpha, const double* x, int n) {
+    for(int i = 0; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+
+// Set y to the system matrix times x, scalar_val adds its multiple of the sum of x to every row
+void system_apply(System* sys, const double* x, double* y) {
+    csr_mult_vec(sys->csr, x, y);
+
+    if(sys->scalar_val != 0) {
+        double sum = 0;
+        for(int i = 0; i < sys->n; i++)
+            sum += x[i];
+
+        for(int i = 0; i < sys->n; i++)
+            y[i] += sys->scalar_val * sum;
+    }
+}
+
+
+// Frobenius norm of the system matrix bounded from above, scalar_val adds at most n |scalar_val|
+double system_norm(System* sys) {
+    double sum = 0;
+    for(long k = 0; k < sys->csr->nnz; k++)
+        sum += sys->csr->vals[k] * sys->csr->vals[k];
+
+    return sqrt(sum) + sys->n * fabs(sys->scalar_val);
+}
+
+
+// Check if ax = A x is at the level of rounding in computing it, x is then numerically in the null
+// space of A and a step along it breaks down
+bool system_null(System* sys, double a_norm, const double* x, const double* ax) {
+    int n = sys->n;
+    return sqrt(vec_dot(ax, ax, n)) <= n * DBL_EPSILON * a_norm * sqrt(vec_dot(x, x, n));
+}
+
+
+// Set z to the preconditioner applied to r, or to r without one
+void system_precond(System* sys, const double* r, double* z) {
+    if(sys->precond)
+        precond_apply(sys->precond, r, z);
+    else
+        memcpy(z, r, sys->n * sizeof(double));
+}
+
+
+// Set r to b - Ax and return its norm
+double system_residual(System* sys, const double* b, const double* x, double* r) {
+    system_apply(sys, x, r);
+
+    for(int i = 0; i < sys->n; i++)
+        r[i] = b[i] - r[i];
+
+    return sqrt(vec_dot(r, r, sys->n));
+}
+
+
+// Preconditioned conjugate gradient from x = 0, breaks down if A is found not to be positive definite
+void solve_cg(System* sys, const double* b, double* x, double stop, int max_iter, SolveStats* stats) {
+    int n = sys->n;
+    double* r = vec_create(n);
+    double* z = vec_create(n);
+    double* p = vec_create(n);
+    double* ap = vec_create(n);
+
+    memcpy(r, b, n * sizeof(double));
+    system_precond(sys, r, z);
+    memcpy(p, z, n * sizeof(double));
+    double rz = vec_dot(r, z, n);
+    double a_norm = system_norm(sys);
+
+    while(stats->iterations < max_iter && sqrt(vec_dot(r, r, n)) > stop) {
+        system_apply(sys, p, ap);
+        double pap = vec_dot(p, ap, n);
+        if(!(pap > 0) || !isfinite(rz) || system_null(sys, a_norm, p, ap)) { // Also catches NaN
+            stats->breakdown = true;
+            break;
+        }
+
+        double alpha = rz / pap;
+        vec_axpy(x, alpha, p, n);
+        vec_axpy(r, -alpha, ap, n);
+        stats->iterations++;
+
+        system_precond(sys, r, z);
+        double rz_next = vec_dot(r, z, n);
+        double beta = rz_next / rz;
+        rz = rz_next;
+
+        for(int i = 0; i < n; i++)
+            p[i] = z[i] + beta * p[i];
+    }
+
+    free(r);
+    free(z);
+    free(p);
+    free(ap);
+}
+
+
+// Right preconditioned BiCGSTAB from x = 0, stops early on a zero or non-finite denominator
+void solve_bicgstab(System* sys, const double* b, double* x, double stop, int max_iter, SolveStats* stats) {
+    int n = sys->n;
+    double* r = vec_create(n);
+    double* r_hat = vec_create(n);
+    double* p = vec_create(n);
+    double* p_hat = vec_create(n);  // Preconditioned p
+    double* v = vec_create(n);
+    double* s = vec_create(n);
+    double* s_hat = vec_create(n);  // Preconditioned s
+    double* t = vec_create(n);
+
+    memcpy(r, b, n * sizeof(double));
+    memcpy(r_hat, b, n * sizeof(double));
+    double rho = 1, alpha = 1, omega = 1;
+    double a_norm = system_norm(sys);
+
+    while(stats->iterations < max_iter && sqrt(vec_dot(r, r, n)) > stop) {
+        double rho_next = vec_dot(r_hat, r, n);
+        if(rho_next == 0 || !isfinite(rho_next)) {
+            stats->breakdown = true;
+            break;
+        }
+
+        double beta = rho_next / rho * alpha / omega;
+        rho = rho_next;
+
+        for(int i = 0; i < n; i++)
+            p[i] = r[i] + beta * (p[i] - omega * v[i]);
+
+        system_precond(sys, p, p_hat);
+        system_apply(sys, p_hat, v);
+        double r_hat_v = vec_dot(r_hat, v, n);
+        if(r_hat_v == 0 || !isfinite(r_hat_v) || system_null(sys, a_norm, p_hat, v)) {
+            stats->breakdown = true;
+            break;
+        }
+
+        alpha = rho / r_hat_v;
+        for(int i = 0; i < n; i++)
+            s[i] = r[i] - alpha * v[i];
+
+        vec_axpy(x, alpha, p_hat, n);
+        stats->iterations++;
+
+        if(sqrt(vec_dot(s, s, n)) <= stop) { // Half step already converged
+            memcpy(r, s, n * sizeof(double));
+            break;
+        }
+
+        system_precond(sys, s, s_hat);
+        system_apply(sys, s_hat, t);
+        double tt = vec_dot(t, t, n);
+        omega = tt > 0 ? vec_dot(t, s, n) / tt : 0;
+        if(omega == 0 || !isfinite(omega)) {
+            stats->breakdown = true;
+            break;
+        }
+
+        vec_axpy(x, omega, s_hat, n);
+        for(int i = 0; i < n; i++)
+            r[i] = s[i] - omega * t[i];
+    }
+
+    free(r);
+    free(r_hat);
+    free(p);
+    free(p_hat);
+    free(v);
+    free(s);
+    free(s_hat);
+    free(t);
+}
+
+
+// Solve a x = b for column vector b until the residual falls to tol times the norm of b, applying
+// the preconditioner kept with a if any. stats gets the iterations run and the final residual. NULL
+// if dimensions do not match, a Cholesky solve finds a is not symmetric positive definite, an LU
+// solve finds it singular or an iterative solve breaks down, which stats records
+Matrix* solver_solve(Matrix* a, Matrix* b, SolverMethod method, double tol, int max_iter, SolveStats* stats) {
+    stats->iterations = 0;
+    stats->breakdown = false;
+    stats->residual = INFINITY; // Stands for early returns, which produce no x
+    stats->converged = false;
+
+    if(a->rows != a->cols || b->rows != a->rows || b->cols != 1)
+        return NULL;
+
+    Cholesky* chol = NULL;
+    if(method == SOLVER_CHOLESKY && !(chol = matrix_cholesky(a)))
+        return NULL;
+
+    SparseLu* lu = NULL;
+    if(method == SOLVER_LU && !(lu = matrix_lu(a)))
+        return NULL;
+
+    Csr* csr = matrix_csr(a);
+    double* rhs = matrix_cells_copy(b);
+    if(!csr || !rhs) {
+        csr_free(csr);
+        free(rhs);
+        return NULL;
+    }
+
+    PROFILE_BEGIN(span);
+    int n = a->rows;
+    System sys = {csr, a->scalar_val, n, a->precond};
+    double* x = vec_create(n);
+    double b_norm = sqrt(vec_dot(rhs, rhs, n));
+
+    if(method == SOLVER_CHOLESKY)
+        cholesky_solve(chol, rhs, x);
+    else if(method == SOLVER_LU)
+        lu_solve(lu, rhs, x);
+    else if(method == SOLVER_CG)
+        solve_cg(&sys, rhs, x, tol * b_norm, max_iter, stats);
+    else
+        solve_bicgstab(&sys, rhs, x, tol * b_norm, max_iter, stats);
+
+    // Report the true residual, the recurrences drift from it in floating point
+    double* r = vec_create(n);
+    double r_norm = system_residual(&sys, rhs, x, r);
+    stats->residual = b_norm > 0 ? r_norm / b_norm : r_norm;
+    stats->converged = stats->residual <= tol;
+    stats->breakdown = stats->breakdown || !isfinite(stats->residual);
+
+    Matrix* result = stats->breakdown ? NULL : matrix_from_cells(x, n, 1);
+    PROFILE_END(PROF_SOLVE, span, csr->nnz, result ? matrix_stored(result) : 0);
+
+    free(r);
+    free(x);
+    free(rhs);
+    csr_free(csr);
+
+    return result;
+}
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "../include/svd.h"
+#include "../include/eigen.h"
+#include "../include/thread_pool.h"
+#include "../include/profile.h"
+
+#define SVD_TASK_ROWS 4096      // Block rows below which another task is not worth starting
+#define SVD_RANK_TOL 1e-12      // Gram eigenvalues below this fraction of the largest are dependent directions
+#define SVD_JACOBI_SWEEPS 60
+
+// Row-major blocks with the same rows and width columns, split into tasks over consecutive rows
+typedef struct {
+    const double* a;
+    double* b;
+    int rows;
+    int width;
+    double* partial;    // a^T b over the rows of each task
+    const double* t;    // width x width matrix every row of b is multiplied by
+    int num_tasks;
+} BlockTasks;
+
+
+void* svd_alloc(size_t bytes) {
+    void* ptr = calloc(1, bytes > 0 ? bytes : 1);
+    if(!ptr) {
+        fprintf(stderr, "Memory allocation failed for svd\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+int block_num_tasks(int rows) {
+    int num_tasks = 1 + rows / SVD_TASK_ROWS;
+
+    return num_tasks < pool_size() ? num_tasks : pool_size();
+}
+
+
+void cross_task(int task, void* ctx) {
+    BlockTasks* tasks = ctx;
+    int width = tasks->width;
+    int end = (long)tasks->rows * (task + 1) / tasks->num_tasks;
+    double* out = tasks->partial + (long)task * width * width;
+
+    for(int r = (long)tasks->rows * task / tasks->num_tasks; r < end; r++) {
+        const double* a = tasks->a + (long)r * width;
+        const double* b = tasks->b + (long)r * width;
+
+        // The Gram matrix a^T a is symmetric, only its upper triangle is summed
+        for(int i = 0; i < width; i++) {
+            if(a[i] == 0)
+                continue;
+
+            for(int j = a == b ? i : 0; j < width; j++)
+                out[i * width + j] += a[i] * b[j];
+        }
+    }
+}
+
+
+// Set out to the width x width product a^T b
+void block_cross(const double* a, double* b, int rows, int width, double* out) {
+    int num_tasks = block_num_tasks(rows);
+    BlockTasks tasks = {a, b, rows, width, svd_alloc((long)num_tasks * width * width * sizeof(double)), NULL, num_tasks};
+
+    pool_parallel_for(num_tasks, cross_task, &tasks);
+
+    memset(out, 0, width * width * sizeof(double));
+    for(int task = 0; task < num_tasks; task++) {
+        for(int i = 0; i < width * width; i++)
+            out[i] += tasks.partial[(long)task * width * width + i];
+    }
+
+    if(a == b) {
+        for(int i = 0; i < width; i++) {
+            for(int j = 0; j < i; j++)
+                out[i * width + j] = out[j * width + i];
+        }
+    }
+
+    free(tasks.partial);
+}
+
+
+void transform_task(int task, void* ctx) {
+    BlockTasks* tasks = ctx;
+    int width = tasks->width;
+    int end = (long)tasks->rows * (task + 1) / tasks->num_tasks;
+    double* row = svd_alloc(width * sizeof(double));
+
+    for(int r = (long)tasks->rows * task / tasks->num_tasks; r < end; r++) {
+        double* b = tasks->b + (long)r * width;
+        memset(row, 0, width * sizeof(double));
+
+        for(int i = 0; i < width; i++) {
+            if(b[i] == 0)
+                continue;
+
+            for(int j = 0; j < width; j++)
+                row[j] += b[i] * tasks->t[i * width + j];
+        }
+
+        memcpy(b, row, width * sizeof(double));
+    }
+
+    free(row);
+}
+
+
+// Set block b to b t, t is width x width
+void block_transform(double* b, int rows, int width, const double* t) {
+    int num_tasks = block_num_tasks(rows);
+    BlockTasks tasks = {NULL, b, rows, width, NULL, t, num_tasks};
+
+    pool_parallel_for(num_tasks, transform_task, &tasks);
+}
+
+
+// Set y to a times x for row-major blocks of width columns, scalar_val adds its multiple of the
+// column sums of x to every row
+void block_apply(Csr* csr, double scalar_val, const double* x, int width, double* y) {
+    csr_mult_block(csr, x, width, y);
+
+    if(scalar_val == 0)
+        return;
+
+    double* sums = svd_alloc(width * sizeof(double));
+    for(long r = 0; r < csr->cols; r++) {
+        for(int c = 0; c < width; c++)
+            sums[c] += x[r * width + c];
+    }
+
+    for(long r = 0; r < csr->rows; r++) {
+        for(int c = 0; c < width; c++)
+            y[r * width + c] += scalar_val * sums[c];
+    }
+
+    free(sums);
+}
+
+
+// Orthonormalize the columns of rows x width block y by passes of SVQB: with Y^T Y = E L E^T the
+// columns of Y E L^-1/2 are orthonormal. Needs two passes over the rows per pass rather than one
+// per column like Householder QR. Dependent directions are dropped, the rank is returned and
+// columns past it are zero
+int block_orthonormalize(double* y, int rows, int width, int passes) {
+    double* gram = svd_alloc(width * width * sizeof(double));
+    double* vals = svd_alloc(width * sizeof(double));
+    double* vecs = svd_alloc(width * width * sizeof(double));
+    double* t = svd_alloc(width * width * sizeof(double));
+    int rank = 0;
+
+    for(int pass = 0; pass < passes; pass++) {
+        block_cross(y, y, rows, width, gram);
+        jacobi_eigen(gram, width, vals, vecs);
+
+        double largest = 0;
+        for(int j = 0; j < width; j++)
+            largest = fmax(largest, vals[j]);
+
+        // Columns of t are the kept directions scaled to unit length, largest first
+        memset(t, 0, width * width * sizeof(double));
+        rank = 0;
+
+        for(int j = 0; j < width; j++) {
+            int best = -1;
+            for(int c = 0; c < width; c++) {
+                if(vals[c] > SVD_RANK_TOL * largest && (best < 0 || vals[c] > vals[best]))
+                    best = c;
+            }
+            if(best < 0)
+                break;
+
+            for(int i = 0; i < width; i++)
+                t[i * width + rank] = vecs[i * width + best] / sqrt(vals[best]);
+
+            vals[best] = 0;
+            rank++;
+        }
+
+        block_transform(y, rows, width, t);
+    }
+
+    free(gram);
+    free(vals);
+    free(vecs);
+    free(t);
+
+    return rank;
+}
+
+
+// Singular value decomposition X diag(sigma) Z^T of small n x n m by one-sided Jacobi rotations of
+// its columns, singular values descending. m is overwritten by X, z receives Z
+void jacobi_svd(double* m, int n, double* sigma, double* z) {
+    for(int i = 0; i < n * n; i++)
+        z[i] = i % (n + 1) == 0;
+
+    for(int sweep = 0; sweep < SVD_JACOBI_SWEEPS; sweep++) {
+        bool rotated = false;
+
+        for(int p = 0; p < n; p++) {
+            for(int q = p + 1; q < n; q++) {
+                double alpha = 0, beta = 0, gamma = 0;
+                for(int r = 0; r < n; r++) {
+                    alpha += m[r * n + p] * m[r * n + p];
+                    beta += m[r * n + q] * m[r * n + q];
+                    gamma += m[r * n + p] * m[r * n + q];
+                }
+
+                if(fabs(gamma) <= DBL_EPSILON * sqrt(alpha * beta))
+                    continue;
+                rotated = true;
+
+                // Rotation making columns p and q orthogonal
+                double zeta = (beta - alpha) / (2 * gamma);
+                double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+                double c = 1 / sqrt(1 + t * t), s = c * t;
+
+                for(int r = 0; r < n; r++) {
+                    double mp = m[r * n + p], mq = m[r * n + q];
+                    m[r * n + p] = c * mp - s * mq;
+                    m[r * n + q] = s * mp + c * mq;
+
+                    double zp = z[r * n + p], zq = z[r * n + q];
+                    z[r * n + p] = c * zp - s * zq;
+                    z[r * n + q] = s * zp + c * zq;
+                }
+            }
+        }
+
+        if(!rotated)
+            break;
+    }
+
+    for(int j = 0; j < n; j++) {
+        double norm = 0;
+        for(int r = 0; r < n; r++)
+            norm += m[r * n + j] * m[r * n + j];
+
+        sigma[j] = sqrt(norm);
+        for(int r = 0; r < n && sigma[j] > 0; r++)
+            m[r * n + j] /= sigma[j];
+    }
+
+    // Selection sort of the columns by singular value, n is small
+    for(int j = 0; j < n; j++) {
+        int best = j;
+        for(int c = j + 1; c < n; c++) {
+            if(sigma[c] > sigma[best])
+                best = c;
+        }
+
+        if(best == j)
+            continue;
+
+        double swap = sigma[j];
+        sigma[j] = sigma[best];
+        sigma[best] = swap;
+
+        for(int r = 0; r < n; r++) {
+            swap = m[r * n + j];
+            m[r * n + j] = m[r * n + best];
+            m[r * n + best] = swap;
+
+            swap = z[r * n + j];
+            z[r * n + j] = z[r * n + best];
+            z[r * n + best] = swap;
+        }
+    }
+}
+
+
+// First columns of rows x width block b as a rows x count matrix
+Matrix* block_columns(const double* b, int rows, int width, int count) {
+    double* cells = svd_alloc((long)rows * count * sizeof(double));
+
+    for(long r = 0; r < rows; r++)
+        memcpy(cells + r * count, b + r * width, count * sizeof(double));
+
+    Matrix* matrix = matrix_from_cells(cells, rows, count);
+    free(cells);
+
+    return matrix;
+}
+
+
+// Truncated SVD A ~ U diag(S) V^T of the k largest singular values by randomized range finding:
+// Q spans A applied to random vectors, sharpened by power iterations, and the SVD of the small
+// Q^T A gives the factors. Returns fewer than k triplets if A has lower rank, false if k is out of
+// range, A is zero or cannot be loaded
+bool svd_truncated(Matrix* a, int k, int power_iters, Matrix** u, Matrix** s, Matrix** v) {
+    int rows = a->rows, cols = a->cols;
+    int small = rows < cols ? rows : cols;
+
+    if(k < 1 || k > small || power_iters < 0)
+        return false;
+
+    Csr* csr = matrix_csr(a);
+    if(!csr)
+        return false;
+
+    PROFILE_BEGIN(span);
+    Csr* csr_t = csr_transpose(csr);
+    int width = k + SVD_OVERSAMPLE < small ? k + SVD_OVERSAMPLE : small;
+
+    double* sample = svd_alloc((long)cols * width * sizeof(double));
+    double* q = svd_alloc((long)rows * width * sizeof(double));
+
+    for(long i = 0; i < (long)cols * width; i++)
+        sample[i] = start_entry(i);
+
+    block_apply(csr, a->scalar_val, sample, width, q);
+    block_orthonormalize(q, rows, width, 1);
+
+    // Orthonormalize after every product, powers of A A^T would bury all but the largest directions
+    for(int it = 0; it < power_iters; it++) {
+        block_apply(csr_t, a->scalar_val, q, width, sample);
+        block_orthonormalize(sample, cols, width, 1);
+        block_apply(csr, a->scalar_val, sample, width, q);
+        block_orthonormalize(q, rows, width, 1);
+    }
+
+    int rank = block_orthonormalize(q, rows, width, 1);
+
+    // B = Q^T A through its transpose W = A^T Q = P R, so B = R^T P^T
+    double* w = sample;
+    block_apply(csr_t, a->scalar_val, q, width, w);
+
+    double* p = svd_alloc((long)cols * width * sizeof(double));
+    memcpy(p, w, (long)cols * width * sizeof(double));
+    int p_rank = block_orthonormalize(p, cols, width, 2);
+
+    double* r = svd_alloc(width * width * sizeof(double));
+    double* rt = svd_alloc(width * width * sizeof(double));
+    block_cross(p, w, cols, width, r);
+
+    for(int i = 0; i < width; i++) {
+        for(int j = 0; j < width; j++)
+            rt[i * width + j] = r[j * width + i];
+    }
+
+    // R^T = X Sigma Z^T, so A ~ (Q X) Sigma (P Z)^T
+    double* sigma = svd_alloc(width * sizeof(double));
+    double* z = svd_alloc(width * width * sizeof(double));
+    jacobi_svd(rt, width, sigma, z);
+
+    int count = k < rank ? k : rank;
+    if(p_rank < count)
+        count = p_rank;
+    while(count > 0 && sigma[count - 1] <= SVD_RANK_TOL * sigma[0])
+        count--;
+
+    if(count > 0) {
+        block_transform(q, rows, width, rt);
+        block_transform(p, cols, width, z);
+
+        *u = block_columns(q, rows, width, count);
+        *v = block_columns(p, cols, width, count);
+        *s = matrix_from_cells(sigma, count, 1);
+    }
+
+    PROFILE_END(PROF_SVD, span, csr->nnz, (long)count * (rows + cols + 1));
+
+    csr_free(csr);
+    csr_free(csr_t);
+    free(sample);
+    free(q);
+    free(p);
+    free(r);
+    free(rt);
+    free(sigma);
+    free(z);
+
+    return count > 0;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/thread_pool.h"
+
+// Parallel loop being run, lives on the calling thread's stack
+typedef struct {
+    PoolTaskFn fn;
+    void* ctx;
+    int num_tasks;
+    int next_task;      // Next task number to claim
+    int active;         // Workers still running tasks of this batch
+} PoolBatch;
+
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t batch_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t batch_done = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER; // Held while a batch runs
+
+PoolBatch* current_batch = NULL;
+long batch_count = 0;
+int num_workers = -1;
+
+
+// Claim and run tasks of batch until none are left
+void run_tasks(PoolBatch* batch) {
+    int task;
+
+    while((task = __atomic_fetch_add(&batch->next_task, 1, __ATOMIC_RELAXED)) < batch->num_tasks)
+        batch->fn(task, batch->ctx);
+}
+
+
+// Worker thread, joins every batch started after it was created
+void* pool_worker(void* arg) {
+    (void)arg;
+    long seen = 0;
+
+    pthread_mutex_lock(&pool_lock);
+
+    while(1) {
+        while(batch_count == seen || !current_batch) // Sleep until next batch
+            pthread_cond_wait(&batch_ready, &pool_lock);
+
+        seen = batch_count;
+        PoolBatch* batch = current_batch;
+        batch->active++;
+        pthread_mutex_unlock(&pool_lock);
+
+        run_tasks(batch);
+
+        pthread_mutex_lock(&pool_lock);
+        if(--batch->active == 0)
+            pthread_cond_signal(&batch_done);
+    }
+
+    return NULL;
+}
+
+
+// Number of threads running a parallel loop, including the caller
+int pool_size() {
+    pthread_mutex_lock(&pool_lock);
+
+    if(num_workers < 0) { // Start one worker per additional core
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int wanted = cores > POOL_MAX_THREADS ? POOL_MAX_THREADS - 1 : (int)cores - 1;
+        num_workers = 0;
+
+        for(int i = 0; i < wanted; i++) {
+            pthread_t worker;
+            if(pthread_create(&worker, NULL, pool_worker, NULL) != 0)
+                break; // Run with the workers created so far
+
+            pthread_detach(worker);
+            num_workers++;
+        }
+    }
+
+    int size = num_workers + 1;
+    pthread_mutex_unlock(&pool_lock);
+
+    return size;
+}
+
+
+// Run fn for every task in [0, num_tasks) on the pool, returns once all tasks finished
+void pool_parallel_for(int num_tasks, PoolTaskFn fn, void* ctx) {
+    PoolBatch batch = {fn, ctx, num_tasks, 0, 0};
+
+    // Run inline if parallelism cannot help or the pool is busy, e.g. nested loops
+    if(num_tasks <= 1 || pool_size() == 1 || pthread_mutex_trylock(&batch_lock) != 0) {
+        run_tasks(&batch);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    current_batch = &batch;
+    batch_count++;
+    pthread_cond_broadcast(&batch_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_tasks(&batch); // Caller works on the batch too
+
+    // Wait for workers that claimed tasks of this batch
+    pthread_mutex_lock(&pool_lock);
+    current_batch = NULL;
+    while(batch.active > 0)
+        pthread_cond_wait(&batch_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    pthread_mutex_unlock(&batch_lock);
+}
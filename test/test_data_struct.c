@@ -1,10 +1,13 @@
 #ifdef TEST
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <float.h>
 #include "../include/list.h"
 #include "../include/hash_map.h"
 #include "../include/map_iterator.h"
+#include "../include/runtime_data.h"
+#include "../include/matrix_pager.h"
 #include "test_util.h"
 #include "test_data_struct.h"
 
@@ -71,10 +74,132 @@ void test_map_it_has_next() {
     free_hash_map(map);
 }
 
+void test_symbol_table() {
+    char name[32];
+
+    // Define more matrices than one table allocation holds
+    for(int i = 0; i < 1000; i++) {
+        sprintf(name, "sym_%d", i);
+        ASSERT_INT_EQ((int)rd_save_matrix(name, matrix_create(1, i + 1)), 1);
+    }
+
+    ASSERT_INT_EQ((int)rd_save_matrix("sym_7", matrix_create(1, 1)), 0);
+
+    // Delete every other matrix, remaining ones must still be found
+    for(int i = 0; i < 1000; i += 2) {
+        sprintf(name, "sym_%d", i);
+        ASSERT_INT_EQ((int)rd_delete_matrix(name), 1);
+    }
+
+    for(int i = 0; i < 1000; i++) {
+        sprintf(name, "sym_%d", i);
+        Matrix* matrix = rd_get_matrix(name);
+
+        if(i % 2 == 0)
+            ASSERT_INT_EQ(matrix == NULL, 1);
+        else
+            ASSERT_INT_EQ(matrix != NULL && matrix->cols == i + 1, 1);
+    }
+
+    // Overwrite releases the replaced matrix but not other owners' references
+    Matrix* shared = matrix_retain(rd_get_matrix("sym_1"));
+    rd_overwrite_matrix("sym_1", matrix_create(2, 2));
+    ASSERT_INT_EQ(shared->refs, 1);
+    ASSERT_INT_EQ(rd_get_matrix("sym_1")->rows, 2);
+    matrix_release(shared);
+
+    for(int i = 1; i < 1000; i += 2) {
+        sprintf(name, "sym_%d", i);
+        rd_delete_matrix(name);
+    }
+}
+
+#define TEST_PAGER_BLOCKS (PAGER_MAX_BLOCKS + 2)
+
+int test_pager_fetches[TEST_PAGER_BLOCKS];  // Times each block was fetched
+int test_pager_releases;
+bool test_pager_fails;                      // Fetches fail while set
+
+// Stand-in for the repository, row r holds r + 1 in column 0
+bool test_pager_fetch(const char* name, int first_row, int last_row, HashMap* dest) {
+    (void)name;
+    if(test_pager_fails)
+        return false;
+
+    for(int block = first_row / PAGER_BLOCK_ROWS; block <= last_row / PAGER_BLOCK_ROWS; block++)
+        test_pager_fetches[block]++;
+
+    for(int row = first_row; row <= last_row; row++)
+        map_set(dest, row, 0, row + 1);
+
+    return true;
+}
+
+void test_pager_release(const char* name) {
+    (void)name;
+    test_pager_releases++;
+}
+
+void test_pager_lru() {
+    MatrixPager* pager = pager_create("paged", TEST_PAGER_BLOCKS * PAGER_BLOCK_ROWS, test_pager_fetch, test_pager_release);
+
+    // Fill the cache, then touch block 0 so block 1 becomes least recently used
+    for(int b = 0; b < PAGER_MAX_BLOCKS; b++)
+        ASSERT_DOUBLE_EQ(pager_get(pager, b * PAGER_BLOCK_ROWS, 0), b * PAGER_BLOCK_ROWS + 1.0);
+    ASSERT_INT_EQ(pager->cached, PAGER_MAX_BLOCKS);
+
+    pager_get(pager, 5, 0);
+    ASSERT_INT_EQ(test_pager_fetches[0], 1);
+
+    // A new block evicts the least recently used one only
+    pager_get(pager, PAGER_MAX_BLOCKS * PAGER_BLOCK_ROWS, 0);
+    ASSERT_INT_EQ(pager->cached, PAGER_MAX_BLOCKS);
+    ASSERT_INT_EQ(pager->blocks[1] == NULL, 1);
+    ASSERT_INT_EQ(pager->blocks[0] != NULL && pager->blocks[2] != NULL, 1);
+
+    // An edited block is pinned and leaves the cache bound
+    pager_set(pager, 2 * PAGER_BLOCK_ROWS, 1, 42);
+    ASSERT_INT_EQ(pager->cached, PAGER_MAX_BLOCKS - 1);
+
+    // Cycling through every other block many times over never evicts the pinned one
+    for(int pass = 0; pass < 3; pass++) {
+        for(int b = 0; b < TEST_PAGER_BLOCKS; b++) {
+            if(b != 2)
+                pager_get(pager, b * PAGER_BLOCK_ROWS, 0);
+        }
+    }
+
+    ASSERT_INT_EQ(pager->cached <= PAGER_MAX_BLOCKS, 1);
+    ASSERT_INT_EQ(pager->blocks[2] != NULL && pager->blocks[2]->pinned, 1);
+    ASSERT_INT_EQ(test_pager_fetches[2], 1);
+    ASSERT_DOUBLE_EQ(pager_get(pager, 2 * PAGER_BLOCK_ROWS, 1), 42.0);
+    ASSERT_INT_EQ(test_pager_fetches[1] > 1, 1);
+
+    pager_free(pager);
+    ASSERT_INT_EQ(test_pager_releases, 1);
+
+    // An edit whose block cannot be fetched is refused and not recorded as a change to save
+    Matrix* m = matrix_create(PAGER_BLOCK_ROWS, 4);
+    m->pager = pager_create("paged", m->rows, test_pager_fetch, NULL);
+    matrix_mark_clean(m, 1);
+
+    test_pager_fails = true;
+    ASSERT_INT_EQ(matrix_set(m, 3, 1, 5.0), false);
+    ASSERT_INT_EQ(m->dirty->size, 0);
+
+    test_pager_fails = false;
+    ASSERT_INT_EQ(matrix_set(m, 3, 1, 5.0), true);
+    ASSERT_INT_EQ(m->dirty->size, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(m, 3, 1), 5.0);
+    matrix_free(m);
+}
+
 void test_data_struct() {
     test_list_remove_val();
     test_map_get_empty();
     test_map_it_has_next();
+    test_symbol_table();
+    test_pager_lru();
     end_test("Data structures");
 }
 
@@ -1,10 +1,13 @@
 #ifdef TEST
 
 #include <stdlib.h>
+#include <string.h>
 #include "../include/token.h"
 #include "../include/runtime_data.h"
 #include "../include/parse_expr.h"
 #include "../include/eval_expr.h"
+#include "../include/parse_input.h"
+#include "../include/run_script.h"
 #include "test_util.h"
 #include "test_eval.h"
 
@@ -108,6 +111,14 @@ void test_eval_expr_invalid() {
     test_eval_expr_case(expr_5, NULL);
     char* expr_6 = "$";
     test_eval_expr_case(expr_6, NULL);
+    char* expr_7 = "kron(A, B, A)";
+    test_eval_expr_case(expr_7, NULL);
+    char* expr_8 = "A, B";
+    test_eval_expr_case(expr_8, NULL);
+    char* expr_9 = "A[2:2][0:5]";
+    test_eval_expr_case(expr_9, NULL);
+    char* expr_10 = "A[0:6][1]";
+    test_eval_expr_case(expr_10, NULL);
 }
 
 void test_eval_expr() {
@@ -171,14 +182,118 @@ void test_eval_expr() {
     matrix_print(res_6);
     test_eval_expr_case(expr_6, res_6);
 
+    char* expr_7 = "kron(A, B + 1)";
+    Matrix* a = rd_get_matrix("A");
+    Matrix* b = rd_get_matrix("B");
+    Matrix* res_7 = matrix_create(25, 25);
+    for(int i = 0; i < 25; i++) {
+        for(int j = 0; j < 25; j++)
+            matrix_set(res_7, i, j, matrix_get(a, i / 5, j / 5) * (matrix_get(b, i % 5, j % 5) + 1));
+    }
+    test_eval_expr_case(expr_7, res_7);
+
+    char* expr_8 = "A[1:4][:] + B[0:3][0:5]";
+    Matrix* res_8 = matrix_create(3, 5);
+    for(int i = 0; i < 3; i++) {
+        for(int j = 0; j < 5; j++)
+            matrix_set(res_8, i, j, matrix_get(a, i + 1, j) + matrix_get(b, i, j));
+    }
+    test_eval_expr_case(expr_8, res_8);
+
+    // Inverting a dense matrix checks its conditioning without factoring it a second time
+    char* expr_9 = "D ^ -1";
+    Matrix* d = matrix_create(3, 3);
+    matrix_set(d, 0, 0, 2);
+    matrix_set(d, 0, 1, 1);
+    matrix_set(d, 1, 1, 3);
+    matrix_set(d, 1, 2, 1);
+    matrix_set(d, 2, 0, 1);
+    matrix_set(d, 2, 2, 4);
+    matrix_make_dense(d);
+    rd_save_matrix("D", d);
+    Matrix* res_9 = matrix_inverse(d);
+    test_eval_expr_case(expr_9, res_9);
+    ASSERT_INT_EQ(d->lu == NULL, 1);
+
     matrix_free(res_1);
     matrix_free(res_2);
     matrix_free(res_3);
     matrix_free(res_4);
     matrix_free(res_5);
+    matrix_free(res_7);
+    matrix_free(res_8);
+    matrix_free(res_9);
     //matrix_free(res_6);
 }
 
+// Plan waves of script statements the way execute_file does, writes each statement's wave
+int plan_script(char** texts, int count, int* waves) {
+    Statement* stmts = calloc(count, sizeof(Statement));
+
+    for(int i = 0; i < count; i++) {
+        stmts[i].text = strdup(texts[i]);
+        if(parse_assignment(stmts[i].text, &stmts[i].target, &stmts[i].expr))
+            stmts[i].reads = expr_reads(stmts[i].expr, &stmts[i].num_reads);
+    }
+
+    int num_waves = plan_waves(stmts, count);
+
+    for(int i = 0; i < count; i++) {
+        waves[i] = stmts[i].wave;
+
+        for(int r = 0; r < stmts[i].num_reads; r++)
+            free(stmts[i].reads[r]);
+        free(stmts[i].reads);
+        free(stmts[i].target);
+        free(stmts[i].expr);
+        free(stmts[i].text);
+    }
+    free(stmts);
+
+    return num_waves;
+}
+
+void test_plan_waves() {
+    int waves[4];
+
+    // Reading a result waits for the wave after the one computing it
+    char* read_after_write[] = {"Wx = A + B", "Wy = Wx * 2"};
+    ASSERT_INT_EQ(plan_script(read_after_write, 2, waves), 2);
+    ASSERT_INT_EQ(waves[0], 0);
+    ASSERT_INT_EQ(waves[1], 1);
+
+    // Overwriting a name read or written earlier shares its wave, results are bound in order
+    char* overwrite[] = {"Wx = A + B", "A = B", "Wx = B'"};
+    ASSERT_INT_EQ(plan_script(overwrite, 3, waves), 1);
+    ASSERT_INT_EQ(waves[1], 0);
+    ASSERT_INT_EQ(waves[2], 0);
+
+    // Commands run alone, between the waves before and after them
+    char* command[] = {"Wx = A", "list", "Wy = B"};
+    ASSERT_INT_EQ(plan_script(command, 3, waves), 3);
+    ASSERT_INT_EQ(waves[1], 1);
+    ASSERT_INT_EQ(waves[2], 2);
+
+    // A statement failing in its wave is rerun serially when bound, so it fails as it would in order
+    // even though a later statement of the wave makes it valid, and the rest of the wave still binds
+    const char* path = "test_plan_waves.txt";
+    FILE* file = fopen(path, "w");
+    if(file) {
+        fputs("Wv = A * 0; Wq = Wv ^ -1; Wv = D; Wx = A + B; Wx = Wx * 2;", file);
+        fclose(file);
+    }
+
+    ASSERT_INT_EQ(execute_file(path, true), true);
+    remove(path);
+
+    ASSERT_INT_EQ(rd_get_matrix("Wq") == NULL, 1);
+    ASSERT_MATRIX_EQ(rd_get_matrix("D"), rd_get_matrix("Wv"));
+
+    Matrix* sum = solve_expr("(A + B) * 2");
+    ASSERT_MATRIX_EQ(sum, rd_get_matrix("Wx"));
+    matrix_free(sum);
+}
+
 void init_user_matrices() {
     // Create matrices
     Matrix* a = matrix_create(5, 5);
@@ -204,6 +319,7 @@ void test_eval() {
     test_replace_all();
     test_eval_expr();
     test_eval_expr_invalid();
+    test_plan_waves();
     end_test("Expression Evaluation");
 }
 
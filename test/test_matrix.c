@@ -2,7 +2,19 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <float.h>
 #include "../include/runtime_data.h"
+#include "../include/csr.h"
+#include "../include/solver.h"
+#include "../include/eigen.h"
+#include "../include/svd.h"
+#include "../include/norm.h"
+#include "../include/qr.h"
+#include "../include/reorder.h"
+#include "../include/export.h"
+#include "../include/repository.h"
+#include "../include/jobs.h"
+#include "../include/parse_input.h"
 #include "test_util.h"
 
 
@@ -152,8 +164,1080 @@ void test_matrix_transpose() {
 
     ASSERT_MATRIX_EQ(exp_res, result);
 
+    // Clearing a cell and setting it again must list its bucket once
+    Matrix* m = matrix_create(3, 3);
+    matrix_set(m, 1, 2, 5);
+    matrix_set(m, 1, 2, 0);
+    matrix_set(m, 1, 2, 6);
+    Matrix* t = matrix_transpose(m);
+    ASSERT_INT_EQ(matrix_size(t), 1);
+    ASSERT_DOUBLE_EQ(matrix_get(t, 2, 1), 6.0);
+
     free(exp_res);
     free(result);
+    free(m);
+    free(t);
+}
+
+void test_matrix_dirty_tracking() {
+    Matrix* m = matrix_create(3, 3);
+    matrix_set(m, 0, 0, 1.0);
+    ASSERT_INT_EQ(m->dirty == NULL, 1); // Untracked until loaded or saved
+
+    matrix_mark_clean(m, 1);
+    matrix_set(m, 1, 2, 4.0);
+    matrix_set(m, 0, 0, 0.0);
+
+    // Both changed cells recorded, including the zeroed one
+    ASSERT_INT_EQ(m->dirty->size, 2);
+    ASSERT_DOUBLE_EQ(map_get(m->dirty, 1, 2), 1.0);
+    ASSERT_DOUBLE_EQ(map_get(m->dirty, 0, 0), 1.0);
+
+    matrix_untrack(m);
+    ASSERT_INT_EQ(m->repo_token, 0);
+
+    matrix_free(m);
+}
+
+void test_matrix_copy_on_write() {
+    Matrix* a = matrix_create(4, 4);
+    for(int i = 0; i < 4; i++)
+        matrix_set(a, i, i, i + 1);
+
+    Matrix* b = matrix_copy(a);
+    ASSERT_INT_EQ(a->vals->table[hash(0, 0)] == b->vals->table[hash(0, 0)], 1); // Storage shared
+
+    // Each side clones only the bucket it modifies
+    matrix_set(b, 0, 0, 9.0);
+    matrix_set(a, 3, 3, 7.0);
+    ASSERT_INT_EQ(a->vals->table[hash(0, 0)] != b->vals->table[hash(0, 0)], 1);
+    ASSERT_INT_EQ(a->vals->table[hash(1, 1)] == b->vals->table[hash(1, 1)], 1);
+
+    ASSERT_DOUBLE_EQ(matrix_get(a, 0, 0), 1.0);
+    ASSERT_DOUBLE_EQ(matrix_get(b, 0, 0), 9.0);
+    ASSERT_DOUBLE_EQ(matrix_get(a, 3, 3), 7.0);
+    ASSERT_DOUBLE_EQ(matrix_get(b, 3, 3), 4.0);
+
+    // Shared buckets outlive the matrix freed first
+    matrix_free(a);
+    ASSERT_DOUBLE_EQ(matrix_get(b, 1, 1), 2.0);
+
+    // Dense copies share the value array until one of them writes
+    Matrix* c = matrix_scalar_add(b, 1);
+    matrix_make_dense(c);
+    Matrix* d = matrix_copy(c);
+    ASSERT_INT_EQ(c->dense == d->dense, 1);
+
+    matrix_set(d, 0, 1, 5.0);
+    ASSERT_INT_EQ(c->dense != d->dense, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(c, 0, 1), 1.0);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 0, 1), 5.0);
+
+    Matrix* e = matrix_copy(c);
+    matrix_free(c);
+    ASSERT_DOUBLE_EQ(matrix_get(e, 0, 0), 10.0);
+
+    matrix_free(b);
+    matrix_free(d);
+    matrix_free(e);
+}
+
+void test_matrix_mem() {
+    Matrix* a = matrix_create(4, 4);
+    for(int i = 0; i < 4; i++)
+        matrix_set(a, i, i, i + 1);
+
+    MatrixMem alone;
+    matrix_mem(a, &alone);
+    ASSERT_INT_EQ(alone.nnz, 4);
+    ASSERT_INT_EQ(alone.index, 0);
+
+    // Copies split the buckets they share
+    Matrix* b = matrix_copy(a);
+    MatrixMem shared_a, shared_b;
+    matrix_mem(a, &shared_a);
+    matrix_mem(b, &shared_b);
+    ASSERT_INT_EQ(shared_a.vals < alone.vals, 1);
+    ASSERT_INT_EQ(shared_a.vals == shared_b.vals, 1);
+
+    // Products cache a row index of their right operand
+    Matrix* product = matrix_mult(b, a);
+    matrix_mem(a, &alone);
+    ASSERT_INT_EQ(alone.index > 0, 1);
+
+    matrix_free(product);
+    matrix_free(b);
+    matrix_free(a);
+}
+
+// n x n matrix with a non-zero in every step-th cell and a dominant diagonal, offset by scalar
+Matrix* pattern_matrix(int n, int step, double scalar) {
+    Matrix* m = matrix_create(n, n);
+    for(int k = 0; k < n * n; k += step)
+        matrix_set(m, k / n, k % n, k % 7 + 1);
+    for(int i = 0; i < n; i++)
+        matrix_set(m, i, i, 10 * n);
+
+    m->scalar_val = scalar;
+    return m;
+}
+
+// Largest difference between cells of a and b
+double max_diff(Matrix* a, Matrix* b) {
+    double diff = 0;
+    for(int i = 0; i < a->rows; i++) {
+        for(int j = 0; j < a->cols; j++)
+            diff = fmax(diff, fabs(matrix_get(a, i, j) - matrix_get(b, i, j)));
+    }
+
+    return diff;
+}
+
+void test_matrix_dense() {
+    Matrix* a = pattern_matrix(40, 3, 0);     // A third full
+    Matrix* b = pattern_matrix(40, 23, 0.5);  // Sparse with scalar_val
+
+    // Reference results with every matrix kept sparse
+    matrix_set_dense_threshold(2);
+    Matrix* sum = matrix_add(b, b);
+    Matrix* ab = matrix_mult(a, b);
+    Matrix* ba = matrix_mult(b, a);
+    Matrix* aa = matrix_mult(a, a);
+    Matrix* diff = matrix_sub(a, b);
+    Matrix* at = matrix_transpose(a);
+    double det = matrix_determinant(a);
+    ASSERT_INT_EQ(sum->dense == NULL && aa->dense == NULL, 1);
+
+    matrix_set_dense_threshold(DENSE_THRESHOLD);
+    Matrix* d = matrix_copy(a);
+    matrix_make_dense(d);
+    ASSERT_INT_EQ(d->dense != NULL, 1);
+    ASSERT_INT_EQ(matrix_size(d), matrix_size(a));
+
+    Matrix* r = matrix_mult(d, b); // Dense x sparse
+    ASSERT_DOUBLE_EQ(max_diff(r, ab), 0.0);
+    matrix_free(r);
+
+    r = matrix_mult(b, d); // Sparse x dense
+    ASSERT_DOUBLE_EQ(max_diff(r, ba), 0.0);
+    matrix_free(r);
+
+    r = matrix_mult(d, d);
+    ASSERT_INT_EQ(r->dense != NULL, 1);
+    ASSERT_DOUBLE_EQ(max_diff(r, aa), 0.0);
+    matrix_free(r);
+
+    r = matrix_sub(d, b);
+    ASSERT_DOUBLE_EQ(max_diff(r, diff), 0.0);
+    matrix_free(r);
+
+    r = matrix_transpose(d);
+    ASSERT_DOUBLE_EQ(max_diff(r, at), 0.0);
+    matrix_free(r);
+
+    ASSERT_INT_EQ(det != 0, 1);
+    ASSERT_DOUBLE_EQ(matrix_determinant(d) / det, 1.0);
+
+    // Dense results switch back once mostly zero
+    r = matrix_scalar_mult(d, 0);
+    ASSERT_INT_EQ(r->dense == NULL, 1);
+    ASSERT_INT_EQ(matrix_size(r), 0);
+    matrix_free(r);
+
+    // Sparse results switch to dense above the threshold
+    r = matrix_add(a, a);
+    ASSERT_INT_EQ(r->dense != NULL, 1);
+    matrix_free(r);
+
+    matrix_free(d);
+    matrix_free(sum);
+    matrix_free(ab);
+    matrix_free(ba);
+    matrix_free(aa);
+    matrix_free(diff);
+    matrix_free(at);
+    matrix_free(a);
+    matrix_free(b);
+}
+
+void test_matrix_band() {
+    int n = 100;
+    Matrix* t = matrix_create(n, n); // Tridiagonal
+    for(int i = 0; i < n; i++) {
+        matrix_set(t, i, i, 4);
+        if(i > 0)
+            matrix_set(t, i, i - 1, -1 - i % 3);
+        if(i + 1 < n)
+            matrix_set(t, i, i + 1, 2);
+    }
+
+    matrix_fit_storage(t);
+    ASSERT_INT_EQ(t->band != NULL, 1);
+    ASSERT_INT_EQ(t->band->num_diags, 3);
+    ASSERT_INT_EQ(matrix_size(t), 3 * n - 2);
+
+    // Dense copy gives reference results
+    Matrix* d = matrix_copy(t);
+    matrix_make_dense(d);
+
+    Matrix* r = matrix_mult(t, t);
+    Matrix* ref = matrix_mult(d, d);
+    ASSERT_INT_EQ(r->band != NULL && r->band->num_diags == 5, 1);
+    ASSERT_DOUBLE_EQ(max_diff(r, ref), 0.0);
+    matrix_free(r);
+    matrix_free(ref);
+
+    Matrix* tt = matrix_transpose(t);
+    ref = matrix_transpose(d);
+    ASSERT_INT_EQ(tt->band != NULL, 1);
+    ASSERT_DOUBLE_EQ(max_diff(tt, ref), 0.0);
+    matrix_free(ref);
+
+    r = matrix_sub(t, tt);
+    ref = matrix_sub(d, tt);
+    ASSERT_INT_EQ(r->band != NULL, 1);
+    ASSERT_DOUBLE_EQ(max_diff(r, ref), 0.0);
+    matrix_free(r);
+    matrix_free(ref);
+
+    ASSERT_DOUBLE_EQ(matrix_determinant(t) / matrix_determinant(d), 1.0);
+
+    // Identity stores nothing and multiplying by it copies the other operand
+    Matrix* id = matrix_identity(n, n);
+    ASSERT_INT_EQ(matrix_stored(id), 0);
+    ASSERT_INT_EQ(matrix_size(id), n);
+    ASSERT_DOUBLE_EQ(matrix_determinant(id), 1.0);
+
+    r = matrix_mult(id, t);
+    ASSERT_DOUBLE_EQ(max_diff(r, t), 0.0);
+
+    // Editing a cell off the band switches to sparse storage
+    matrix_set(r, 0, n - 1, 7);
+    ASSERT_INT_EQ(r->band == NULL, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(r, 0, n - 1), 7.0);
+    ASSERT_DOUBLE_EQ(matrix_get(r, 5, 4), matrix_get(t, 5, 4));
+    matrix_free(r);
+
+    // Powers of a shift run out of diagonals, leaving a zero matrix
+    Matrix* shift = matrix_create(40, 40);
+    for(int i = 0; i + 1 < 40; i++)
+        matrix_set(shift, i, i + 1, 1);
+    matrix_fit_storage(shift);
+    ASSERT_INT_EQ(shift->band != NULL, 1);
+
+    r = matrix_copy(shift);
+    for(int k = 1; k < 40; k++) {
+        Matrix* next = matrix_mult(r, shift);
+        matrix_free(r);
+        r = next;
+    }
+    ASSERT_INT_EQ(matrix_size(r), 0);
+    ASSERT_DOUBLE_EQ(matrix_determinant(r), 0.0);
+    matrix_free(r);
+    matrix_free(shift);
+
+    matrix_free(id);
+    matrix_free(tt);
+    matrix_free(d);
+    matrix_free(t);
+}
+
+void test_matrix_csr_kernels() {
+    matrix_set_dense_threshold(2); // Keep results sparse
+    Matrix* a = pattern_matrix(60, 7, 0);
+    Matrix* b = pattern_matrix(60, 11, 0.25);
+    Matrix* d = matrix_copy(a);
+    matrix_make_dense(d);
+    Matrix* e = matrix_copy(b);
+    matrix_make_dense(e);
+
+    // Transposed rows come out in order with ascending columns
+    Csr* csr = csr_from_map(a->vals, a->rows, a->cols);
+    Csr* by_col = csr_transpose(csr);
+    ASSERT_INT_EQ(by_col->nnz, csr->nnz);
+    bool ordered = true;
+    for(int i = 0; i < by_col->rows; i++) {
+        for(long k = by_col->row_ptr[i] + 1; k < by_col->row_ptr[i + 1]; k++)
+            ordered = ordered && by_col->col_idx[k - 1] < by_col->col_idx[k];
+    }
+    ASSERT_INT_EQ(ordered, 1);
+    csr_free(by_col);
+    csr_free(csr);
+
+    Matrix* r = matrix_transpose(b);
+    Matrix* ref = matrix_transpose(e);
+    ASSERT_INT_EQ(r->dense == NULL && matrix_size(r) == matrix_size(b), 1);
+    ASSERT_DOUBLE_EQ(max_diff(r, ref), 0.0);
+    matrix_free(r);
+    matrix_free(ref);
+
+    // Scalar values of sparse operands add row and column sums
+    r = matrix_mult(b, b);
+    ref = matrix_mult(e, e);
+    ASSERT_DOUBLE_EQ(max_diff(r, ref) / 1e6, 0.0);
+    matrix_free(r);
+    matrix_free(ref);
+
+    // Merged rows drop cells that cancel
+    r = matrix_add(a, b);
+    ref = matrix_add(d, e);
+    ASSERT_DOUBLE_EQ(max_diff(r, ref), 0.0);
+    matrix_free(r);
+    matrix_free(ref);
+
+    r = matrix_sub(b, b);
+    ASSERT_INT_EQ(r->vals->size, 0);
+    ASSERT_DOUBLE_EQ(r->scalar_val, 0.0);
+    matrix_free(r);
+
+    ASSERT_DOUBLE_EQ(matrix_determinant(a) / matrix_determinant(d), 1.0);
+    ASSERT_DOUBLE_EQ(matrix_determinant(b) / matrix_determinant(e), 1.0);
+
+    // One row swap negates the determinant
+    Matrix* p = matrix_create(3, 3);
+    matrix_set(p, 0, 1, 1);
+    matrix_set(p, 1, 0, 1);
+    matrix_set(p, 2, 2, 2);
+    ASSERT_DOUBLE_EQ(matrix_determinant(p), -2.0);
+    matrix_set(p, 2, 2, 0);
+    ASSERT_DOUBLE_EQ(matrix_determinant(p), 0.0);
+
+    matrix_set_dense_threshold(DENSE_THRESHOLD);
+    matrix_free(p);
+    matrix_free(e);
+    matrix_free(d);
+    matrix_free(b);
+    matrix_free(a);
+}
+
+void test_matrix_solver() {
+    int n = 80;
+    Matrix* b = matrix_create(n, 1);
+    for(int i = 0; i < n; i++)
+        matrix_set(b, i, 0, 1 + i % 5);
+
+    // Symmetric positive definite, stored banded
+    Matrix* t = matrix_create(n, n);
+    for(int i = 0; i < n; i++) {
+        matrix_set(t, i, i, 4);
+        if(i > 0)
+            matrix_set(t, i, i - 1, -1);
+        if(i + 1 < n)
+            matrix_set(t, i, i + 1, -1);
+    }
+    matrix_fit_storage(t);
+    ASSERT_INT_EQ(t->band != NULL, 1);
+
+    SolveStats stats;
+    Matrix* x = solver_solve(t, b, SOLVER_CG, 1e-10, 1000, &stats);
+    ASSERT_INT_EQ(stats.converged, 1);
+    ASSERT_INT_EQ(stats.iterations > 0 && stats.iterations <= n, 1);
+
+    Matrix* tx = matrix_mult(t, x);
+    ASSERT_DOUBLE_EQ(max_diff(tx, b), 0.0);
+    matrix_free(tx);
+    matrix_free(x);
+
+    // Nonsymmetric with scalar_val
+    Matrix* a = pattern_matrix(n, 13, 0.1);
+    x = solver_solve(a, b, SOLVER_BICGSTAB, 1e-10, 1000, &stats);
+    ASSERT_INT_EQ(stats.converged, 1);
+
+    Matrix* ax = matrix_mult(a, x);
+    ASSERT_DOUBLE_EQ(max_diff(ax, b), 0.0);
+    matrix_free(ax);
+    matrix_free(x);
+
+    // ILU(0) of a tridiagonal matrix is exact
+    x = solver_solve(t, b, SOLVER_CG, 1e-10, 1000, &stats);
+    int plain = stats.iterations;
+    matrix_free(x);
+    ASSERT_INT_EQ(matrix_precondition(t, PRECOND_ILU0), 1);
+    x = solver_solve(t, b, SOLVER_CG, 1e-10, 1000, &stats);
+    ASSERT_INT_EQ(stats.converged && stats.iterations == 1 && plain > 1, 1);
+    matrix_free(x);
+
+    // Jacobi helps with a dominant diagonal
+    x = solver_solve(a, b, SOLVER_BICGSTAB, 1e-10, 1000, &stats);
+    plain = stats.iterations;
+    matrix_free(x);
+    ASSERT_INT_EQ(matrix_precondition(a, PRECOND_JACOBI), 1);
+    x = solver_solve(a, b, SOLVER_BICGSTAB, 1e-10, 1000, &stats);
+    ASSERT_INT_EQ(stats.converged && stats.iterations <= plain, 1);
+    matrix_free(x);
+
+    // Changing a cell drops the preconditioner, a zero diagonal prevents building one
+    matrix_set(t, 0, 0, 0);
+    ASSERT_INT_EQ(t->precond == NULL, 1);
+    ASSERT_INT_EQ(matrix_precondition(t, PRECOND_JACOBI), 0);
+    matrix_set(t, 0, 0, 4);
+
+    // Iteration limit stops before convergence, mismatched sizes are rejected
+    x = solver_solve(t, b, SOLVER_CG, 1e-14, 2, &stats);
+    ASSERT_INT_EQ(stats.converged == false && stats.iterations == 2, 1);
+    matrix_free(x);
+    ASSERT_INT_EQ(solver_solve(t, t, SOLVER_CG, 1e-8, 10, &stats) == NULL, 1);
+    ASSERT_INT_EQ(stats.breakdown, 0);
+
+    // Singular system with b outside the range, both methods hit a zero denominator on step 2
+    Matrix* singular = matrix_create(2, 2);
+    matrix_set(singular, 0, 0, 1);
+    matrix_set(singular, 0, 1, -1);
+    matrix_set(singular, 1, 0, -1);
+    matrix_set(singular, 1, 1, 1);
+    Matrix* e = matrix_create(2, 1);
+    matrix_set(e, 0, 0, 1);
+
+    ASSERT_INT_EQ(solver_solve(singular, e, SOLVER_CG, 1e-10, 100, &stats) == NULL, 1);
+    ASSERT_INT_EQ(stats.breakdown && stats.iterations == 1, 1);
+    ASSERT_INT_EQ(solver_solve(singular, e, SOLVER_BICGSTAB, 1e-10, 100, &stats) == NULL, 1);
+    ASSERT_INT_EQ(stats.breakdown && stats.iterations == 1, 1);
+
+    // A zero right-hand side is solved without any step
+    matrix_set(e, 0, 0, 0);
+    x = solver_solve(singular, e, SOLVER_BICGSTAB, 1e-10, 100, &stats);
+    ASSERT_INT_EQ(x != NULL && !stats.breakdown && stats.iterations == 0, 1);
+    matrix_free(x);
+
+    matrix_free(singular);
+    matrix_free(e);
+    matrix_free(a);
+    matrix_free(t);
+    matrix_free(b);
+}
+
+void test_matrix_cholesky() {
+    // Five point Laplacian of a 7 x 9 grid, symmetric positive definite
+    int w = 7, h = 9, n = w * h;
+    Matrix* a = matrix_create(n, n);
+    for(int i = 0; i < n; i++) {
+        matrix_set(a, i, i, 4.5);
+        if(i % w > 0)
+            matrix_set(a, i, i - 1, -1);
+        if(i % w < w - 1)
+            matrix_set(a, i, i + 1, -1);
+        if(i >= w)
+            matrix_set(a, i, i - w, -1);
+        if(i + w < n)
+            matrix_set(a, i, i + w, -1);
+    }
+
+    Cholesky* chol = matrix_cholesky(a);
+    ASSERT_INT_EQ(chol != NULL, 1);
+    ASSERT_INT_EQ(matrix_cholesky(a) == chol, 1); // Kept with the matrix
+
+    // Determinant from the factor agrees with sparse LU
+    Csr* csr = matrix_csr(a);
+    SparseLu* lu = lu_factor(csr);
+    ASSERT_DOUBLE_EQ(matrix_determinant(a) / lu->det, 1.0);
+    lu_free(lu);
+    csr_free(csr);
+
+    Matrix* b = matrix_create(n, 1);
+    for(int i = 0; i < n; i++)
+        matrix_set(b, i, 0, 1 + i % 3);
+
+    SolveStats stats;
+    Matrix* x = solver_solve(a, b, SOLVER_CHOLESKY, 1e-10, 1, &stats);
+    ASSERT_INT_EQ(stats.converged, 1);
+    Matrix* ax = matrix_mult(a, x);
+    ASSERT_DOUBLE_EQ(max_diff(ax, b), 0.0);
+    matrix_free(ax);
+    matrix_free(x);
+
+    // Inverse solves through the factor
+    Matrix* inv = matrix_inverse(a);
+    Matrix* product = matrix_mult(inv, a);
+    Matrix* eye = matrix_create(n, n);
+    for(int i = 0; i < n; i++)
+        matrix_set(eye, i, i, 1);
+    ASSERT_DOUBLE_EQ(max_diff(product, eye), 0.0);
+    matrix_free(product);
+    matrix_free(inv);
+    matrix_free(eye);
+
+    // Changing a cell drops the factor, nonsymmetric and indefinite matrices have none
+    matrix_set(a, 0, 1, -2);
+    ASSERT_INT_EQ(a->chol == NULL, 1);
+    ASSERT_INT_EQ(matrix_cholesky(a) == NULL, 1);
+    ASSERT_INT_EQ(solver_solve(a, b, SOLVER_CHOLESKY, 1e-10, 1, &stats) == NULL, 1);
+    ASSERT_INT_EQ(stats.converged, 0);
+    ASSERT_INT_EQ(isinf(stats.residual), 1);
+    matrix_set(a, 0, 1, -1);
+    ASSERT_INT_EQ(a->chol_failed, 0);
+    matrix_set(a, 5, 5, -4.5);
+    ASSERT_INT_EQ(matrix_cholesky(a) == NULL, 1);
+    ASSERT_INT_EQ(a->chol_failed, 1);
+
+    // Singular positive semidefinite, the last pivot is rounding noise and is rejected
+    Matrix* s = matrix_create(3, 3);
+    matrix_set(s, 0, 0, 7);
+    matrix_set(s, 0, 1, 7);
+    matrix_set(s, 1, 0, 7);
+    matrix_set(s, 1, 1, 7);
+    matrix_set(s, 2, 2, 2);
+    ASSERT_INT_EQ(matrix_cholesky(s) == NULL, 1);
+    ASSERT_INT_EQ(s->chol_failed, 1);
+    ASSERT_INT_EQ(matrix_inverse(s) == NULL, 1);
+    ASSERT_DOUBLE_EQ(matrix_determinant(s), 0.0);
+    ASSERT_INT_EQ(isinf(matrix_cond(s)), 1);
+
+    matrix_free(s);
+    matrix_free(a);
+    matrix_free(b);
+}
+
+void test_matrix_eigen() {
+    // Second difference matrix, eigenvalues 2 - 2 cos(pi j / (n + 1))
+    int n = 60;
+    Matrix* t = matrix_create(n, n);
+    for(int i = 0; i < n; i++) {
+        matrix_set(t, i, i, 2);
+        if(i > 0)
+            matrix_set(t, i, i - 1, -1);
+        if(i + 1 < n)
+            matrix_set(t, i, i + 1, -1);
+    }
+
+    EigenStats stats;
+    Matrix* d;
+    Matrix* v;
+    ASSERT_INT_EQ(eigen_solve(t, 4, EIGEN_LARGEST, &d, &v, &stats), 1);
+    ASSERT_INT_EQ(stats.symmetric && stats.converged == 4 && d->cols == 1, 1);
+
+    for(int j = 0; j < 4; j++) {
+        double exact = 2 - 2 * cos(M_PI * (n - j) / (n + 1));
+        ASSERT_DOUBLE_EQ(matrix_get(d, j, 0), exact);
+    }
+
+    // Columns of V are eigenvectors
+    Matrix* tv = matrix_mult(t, v);
+    double diff = 0;
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < 4; j++)
+            diff = fmax(diff, fabs(matrix_get(tv, i, j) - matrix_get(d, j, 0) * matrix_get(v, i, j)));
+    }
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+    matrix_free(tv);
+    matrix_free(v);
+    matrix_free(d);
+
+    ASSERT_INT_EQ(eigen_solve(t, 2, EIGEN_SMALLEST, &d, NULL, &stats), 1);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 0, 0), 2 - 2 * cos(M_PI / (n + 1)));
+    matrix_free(d);
+
+    // Block upper triangular, eigenvalues 3..n and the pair 0.5 +- i of the leading block
+    Matrix* a = matrix_create(n, n);
+    matrix_set(a, 0, 0, 0.5);
+    matrix_set(a, 0, 1, 1);
+    matrix_set(a, 1, 0, -1);
+    matrix_set(a, 1, 1, 0.5);
+    for(int i = 2; i < n; i++)
+        matrix_set(a, i, i, i + 1);
+    for(int i = 0; i + 3 < n; i++)
+        matrix_set(a, i, i + 3, 0.7);
+
+    ASSERT_INT_EQ(eigen_solve(a, 3, EIGEN_LARGEST, &d, NULL, &stats), 1);
+    ASSERT_INT_EQ(!stats.symmetric && stats.converged == 3 && d->cols == 1, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 0, 0), (double)n);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 2, 0), n - 2.0);
+    matrix_free(d);
+
+    // A conjugate pair gives the real and imaginary parts of its vector, A (x + iy) = (0.5 + i)(x + iy)
+    ASSERT_INT_EQ(eigen_solve(a, 2, EIGEN_SMALLEST, &d, &v, &stats), 1);
+    ASSERT_INT_EQ(d->cols == 2 && stats.converged == 2, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 0, 0), 0.5);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 0, 1), 1.0);
+    ASSERT_DOUBLE_EQ(matrix_get(d, 1, 1), -1.0);
+
+    Matrix* av = matrix_mult(a, v);
+    diff = 0;
+    for(int i = 0; i < n; i++) {
+        double x = matrix_get(v, i, 0), y = matrix_get(v, i, 1);
+        diff = fmax(diff, fabs(matrix_get(av, i, 0) - (0.5 * x - y)));
+        diff = fmax(diff, fabs(matrix_get(av, i, 1) - (x + 0.5 * y)));
+    }
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+    matrix_free(av);
+    matrix_free(v);
+    matrix_free(d);
+
+    ASSERT_INT_EQ(eigen_solve(a, n + 1, EIGEN_LARGEST, &d, NULL, &stats), 0);
+
+    matrix_free(a);
+    matrix_free(t);
+}
+
+void test_matrix_svd() {
+    // Scattered diagonal of rank 8, singular values 8..1 exactly
+    int rows = 40, cols = 30;
+    Matrix* a = matrix_create(rows, cols);
+    for(int i = 0; i < 8; i++)
+        matrix_set(a, 3 * i + 1, (7 * i) % cols, i % 2 ? i - 8 : 8 - i);
+
+    Matrix* u;
+    Matrix* s;
+    Matrix* v;
+    ASSERT_INT_EQ(svd_truncated(a, 5, SVD_POWER_ITERS, &u, &s, &v), 1);
+    ASSERT_INT_EQ(u->rows == rows && u->cols == 5 && v->rows == cols && s->rows == 5, 1);
+    for(int j = 0; j < 5; j++)
+        ASSERT_DOUBLE_EQ(matrix_get(s, j, 0), 8.0 - j);
+
+    // A V = U S with orthonormal U
+    Matrix* av = matrix_mult(a, v);
+    Matrix* ut = matrix_transpose(u);
+    Matrix* utu = matrix_mult(ut, u);
+    double diff = 0;
+    for(int i = 0; i < rows; i++) {
+        for(int j = 0; j < 5; j++)
+            diff = fmax(diff, fabs(matrix_get(av, i, j) - matrix_get(s, j, 0) * matrix_get(u, i, j)));
+    }
+    for(int i = 0; i < 5; i++) {
+        for(int j = 0; j < 5; j++)
+            diff = fmax(diff, fabs(matrix_get(utu, i, j) - (i == j)));
+    }
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+    matrix_free(av);
+    matrix_free(ut);
+    matrix_free(utu);
+    matrix_free(u);
+    matrix_free(s);
+    matrix_free(v);
+
+    // Asking for more than the rank returns the rank
+    ASSERT_INT_EQ(svd_truncated(a, 12, 0, &u, &s, &v), 1);
+    ASSERT_INT_EQ(s->rows, 8);
+    ASSERT_DOUBLE_EQ(matrix_get(s, 7, 0), 1.0);
+    matrix_free(u);
+    matrix_free(s);
+    matrix_free(v);
+
+    // Constant matrix held in scalar_val has one singular value
+    Matrix* c = matrix_create(rows, cols);
+    c->scalar_val = 2;
+    ASSERT_INT_EQ(svd_truncated(c, 3, 1, &u, &s, &v), 1);
+    ASSERT_INT_EQ(s->rows, 1);
+    ASSERT_DOUBLE_EQ(matrix_get(s, 0, 0), 2 * sqrt(rows * cols));
+    matrix_free(u);
+    matrix_free(s);
+    matrix_free(v);
+
+    ASSERT_INT_EQ(svd_truncated(a, cols + 1, 1, &u, &s, &v), 0);
+
+    matrix_free(c);
+    matrix_free(a);
+}
+
+void test_matrix_norm() {
+    double vals[] = {1, -2, 0, 0, 3, 0, 4, 0, -6};
+    Matrix* a = matrix_from_cells(vals, 3, 3);
+    ASSERT_DOUBLE_EQ(matrix_norm(a, NORM_ONE), 6.0);
+    ASSERT_DOUBLE_EQ(matrix_norm(a, NORM_INF), 10.0);
+    ASSERT_DOUBLE_EQ(matrix_norm(a, NORM_FRO), sqrt(66));
+
+    // Cells not stored count with scalar_val
+    Matrix* b = matrix_scalar_add(a, 1);
+    ASSERT_DOUBLE_EQ(matrix_norm(b, NORM_ONE), 8.0);
+    ASSERT_DOUBLE_EQ(matrix_norm(b, NORM_INF), 11.0);
+    ASSERT_DOUBLE_EQ(matrix_norm(b, NORM_FRO), sqrt(75));
+    matrix_free(b);
+    matrix_free(a);
+
+    // Scaled permutation, its condition number is the ratio of its largest and smallest values.
+    // Values far below the old absolute pivot limit still factor
+    int n = 50;
+    Matrix* p = matrix_create(n, n);
+    for(int i = 0; i < n; i++)
+        matrix_set(p, i, (7 * i + 3) % n, 1e-20 * (1 + i));
+    ASSERT_INT_EQ(matrix_lu(p) != NULL, 1);
+    ASSERT_DOUBLE_EQ(matrix_cond(p), (double)n);
+    matrix_free(p);
+
+    // Nonsymmetric sparse matrix, the factor solves with it and its transpose
+    Matrix* c = matrix_create(n, n);
+    for(int i = 0; i < n; i++) {
+        matrix_set(c, i, i, 4 + i % 3);
+        matrix_set(c, i, (i * 11 + 5) % n, -1);
+        matrix_set(c, (i * 17 + 2) % n, i, 2);
+    }
+
+    SparseLu* lu = matrix_lu(c);
+    ASSERT_INT_EQ(lu != NULL, 1);
+    ASSERT_INT_EQ(matrix_lu(c) == lu, 1); // Kept with the matrix
+
+    Csr* csr = matrix_csr(c);
+    Csr* t = csr_transpose(csr);
+    double* rhs = malloc(n * sizeof(double));
+    double* x = malloc(n * sizeof(double));
+    double* r = malloc(n * sizeof(double));
+    for(int i = 0; i < n; i++)
+        rhs[i] = 1 + i % 4;
+
+    double diff = 0;
+    lu_solve(lu, rhs, x);
+    csr_mult_vec(csr, x, r);
+    for(int i = 0; i < n; i++)
+        diff = fmax(diff, fabs(r[i] - rhs[i]));
+
+    lu_solve_transpose(lu, rhs, x);
+    csr_mult_vec(t, x, r);
+    for(int i = 0; i < n; i++)
+        diff = fmax(diff, fabs(r[i] - rhs[i]));
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+
+    // Inverse from the same factor
+    Matrix* inv = matrix_inverse(c);
+    Matrix* id = matrix_mult(inv, c);
+    diff = 0;
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++)
+            diff = fmax(diff, fabs(matrix_get(id, i, j) - (i == j)));
+    }
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+
+    // Estimate is a lower bound within a small factor of the condition number from the inverse
+    double exact = matrix_norm(c, NORM_ONE) * matrix_norm(inv, NORM_ONE);
+    double estimate = matrix_cond(c);
+    ASSERT_INT_EQ(estimate <= exact * (1 + 1e-12) && estimate >= exact / 3, 1);
+    matrix_free(inv);
+    matrix_free(id);
+
+    // An edit drops the factor, equal rows make the matrix singular
+    for(int j = 0; j < n; j++)
+        matrix_set(c, 1, j, matrix_get(c, 0, j));
+    ASSERT_INT_EQ(c->lu == NULL, 1);
+    ASSERT_INT_EQ(matrix_lu(c) == NULL, 1);
+    ASSERT_INT_EQ(isinf(matrix_cond(c)) != 0, 1);
+    ASSERT_DOUBLE_EQ(matrix_determinant(c), 0.0);
+
+    free(rhs);
+    free(x);
+    free(r);
+    csr_free(csr);
+    csr_free(t);
+    matrix_free(c);
+}
+
+// Largest entry of X^T (y - X b), zero at a least-squares solution b
+double lstsq_gradient(Matrix* x, Matrix* y, Matrix* b) {
+    Matrix* xb = matrix_mult(x, b);
+    Matrix* r = matrix_sub(y, xb);
+    Matrix* xt = matrix_transpose(x);
+    Matrix* g = matrix_mult(xt, r);
+    double max = 0;
+
+    for(int j = 0; j < g->rows; j++)
+        max = fmax(max, fabs(matrix_get(g, j, 0)));
+
+    matrix_free(xb);
+    matrix_free(r);
+    matrix_free(xt);
+    matrix_free(g);
+
+    return max;
+}
+
+void test_matrix_lstsq() {
+    // Tall sparse design matrix, 3 entries per row
+    int m = 400, n = 60;
+    Matrix* x = matrix_create(m, n);
+    Matrix* y = matrix_create(m, 1);
+    for(int i = 0; i < m; i++) {
+        matrix_set(x, i, i % n, 1 + i % 5);
+        matrix_set(x, i, (i * 7 + 3) % n, -2);
+        matrix_set(x, i, (i * 13 + 1) % n, 0.5 * (1 + i % 3));
+        matrix_set(y, i, 0, 1 + i % 7);
+    }
+
+    LstsqStats stats;
+    Matrix* b = qr_lstsq(x, y, &stats);
+    ASSERT_INT_EQ(b != NULL && b->rows == n, 1);
+    ASSERT_INT_EQ(stats.rank, n);
+    ASSERT_DOUBLE_EQ(lstsq_gradient(x, y, b) / (stats.residual + 1), 0.0);
+    matrix_free(b);
+
+    // Consistent system is solved exactly
+    Matrix* truth = matrix_create(n, 1);
+    for(int j = 0; j < n; j++)
+        matrix_set(truth, j, 0, j % 4 - 1.5);
+    Matrix* exact = matrix_mult(x, truth);
+    b = qr_lstsq(x, exact, &stats);
+    double diff = 0;
+    for(int j = 0; j < n; j++)
+        diff = fmax(diff, fabs(matrix_get(b, j, 0) - matrix_get(truth, j, 0)));
+    ASSERT_DOUBLE_EQ(diff, 0.0);
+    ASSERT_DOUBLE_EQ(stats.relative, 0.0);
+    matrix_free(b);
+
+    // A repeated column leaves the rank one short, the solution still minimizes the residual
+    for(int i = 0; i < m; i++)
+        matrix_set(x, i, n - 1, matrix_get(x, i, 0));
+    b = qr_lstsq(x, y, &stats);
+    ASSERT_INT_EQ(stats.rank, n - 1);
+    ASSERT_DOUBLE_EQ(lstsq_gradient(x, y, b) / (stats.residual + 1), 0.0);
+    matrix_free(b);
+
+    // Cells held by scalar_val are part of the system
+    Matrix* shifted = matrix_scalar_add(x, 1);
+    b = qr_lstsq(shifted, y, &stats);
+    ASSERT_DOUBLE_EQ(lstsq_gradient(shifted, y, b) / (stats.residual + 1), 0.0);
+    matrix_free(b);
+
+    ASSERT_INT_EQ(qr_lstsq(x, truth, &stats) == NULL, 1);
+
+    matrix_free(shifted);
+    matrix_free(truth);
+    matrix_free(exact);
+    matrix_free(x);
+    matrix_free(y);
+}
+
+void test_matrix_reorder() {
+    // 2D grid Laplacian with scrambled vertex numbers
+    int side = 12, n = side * side;
+    Matrix* a = matrix_create(n, n);
+    for(int v = 0; v < n; v++) {
+        int label = v * 37 % n, right = (v + 1) * 37 % n, down = (v + side) * 37 % n;
+        matrix_set(a, label, label, 4);
+        if(v % side < side - 1) {
+            matrix_set(a, label, right, -1);
+            matrix_set(a, right, label, -1);
+        }
+        if(v + side < n) {
+            matrix_set(a, label, down, -1);
+            matrix_set(a, down, label, -1);
+        }
+    }
+
+    Envelope before, after;
+    Matrix* perm;
+    Matrix* r = matrix_reorder(a, REORDER_RCM, &perm, &before, &after);
+    ASSERT_INT_EQ(after.bandwidth <= side + 1 && after.bandwidth < before.bandwidth, 1);
+    ASSERT_INT_EQ(after.profile < before.profile, 1);
+
+    // Cell (k, l) of the result is cell (P(k), P(l)) of a
+    bool moved = true;
+    for(int k = 0; k < n; k++) {
+        int i = matrix_get(perm, k, 0) - 1;
+        for(int l = 0; l < n; l++)
+            moved = moved && matrix_get(r, k, l) == matrix_get(a, i, (int)matrix_get(perm, l, 0) - 1);
+    }
+    ASSERT_INT_EQ(moved, 1);
+
+    // Undoing the permutation restores a, a vector is permuted by rows
+    Matrix* back = reorder_apply(r, perm, true);
+    Matrix* diff = matrix_sub(back, a);
+    ASSERT_DOUBLE_EQ(matrix_norm(diff, NORM_FRO), 0.0);
+
+    Matrix* b = matrix_create(n, 1);
+    for(int i = 0; i < n; i++)
+        matrix_set(b, i, 0, i + 1);
+    Matrix* pb = reorder_apply(b, perm, false);
+    Matrix* same = matrix_sub(pb, perm);
+    ASSERT_DOUBLE_EQ(matrix_norm(same, NORM_FRO), 0.0);
+
+    Matrix* amd_perm;
+    Matrix* s = matrix_reorder(a, REORDER_AMD, &amd_perm, &before, &after);
+    Matrix* unpermuted = reorder_apply(b, amd_perm, true);
+    ASSERT_INT_EQ(unpermuted != NULL, 1);
+    matrix_free(unpermuted);
+
+    // A column with a repeated index is no permutation
+    matrix_set(b, 0, 0, 2);
+    ASSERT_INT_EQ(reorder_apply(a, b, false) == NULL, 1);
+
+    matrix_free(a);
+    matrix_free(r);
+    matrix_free(perm);
+    matrix_free(back);
+    matrix_free(diff);
+    matrix_free(b);
+    matrix_free(pb);
+    matrix_free(same);
+    matrix_free(amd_perm);
+    matrix_free(s);
+}
+
+// Check slice holds the block of matrix from (row, col) on, cell by cell
+bool slice_matches(Matrix* slice, Matrix* matrix, int row, int col) {
+    bool same = slice != NULL;
+
+    for(int i = 0; same && i < slice->rows; i++) {
+        for(int j = 0; j < slice->cols; j++)
+            same = same && matrix_get(slice, i, j) == matrix_get(matrix, row + i, col + j);
+    }
+
+    return same;
+}
+
+void test_matrix_slice() {
+    int n = 300;
+    Matrix* a = matrix_create(n, n);
+    for(int i = 0; i < n; i++) {
+        matrix_set(a, i, i, 2 + i % 7);
+        matrix_set(a, i, (i * 31 + 5) % n, -1 - i % 3);
+    }
+
+    // Small blocks look up cells, large ones read rows of the row index
+    Matrix* small = matrix_slice(a, 10, 20, 5, 40);
+    ASSERT_INT_EQ(slice_matches(small, a, 10, 5), 1);
+    Matrix* large = matrix_slice(a, 0, 200, 50, 300);
+    ASSERT_INT_EQ(slice_matches(large, a, 0, 50), 1);
+    ASSERT_INT_EQ(matrix_slice(a, 5, 5, 0, 1) == NULL && matrix_slice(a, 0, n + 1, 0, 1) == NULL, 1);
+
+    // Blocks of shifted, dense and banded matrices
+    Matrix* shifted = matrix_scalar_add(a, 1.5);
+    Matrix* shifted_slice = matrix_slice(shifted, 100, 300, 0, 120);
+    ASSERT_INT_EQ(slice_matches(shifted_slice, shifted, 100, 0), 1);
+
+    Matrix* dense = matrix_copy(a);
+    matrix_make_dense(dense);
+    Matrix* dense_slice = matrix_slice(dense, 7, 90, 3, 250);
+    ASSERT_INT_EQ(slice_matches(dense_slice, dense, 7, 3), 1);
+
+    Matrix* identity = matrix_identity(n, n);
+    Matrix* identity_slice = matrix_slice(identity, 40, 80, 30, 90);
+    ASSERT_INT_EQ(slice_matches(identity_slice, identity, 40, 30), 1);
+
+    // Assigning a block writes its cells and clears cells it does not store, the rest is unchanged
+    Matrix* expected = matrix_copy(a);
+    for(int i = 0; i < 40; i++) {
+        for(int j = 0; j < 60; j++)
+            matrix_set(expected, 20 + i, 100 + j, matrix_get(identity_slice, i, j));
+    }
+    ASSERT_INT_EQ(matrix_assign_slice(a, 20, 100, identity_slice), 1);
+    ASSERT_INT_EQ(slice_matches(a, expected, 0, 0), 1);
+
+    for(int i = 0; i < 83; i++) {
+        for(int j = 0; j < 247; j++)
+            matrix_set(expected, 210 + i, 50 + j, matrix_get(shifted, 100 + i, j));
+    }
+    Matrix* block = matrix_slice(shifted, 100, 183, 0, 247);
+    ASSERT_INT_EQ(matrix_assign_slice(a, 210, 50, block), 1);
+    ASSERT_INT_EQ(slice_matches(a, expected, 0, 0), 1);
+    ASSERT_INT_EQ(matrix_assign_slice(a, 250, 50, block), 0);
+
+    matrix_free(a);
+    matrix_free(small);
+    matrix_free(large);
+    matrix_free(shifted);
+    matrix_free(shifted_slice);
+    matrix_free(dense);
+    matrix_free(dense_slice);
+    matrix_free(identity);
+    matrix_free(identity_slice);
+    matrix_free(expected);
+    matrix_free(block);
+}
+
+void test_matrix_export() {
+    // Formatted values read back exactly, and take the shortest form that does
+    double vals[] = {0.1, 0.3, 1.0 / 3, -2.5e-300, 1e300, 123456.789, M_PI, 5e-324, DBL_MAX, 1e21, 79.93185419968305};
+    char text_buf[64];
+    char* text = text_buf;
+
+    for(int i = 0; i < (int)(sizeof(vals) / sizeof(vals[0])); i++) {
+        text[format_double(vals[i], text)] = '\0';
+        ASSERT_INT_EQ(strtod(text, NULL) == vals[i], 1);
+    }
+
+    text[format_double(0.1, text)] = '\0';
+    ASSERT_STR_EQ(text, "0.1");
+    text[format_double(-2.5e-300, text)] = '\0';
+    ASSERT_STR_EQ(text, "-2.5e-300");
+    text[format_double(1.0 / 3, text)] = '\0';
+    ASSERT_STR_EQ(text, "0.3333333333333333");
+
+    // Triplet export lists non-zeros in row order and leaves dense storage alone
+    Matrix* m = matrix_create(3, 3);
+    matrix_set(m, 2, 2, 1.0 / 3);
+    matrix_set(m, 0, 1, 0.1);
+    matrix_set(m, 2, 0, -2.5);
+    matrix_make_dense(m);
+
+    const char* name = "test_matrix_export.csv";
+    ASSERT_INT_EQ(export_csv_file(m, name, EXPORT_TRIPLET), true);
+    ASSERT_INT_EQ(m->dense != NULL, 1);
+
+    char file_buf[256] = "";
+    char* contents = file_buf;
+    FILE* file = fopen(name, "r");
+    if(file) {
+        contents[fread(contents, 1, sizeof(file_buf) - 1, file)] = '\0';
+        fclose(file);
+    }
+    remove(name);
+
+    ASSERT_STR_EQ(contents, "row,col,val\n0,1,0.1\n2,0,-2.5\n2,2,0.3333333333333333\n");
+
+    matrix_free(m);
+}
+
+void test_matrix_repository() {
+    char* name = "repo_test_a";
+    Matrix* first = matrix_create(3, 3);
+    matrix_set(first, 0, 0, 1);
+    Matrix* second = matrix_create(3, 3);
+    matrix_set(second, 2, 1, 7);
+
+    // Saves of one name commit in submission order, waiting on the name waits for the last of them
+    ASSERT_INT_EQ(jobs_submit_save(name, first) > 0, 1);
+    ASSERT_INT_EQ(jobs_submit_save(name, second) > 0, 1);
+    jobs_wait_name(name);
+
+    Matrix* loaded = repo_matrix_load(name);
+    ASSERT_MATRIX_EQ(second, loaded);
+    matrix_free(loaded);
+    ASSERT_INT_EQ(jobs_wait(), true);
+
+    // Loading several matrices keeps none of them if one is missing
+    char* names[] = {name, "repo_test_missing"};
+    Matrix* matrices[2] = {NULL, NULL};
+    ASSERT_INT_EQ(repo_matrix_load_many(names, 2, matrices), false);
+    ASSERT_INT_EQ(matrices[0] == NULL && matrices[1] == NULL, 1);
+
+    char command[] = "load repo_test_a repo_test_missing";
+    ASSERT_INT_EQ(handle_input(command), false);
+    ASSERT_INT_EQ(rd_get_matrix(name) == NULL, 1);
+
+    // Nothing discarded still pins the saved copy
+    ASSERT_INT_EQ(repo_matrix_delete(name), true);
+
+    matrix_free(first);
+    matrix_free(second);
+}
+
+
+void test_matrix_repository_delta() {
+    char* name = "repo_test_delta";
+    Matrix* matrix = matrix_create(3, 3);
+    matrix_set(matrix, 0, 0, 1);
+    matrix_set(matrix, 1, 2, 4);
+    matrix_set(matrix, 2, 1, 7);
+    ASSERT_INT_EQ(repo_matrix_save(name, matrix), true);
+
+    // Saved matrix is tracked, the next save writes only what changed since
+    matrix_set(matrix, 0, 0, 5);
+    matrix_set(matrix, 2, 1, 0);
+    matrix->scalar_val = 2;
+    RepoWrite* write = repo_prepare_save(name, matrix);
+    ASSERT_INT_EQ(write != NULL && write->delta, 1);
+    ASSERT_INT_EQ(write->snapshot->dirty->size, 2);
+    ASSERT_INT_EQ(repo_commit_save(write), true);
+    repo_write_free(write);
+
+    // Edited cell is upserted, zeroed cell deleted and the new scalar_val stored
+    Matrix* loaded = repo_matrix_load(name);
+    ASSERT_DOUBLE_EQ(loaded->scalar_val, 2.0);
+    ASSERT_INT_EQ(matrix_materialize(loaded), true);
+    ASSERT_INT_EQ(loaded->vals->size, 2);
+    ASSERT_DOUBLE_EQ(matrix_get(loaded, 0, 0), 7.0);
+    ASSERT_DOUBLE_EQ(matrix_get(loaded, 1, 2), 6.0);
+    ASSERT_DOUBLE_EQ(matrix_get(loaded, 2, 1), 2.0);
+
+    matrix_free(loaded);
+    ASSERT_INT_EQ(repo_matrix_delete(name), true);
+    matrix_free(matrix);
 }
 
 void test_matrix_save_load() {
@@ -201,6 +1285,23 @@ void test_matrix() {
     test_matrix_scalar_mult();
     test_matrix_subtract();
     test_matrix_transpose();
+    test_matrix_dirty_tracking();
+    test_matrix_copy_on_write();
+    test_matrix_mem();
+    test_matrix_dense();
+    test_matrix_band();
+    test_matrix_csr_kernels();
+    test_matrix_solver();
+    test_matrix_cholesky();
+    test_matrix_eigen();
+    test_matrix_svd();
+    test_matrix_norm();
+    test_matrix_lstsq();
+    test_matrix_reorder();
+    test_matrix_slice();
+    test_matrix_export();
+    test_matrix_repository();
+    test_matrix_repository_delta();
     //test_matrix_save_load();
     end_test("Matrices");
 }